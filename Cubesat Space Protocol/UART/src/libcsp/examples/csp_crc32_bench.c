@@ -0,0 +1,115 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk)
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+/* Checks that every csp_crc32_memory() implementation gives the same result, and measures them over a sweep of packet sizes */
+
+#include <csp/csp_crc32.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_SIZE	4096
+#define BYTES_PER_RUN	(64 * 1024 * 1024)
+
+static const struct {
+    csp_crc32_impl_t impl;
+    const char * name;
+} impls[] = {
+    {CSP_CRC32_TABLE, "table"},
+    {CSP_CRC32_SLICE8, "slice8"},
+    {CSP_CRC32_HW, "hw"},
+};
+#define IMPL_COUNT (sizeof(impls) / sizeof(impls[0]))
+
+static const uint32_t sizes[] = {8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096};
+#define SIZE_COUNT (sizeof(sizes) / sizeof(sizes[0]))
+
+static uint8_t data[MAX_SIZE + 8];
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// every length and alignment up to a few words past the unrolled loops must match the byte at a time table
+static int check(csp_crc32_impl_t impl, const char * name) {
+    if (csp_crc32_memory((const uint8_t *) "123456789", 9) != 0xE3069283) {
+        printf("%s: wrong check value\n", name);
+        return -1;
+    }
+    for (uint32_t offset = 0; offset < 8; offset++) {
+        for (uint32_t length = 0; length <= 300; length++) {
+            csp_crc32_set_impl(CSP_CRC32_TABLE);
+            uint32_t expected = csp_crc32_memory(&data[offset], length);
+            csp_crc32_set_impl(impl);
+            if (csp_crc32_memory(&data[offset], length) != expected) {
+                printf("%s: mismatch at offset %"PRIu32" length %"PRIu32"\n", name, offset, length);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char * argv[]) {
+
+    for (unsigned int i = 0; i < sizeof(data); i++) {
+        data[i] = rand();
+    }
+
+    bool supported[IMPL_COUNT];
+    for (unsigned int i = 0; i < IMPL_COUNT; i++) {
+        supported[i] = (csp_crc32_set_impl(impls[i].impl) == CSP_ERR_NONE);
+        if (supported[i] && (check(impls[i].impl, impls[i].name) != 0)) {
+            return 1;
+        }
+    }
+
+    printf("%-8s", "size");
+    for (unsigned int i = 0; i < IMPL_COUNT; i++) {
+        printf(" %10s ns %8s MB/s", impls[i].name, "");
+    }
+    printf("\n");
+
+    volatile uint32_t sink = 0;
+    for (unsigned int s = 0; s < SIZE_COUNT; s++) {
+        uint32_t calls = BYTES_PER_RUN / sizes[s];
+        printf("%-8"PRIu32, sizes[s]);
+        for (unsigned int i = 0; i < IMPL_COUNT; i++) {
+            if (!supported[i]) {
+                printf(" %13s %13s", "-", "-");
+                continue;
+            }
+            csp_crc32_set_impl(impls[i].impl);
+            double start = now();
+            for (uint32_t c = 0; c < calls; c++) {
+                sink += csp_crc32_memory(data, sizes[s]);
+            }
+            double elapsed = now() - start;
+            printf(" %13.1f %13.1f", elapsed * 1e9 / calls, (double) calls * sizes[s] / elapsed / 1e6);
+        }
+        printf("\n");
+    }
+
+    csp_crc32_set_impl(CSP_CRC32_AUTO);
+    return 0;
+}
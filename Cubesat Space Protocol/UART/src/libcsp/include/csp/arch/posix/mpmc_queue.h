@@ -0,0 +1,118 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk) 
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _MPMC_QUEUE_H_
+#define _MPMC_QUEUE_H_
+
+/**
+   @file
+
+   Lock-free bounded multi-producer/multi-consumer queue.
+
+   Each slot carries a sequence number, telling producers and consumers whose turn it is (Dmitry Vyukov's design),
+   so a slot is claimed with a single compare-and-swap on the insert or extract point. Threads only sleep, on a
+   Linux futex, when the queue is empty or full. Selected with: waf configure --with-posix-queue=mpmc
+*/
+
+#include <csp/arch/csp_queue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   Queue error codes.
+   @{
+*/
+/**
+   General error code - something went wrong.
+*/
+#define MPMC_QUEUE_ERROR CSP_QUEUE_ERROR
+/**
+   Queue is empty - cannot extract element.
+*/
+#define MPMC_QUEUE_EMPTY CSP_QUEUE_ERROR
+/**
+   Queue is full - cannot insert element.
+*/
+#define MPMC_QUEUE_FULL CSP_QUEUE_ERROR
+/**
+   Ok - no error.
+*/
+#define MPMC_QUEUE_OK CSP_QUEUE_OK
+/** @{ */
+
+/**
+   Queue handle.
+*/
+typedef struct mpmc_queue_s {
+    //! Memory area, \a size slots of \a slot_size bytes: sequence number followed by element.
+    char * slots;
+    //! Number of slots.
+    uint32_t size;
+    //! Item/element size.
+    uint32_t item_size;
+    //! Slot size.
+    uint32_t slot_size;
+    //! Keeps the insert point off the cache line of the fields above.
+    char pad0[64];
+    //! Insert point, counting up.
+    uint64_t in;
+    //! Keeps the insert and extract points on separate cache lines.
+    char pad1[64 - sizeof(uint64_t)];
+    //! Extract point, counting up.
+    uint64_t out;
+    //! Keeps the extract point off the cache line of the fields below.
+    char pad2[64 - sizeof(uint64_t)];
+    //! Futex for threads waiting because queue is empty (extract). Bit 0 is set while any sleep, the rest counts wake-ups.
+    uint32_t not_empty;
+    //! Futex for threads waiting because queue is full (insert). Bit 0 is set while any sleep, the rest counts wake-ups.
+    uint32_t not_full;
+} mpmc_queue_t;
+
+/**
+   Create queue.
+*/
+mpmc_queue_t * mpmc_queue_create(int length, size_t item_size);
+
+/**
+   Delete queue.
+*/
+void mpmc_queue_delete(mpmc_queue_t * q);
+
+/**
+   Enqueue/insert element.
+*/
+int mpmc_queue_enqueue(mpmc_queue_t * queue, const void * value, uint32_t timeout);
+
+/**
+   Dequeue/extract element.
+*/
+int mpmc_queue_dequeue(mpmc_queue_t * queue, void * buf, uint32_t timeout);
+
+/**
+   Return number of elements in the queue.
+*/
+int mpmc_queue_items(mpmc_queue_t * queue);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
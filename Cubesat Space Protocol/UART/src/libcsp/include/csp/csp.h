@@ -58,6 +58,8 @@ typedef struct csp_conf_s {
 	uint8_t rdp_max_window;		/**< Max RDP window size */
 	uint16_t buffers;		/**< Number of CSP buffers */
 	uint16_t buffer_data_size;	/**< Data size of a CSP buffer. Total size will be sizeof(#csp_packet_t) + data_size. */
+	const csp_buffer_class_t * buffer_classes;	/**< Classes of smaller buffers, in increasing data size, allocated besides the buffers above. csp_buffer_get() takes the smallest that fits. */
+	uint8_t buffer_class_count;	/**< Number of entries in buffer_classes, at most #CSP_BUFFER_CLASSES_MAX - 1 */
 	uint32_t conn_dfl_so;		/**< Default connection options. Options will always be or'ed onto new connections, see csp_connect() */
 } csp_conf_t;
 
@@ -76,6 +78,8 @@ static inline void csp_conf_get_defaults(csp_conf_t * conf) {
 	conf->rdp_max_window = 20;
 	conf->buffers = 10;
 	conf->buffer_data_size = 256;
+	conf->buffer_classes = NULL;
+	conf->buffer_class_count = 0;
 	conf->conn_dfl_so = CSP_O_NONE;
 }
 
@@ -310,7 +314,8 @@ int csp_bind(csp_socket_t *socket, uint8_t port);
 int csp_route_start_task(unsigned int task_stack_size, unsigned int task_priority);
 
 /**
-   Route packet from the incoming router queue and check RDP timeouts.
+   Route packets from the incoming router queue and check RDP timeouts.
+   Takes up to #CSP_ROUTE_BATCH packets per call, waiting only for the first, and forwards them with one call per outgoing interface.
    In order for incoming packets to routed and RDP timeouts to be checked, this function must be called reguarly.
    If the router task is started by calling csp_route_start_task(), there function should not be called.
    @param[in] timeout timeout in mS to wait for an incoming packet.
@@ -32,8 +32,25 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 extern "C" {
 #endif
 
+/**
+   Max number of buffer classes, including the class of csp_conf_t.buffers.
+*/
+#define CSP_BUFFER_CLASSES_MAX	4
+
+/**
+   Buffer class.
+   Besides the csp_conf_t.buffers buffers of csp_conf_t.buffer_data_size, CSP can be given classes of smaller buffers,
+   see csp_conf_t.buffer_classes.
+*/
+typedef struct {
+	uint16_t data_size;	/**< Data size of the buffers in the class. */
+	uint16_t count;		/**< Number of buffers in the class. */
+} csp_buffer_class_t;
+
 /**
    Get free buffer (from task context).
+   The buffer is taken from the smallest class with room for \a data_size, plus the headers and trailers CSP may add
+   when sending it. If that class is empty, the next larger class is tried.
 
    @param[in] data_size minimum data size of requested buffer.
    @return Buffer (pointer to #csp_packet_t) or NULL if no buffers available or size too big.
@@ -70,24 +87,32 @@ void * csp_buffer_clone(void *buffer);
 
 /**
    Return number of remaining/free buffers.
-   The number of buffers is set by csp_init().
+   The number of buffers is set by csp_init(), and the count covers all buffer classes.
    @return number of remaining/free buffers
 */
 int csp_buffer_remaining(void);
 
 /**
-   Return the size of a CSP buffer.
+   Return the size of a CSP buffer of the largest class.
    @return size of a CSP buffer, sizeof(#csp_packet_t) + data_size.
 */
 size_t csp_buffer_size(void);
 
 /**
    Return the data size of a CSP buffer.
-   The data size is set by csp_init().
+   The data size is set by csp_init(), and is the size of the largest buffer class.
    @return data size of a CSP buffer
 */
 size_t csp_buffer_data_size(void);
 
+/**
+   Return the data size of a specific buffer.
+   This is the data size of the class the buffer was taken from, and the most data it can hold.
+   @param[in] buffer buffer from csp_buffer_get() or csp_buffer_get_isr().
+   @return data size of \a buffer
+*/
+size_t csp_buffer_data_size_of(const void * buffer);
+
 #ifdef __cplusplus
 }
 #endif
@@ -48,6 +48,24 @@ int csp_crc32_append(csp_packet_t * packet, bool include_header);
 */
 int csp_crc32_verify(csp_packet_t * packet, bool include_header);
 
+/**
+   CRC32 implementations, see csp_crc32_set_impl().
+*/
+typedef enum {
+	CSP_CRC32_AUTO,   //!< Fastest one the CPU supports (default)
+	CSP_CRC32_TABLE,  //!< Table lookup, one byte at a time
+	CSP_CRC32_SLICE8, //!< Table lookup, eight bytes at a time
+	CSP_CRC32_HW,     //!< SSE4.2 or ARMv8 CRC32C instructions
+} csp_crc32_impl_t;
+
+/**
+   Select the implementation used by csp_crc32_memory(), for testing and benchmarks.
+   All of them give the same result. By default the fastest one the CPU supports is used.
+   @param[in] impl implementation to use.
+   @return #CSP_ERR_NONE on success, #CSP_ERR_NOTSUP if it is not available on this CPU or build.
+*/
+int csp_crc32_set_impl(csp_crc32_impl_t impl);
+
 /**
    Calculate checksum for a given memory area.
    @param[in] addr memory address
@@ -46,6 +46,18 @@ extern "C" {
 */
 typedef int (*nexthop_t)(const csp_route_t * ifroute, csp_packet_t *packet);
 
+/**
+   Interface Tx function for several packets (optional).
+
+   Used by the router to forward the packets of a batch in one call. Interfaces without it get one nexthop_t call per packet.
+
+   @param[in] ifroute contains the interface and the \a mac adddress, one per packet. All have the same interface.
+   @param[in] packet CSP packets to send, in order. Packets that are sent must be freed using csp_buffer_free().
+   @param[in] count number of packets.
+   @return number of packets sent, which must be the first ones. The caller keeps the rest.
+*/
+typedef unsigned int (*nexthop_batch_t)(const csp_route_t * const ifroute[], csp_packet_t * const packet[], unsigned int count);
+
 //doc-begin:csp_iface_s
 /**
    CSP interface.
@@ -55,6 +67,7 @@ struct csp_iface_s {
     void * interface_data;     //!< Interface data, only known/used by the interface layer, e.g. state information.
     void * driver_data;        //!< Driver data, only known/used by the driver layer, e.g. device/channel references.
     nexthop_t nexthop;         //!< Next hop (Tx) function
+    nexthop_batch_t nexthop_batch; //!< Next hop (Tx) function for several packets, optional
     uint16_t mtu;              //!< Maximum Transmission Unit of interface
     uint8_t split_horizon_off; //!< Disable the route-loop prevention
     uint32_t tx;               //!< Successfully transmitted packets
@@ -77,6 +77,8 @@ typedef enum {
 #define CSP_RX_QUEUES			1
 #endif
 
+#define CSP_ROUTE_BATCH			16 //!< Max number of packets the router takes from the incoming fifos per wakeup
+
 /**
    @defgroup CSP_HEADER_DEF CSP header definition.
    @{
@@ -226,7 +228,7 @@ typedef struct {
 	/**
            Data part of packet.
            When using the csp_buffer API, the size of the data part is set by
-           csp_buffer_init(), and can later be accessed by csp_buffer_data_size()
+           csp_buffer_init(), and can later be accessed by csp_buffer_data_size_of()
         */
 	union {
 		/** Access data as uint8_t. */
@@ -98,11 +98,24 @@ int csp_kiss_add_interface(csp_iface_t * iface);
 */
 int csp_kiss_tx(const csp_route_t * ifroute, csp_packet_t * packet);
 
+/**
+   Send several CSP packets over KISS, holding the interface lock once (nexthop_batch).
+
+   @param[in] ifroute routes, one per packet.
+   @param[in] packet CSP packets to send.
+   @param[in] count number of packets.
+   @return number of packets sent, either all or none.
+*/
+unsigned int csp_kiss_tx_batch(const csp_route_t * const ifroute[], csp_packet_t * const packet[], unsigned int count);
+
 /**
    Process received CAN frame.
 
    Called from driver when a chunk of data has been received. Once a complete frame has been received, the CSP packet will be routed on.
 
+   A frame's length is only known once its closing FEND arrives, so each frame is received into a full-size buffer (csp_buffer_data_size())
+   and routed on in it. KISS therefore never uses the smaller buffer classes in csp_conf_t.buffer_classes.
+
    @param[in] iface incoming interface.
    @param[in] buf reveived data.
    @param[in] len length of \a buf.
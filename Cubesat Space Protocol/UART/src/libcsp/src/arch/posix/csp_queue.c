@@ -19,18 +19,33 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
 #include <csp/arch/csp_queue.h>
+
+#if (CSP_POSIX_QUEUE_MPMC)
+#include <csp/arch/posix/mpmc_queue.h>
+#define queue_create	mpmc_queue_create
+#define queue_delete	mpmc_queue_delete
+#define queue_enqueue	mpmc_queue_enqueue
+#define queue_dequeue	mpmc_queue_dequeue
+#define queue_items	mpmc_queue_items
+#else
 #include <csp/arch/posix/pthread_queue.h>
+#define queue_create	pthread_queue_create
+#define queue_delete	pthread_queue_delete
+#define queue_enqueue	pthread_queue_enqueue
+#define queue_dequeue	pthread_queue_dequeue
+#define queue_items	pthread_queue_items
+#endif
 
 csp_queue_handle_t csp_queue_create(int length, size_t item_size) {
-	return pthread_queue_create(length, item_size);
+	return queue_create(length, item_size);
 }
 
 void csp_queue_remove(csp_queue_handle_t queue) {
-	return pthread_queue_delete(queue);
+	return queue_delete(queue);
 }
 
 int csp_queue_enqueue(csp_queue_handle_t handle, const void *value, uint32_t timeout) {
-	return pthread_queue_enqueue(handle, value, timeout);
+	return queue_enqueue(handle, value, timeout);
 }
 
 int csp_queue_enqueue_isr(csp_queue_handle_t handle, const void * value, CSP_BASE_TYPE * task_woken) {
@@ -41,7 +56,7 @@ int csp_queue_enqueue_isr(csp_queue_handle_t handle, const void * value, CSP_BAS
 }
 
 int csp_queue_dequeue(csp_queue_handle_t handle, void *buf, uint32_t timeout) {
-	return pthread_queue_dequeue(handle, buf, timeout);
+	return queue_dequeue(handle, buf, timeout);
 }
 
 int csp_queue_dequeue_isr(csp_queue_handle_t handle, void *buf, CSP_BASE_TYPE * task_woken) {
@@ -52,9 +67,9 @@ int csp_queue_dequeue_isr(csp_queue_handle_t handle, void *buf, CSP_BASE_TYPE *
 }
 
 int csp_queue_size(csp_queue_handle_t handle) {
-	return pthread_queue_items(handle);
+	return queue_items(handle);
 }
 
 int csp_queue_size_isr(csp_queue_handle_t handle) {
-	return pthread_queue_items(handle);
+	return queue_items(handle);
 }
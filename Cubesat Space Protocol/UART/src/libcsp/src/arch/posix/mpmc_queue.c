@@ -0,0 +1,272 @@
+/*
+Cubesat Space Protocol - A small network-layer protocol designed for Cubesats
+Copyright (C) 2012 Gomspace ApS (http://www.gomspace.com)
+Copyright (C) 2012 AAUSAT3 Project (http://aausat3.space.aau.dk) 
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation; either
+version 2.1 of the License, or (at your option) any later version.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include <csp/arch/posix/mpmc_queue.h>
+
+#if (CSP_POSIX_QUEUE_MPMC)
+
+#if !defined(__linux__)
+#error "The mpmc queue blocks on futexes, which are only available on Linux"
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include <csp/arch/csp_malloc.h>
+
+// Sequence number at the start of each slot
+#define SLOT_SEQ(q, pos)	((uint64_t *) (void *) &(q)->slots[((pos) % (q)->size) * (q)->slot_size])
+#define SLOT_ITEM(q, pos)	((void *) (SLOT_SEQ(q, pos) + 1))
+
+static inline int get_deadline(struct timespec *ts, uint32_t timeout_ms)
+{
+	int ret = clock_gettime(CLOCK_MONOTONIC, ts);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	uint32_t sec = timeout_ms / 1000;
+	uint32_t nsec = (timeout_ms - 1000 * sec) * 1000000;
+
+	ts->tv_sec += sec;
+
+	if (ts->tv_nsec + nsec >= 1000000000) {
+		ts->tv_sec++;
+	}
+
+	ts->tv_nsec = (ts->tv_nsec + nsec) % 1000000000;
+
+	return ret;
+}
+
+// Bit 0 of a futex word: threads are, or are about to be, sleeping on it
+#define FUTEX_SLEEPERS	1U
+
+/* Marks futex as slept on, and returns the value to sleep on. Must come before the last check of the queue. */
+static uint32_t futex_prepare(uint32_t * futex)
+{
+	return __atomic_or_fetch(futex, FUTEX_SLEEPERS, __ATOMIC_SEQ_CST);
+}
+
+/* Sleeps until *futex no longer holds seen, or the CLOCK_MONOTONIC deadline (NULL for none) has passed, which returns false */
+static bool futex_wait(uint32_t * futex, uint32_t seen, const struct timespec * deadline)
+{
+	if (syscall(SYS_futex, futex, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, seen, deadline, NULL, FUTEX_BITSET_MATCH_ANY) != 0) {
+		return (errno != ETIMEDOUT);
+	}
+	return true;
+}
+
+/* Wakes the threads sleeping on futex, if there are any. Must follow the change they wait for.
+ * Clearing the mark means only the first change after they went to sleep makes a system call;
+ * the woken threads mark it again if they have to go back to sleep. */
+static void futex_wake(uint32_t * futex)
+{
+	// Pairs with futex_prepare() before the sleeper checks the queue, so either it sees the change or its mark is seen here
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	uint32_t seen = __atomic_load_n(futex, __ATOMIC_RELAXED);
+	while (seen & FUTEX_SLEEPERS) {
+		if (__atomic_compare_exchange_n(futex, &seen, (seen + 2) & ~FUTEX_SLEEPERS, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			syscall(SYS_futex, futex, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT_MAX, NULL, NULL, 0);
+			break;
+		}
+	}
+}
+
+mpmc_queue_t * mpmc_queue_create(int length, size_t item_size) {
+
+	if (length <= 0) {
+		return NULL;
+	}
+
+	mpmc_queue_t * q = csp_malloc(sizeof(mpmc_queue_t));
+
+	if (q != NULL) {
+		memset(q, 0, sizeof(*q));
+		q->size = length;
+		q->item_size = item_size;
+		q->slot_size = sizeof(uint64_t) * (1 + ((item_size + sizeof(uint64_t) - 1) / sizeof(uint64_t)));
+		q->slots = csp_malloc(q->size * q->slot_size);
+		if (q->slots != NULL) {
+			// Slot i is first written at insert point i
+			for (uint32_t i = 0; i < q->size; i++) {
+				*SLOT_SEQ(q, i) = i;
+			}
+		} else {
+			csp_free(q);
+			q = NULL;
+		}
+	}
+
+	return q;
+
+}
+
+void mpmc_queue_delete(mpmc_queue_t * q) {
+
+	if (q == NULL)
+		return;
+
+	csp_free(q->slots);
+	csp_free(q);
+
+	return;
+
+}
+
+/* A slot at position pos is free to insert into when its sequence is pos, and holds an element to extract when it is pos + 1 */
+static int try_enqueue(mpmc_queue_t * queue, const void * value) {
+
+	uint64_t pos = __atomic_load_n(&queue->in, __ATOMIC_RELAXED);
+
+	for (;;) {
+		const int64_t diff = (int64_t) (__atomic_load_n(SLOT_SEQ(queue, pos), __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&queue->in, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// Slot not yet extracted from one lap ago
+			return MPMC_QUEUE_FULL;
+		} else {
+			pos = __atomic_load_n(&queue->in, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(SLOT_ITEM(queue, pos), value, queue->item_size);
+	__atomic_store_n(SLOT_SEQ(queue, pos), pos + 1, __ATOMIC_RELEASE);
+
+	futex_wake(&queue->not_empty);
+
+	return MPMC_QUEUE_OK;
+
+}
+
+static int try_dequeue(mpmc_queue_t * queue, void * buf) {
+
+	uint64_t pos = __atomic_load_n(&queue->out, __ATOMIC_RELAXED);
+
+	for (;;) {
+		const int64_t diff = (int64_t) (__atomic_load_n(SLOT_SEQ(queue, pos), __ATOMIC_ACQUIRE) - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&queue->out, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// Slot not yet inserted into
+			return MPMC_QUEUE_EMPTY;
+		} else {
+			pos = __atomic_load_n(&queue->out, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(buf, SLOT_ITEM(queue, pos), queue->item_size);
+	__atomic_store_n(SLOT_SEQ(queue, pos), pos + queue->size, __ATOMIC_RELEASE);
+
+	futex_wake(&queue->not_full);
+
+	return MPMC_QUEUE_OK;
+
+}
+
+int mpmc_queue_enqueue(mpmc_queue_t * queue, const void * value, uint32_t timeout) {
+
+	if (try_enqueue(queue, value) == MPMC_QUEUE_OK) {
+		return MPMC_QUEUE_OK;
+	}
+	if (timeout == 0) {
+		return MPMC_QUEUE_FULL;
+	}
+
+	/* Calculate timeout */
+	struct timespec ts;
+	struct timespec *pts = NULL;
+	if (timeout != CSP_MAX_TIMEOUT) {
+		if (get_deadline(&ts, timeout) != 0) {
+			return MPMC_QUEUE_ERROR;
+		}
+		pts = &ts;
+	}
+
+	for (;;) {
+		/* Mark as sleeping before checking again, so a slot freed from here on wakes us */
+		const uint32_t seen = futex_prepare(&queue->not_full);
+		if (try_enqueue(queue, value) == MPMC_QUEUE_OK) {
+			return MPMC_QUEUE_OK;
+		}
+		if (!futex_wait(&queue->not_full, seen, pts)) {
+			return try_enqueue(queue, value); //Timeout
+		}
+	}
+
+}
+
+int mpmc_queue_dequeue(mpmc_queue_t * queue, void * buf, uint32_t timeout) {
+
+	if (try_dequeue(queue, buf) == MPMC_QUEUE_OK) {
+		return MPMC_QUEUE_OK;
+	}
+	if (timeout == 0) {
+		return MPMC_QUEUE_EMPTY;
+	}
+
+	/* Calculate timeout */
+	struct timespec ts;
+	struct timespec *pts = NULL;
+	if (timeout != CSP_MAX_TIMEOUT) {
+		if (get_deadline(&ts, timeout) != 0) {
+			return MPMC_QUEUE_ERROR;
+		}
+		pts = &ts;
+	}
+
+	for (;;) {
+		/* Mark as sleeping before checking again, so an element inserted from here on wakes us */
+		const uint32_t seen = futex_prepare(&queue->not_empty);
+		if (try_dequeue(queue, buf) == MPMC_QUEUE_OK) {
+			return MPMC_QUEUE_OK;
+		}
+		if (!futex_wait(&queue->not_empty, seen, pts)) {
+			return try_dequeue(queue, buf); //Timeout
+		}
+	}
+
+}
+
+int mpmc_queue_items(mpmc_queue_t * queue) {
+
+	// Extract point first, so a concurrent insert and extract can not make it pass the insert point
+	const uint64_t out = __atomic_load_n(&queue->out, __ATOMIC_ACQUIRE);
+	const uint64_t in = __atomic_load_n(&queue->in, __ATOMIC_ACQUIRE);
+
+	if (in <= out) {
+		return 0;
+	}
+	return ((in - out) > queue->size) ? (int) queue->size : (int) (in - out);
+
+}
+
+#endif // CSP_POSIX_QUEUE_MPMC
@@ -150,7 +150,12 @@ int pthread_queue_enqueue(pthread_queue_t * queue, const void * value, uint32_t
 	/* Get queue lock */
 	pthread_mutex_lock(&(queue->mutex));
 
-	ret = wait_slot_available(queue, pts);
+	/* Don't sleep on an expired deadline when not waiting at all */
+	if ((timeout == 0) && (queue->items == queue->size)) {
+		ret = PTHREAD_QUEUE_FULL;
+	} else {
+		ret = wait_slot_available(queue, pts);
+	}
 	if (ret == PTHREAD_QUEUE_OK) {
 		/* Copy object from input buffer */
 		memcpy(queue->buffer+(queue->in * queue->item_size), value, queue->item_size);
@@ -209,7 +214,12 @@ int pthread_queue_dequeue(pthread_queue_t * queue, void * buf, uint32_t timeout)
 	/* Get queue lock */
 	pthread_mutex_lock(&(queue->mutex));
 
-	ret = wait_item_available(queue, pts);
+	/* Don't sleep on an expired deadline when not waiting at all */
+	if ((timeout == 0) && (queue->items == 0)) {
+		ret = PTHREAD_QUEUE_EMPTY;
+	} else {
+		ret = wait_item_available(queue, pts);
+	}
 	if (ret == PTHREAD_QUEUE_OK) {
 		/* Coby object to output buffer */
 		memcpy(buf, queue->buffer+(queue->out * queue->item_size), queue->item_size);
@@ -852,7 +852,7 @@ static PyObject* pycsp_packet_set_data(PyObject *self, PyObject *args) {
     if (packet == NULL) {
         return NULL; // TypeError is thrown
     }
-    if (data.len > (int)csp_buffer_data_size()) {
+    if (data.len > (int)csp_buffer_data_size_of(packet)) {
         return PyErr_Error("packet_set_data() - exceeding data size", CSP_ERR_INVAL);
     }
 
@@ -128,7 +128,7 @@ int csp_xtea_encrypt_packet(csp_packet_t * packet) {
 	const uint32_t nonce = (uint32_t)rand();
 	const uint32_t nonce_n = csp_hton32(nonce);
 
-	if ((packet->length + sizeof(nonce_n)) > csp_buffer_data_size()) {
+	if ((packet->length + sizeof(nonce_n)) > csp_buffer_data_size_of(packet)) {
 		return CSP_ERR_NOMEM;
 	}
 
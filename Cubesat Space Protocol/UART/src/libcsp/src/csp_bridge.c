@@ -41,7 +41,7 @@ static CSP_DEFINE_TASK(csp_bridge) {
 
 		/* Get next packet to route */
 		csp_qfifo_t input;
-		if (csp_qfifo_read(&input) != CSP_ERR_NONE) {
+		if (csp_qfifo_read(&input, 1) == 0) {
 			continue;
 		}
 
@@ -29,15 +29,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #define CSP_BUFFER_ALIGN	(sizeof(int *))
 #endif
 
+// Room csp_buffer_get() leaves for what is appended in place when sending: RDP header (6), HMAC (4), XTEA nonce (4) and CRC32 (4)
+#ifndef CSP_BUFFER_CLASS_RESERVE
+#define CSP_BUFFER_CLASS_RESERVE	20
+#endif
+
 /** Internal buffer header */
 typedef struct csp_skbf_s {
 	unsigned int refcount;
+	uint8_t skbf_class;
 	void * skbf_addr;
 	char skbf_data[]; // -> csp_packet_t
 } csp_skbf_t;
 
-// Queue of free CSP buffers
-static csp_queue_handle_t csp_buffers;
 // Chunk of memory allocated for CSP buffers
 static char * csp_buffer_pool;
 
@@ -48,40 +52,438 @@ CSP_STATIC_ASSERT(offsetof(csp_packet_t, length) == 10, length_field_misaligned)
 CSP_STATIC_ASSERT(offsetof(csp_packet_t, id) == 12, csp_id_field_misaligned);
 CSP_STATIC_ASSERT(offsetof(csp_packet_t, data) == 16, data_field_misaligned);
 
+#if (CSP_POSIX)
+
+#include <pthread.h>
+
+#ifndef CSP_BUFFER_CACHE_SIZE
+#define CSP_BUFFER_CACHE_SIZE	16
+#endif
+
+/*
+ * Free buffers of a class are kept on a lock-free stack, linked by index + 1 through next. The head packs
+ * the top index + 1 (0 when empty), the number of buffers on the stack and a tag that changes on every
+ * update, so a compare-and-swap can not succeed on a head that was popped and pushed back in between.
+ */
+#define HEAD_TOP(head)		((uint32_t) ((head) & 0xFFFF))
+#define HEAD_COUNT(head)	((uint32_t) (((head) >> 16) & 0xFFFF))
+#define HEAD_TAG(head)		((uint32_t) ((head) >> 32))
+#define HEAD(top, count, tag)	(((uint64_t) (tag) << 32) | ((uint64_t) (count) << 16) | (uint64_t) (top))
+
+/** Buffers of one class */
+typedef struct {
+	size_t data_size;
+	unsigned int count;
+	unsigned int skbfsize;
+	char * pool;
+	uint64_t head;
+	uint16_t * next;
+	unsigned int cache_size;
+	// Threads that may cache this class, and how many do
+	unsigned int cache_threads;
+	unsigned int cache_users;
+} csp_buffer_slab_t;
+
+/*
+ * Each thread keeps a few free buffers of each class, taken from and returned to the stack in batches of half
+ * the cache. The cache is at most 1/16 of the class, and not used at all for small classes. Only the first
+ * threads to use a class cache it, so all caches together hold at most a quarter of the class, and buffers held
+ * by idle threads can not starve the others however many threads there are. The rest use the stack directly.
+ * Caches from before the last csp_buffer_init() are recognized by their generation and dropped.
+ */
+typedef struct csp_buffer_cache_s {
+	unsigned int generation;
+	bool enabled[CSP_BUFFER_CLASSES_MAX];
+	unsigned int count[CSP_BUFFER_CLASSES_MAX];
+	csp_skbf_t * buffers[CSP_BUFFER_CLASSES_MAX][CSP_BUFFER_CACHE_SIZE];
+	struct csp_buffer_cache_s * next;
+	bool registered;
+} csp_buffer_cache_t;
+
+static __thread csp_buffer_cache_t csp_buffer_cache;
+static unsigned int csp_buffer_generation;
+
+// Caches of live threads, for csp_buffer_remaining()
+static csp_buffer_cache_t * csp_buffer_caches;
+static pthread_mutex_t csp_buffer_caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t csp_buffer_cache_key;
+static pthread_once_t csp_buffer_cache_once = PTHREAD_ONCE_INIT;
+
+#else
+
+/** Buffers of one class */
+typedef struct {
+	size_t data_size;
+	unsigned int count;
+	unsigned int skbfsize;
+	char * pool;
+	// Queue of free buffers
+	csp_queue_handle_t queue;
+} csp_buffer_slab_t;
+
+#endif // CSP_POSIX
+
+// Buffer classes, in increasing data size. The last one is csp_conf.buffers of csp_conf.buffer_data_size.
+static csp_buffer_slab_t csp_buffer_slabs[CSP_BUFFER_CLASSES_MAX];
+static unsigned int csp_buffer_slab_count;
+
+#if (CSP_POSIX)
+
+static inline unsigned int csp_buffer_index(csp_buffer_slab_t * slab, csp_skbf_t * buf) {
+	return ((char *) buf - slab->pool) / slab->skbfsize;
+}
+
+static unsigned int csp_buffer_stack_pop(csp_buffer_slab_t * slab, csp_skbf_t ** buffers, unsigned int max) {
+
+	uint64_t head = __atomic_load_n(&slab->head, __ATOMIC_ACQUIRE);
+	uint32_t top;
+	unsigned int count;
+
+	// Nothing below the top changes without the head changing, so the chain walked is valid if the swap succeeds
+	do {
+		top = HEAD_TOP(head);
+		for (count = 0; (count < max) && (top != 0); count++) {
+			buffers[count] = (void *) &slab->pool[(top - 1) * slab->skbfsize];
+			top = __atomic_load_n(&slab->next[top - 1], __ATOMIC_RELAXED);
+		}
+		if (count == 0) {
+			return 0;
+		}
+	} while (!__atomic_compare_exchange_n(&slab->head, &head, HEAD(top, HEAD_COUNT(head) - count, HEAD_TAG(head) + 1),
+					      true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+	return count;
+
+}
+
+static void csp_buffer_stack_push(csp_buffer_slab_t * slab, csp_skbf_t ** buffers, unsigned int count) {
+
+	// Link the buffers first, so they all go on with one swap
+	for (unsigned int i = 0; i + 1 < count; i++) {
+		__atomic_store_n(&slab->next[csp_buffer_index(slab, buffers[i])], csp_buffer_index(slab, buffers[i + 1]) + 1, __ATOMIC_RELAXED);
+	}
+
+	const uint32_t top = csp_buffer_index(slab, buffers[0]) + 1;
+	const unsigned int last = csp_buffer_index(slab, buffers[count - 1]);
+	uint64_t head = __atomic_load_n(&slab->head, __ATOMIC_RELAXED);
+	do {
+		__atomic_store_n(&slab->next[last], HEAD_TOP(head), __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&slab->head, &head, HEAD(top, HEAD_COUNT(head) + count, HEAD_TAG(head) + 1),
+					      true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+}
+
+static void csp_buffer_cache_release(void * arg) {
+
+	csp_buffer_cache_t * cache = arg;
+
+	pthread_mutex_lock(&csp_buffer_caches_lock);
+	for (csp_buffer_cache_t ** p = &csp_buffer_caches; *p != NULL; p = &(*p)->next) {
+		if (*p == cache) {
+			*p = cache->next;
+			break;
+		}
+	}
+	for (unsigned int i = 0; i < CSP_BUFFER_CLASSES_MAX; i++) {
+		if (cache->generation == csp_buffer_generation) {
+			if (cache->count[i] > 0) {
+				csp_buffer_stack_push(&csp_buffer_slabs[i], cache->buffers[i], cache->count[i]);
+			}
+			if (cache->enabled[i]) {
+				csp_buffer_slabs[i].cache_users--;
+			}
+		}
+		cache->count[i] = 0;
+		cache->enabled[i] = false;
+	}
+	cache->registered = false;
+	pthread_mutex_unlock(&csp_buffer_caches_lock);
+
+}
+
+static void csp_buffer_cache_key_create(void) {
+	pthread_key_create(&csp_buffer_cache_key, csp_buffer_cache_release);
+}
+
+static csp_buffer_cache_t * csp_buffer_thread_cache(csp_buffer_slab_t * slab) {
+
+	if (slab->cache_size == 0) {
+		return NULL;
+	}
+
+	csp_buffer_cache_t * cache = &csp_buffer_cache;
+	if (!cache->registered || (cache->generation != csp_buffer_generation)) {
+		// Register on first use, so the buffers go back to the stack when the thread exits
+		if (!cache->registered) {
+			pthread_once(&csp_buffer_cache_once, csp_buffer_cache_key_create);
+			if (pthread_setspecific(csp_buffer_cache_key, cache) != 0) {
+				return NULL;
+			}
+		}
+
+		pthread_mutex_lock(&csp_buffer_caches_lock);
+		if (!cache->registered) {
+			cache->next = csp_buffer_caches;
+			csp_buffer_caches = cache;
+			cache->registered = true;
+		}
+
+		// Take one of the cache places of every class that has one left
+		for (unsigned int i = 0; i < CSP_BUFFER_CLASSES_MAX; i++) {
+			__atomic_store_n(&cache->count[i], 0, __ATOMIC_RELAXED);
+			cache->enabled[i] = (i < csp_buffer_slab_count) &&
+					    (csp_buffer_slabs[i].cache_users < csp_buffer_slabs[i].cache_threads);
+			if (cache->enabled[i]) {
+				csp_buffer_slabs[i].cache_users++;
+			}
+		}
+		cache->generation = csp_buffer_generation;
+		pthread_mutex_unlock(&csp_buffer_caches_lock);
+	}
+
+	return cache->enabled[slab - csp_buffer_slabs] ? cache : NULL;
+
+}
+
+static int csp_buffer_list_create(csp_buffer_slab_t * slab) {
+
+	slab->next = NULL;
+	if (slab->count > 0) {
+		slab->next = csp_malloc(slab->count * sizeof(*slab->next));
+		if (slab->next == NULL) {
+			return CSP_ERR_NOMEM;
+		}
+	}
+
+	slab->cache_size = slab->count / 16;
+	if (slab->cache_size > CSP_BUFFER_CACHE_SIZE) {
+		slab->cache_size = CSP_BUFFER_CACHE_SIZE;
+	}
+	if (slab->cache_size < 2) {
+		slab->cache_size = 0;
+	}
+	slab->cache_threads = (slab->cache_size > 0) ? slab->count / 4 / slab->cache_size : 0;
+	slab->cache_users = 0;
+	csp_buffer_generation++;
+	__atomic_store_n(&slab->head, HEAD(0, 0, 0), __ATOMIC_RELAXED);
+
+	return CSP_ERR_NONE;
+
+}
+
+static void csp_buffer_list_remove(csp_buffer_slab_t * slab) {
+
+	__atomic_store_n(&slab->head, HEAD(0, 0, 0), __ATOMIC_RELAXED);
+	slab->cache_size = 0;
+	slab->cache_threads = 0;
+	csp_free(slab->next);
+	slab->next = NULL;
+
+}
+
+static csp_skbf_t * csp_buffer_list_get(csp_buffer_slab_t * slab) {
+
+	csp_skbf_t * buf;
+	csp_buffer_cache_t * cache = csp_buffer_thread_cache(slab);
+	if (cache == NULL) {
+		return csp_buffer_stack_pop(slab, &buf, 1) ? buf : NULL;
+	}
+
+	const unsigned int class = slab - csp_buffer_slabs;
+	unsigned int count = cache->count[class];
+	if (count == 0) {
+		count = csp_buffer_stack_pop(slab, cache->buffers[class], slab->cache_size / 2);
+		if (count == 0) {
+			return NULL;
+		}
+	}
+	buf = cache->buffers[class][--count];
+	__atomic_store_n(&cache->count[class], count, __ATOMIC_RELAXED);
+
+	return buf;
+
+}
+
+static csp_skbf_t * csp_buffer_list_get_isr(csp_buffer_slab_t * slab) {
+
+	csp_skbf_t * buf;
+	return csp_buffer_stack_pop(slab, &buf, 1) ? buf : NULL;
+
+}
+
+static void csp_buffer_list_put(csp_buffer_slab_t * slab, csp_skbf_t * buf) {
+
+	csp_buffer_cache_t * cache = csp_buffer_thread_cache(slab);
+	if (cache == NULL) {
+		csp_buffer_stack_push(slab, &buf, 1);
+		return;
+	}
+
+	const unsigned int class = slab - csp_buffer_slabs;
+	unsigned int count = cache->count[class];
+	if (count == slab->cache_size) {
+		count -= slab->cache_size / 2;
+		csp_buffer_stack_push(slab, &cache->buffers[class][count], slab->cache_size / 2);
+	}
+	cache->buffers[class][count++] = buf;
+	__atomic_store_n(&cache->count[class], count, __ATOMIC_RELAXED);
+
+}
+
+static void csp_buffer_list_put_isr(csp_buffer_slab_t * slab, csp_skbf_t * buf) {
+	csp_buffer_stack_push(slab, &buf, 1);
+}
+
+static int csp_buffer_list_size(csp_buffer_slab_t * slab) {
+
+	const unsigned int class = slab - csp_buffer_slabs;
+	int size = HEAD_COUNT(__atomic_load_n(&slab->head, __ATOMIC_RELAXED));
+
+	pthread_mutex_lock(&csp_buffer_caches_lock);
+	for (csp_buffer_cache_t * cache = csp_buffer_caches; cache != NULL; cache = cache->next) {
+		if (cache->generation == csp_buffer_generation) {
+			size += __atomic_load_n(&cache->count[class], __ATOMIC_RELAXED);
+		}
+	}
+	pthread_mutex_unlock(&csp_buffer_caches_lock);
+
+	return size;
+
+}
+
+#else
+
+static int csp_buffer_list_create(csp_buffer_slab_t * slab) {
+
+	slab->queue = csp_queue_create(slab->count, sizeof(void *));
+	if (!slab->queue) {
+		return CSP_ERR_NOMEM;
+	}
+
+	return CSP_ERR_NONE;
+
+}
+
+static void csp_buffer_list_remove(csp_buffer_slab_t * slab) {
+
+	if (slab->queue) {
+		csp_queue_remove(slab->queue);
+		slab->queue = NULL;
+	}
+
+}
+
+static csp_skbf_t * csp_buffer_list_get(csp_buffer_slab_t * slab) {
+
+	csp_skbf_t * buf = NULL;
+	csp_queue_dequeue(slab->queue, &buf, 0);
+	return buf;
+
+}
+
+static csp_skbf_t * csp_buffer_list_get_isr(csp_buffer_slab_t * slab) {
+
+	csp_skbf_t * buf = NULL;
+	CSP_BASE_TYPE task_woken = 0;
+	csp_queue_dequeue_isr(slab->queue, &buf, &task_woken);
+	return buf;
+
+}
+
+static void csp_buffer_list_put(csp_buffer_slab_t * slab, csp_skbf_t * buf) {
+	csp_queue_enqueue(slab->queue, &buf, 0);
+}
+
+static void csp_buffer_list_put_isr(csp_buffer_slab_t * slab, csp_skbf_t * buf) {
+
+	CSP_BASE_TYPE task_woken = 0;
+	csp_queue_enqueue_isr(slab->queue, &buf, &task_woken);
+
+}
+
+static int csp_buffer_list_size(csp_buffer_slab_t * slab) {
+	return csp_queue_size(slab->queue);
+}
+
+#endif // CSP_POSIX
+
+// Smallest class with room for data_size and what may be appended when sending, or else the largest class
+static unsigned int csp_buffer_class(size_t data_size) {
+
+	unsigned int class = 0;
+	while (((class + 1) < csp_buffer_slab_count) && (csp_buffer_slabs[class].data_size < (data_size + CSP_BUFFER_CLASS_RESERVE))) {
+		class++;
+	}
+	return class;
+
+}
+
 int csp_buffer_init(void) {
 
-	// calculate total size and ensure correct alignment (int *) for buffers
-	const unsigned int skbfsize = CSP_BUFFER_ALIGN * ((sizeof(csp_skbf_t) + csp_buffer_size() + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
+	if (csp_conf.buffer_class_count >= CSP_BUFFER_CLASSES_MAX) {
+		return CSP_ERR_INVAL;
+	}
+
+	// the classes from csp_conf.buffer_classes, followed by csp_conf.buffers
+	size_t pool_size = 0;
+	csp_buffer_slab_count = csp_conf.buffer_class_count + 1;
+	for (unsigned int i = 0; i < csp_buffer_slab_count; i++) {
+		csp_buffer_slab_t * slab = &csp_buffer_slabs[i];
+		memset(slab, 0, sizeof(*slab));
+		if (i < csp_conf.buffer_class_count) {
+			slab->data_size = csp_conf.buffer_classes[i].data_size;
+			slab->count = csp_conf.buffer_classes[i].count;
+		} else {
+			slab->data_size = csp_conf.buffer_data_size;
+			slab->count = csp_conf.buffers;
+		}
+		if ((i > 0) && (slab->data_size <= csp_buffer_slabs[i - 1].data_size)) {
+			csp_buffer_slab_count = 0;
+			return CSP_ERR_INVAL;
+		}
+
+		// calculate total size and ensure correct alignment (int *) for buffers
+		slab->skbfsize = CSP_BUFFER_ALIGN * ((sizeof(csp_skbf_t) + CSP_BUFFER_PACKET_OVERHEAD + slab->data_size + (CSP_BUFFER_ALIGN - 1)) / CSP_BUFFER_ALIGN);
+		pool_size += slab->count * slab->skbfsize;
+	}
 
-	csp_buffer_pool = csp_malloc(csp_conf.buffers * skbfsize);
+	csp_buffer_pool = csp_malloc(pool_size);
 	if (csp_buffer_pool == NULL)
 		goto fail_malloc;
 
-	csp_buffers = csp_queue_create(csp_conf.buffers, sizeof(void *));
-	if (!csp_buffers)
-		goto fail_queue;
-
-	for (unsigned int i = 0; i < csp_conf.buffers; i++) {
-		csp_skbf_t * buf = (void *) &csp_buffer_pool[i * skbfsize];
-		buf->skbf_addr = buf;
-		csp_queue_enqueue(csp_buffers, &buf, 0);
+	char * pool = csp_buffer_pool;
+	for (unsigned int i = 0; i < csp_buffer_slab_count; i++) {
+		csp_buffer_slab_t * slab = &csp_buffer_slabs[i];
+		slab->pool = pool;
+		pool += slab->count * slab->skbfsize;
+
+		if (csp_buffer_list_create(slab) != CSP_ERR_NONE)
+			goto fail_list;
+
+		for (unsigned int j = 0; j < slab->count; j++) {
+			csp_skbf_t * buf = (void *) &slab->pool[j * slab->skbfsize];
+			buf->skbf_class = i;
+			buf->skbf_addr = buf;
+			csp_buffer_list_put_isr(slab, buf);
+		}
 	}
 
 	return CSP_ERR_NONE;
 
-fail_queue:
+fail_list:
 	csp_buffer_free_resources();
 fail_malloc:
+	csp_buffer_slab_count = 0;
 	return CSP_ERR_NOMEM;
 
 }
 
 void csp_buffer_free_resources(void) {
 
-	if (csp_buffers) {
-		csp_queue_remove(csp_buffers);
-		csp_buffers = NULL;
+	for (unsigned int i = 0; i < csp_buffer_slab_count; i++) {
+		csp_buffer_list_remove(&csp_buffer_slabs[i]);
 	}
+	csp_buffer_slab_count = 0;
 	csp_free(csp_buffer_pool);
 	csp_buffer_pool = NULL;
 
@@ -93,8 +495,9 @@ void *csp_buffer_get_isr(size_t _data_size) {
 		return NULL;
 
 	csp_skbf_t * buffer = NULL;
-	CSP_BASE_TYPE task_woken = 0;
-	csp_queue_dequeue_isr(csp_buffers, &buffer, &task_woken);
+	for (unsigned int i = csp_buffer_class(_data_size); (i < csp_buffer_slab_count) && (buffer == NULL); i++) {
+		buffer = csp_buffer_list_get_isr(&csp_buffer_slabs[i]);
+	}
 	if (buffer == NULL)
 		return NULL;
 
@@ -114,7 +517,9 @@ void *csp_buffer_get(size_t _data_size) {
 	}
 
 	csp_skbf_t * buffer = NULL;
-	csp_queue_dequeue(csp_buffers, &buffer, 0);
+	for (unsigned int i = csp_buffer_class(_data_size); (i < csp_buffer_slab_count) && (buffer == NULL); i++) {
+		buffer = csp_buffer_list_get(&csp_buffer_slabs[i]);
+	}
 	if (buffer == NULL) {
 		csp_log_error("GET: Out of buffers");
 		return NULL;
@@ -156,8 +561,7 @@ void csp_buffer_free_isr(void *packet) {
 		return;
 	}
 
-	CSP_BASE_TYPE task_woken = 0;
-	csp_queue_enqueue_isr(csp_buffers, &buf, &task_woken);
+	csp_buffer_list_put_isr(&csp_buffer_slabs[buf->skbf_class], buf);
 
 }
 
@@ -191,7 +595,7 @@ void csp_buffer_free(void *packet) {
 	}
 
 	csp_log_buffer("FREE: %p", buf);
-	csp_queue_enqueue(csp_buffers, &buf, 0);
+	csp_buffer_list_put(&csp_buffer_slabs[buf->skbf_class], buf);
 
 }
 
@@ -202,9 +606,10 @@ void *csp_buffer_clone(void *buffer) {
 		return NULL;
 	}
 
+	// the clone may come from a smaller class, so only the packet itself is copied
 	csp_packet_t *clone = csp_buffer_get(packet->length);
 	if (clone) {
-		memcpy(clone, packet, csp_buffer_size());
+		memcpy(clone, packet, CSP_BUFFER_PACKET_OVERHEAD + packet->length);
 	}
 
 	return clone;
@@ -212,7 +617,13 @@ void *csp_buffer_clone(void *buffer) {
 }
 
 int csp_buffer_remaining(void) {
-	return csp_queue_size(csp_buffers);
+
+	int remaining = 0;
+	for (unsigned int i = 0; i < csp_buffer_slab_count; i++) {
+		remaining += csp_buffer_list_size(&csp_buffer_slabs[i]);
+	}
+	return remaining;
+
 }
 
 size_t csp_buffer_size(void) {
@@ -222,3 +633,10 @@ size_t csp_buffer_size(void) {
 size_t csp_buffer_data_size(void) {
 	return csp_conf.buffer_data_size;
 }
+
+size_t csp_buffer_data_size_of(const void * buffer) {
+
+	const csp_skbf_t * buf = (const void*)(((const uint8_t*)buffer) - sizeof(csp_skbf_t));
+	return csp_buffer_slabs[buf->skbf_class].data_size;
+
+}
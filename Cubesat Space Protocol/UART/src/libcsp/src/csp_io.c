@@ -165,17 +165,8 @@ csp_packet_t * csp_read(csp_conn_t * conn, uint32_t timeout) {
 
 }
 
-int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * ifroute, uint32_t timeout) {
-
-	if (packet == NULL) {
-		csp_log_error("csp_send_direct called with NULL packet");
-		goto err;
-	}
-
-	if (ifroute == NULL) {
-		csp_log_error("No route to host: %u (0x%08"PRIx32")", idout.dst, idout.ext);
-		goto err;
-	}
+/* Logs the packet, copies the identifier to it and adds HMAC, CRC32 and XTEA, as required */
+static int csp_send_prepare(csp_id_t idout, csp_packet_t * packet, const csp_route_t * ifroute) {
 
 	csp_iface_t * ifout = ifroute->iface;
 
@@ -202,11 +193,11 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 			if (csp_hmac_append(packet, false) != CSP_ERR_NONE) {
 				/* HMAC append failed */
 				csp_log_warn("HMAC append failed!");
-				goto tx_err;
+				return CSP_ERR_TX;
 			}
 #else
 			csp_log_warn("Attempt to send packet with HMAC, but CSP was compiled without HMAC support. Discarding packet");
-			goto tx_err;
+			return CSP_ERR_TX;
 #endif
 		}
 
@@ -217,7 +208,7 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 			if (csp_crc32_append(packet, false) != CSP_ERR_NONE) {
 				/* CRC32 append failed */
 				csp_log_warn("CRC32 append failed!");
-				goto tx_err;
+				return CSP_ERR_TX;
 			}
 #else
 			csp_log_warn("Attempt to send packet with CRC32, but CSP was compiled without CRC32 support. Sending without CRC32r");
@@ -231,22 +222,44 @@ int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * i
 			if (csp_xtea_encrypt_packet(packet) != CSP_ERR_NONE) {
 				/* Encryption failed */
 				csp_log_warn("XTEA Encryption failed!");
-				goto tx_err;
+				return CSP_ERR_TX;
 			}
 #else
 			csp_log_warn("Attempt to send XTEA encrypted packet, but CSP was compiled without XTEA support. Discarding packet");
-			goto tx_err;
+			return CSP_ERR_TX;
 #endif
 		}
 	}
 
-	/* Store length before passing to interface */
-	uint16_t bytes = packet->length;
 	uint16_t mtu = ifout->mtu;
 
-	if (mtu > 0 && bytes > mtu)
+	if (mtu > 0 && packet->length > mtu)
+		return CSP_ERR_TX;
+
+	return CSP_ERR_NONE;
+
+}
+
+int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * ifroute, uint32_t timeout) {
+
+	if (packet == NULL) {
+		csp_log_error("csp_send_direct called with NULL packet");
+		goto err;
+	}
+
+	if (ifroute == NULL) {
+		csp_log_error("No route to host: %u (0x%08"PRIx32")", idout.dst, idout.ext);
+		goto err;
+	}
+
+	csp_iface_t * ifout = ifroute->iface;
+
+	if (csp_send_prepare(idout, packet, ifroute) != CSP_ERR_NONE)
 		goto tx_err;
 
+	/* Store length before passing to interface */
+	uint16_t bytes = packet->length;
+
 	if ((*ifout->nexthop)(ifroute, packet) != CSP_ERR_NONE)
 		goto tx_err;
 
@@ -261,6 +274,53 @@ err:
 
 }
 
+unsigned int csp_send_direct_batch(const csp_route_t * ifroute[], csp_packet_t * packet[], unsigned int count) {
+
+	csp_iface_t * ifout = ifroute[0]->iface;
+	uint16_t bytes[CSP_ROUTE_BATCH];
+	unsigned int ready = 0;
+
+	/* Drop the packets that can not be sent, and close the gaps they leave */
+	for (unsigned int i = 0; i < count; i++) {
+		if (csp_send_prepare(packet[i]->id, packet[i], ifroute[i]) != CSP_ERR_NONE) {
+			ifout->tx_error++;
+			csp_buffer_free(packet[i]);
+			continue;
+		}
+		ifroute[ready] = ifroute[i];
+		packet[ready] = packet[i];
+		bytes[ready] = packet[i]->length;
+		ready++;
+	}
+
+	unsigned int sent = 0;
+	if (ifout->nexthop_batch && (ready > 0)) {
+		sent = (*ifout->nexthop_batch)(ifroute, packet, ready);
+		for (unsigned int i = sent; i < ready; i++) {
+			ifout->tx_error++;
+			csp_buffer_free(packet[i]);
+		}
+		for (unsigned int i = 0; i < sent; i++) {
+			ifout->txbytes += bytes[i];
+		}
+		ifout->tx += sent;
+	} else {
+		for (unsigned int i = 0; i < ready; i++) {
+			if ((*ifout->nexthop)(ifroute[i], packet[i]) != CSP_ERR_NONE) {
+				ifout->tx_error++;
+				csp_buffer_free(packet[i]);
+				continue;
+			}
+			ifout->tx++;
+			ifout->txbytes += bytes[i];
+			sent++;
+		}
+	}
+
+	return sent;
+
+}
+
 int csp_send(csp_conn_t * conn, csp_packet_t * packet, uint32_t timeout) {
 
 	if ((conn == NULL) || (packet == NULL) || (conn->state != CONN_OPEN)) {
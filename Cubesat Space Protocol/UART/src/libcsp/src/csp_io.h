@@ -38,6 +38,18 @@ extern "C" {
 */
 int csp_send_direct(csp_id_t idout, csp_packet_t * packet, const csp_route_t * ifroute, uint32_t timeout);
 
+/**
+   Send CSP packets on one interface, each with its own identifier, as the router forwards them.
+
+   Uses the interface's nexthop_batch function if it has one.
+
+   @param ifroute routes to destination, one per packet, all with the same interface. Reordered along with \a packet.
+   @param packet packets to send - the ones that could not be sent are freed.
+   @param count number of packets, at most #CSP_ROUTE_BATCH.
+   @return number of packets sent.
+*/
+unsigned int csp_send_direct_batch(const csp_route_t * ifroute[], csp_packet_t * packet[], unsigned int count);
+
 #ifdef __cplusplus
 }
 #endif
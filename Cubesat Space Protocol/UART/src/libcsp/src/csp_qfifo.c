@@ -70,34 +70,44 @@ void csp_qfifo_free_resources(void) {
 
 }
 
-int csp_qfifo_read(csp_qfifo_t * input) {
+int csp_qfifo_read(csp_qfifo_t * input, int max) {
+
+	int count;
 
 #if (CSP_USE_QOS)
-	int prio, found, event;
+	int prio, event;
 
 	/* Wait for packet in any queue */
 	if (csp_queue_dequeue(qfifo_events, &event, FIFO_TIMEOUT) != CSP_QUEUE_OK)
-		return CSP_ERR_TIMEDOUT;
-
-	/* Find packet with highest priority */
-	found = 0;
-	for (prio = 0; prio < CSP_ROUTE_FIFOS; prio++) {
-		if (csp_queue_dequeue(qfifo[prio], input, 0) == CSP_QUEUE_OK) {
-			found = 1;
-			break;
+		return 0;
+
+	/* Take packets with highest priority first, and the events of all but the one waited for.
+	 * A fifo found empty is not looked at again, packets arriving there wait for the next batch. */
+	count = 0;
+	for (prio = 0; (prio < CSP_ROUTE_FIFOS) && (count < max); prio++) {
+		while ((count < max) && (csp_queue_dequeue(qfifo[prio], &input[count], 0) == CSP_QUEUE_OK)) {
+			if (count > 0) {
+				csp_queue_dequeue(qfifo_events, &event, 0);
+			}
+			count++;
 		}
 	}
 
-	if (!found) {
+	if (count == 0) {
 		csp_log_warn("Spurious wakeup: No packet found");
-		return CSP_ERR_TIMEDOUT;
 	}
 #else
-	if (csp_queue_dequeue(qfifo[0], input, FIFO_TIMEOUT) != CSP_QUEUE_OK)
-		return CSP_ERR_TIMEDOUT;
+	if (csp_queue_dequeue(qfifo[0], &input[0], FIFO_TIMEOUT) != CSP_QUEUE_OK)
+		return 0;
+
+	/* Take what else is waiting, without blocking */
+	for (count = 1; count < max; count++) {
+		if (csp_queue_dequeue(qfifo[0], &input[count], 0) != CSP_QUEUE_OK)
+			break;
+	}
 #endif
 
-	return CSP_ERR_NONE;
+	return count;
 
 }
 
@@ -43,11 +43,12 @@ typedef struct {
 } csp_qfifo_t;
 
 /**
- * Read next packet from router input queue
- * @param input pointer to router queue item element
- * @return CSP_ERR type
+ * Read packets from router input queue, waiting for the first one only
+ * @param input array of router queue item elements
+ * @param max size of input array
+ * @return number of elements read, 0 on timeout
  */
-int csp_qfifo_read(csp_qfifo_t * input);
+int csp_qfifo_read(csp_qfifo_t * input, int max);
 
 /**
  * Wake up any task (e.g. router) waiting on messages.
@@ -154,31 +154,29 @@ static int csp_route_security_check(uint32_t security_opts, csp_iface_t * iface,
 
 }
 
-int csp_route_work(uint32_t timeout) {
+/**
+ * Packets of one router batch to forward
+ */
+typedef struct {
+	unsigned int fwd_count;                         //!< Number of packets to forward
+	const csp_route_t * fwd_route[CSP_ROUTE_BATCH]; //!< Route of each packet
+	csp_packet_t * fwd_packet[CSP_ROUTE_BATCH];     //!< Packets, in the order they arrived
+} csp_route_batch_t;
+
+/**
+ * Route one incoming packet: deliver it locally, or add it to the packets the batch forwards
+ * @param batch current batch
+ * @param input packet and incoming interface
+ */
+static void csp_route_input(csp_route_batch_t * batch, csp_qfifo_t * input) {
 
-	csp_qfifo_t input;
-	csp_packet_t * packet;
+	csp_packet_t * packet = input->packet;
 	csp_conn_t * conn;
 	csp_socket_t * socket;
 
-#if (CSP_USE_RDP)
-	/* Check connection timeouts (currently only for RDP) */
-	csp_conn_check_timeouts();
-#endif
-
-	/* Get next packet to route */
-	if (csp_qfifo_read(&input) != CSP_ERR_NONE) {
-		return CSP_ERR_TIMEDOUT;
-	}
-
-	packet = input.packet;
-	if (packet == NULL) {
-		return CSP_ERR_TIMEDOUT;
-	}
-
 	csp_log_packet("INP: S %u, D %u, Dp %u, Sp %u, Pr %u, Fl 0x%02X, Sz %"PRIu16" VIA: %s",
 			packet->id.src, packet->id.dst, packet->id.dport,
-			packet->id.sport, packet->id.pri, packet->id.flags, packet->length, input.iface->name);
+			packet->id.sport, packet->id.pri, packet->id.flags, packet->length, input->iface->name);
 
 	/* Here there be promiscuous mode */
 #if (CSP_USE_PROMISC)
@@ -190,15 +188,15 @@ int csp_route_work(uint32_t timeout) {
 	if (csp_dedup_is_duplicate(packet)) {
 		/* Discard packet */
 		csp_log_packet("Duplicate packet discarded");
-		input.iface->drop++;
+		input->iface->drop++;
 		csp_buffer_free(packet);
-		return CSP_ERR_NONE;
+		return;
 	}
 #endif
 
 	/* Now we count the message (since its deduplicated) */
-	input.iface->rx++;
-	input.iface->rxbytes += packet->length;
+	input->iface->rx++;
+	input->iface->rxbytes += packet->length;
 
 	/* If the message is not to me, route the message to the correct interface */
 	if ((packet->id.dst != csp_conf.address) && (packet->id.dst != CSP_BROADCAST_ADDR)) {
@@ -207,25 +205,24 @@ int csp_route_work(uint32_t timeout) {
 		const csp_route_t * ifroute = csp_rtable_find_route(packet->id.dst);
 
 		/* If the message resolves to the input interface, don't loop it back out */
-		if ((ifroute == NULL) || ((ifroute->iface == input.iface) && (input.iface->split_horizon_off == 0))) {
+		if ((ifroute == NULL) || ((ifroute->iface == input->iface) && (input->iface->split_horizon_off == 0))) {
 			csp_buffer_free(packet);
-			return CSP_ERR_NONE;
+			return;
 		}
 
-		/* Otherwise, actually send the message */
-		if (csp_send_direct(packet->id, packet, ifroute, 0) != CSP_ERR_NONE) {
-			csp_log_warn("Router failed to send");
-			csp_buffer_free(packet);
-		}
+		/* Otherwise, send the message along with the rest of the batch */
+		batch->fwd_route[batch->fwd_count] = ifroute;
+		batch->fwd_packet[batch->fwd_count] = packet;
+		batch->fwd_count++;
 
 		/* Next message, please */
-		return CSP_ERR_NONE;
+		return;
 	}
 
 	/* Discard packets with unsupported options */
-	if (csp_route_check_options(input.iface, packet) != CSP_ERR_NONE) {
+	if (csp_route_check_options(input->iface, packet) != CSP_ERR_NONE) {
 		csp_buffer_free(packet);
-		return CSP_ERR_NONE;
+		return;
 	}
 
 	/* The message is to me, search for incoming socket */
@@ -233,16 +230,16 @@ int csp_route_work(uint32_t timeout) {
 
 	/* If the socket is connection-less, deliver now */
 	if (socket && (socket->opts & CSP_SO_CONN_LESS)) {
-		if (csp_route_security_check(socket->opts, input.iface, packet) < 0) {
+		if (csp_route_security_check(socket->opts, input->iface, packet) < 0) {
 			csp_buffer_free(packet);
-			return CSP_ERR_NONE;
+			return;
 		}
 		if (csp_queue_enqueue(socket->socket, &packet, 0) != CSP_QUEUE_OK) {
 			csp_log_error("Conn-less socket queue full");
 			csp_buffer_free(packet);
-			return CSP_ERR_NONE;
+			return;
 		}
-		return CSP_ERR_NONE;
+		return;
 	}
 
 	/* Search for an existing connection */
@@ -254,13 +251,13 @@ int csp_route_work(uint32_t timeout) {
 		/* Reject packet if no matching socket is found */
 		if (!socket) {
 			csp_buffer_free(packet);
-			return CSP_ERR_NONE;
+			return;
 		}
 
 		/* Run security check on incoming packet */
-		if (csp_route_security_check(socket->opts, input.iface, packet) < 0) {
+		if (csp_route_security_check(socket->opts, input->iface, packet) < 0) {
 			csp_buffer_free(packet);
-			return CSP_ERR_NONE;
+			return;
 		}
 
 		/* New incoming connection accepted */
@@ -279,7 +276,7 @@ int csp_route_work(uint32_t timeout) {
 		if (!conn) {
 			csp_log_error("No more connections available");
 			csp_buffer_free(packet);
-			return CSP_ERR_NONE;
+			return;
 		}
 
 		/* Store the socket queue and options */
@@ -290,9 +287,9 @@ int csp_route_work(uint32_t timeout) {
 	} else {
 
 		/* Run security check on incoming packet */
-		if (csp_route_security_check(conn->opts, input.iface, packet) < 0) {
+		if (csp_route_security_check(conn->opts, input->iface, packet) < 0) {
 			csp_buffer_free(packet);
-			return CSP_ERR_NONE;
+			return;
 		}
 
 	}
@@ -304,12 +301,76 @@ int csp_route_work(uint32_t timeout) {
 		if (close_connection) {
 			csp_close(conn);
 		}
-		return CSP_ERR_NONE;
+		return;
 	}
 #endif
 
 	/* Pass packet to UDP module */
 	csp_udp_new_packet(conn, packet);
+}
+
+
+/**
+ * Forward the packets of a batch, with one call per outgoing interface
+ * @param batch current batch
+ */
+static void csp_route_forward(csp_route_batch_t * batch) {
+
+	while (batch->fwd_count > 0) {
+
+		/* Take the packets for the interface of the first one, keeping their order */
+		const csp_iface_t * ifout = batch->fwd_route[0]->iface;
+		const csp_route_t * route[CSP_ROUTE_BATCH];
+		csp_packet_t * packet[CSP_ROUTE_BATCH];
+		unsigned int count = 0;
+		unsigned int rest = 0;
+
+		for (unsigned int i = 0; i < batch->fwd_count; i++) {
+			if (batch->fwd_route[i]->iface == ifout) {
+				route[count] = batch->fwd_route[i];
+				packet[count] = batch->fwd_packet[i];
+				count++;
+			} else {
+				batch->fwd_route[rest] = batch->fwd_route[i];
+				batch->fwd_packet[rest] = batch->fwd_packet[i];
+				rest++;
+			}
+		}
+		batch->fwd_count = rest;
+
+		if (csp_send_direct_batch(route, packet, count) != count) {
+			csp_log_warn("Router failed to send");
+		}
+	}
+
+}
+
+int csp_route_work(uint32_t timeout) {
+
+	csp_qfifo_t input[CSP_ROUTE_BATCH];
+	csp_route_batch_t batch;
+
+#if (CSP_USE_RDP)
+	/* Check connection timeouts (currently only for RDP) */
+	csp_conn_check_timeouts();
+#endif
+
+	/* Get next packets to route */
+	const int count = csp_qfifo_read(input, CSP_ROUTE_BATCH);
+	if (count == 0) {
+		return CSP_ERR_TIMEDOUT;
+	}
+
+	batch.fwd_count = 0;
+	for (int i = 0; i < count; i++) {
+		/* Skip wake-ups */
+		if (input[i].packet != NULL) {
+			csp_route_input(&batch, &input[i]);
+		}
+	}
+
+	csp_route_forward(&batch);
+
 	return CSP_ERR_NONE;
 }
 
@@ -165,6 +165,29 @@ static int do_cmp_clock(struct csp_cmp_message *cmp) {
 
 }
 
+/**
+ * Replies are written over the request, which may have arrived in a buffer sized for the request alone.
+ * Moves the request to a full-size buffer if its own can not hold reply_size bytes.
+ * @return packet to reply in, or NULL if none could be had, in which case the request is freed
+ */
+static csp_packet_t * csp_service_reply_buffer(csp_packet_t * packet, size_t reply_size) {
+
+	if (csp_buffer_data_size_of(packet) >= reply_size)
+		return packet;
+
+	csp_packet_t * reply = csp_buffer_get(csp_buffer_data_size());
+	if ((reply == NULL) || (csp_buffer_data_size_of(reply) < reply_size)) {
+		csp_buffer_free(reply);
+		csp_buffer_free(packet);
+		return NULL;
+	}
+
+	memcpy(reply, packet, CSP_BUFFER_PACKET_OVERHEAD + packet->length);
+	csp_buffer_free(packet);
+	return reply;
+
+}
+
 /* CSP Management Protocol handler */
 static int csp_cmp_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
@@ -218,6 +241,11 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 	switch (csp_conn_dport(conn)) {
 
 	case CSP_CMP:
+		/* Every CMP request is handled in place as a whole message */
+		packet = csp_service_reply_buffer(packet, sizeof(struct csp_cmp_message));
+		if (packet == NULL)
+			return;
+
 		/* Pass to CMP handler */
 		if (csp_cmp_handler(conn, packet) != CSP_ERR_NONE) {
 			csp_buffer_free(packet);
@@ -284,6 +312,9 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
 	case CSP_MEMFREE: {
 		uint32_t total = csp_sys_memfree();
+		packet = csp_service_reply_buffer(packet, sizeof(total));
+		if (packet == NULL)
+			return;
 
 		total = csp_hton32(total);
 		memcpy(packet->data, &total, sizeof(total));
@@ -311,6 +342,9 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
 	case CSP_BUF_FREE: {
 		uint32_t size = csp_buffer_remaining();
+		packet = csp_service_reply_buffer(packet, sizeof(size));
+		if (packet == NULL)
+			return;
 		size = csp_hton32(size);
 		memcpy(packet->data, &size, sizeof(size));
 		packet->length = sizeof(size);
@@ -319,6 +353,9 @@ void csp_service_handler(csp_conn_t * conn, csp_packet_t * packet) {
 
 	case CSP_UPTIME: {
 		uint32_t time = csp_get_uptime_s();
+		packet = csp_service_reply_buffer(packet, sizeof(time));
+		if (packet == NULL)
+			return;
 		time = csp_hton32(time);
 		memcpy(packet->data, &time, sizeof(time));
 		packet->length = sizeof(time);
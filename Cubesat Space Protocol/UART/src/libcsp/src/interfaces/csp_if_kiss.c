@@ -31,18 +31,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 #define TFESC 		0xDD
 #define TNC_DATA	0x00
 
-int csp_kiss_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
-
-	csp_kiss_interface_data_t * ifdata = ifroute->iface->interface_data;
-	void * driver = ifroute->iface->driver_data;
-
-	/* Add CRC32 checksum - the MTU setting ensures there are space */
-	csp_crc32_append(packet, false);
-
-	/* Lock */
-	if (csp_mutex_lock(&ifdata->lock, 1000) != CSP_MUTEX_OK) {
-            return CSP_ERR_TIMEDOUT;
-        }
+/**
+ * Write one KISS frame and free the packet, with the interface locked.
+ */
+static void csp_kiss_tx_frame(csp_kiss_interface_data_t * ifdata, void * driver, csp_packet_t * packet) {
 
 	/* Save the outgoing id in the buffer */
 	packet->id.ext = csp_hton32(packet->id.ext);
@@ -70,6 +62,22 @@ int csp_kiss_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
 
 	/* Free data */
 	csp_buffer_free(packet);
+}
+
+int csp_kiss_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
+
+	csp_kiss_interface_data_t * ifdata = ifroute->iface->interface_data;
+	void * driver = ifroute->iface->driver_data;
+
+	/* Add CRC32 checksum - the MTU setting ensures there are space */
+	csp_crc32_append(packet, false);
+
+	/* Lock */
+	if (csp_mutex_lock(&ifdata->lock, 1000) != CSP_MUTEX_OK) {
+            return CSP_ERR_TIMEDOUT;
+        }
+
+	csp_kiss_tx_frame(ifdata, driver, packet);
 
 	/* Unlock */
 	csp_mutex_unlock(&ifdata->lock);
@@ -77,6 +85,31 @@ int csp_kiss_tx(const csp_route_t * ifroute, csp_packet_t * packet) {
 	return CSP_ERR_NONE;
 }
 
+unsigned int csp_kiss_tx_batch(const csp_route_t * const ifroute[], csp_packet_t * const packet[], unsigned int count) {
+
+	csp_kiss_interface_data_t * ifdata = ifroute[0]->iface->interface_data;
+	void * driver = ifroute[0]->iface->driver_data;
+
+	/* Add CRC32 checksum - the MTU setting ensures there are space */
+	for (unsigned int i = 0; i < count; i++) {
+		csp_crc32_append(packet[i], false);
+	}
+
+	/* Lock once, so the frames go out back to back */
+	if (csp_mutex_lock(&ifdata->lock, 1000) != CSP_MUTEX_OK) {
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		csp_kiss_tx_frame(ifdata, driver, packet[i]);
+	}
+
+	/* Unlock */
+	csp_mutex_unlock(&ifdata->lock);
+
+	return count;
+}
+
 /**
  * Decode received data and eventually route the packet.
  */
@@ -108,7 +141,9 @@ void csp_kiss_rx(csp_iface_t * iface, const uint8_t * buf, size_t len, void * px
 
 			/* Try to allocate new buffer */
 			if (ifdata->rx_packet == NULL) {
-				ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(0) : csp_buffer_get(0); // CSP only supports one size
+				/* The length is not known until the closing FEND, so this is always a full-size buffer. The frame is routed on
+				   in it rather than copied to a smaller class, which would cost a copy and a second allocation per frame. */
+				ifdata->rx_packet = pxTaskWoken ? csp_buffer_get_isr(csp_buffer_data_size()) : csp_buffer_get(csp_buffer_data_size());
 			}
 
 			/* If no more memory, skip frame */
@@ -240,6 +275,7 @@ int csp_kiss_add_interface(csp_iface_t * iface) {
         }
 
 	iface->nexthop = csp_kiss_tx;
+	iface->nexthop_batch = csp_kiss_tx_batch;
 
 	return csp_iflist_add(iface);
 }
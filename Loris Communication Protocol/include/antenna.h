@@ -13,16 +13,21 @@
 // Standard C libraries
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <unistd.h>
 
 // Settings //
 // UART
 #define UART_SPEED B9600
+#define UART_BAUD 9600
+#define UART_VMIN 1
+#define UART_VTIME 1
 #define UART_PARITY 0
 
 // Reed-solomon
@@ -33,12 +38,41 @@
 // Antenna
 #define MAX_TXT_FILE_SIZE 8191
 #define MAX_READ_LEN 256
-#define FILE_BUFFER_SIZE 255
-#define FILE_NOTICE_FMT "F%u"
-#define FILE_NOTICE_LEN 16
+
+// Largest iovec count handed to writev() in one call (Linux UIO_MAXIOV)
+#ifdef IOV_MAX
+#define ANTENNA_IOV_MAX IOV_MAX
+#else
+#define ANTENNA_IOV_MAX 1024
+#endif
 
 enum { READ_MODE_UPTO, READ_MODE_UNTIL };
 
+/**
+ * @brief UART line settings.
+ *
+ * baud may be any rate the driver can generate. The standard Bxxx rates go
+ * through termios, and anything else through termios2 with BOTHER.
+ *
+ * vmin and vtime are the termios VMIN and VTIME: a read() returns once vmin
+ * bytes are in, or vtime tenths of a second after the last byte. Raising vmin
+ * to about a frame lets the reader sleep through a frame instead of waking for
+ * every byte. With vmin 0 and vtime 0 reads never wait.
+ *
+ * flow_control turns on RTS/CTS hardware flow control. low_latency asks the
+ * driver to hand received bytes over at once rather than on its next tick,
+ * where it supports that.
+ */
+struct antenna_uart_config {
+  unsigned int baud;
+  cc_t vmin;
+  cc_t vtime;
+  int flow_control;
+  int low_latency;
+};
+
+#define ANTENNA_UART_CONFIG_DEFAULT {UART_BAUD, UART_VMIN, UART_VTIME, 0, 0}
+
 /**
  * @brief Initializes the UART port for the antenna.
  *
@@ -47,6 +81,44 @@ enum { READ_MODE_UPTO, READ_MODE_UNTIL };
  */
 int antenna_init(const char* path);
 
+/**
+ * @brief Initializes the UART port for the antenna with the given settings
+ * instead of the defaults.
+ *
+ * @param path Sets the device path to configure.
+ * @param config Line settings.
+ * @return 0 on success, -1 on error.
+ */
+int antenna_init_config(const char* path,
+                        const struct antenna_uart_config* config);
+
+/**
+ * @brief Returns the file descriptor of the port opened by antenna_init().
+ *
+ * @return antenna file descriptor, or -1 before antenna_init().
+ */
+int antenna_get_fd();
+
+/**
+ * @brief Puts a tty in raw 8N1 mode with the given line settings.
+ *
+ * @param fd File descriptor of the tty.
+ * @param config Line settings.
+ * @return 0 on success, -1 on error.
+ */
+int antenna_configure_fd(int fd, const struct antenna_uart_config* config);
+
+/**
+ * @brief Turns PARMRK error marking on or off for a tty. While on, a byte
+ * received with a parity or framing error, or a break, is read as \377 \0 byte
+ * and a real \377 as \377 \377, which antenna_session_set_parmrk() undoes.
+ *
+ * @param fd File descriptor of the tty.
+ * @param enable 1 to mark errors, 0 to pass bytes through as received.
+ * @return 0 on success, -1 on error.
+ */
+int antenna_set_parmrk_fd(int fd, int enable);
+
 /**
  * @brief Writes bytes to the antenna.
  *
@@ -68,6 +140,18 @@ int antenna_write(const char* data, size_t data_len);
  */
 int antenna_write_fd(int fd, const char* data, size_t data_len);
 
+/**
+ * @brief Writes a list of buffers to a custom file descriptor, handing as many
+ * of them to the kernel per syscall as it will take. Partial writes are
+ * resumed. The iov array is modified.
+ *
+ * @param fd File descriptor to use.
+ * @param iov Array of buffers to send.
+ * @param iovcnt Number of entries in iov.
+ * @return 0 on success, -1 on error
+ */
+int antenna_writev_fd(int fd, struct iovec* iov, int iovcnt);
+
 /**
  * @brief Writes bytes to the antenna with Reed-solomon FEC
  *
@@ -88,6 +172,19 @@ int antenna_write_rs(const char* data, size_t data_len);
  */
 int antenna_write_rs_fd(int fd, const char* data, size_t data_len);
 
+/**
+ * @brief Identical to antenna_write_rs_fd, but interleaves depth codewords
+ * symbol by symbol so longer error bursts can be repaired.
+ *
+ * @param fd File descriptor to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @param depth Interleave depth, 1 to 8. Must match the receiver.
+ * @return 0 on success, -1 on error
+ */
+int antenna_write_rs_interleaved_fd(int fd, const char* data, size_t data_len,
+                                    int depth);
+
 /**
  * @brief Reads bytes from the antenna.
  * Note that there are 2 ways to read:
@@ -136,6 +233,20 @@ int antenna_read_rs(char* buffer, size_t read_len, int read_mode);
  */
 int antenna_read_rs_fd(int fd, char* buffer, size_t read_len, int read_mode);
 
+/**
+ * @brief Identical to antenna_read_rs_fd, but for data sent with
+ * antenna_write_rs_interleaved_fd.
+ *
+ * @param fd File descriptor to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @param depth Interleave depth, 1 to 8. Must match the sender.
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_read_rs_interleaved_fd(int fd, char* buffer, size_t read_len,
+                                   int read_mode, int depth);
+
 /**
  * @brief Send file over the air.
  *
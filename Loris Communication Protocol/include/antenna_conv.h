@@ -0,0 +1,161 @@
+/**
+ * @file antenna_conv.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Convolutional inner code for the concatenated antenna link mode
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_CONV_H
+#define LORIS_ANTENNA_CONV_H
+
+// Convolutional code library
+#include "correct.h"
+#ifdef ANTENNA_CONV_SSE
+#include "correct-sse.h"
+#endif
+
+// Standard C libraries
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+// Settings (CCSDS rate 1/2, K = 7)
+#define CONV_RATE 2
+#define CONV_ORDER 7
+#define CONV_POLYNOMIAL correct_conv_r12_7_polynomial
+#define CONV_ENCODED_BITS(data_len) \
+  (CONV_RATE * (8 * (data_len) + CONV_ORDER - 1))
+#define CONV_PUNCTURE_PERIOD_MAX 7
+#define CONV_NEUTRAL_SOFT 128
+
+enum { ANTENNA_DECISION_HARD, ANTENNA_DECISION_SOFT };
+enum {
+  ANTENNA_CONV_RATE_1_2,
+  ANTENNA_CONV_RATE_2_3,
+  ANTENNA_CONV_RATE_3_4,
+  ANTENNA_CONV_RATE_5_6,
+  ANTENNA_CONV_RATE_7_8,
+  ANTENNA_CONV_RATES
+};
+
+/*
+ * Higher rates are the rate 1/2 code with some coded bits left out, using the
+ * CCSDS 131.0-B / DVB-S puncturing patterns. X is the first coded bit of each
+ * input bit and Y the second; a 1 is sent, a 0 dropped, and what is kept goes
+ * out in order X1 Y1 X2 Y2...
+ *
+ *   rate   X         Y         sent
+ *   2/3    10        11        X1 Y1 Y2
+ *   3/4    101       110       X1 Y1 Y2 X3
+ *   5/6    10101     11010     X1 Y1 Y2 X3 Y4 X5
+ *   7/8    1000101   1111010   X1 Y1 Y2 Y3 Y4 X5 Y6 X7
+ *
+ * The pattern restarts with every block, so blocks still decode on their own.
+ * The receiver puts a CONV_NEUTRAL_SOFT symbol back for every dropped bit and
+ * runs the rate 1/2 soft decoder, also for hard decisions.
+ */
+
+/**
+ * @brief K = 7 convolutional coder used as the inner code under Reed-solomon,
+ * at rate 1/2 or punctured to a higher rate.
+ *
+ * The transmit side always sends the coded bits packed 8 to a byte. With hard
+ * decisions the receive side expects the same packed bits back. With soft
+ * decisions it expects one byte per coded bit from the demodulator, 0 for a
+ * confident 0, 255 for a confident 1 and 128 for an erasure.
+ */
+struct antenna_conv {
+  int decision;
+  int rate;
+#ifdef ANTENNA_CONV_SSE
+  correct_convolutional_sse *conv;
+#else
+  correct_convolutional *conv;
+#endif
+
+  // Rate 1/2 soft symbols rebuilt from a punctured block
+  uint8_t *depunctured;
+  size_t depunctured_len;
+};
+
+/**
+ * @brief Builds the convolutional coder.
+ *
+ * @param c Pointer to allocated coder which will be initialized.
+ * @param decision ANTENNA_DECISION_HARD or ANTENNA_DECISION_SOFT.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_conv_new(struct antenna_conv *c, int decision);
+
+/**
+ * @brief Releases the coder.
+ *
+ * @param c Coder to tear down.
+ */
+void antenna_conv_destroy(struct antenna_conv *c);
+
+/**
+ * @brief Selects the code rate. Both ends of the link must use the same rate.
+ *
+ * @param c Coder to configure.
+ * @param rate ANTENNA_CONV_RATE_1_2, _2_3, _3_4, _5_6 or _7_8.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_conv_set_rate(struct antenna_conv *c, int rate);
+
+/**
+ * @brief Number of bytes sent on the wire for data_len bytes of input.
+ *
+ * @param c Coder to use.
+ * @param data_len Number of bytes before the inner code.
+ * @return number of coded bytes.
+ */
+size_t antenna_conv_encoded_len(struct antenna_conv *c, size_t data_len);
+
+/**
+ * @brief Number of bytes the receiver reads for data_len bytes of input. This
+ * is the encoded length for hard decisions, and one byte per bit of the encoded
+ * bytes (padding included) for soft decisions.
+ *
+ * @param c Coder to use.
+ * @param data_len Number of bytes before the inner code.
+ * @return number of bytes to read.
+ */
+size_t antenna_conv_received_len(struct antenna_conv *c, size_t data_len);
+
+/**
+ * @brief Encodes bytes with the inner code. The output holds
+ * antenna_conv_encoded_len(c, data_len) bytes, but is punctured in place, so
+ * coded must have room for the CONV_ENCODED_BITS(data_len) bits of rate 1/2.
+ *
+ * @param c Coder to use.
+ * @param data Array of bytes to encode.
+ * @param data_len Number of bytes from data to encode.
+ * @param coded Output buffer for the coded bytes.
+ * @return number of coded bytes or -1 on error.
+ */
+ssize_t antenna_conv_encode(struct antenna_conv *c, const uint8_t *data,
+                            size_t data_len, uint8_t *coded);
+
+/**
+ * @brief Runs the Viterbi decoder over received bytes, using hard or soft
+ * decisions as the coder was built with.
+ *
+ * @param c Coder to use.
+ * @param received Array of received bytes.
+ * @param received_len Number of bytes in received. Must be a value returned by
+ * antenna_conv_received_len.
+ * @param data Output buffer for the decoded bytes.
+ * @param data_cap Size of data. Blocks that would decode to more are rejected.
+ * @return number of decoded bytes or -1 on error.
+ */
+ssize_t antenna_conv_decode(struct antenna_conv *c, const uint8_t *received,
+                            size_t received_len, uint8_t *data,
+                            size_t data_cap);
+
+#endif
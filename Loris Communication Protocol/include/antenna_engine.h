@@ -0,0 +1,233 @@
+/**
+ * @file antenna_engine.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Event driven I/O for several antenna links from one thread
+ * @version 0.1
+ * @date 2022-04-18
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_ENGINE_H
+#define LORIS_ANTENNA_ENGINE_H
+
+// Project headers
+#include "antenna_session.h"
+
+// Standard C libraries
+#include <pthread.h>
+#include <stdint.h>
+
+// Settings
+#define ANTENNA_ENGINE_MAX_HANDLES 32
+#define ANTENNA_ENGINE_MAX_EVENTS 16
+#define ANTENNA_HANDLE_TX_QUEUE_LEN (64 * ANTENNA_FRAME_MAX_LEN)
+#define ANTENNA_HANDLE_RX_QUEUE_LEN 16
+#define ANTENNA_HANDLE_FRAME_LEN (ANTENNA_MAX_INTERLEAVE * RS_DATA_LEN)
+
+enum { ANTENNA_TIMEOUT_RX, ANTENNA_TIMEOUT_TX };
+
+struct antenna_handle;
+
+/**
+ * @brief Called from the engine thread with every frame decoded on a handle.
+ * data is only valid for the duration of the call.
+ */
+typedef void (*antenna_frame_cb)(struct antenna_handle *h, const char *data,
+                                 size_t len, void *user);
+
+/**
+ * @brief Called from the engine thread when a handle has received nothing for
+ * its RX timeout (ANTENNA_TIMEOUT_RX), or its fd has accepted nothing for its
+ * TX timeout while data was queued (ANTENNA_TIMEOUT_TX). Queued TX data is
+ * dropped before a TX timeout is reported.
+ */
+typedef void (*antenna_timeout_cb)(struct antenna_handle *h, int direction,
+                                   void *user);
+
+/**
+ * @brief One antenna link driven by an engine. The fd is switched to
+ * non-blocking mode when the handle is added to an engine.
+ *
+ * Frames go out through a TX queue that the engine drains as the fd becomes
+ * writable, so antenna_handle_send() never blocks on the radio. Decoded
+ * frames are handed to the frame callback, or kept in a small RX queue for
+ * antenna_handle_recv() when there is none.
+ */
+struct antenna_handle {
+  int fd;
+  struct antenna_session session;
+  struct antenna_engine *engine;
+  pthread_mutex_t lock;
+
+  // Callbacks
+  antenna_frame_cb on_frame;
+  antenna_timeout_cb on_timeout;
+  void *user;
+
+  // Timeouts in milliseconds, < 0 for none
+  int rx_timeout;
+  int tx_timeout;
+  uint64_t rx_deadline;
+  uint64_t tx_deadline;
+
+  // Encoded bytes waiting for the fd
+  uint8_t *tx_queue;
+  size_t tx_start;
+  size_t tx_end;
+
+  // Decoded frames waiting for antenna_handle_recv()
+  char (*rx_queue)[ANTENNA_HANDLE_FRAME_LEN];
+  size_t rx_queue_len[ANTENNA_HANDLE_RX_QUEUE_LEN];
+  size_t rx_head;
+  size_t rx_count;
+
+  // Statistics, read and written under lock
+  size_t frames_received;
+  size_t frames_failed;
+  size_t frames_dropped;
+  size_t bytes_sent;
+  size_t timeouts;
+};
+
+/**
+ * @brief A single epoll loop serving any number of handles, up to
+ * ANTENNA_ENGINE_MAX_HANDLES.
+ */
+struct antenna_engine {
+  int epfd;
+  int wakefd;
+  int running;
+  pthread_mutex_t lock;
+  struct antenna_handle *handles[ANTENNA_ENGINE_MAX_HANDLES];
+  size_t handle_count;
+};
+
+/**
+ * @brief Generates a new handle at memory location h. Must be allocated
+ * memory or undefined behavior will occur. The handle owns a session which
+ * may be configured with the antenna_session_set_* calls before the handle is
+ * added to an engine. Framing must stay ANTENNA_FRAMING_ASM.
+ *
+ * @param h Pointer to allocated handle which will be initialized.
+ * @param fd File descriptor of the link. Not closed by the handle.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_handle_new(struct antenna_handle *h, int fd);
+
+/**
+ * @brief Releases the handle. It must have been removed from its engine.
+ *
+ * @param h Handle to tear down.
+ */
+void antenna_handle_destroy(struct antenna_handle *h);
+
+/**
+ * @brief Sets the callbacks of a handle.
+ *
+ * @param h Handle to configure.
+ * @param on_frame Frame callback, or NULL to queue frames for
+ * antenna_handle_recv().
+ * @param on_timeout Timeout callback, or NULL.
+ * @param user Passed to both callbacks.
+ */
+void antenna_handle_set_callbacks(struct antenna_handle *h,
+                                  antenna_frame_cb on_frame,
+                                  antenna_timeout_cb on_timeout, void *user);
+
+/**
+ * @brief Sets the RX and TX timeouts of a handle.
+ *
+ * @param h Handle to configure.
+ * @param rx_timeout_ms Longest gap between frames, or < 0 for none.
+ * @param tx_timeout_ms Longest stall of a non-empty TX queue, or < 0 for none.
+ */
+void antenna_handle_set_timeouts(struct antenna_handle *h, int rx_timeout_ms,
+                                 int tx_timeout_ms);
+
+/**
+ * @brief Encodes bytes and queues them for the engine to send. Safe to call
+ * from any thread. Never blocks on the fd.
+ *
+ * @param h Handle to send on.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @return 0 on success, -1 on error or if the TX queue is full.
+ */
+int antenna_handle_send(struct antenna_handle *h, const char *data,
+                        size_t data_len);
+
+/**
+ * @brief Pops the oldest queued frame of a handle without a frame callback.
+ * Safe to call from any thread. Never blocks.
+ *
+ * @param h Handle to read from.
+ * @param buffer Output buffer array for the frame.
+ * @param read_len Size of buffer. Longer frames are truncated.
+ * @return number of bytes read, 0 if no frame is queued.
+ */
+int antenna_handle_recv(struct antenna_handle *h, char *buffer,
+                        size_t read_len);
+
+/**
+ * @brief Generates a new engine at memory location e. Must be allocated
+ * memory or undefined behavior will occur.
+ *
+ * @param e Pointer to allocated engine which will be initialized.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_new(struct antenna_engine *e);
+
+/**
+ * @brief Releases the engine. Handles still added are removed, not destroyed.
+ *
+ * @param e Engine to tear down.
+ */
+void antenna_engine_destroy(struct antenna_engine *e);
+
+/**
+ * @brief Starts driving a handle.
+ *
+ * @param e Engine to use.
+ * @param h Handle to add.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_add(struct antenna_engine *e, struct antenna_handle *h);
+
+/**
+ * @brief Stops driving a handle. Queued TX data stays queued.
+ *
+ * @param e Engine to use.
+ * @param h Handle to remove.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_remove(struct antenna_engine *e, struct antenna_handle *h);
+
+/**
+ * @brief Waits for activity on any handle and services it: reads and decodes
+ * incoming frames, writes queued frames and fires due timeouts.
+ *
+ * @param e Engine to use.
+ * @param timeout_ms Longest wait, or < 0 to wait until something happens.
+ * @return number of events serviced or -1 on error.
+ */
+int antenna_engine_run_once(struct antenna_engine *e, int timeout_ms);
+
+/**
+ * @brief Runs the engine until antenna_engine_stop() is called. Callbacks run
+ * on this thread and must not add or remove handles.
+ *
+ * @param e Engine to use.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_run(struct antenna_engine *e);
+
+/**
+ * @brief Makes antenna_engine_run() return. Safe to call from any thread.
+ *
+ * @param e Engine to stop.
+ */
+void antenna_engine_stop(struct antenna_engine *e);
+
+#endif
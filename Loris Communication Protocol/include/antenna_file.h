@@ -0,0 +1,152 @@
+/**
+ * @file antenna_file.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Resumable file transfer over an antenna session
+ * @version 0.1
+ * @date 2022-04-14
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_FILE_H
+#define LORIS_ANTENNA_FILE_H
+
+// Project headers
+#include "antenna_pipeline.h"
+#include "antenna_session.h"
+
+// Standard C libraries
+#include <stdint.h>
+
+// Settings
+#define FILE_MSG_LEN RS_DATA_LEN
+#define FILE_MSG_HEADER_LEN 5
+#define FILE_MSG_CRC_LEN 4
+#define FILE_MSG_BODY_LEN (FILE_MSG_LEN - FILE_MSG_HEADER_LEN - FILE_MSG_CRC_LEN)
+#define FILE_CHUNK_LEN (FILE_MSG_BODY_LEN - 6)
+#define FILE_ZCHUNK_LEN (FILE_MSG_BODY_LEN - 12)
+#define FILE_NACK_BITS (8 * (FILE_MSG_BODY_LEN - 6))
+#define FILE_TX_BATCH 64
+#define FILE_TIMEOUT_MS 10000
+#define FILE_MAX_TIMEOUTS 5
+#define FILE_MAX_ERRORS 32
+#define FILE_LINGER_TIMEOUTS 2
+#define FILE_SIDECAR_SUFFIX ".part"
+#define FILE_SIDECAR_MAGIC 0x4C465431
+
+// Message types
+enum {
+  FILE_MSG_OFFER = 'O',
+  FILE_MSG_CHUNK = 'C',
+  FILE_MSG_ZCHUNK = 'Z',
+  FILE_MSG_POLL = 'P',
+  FILE_MSG_NACK = 'N',
+  FILE_MSG_DONE = 'D',
+  FILE_MSG_FOUNTAIN = 'F',
+};
+
+// Offer flags
+#define FILE_OFFER_COMPRESSED 0x01
+
+/*
+ * Every message fills exactly one FILE_MSG_LEN slot, so it lines up with one
+ * Reed-solomon block whatever the interleave depth. Multi-byte fields are big
+ * endian:
+ *
+ *   | type (1) | file id (4) | body (FILE_MSG_BODY_LEN) | CRC-32 (4) |
+ *
+ * The CRC-32 covers everything before it. Slots that fail it are dropped and
+ * recovered by retransmission. Bodies by type:
+ *
+ *   OFFER  size (4) | chunk count (4) | chunk length (2) | flags (1)
+ *   CHUNK  index (4) | length (2) | data (FILE_CHUNK_LEN)
+ *   ZCHUNK index (4) | offset (4) | length (2) | stored length (2) |
+ *          data (FILE_ZCHUNK_LEN)
+ *   NACK   first index (4) | bit count (2) | bitmap, 1 = chunk missing
+ *   POLL   (empty) asks the receiver for a NACK or DONE
+ *   DONE   (empty) every chunk is on disk
+ *
+ * The sender offers the file, then sends whatever chunks each NACK lists
+ * followed by a POLL, until the receiver answers DONE. The receiver keeps a
+ * bitmap of the chunks it has in a memory mapped sidecar next to the output
+ * file, so a transfer cut off at the end of a pass picks up where it left off
+ * the next time the same file is offered.
+ *
+ * A compressed file (FILE_OFFER_COMPRESSED, chunk length 0) is sent as
+ * ZCHUNKs instead. Each covers as much of the file as compresses into one
+ * slot, so chunks vary in length and carry their own offset. A chunk whose
+ * stored length equals its length is not compressed, otherwise its data is
+ * one antenna_lz block. Chunks are compressed on their own, so a lost slot
+ * costs only its own chunk.
+ */
+
+/**
+ * @brief On-disk layout of the sidecar file, followed by the chunk bitmap
+ * (1 = chunk received).
+ */
+struct antenna_file_sidecar {
+  uint32_t magic;
+  uint32_t file_id;
+  uint32_t file_size;
+  uint32_t chunk_count;
+  uint32_t chunk_len;
+  uint32_t chunks_received;
+  uint8_t bitmap[];
+};
+
+/**
+ * @brief Computes the CRC-32 (poly 0xEDB88320 reflected, init 0xFFFFFFFF) of a
+ * buffer.
+ *
+ * @param data Bytes to checksum.
+ * @param len Number of bytes in data.
+ * @return the CRC.
+ */
+uint32_t antenna_file_crc32(const uint8_t *data, size_t len);
+
+/**
+ * @brief Sends a file over the session. Framing must be enabled. Returns
+ * once the receiver has every chunk, or after FILE_MAX_TIMEOUTS polls in a
+ * row go unanswered. Calling it again later resumes the transfer. If the
+ * session compresses, the file is sent compressed chunk by chunk, and frame
+ * compression is paused for the transfer.
+ *
+ * @param s Session to use.
+ * @param rx_fd File descriptor replies are read from.
+ * @param tx_fd File descriptor chunks are written to.
+ * @param file_path Path to file to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_file_send(struct antenna_session *s, int rx_fd, int tx_fd,
+                      const char *file_path);
+
+/**
+ * @brief Receives one file over the session. Framing must be enabled. Waits
+ * for an offer, then stores chunks until the file is complete. If the sender
+ * goes quiet for FILE_MAX_TIMEOUTS timeouts the sidecar is kept so the next
+ * call resumes the transfer.
+ *
+ * @param s Session to use.
+ * @param rx_fd File descriptor chunks are read from.
+ * @param tx_fd File descriptor replies are written to.
+ * @param file_path Path to incoming file destination.
+ * @return 0 on success, -1 on error
+ */
+int antenna_file_receive(struct antenna_session *s, int rx_fd, int tx_fd,
+                         const char *file_path);
+
+/**
+ * @brief Identical to antenna_file_receive(), but takes the incoming frames
+ * from a pipeline started on the receive fd without a callback, so the fd is
+ * drained while chunks are decoded and stored.
+ *
+ * @param p Pipeline to read from. Its session is used for the replies.
+ * @param tx_fd File descriptor replies are written to.
+ * @param file_path Path to incoming file destination.
+ * @return 0 on success, -1 on error
+ */
+int antenna_file_receive_pipeline(struct antenna_pipeline *p, int tx_fd,
+                                  const char *file_path);
+
+#endif
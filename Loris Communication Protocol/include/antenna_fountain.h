@@ -0,0 +1,161 @@
+/**
+ * @file antenna_fountain.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Fountain coded file broadcast over an antenna session
+ * @version 0.1
+ * @date 2022-04-29
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_FOUNTAIN_H
+#define LORIS_ANTENNA_FOUNTAIN_H
+
+// Project headers
+#include "antenna_file.h"
+
+// Standard C libraries
+#include <stdint.h>
+
+// Settings
+#define FOUNTAIN_SYMBOL_LEN (FILE_MSG_BODY_LEN - 10)
+#define FOUNTAIN_MAX_DEGREE 1024
+#define FOUNTAIN_SOLITON_C 0.03
+#define FOUNTAIN_SOLITON_DELTA 0.5
+#define FOUNTAIN_GE_MAX 2048
+#define FOUNTAIN_GE_STEP 16
+
+/*
+ * A file of K = ceil(size / FOUNTAIN_SYMBOL_LEN) source symbols, the last one
+ * zero padded, is sent as an endless stream of encoded symbols, one per
+ * FILE_MSG_LEN slot of type FILE_MSG_FOUNTAIN (see antenna_file.h). Bodies are
+ *
+ *   size (4) | symbol id (4) | degree (2) | data (FOUNTAIN_SYMBOL_LEN)
+ *
+ * Each encoded symbol is the XOR of degree distinct source symbols, picked by
+ * a generator seeded with the file id and symbol id. The sender draws degrees
+ * from a robust soliton distribution cut off at its spike, and states them, so
+ * the receiver needs nothing but the slot. Any set of distinct symbol ids a
+ * few percent larger than K rebuilds the file, so nothing is ever asked for
+ * and ground stations can pool what they heard. Stations sending the same
+ * file must use disjoint symbol ids.
+ *
+ * The receiver peels: a symbol with one unknown source symbol left gives it,
+ * which is then removed from every other symbol. If that stalls once K
+ * symbols are in, the rest is solved by Gaussian elimination over GF(2),
+ * retried every FOUNTAIN_GE_STEP symbols, for up to FOUNTAIN_GE_MAX unknowns.
+ */
+
+/**
+ * @brief Received symbol still waiting for its last unknown source symbols.
+ */
+struct fountain_symbol {
+  uint32_t degree;
+  uint32_t unknown_xor;
+};
+
+/**
+ * @brief Fountain decoder state. Holds one file, the first one heard, until
+ * destroyed.
+ */
+struct antenna_fountain_decoder {
+  int started;
+  uint32_t file_id;
+  uint32_t file_size;
+  uint32_t k;
+  uint32_t recovered;
+  uint32_t received;
+  uint32_t ge_received;
+
+  // Source symbols and which are known
+  uint8_t *source;
+  uint8_t *known;
+
+  // Received symbols still in use, and their data
+  struct fountain_symbol *symbols;
+  uint8_t *data;
+  uint32_t symbol_count;
+  uint32_t symbol_cap;
+
+  // Per source symbol list of the symbols it is an unknown of
+  uint32_t *edge_head;
+  uint32_t *edge_symbol;
+  uint32_t *edge_next;
+  uint32_t edge_count;
+  uint32_t edge_cap;
+
+  // Scratch
+  uint32_t *stack;
+  uint32_t *neighbours;
+};
+
+/**
+ * @brief Generates a new fountain decoder at memory location d. Must be
+ * allocated memory or undefined behavior will occur.
+ *
+ * @param d Pointer to allocated decoder which will be initialized.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_fountain_decoder_new(struct antenna_fountain_decoder *d);
+
+/**
+ * @brief Releases everything held by the decoder.
+ *
+ * @param d Decoder to tear down.
+ */
+void antenna_fountain_decoder_destroy(struct antenna_fountain_decoder *d);
+
+/**
+ * @brief Feeds one FILE_MSG_LEN slot into the decoder. Slots that fail their
+ * CRC, are not fountain symbols or belong to another file are ignored.
+ *
+ * @param d Decoder to use.
+ * @param msg Slot of FILE_MSG_LEN bytes.
+ * @return 1 once the file is complete, 0 if more symbols are needed, -1 on
+ * error.
+ */
+int antenna_fountain_decoder_add(struct antenna_fountain_decoder *d,
+                                 const uint8_t *msg);
+
+/**
+ * @brief Writes the rebuilt file.
+ *
+ * @param d Decoder holding a complete file.
+ * @param file_path Path to output file.
+ * @return 0 on success, -1 on error
+ */
+int antenna_fountain_decoder_write(struct antenna_fountain_decoder *d,
+                                   const char *file_path);
+
+/**
+ * @brief Sends count encoded symbols of a file over the session, with ids
+ * first_id onwards. Framing must be enabled. Call again with the next ids to
+ * keep the stream going.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor symbols are written to.
+ * @param file_path Path to file to send.
+ * @param first_id Id of the first symbol to send.
+ * @param count Number of symbols to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_fountain_send(struct antenna_session *s, int fd,
+                          const char *file_path, uint32_t first_id,
+                          uint32_t count);
+
+/**
+ * @brief Collects symbols from the session into the decoder until the file is
+ * complete, or the sender goes quiet for FILE_MAX_TIMEOUTS timeouts. Framing
+ * must be enabled. The decoder keeps what it has either way, so symbols from
+ * a later pass or another station can be added to it.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor symbols are read from.
+ * @param d Decoder to collect into.
+ * @return 1 if the file is complete, 0 if the sender went quiet, -1 on error
+ */
+int antenna_fountain_receive(struct antenna_session *s, int fd,
+                             struct antenna_fountain_decoder *d);
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file antenna_lz.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Small LZSS block compressor for data sent over the antenna
+ * @version 0.1
+ * @date 2022-04-27
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_LZ_H
+#define LORIS_ANTENNA_LZ_H
+
+// Project headers
+#include "antenna.h"
+#include "correct-interleave.h"
+
+// Standard C libraries
+#include <stdint.h>
+
+// Settings
+#define ANTENNA_LZ_BLOCK_LEN (CORRECT_RS_MAX_INTERLEAVE * RS_DATA_LEN)
+#define ANTENNA_LZ_HASH_BITS 12
+#define ANTENNA_LZ_CHAIN 16
+#define ANTENNA_LZ_MIN_MATCH 3
+#define ANTENNA_LZ_MAX_MATCH (ANTENNA_LZ_MIN_MATCH + 31)
+#define ANTENNA_LZ_WINDOW 2048
+
+/*
+ * Blocks are compressed on their own, so the dictionary is never more than
+ * the ANTENNA_LZ_BLOCK_LEN bytes of the block itself and a lost block does
+ * not affect any other. The stream is groups of a control byte followed by up
+ * to 8 items, one per control bit from the most significant:
+ *
+ *   0  literal byte (1)
+ *   1  match (2): distance - 1 (11 bits) | length - ANTENNA_LZ_MIN_MATCH (5)
+ *
+ * A match copies length bytes starting distance bytes back in the output, and
+ * may overlap what it writes. The stream does not record its own length, so
+ * callers carry the uncompressed length next to it.
+ */
+
+/**
+ * @brief Compressor match finder state. About 8 kB, so it is kept with its
+ * owner rather than on the stack.
+ */
+struct antenna_lz {
+  uint16_t head[1 << ANTENNA_LZ_HASH_BITS];
+  uint16_t prev[ANTENNA_LZ_BLOCK_LEN];
+};
+
+/**
+ * @brief Compresses as much of in as fits in out, as one block.
+ *
+ * @param z Compressor state.
+ * @param in Bytes to compress.
+ * @param in_len Number of bytes in in. Only the first ANTENNA_LZ_BLOCK_LEN
+ * are looked at.
+ * @param consumed Set to the number of bytes of in compressed into out.
+ * @param out Output buffer.
+ * @param out_len Capacity of out.
+ * @return number of bytes written to out.
+ */
+size_t antenna_lz_compress(struct antenna_lz *z, const uint8_t *in,
+                           size_t in_len, size_t *consumed, uint8_t *out,
+                           size_t out_len);
+
+/**
+ * @brief Decompresses one block. Decoding stops after out_len bytes, so in
+ * may carry padding after the block.
+ *
+ * @param in Compressed block.
+ * @param in_len Number of bytes in in.
+ * @param out Output buffer.
+ * @param out_len Uncompressed length of the block.
+ * @return out_len or -1 if the block is malformed or does not decompress to
+ * exactly out_len bytes.
+ */
+ssize_t antenna_lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out,
+                              size_t out_len);
+
+#endif
@@ -13,28 +13,199 @@
 #define LORIS_ANTENNA_PACKET_H
 
 // Standard C library
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
 
 // Settings
-#define PACKET_DELIMITER "###"
-#define PACKET_DELIMITER_LEN 3
-#define PACKET_DATA_LEN 255
+#define PACKET_ASM 0x1ACFFC1D
+#define PACKET_ASM_LEN 4
+#define PACKET_HEADER_LEN (PACKET_ASM_LEN + 5)
+#define PACKET_DATA_LEN 4096
+#define PACKET_ASM_TOLERANCE 3
+#define PACKET_ASM_TOLERANCE_MAX 8
+#define PACKET_BUFFER_LEN (2 * (PACKET_HEADER_LEN + PACKET_DATA_LEN))
+#define PACKET_MAX_ERASURES 256
 
-// Packet struct
+/*
+ * Frame layout, multi-byte fields big endian:
+ *
+ *   | ASM 0x1ACFFC1D (4) | length (2) | flags (1) | header CRC (2) | data |
+ *
+ * The header CRC is CRC-16/CCITT over the length and flags bytes. It lets the
+ * receiver reject a false sync before trusting the length.
+ */
+
+// Packet struct. erasures lists the offsets into data of bytes known to be
+// bad, ascending, for an erasure decoder.
 struct antenna_packet {
-  char start_delimiter[PACKET_DELIMITER_LEN];
-  char data[PACKET_DATA_LEN];
-  char end_delimiter[PACKET_DELIMITER_LEN];
+  uint16_t len;
+  uint8_t flags;
+  const uint8_t *data;
+  const uint16_t *erasures;
+  size_t erasure_count;
+};
+
+/**
+ * @brief Streaming deframer. Bytes are fed in as they arrive, in any chunking,
+ * and whole frames come out. Garbage between frames is skipped, and the sync
+ * marker is accepted with up to tolerance bit errors.
+ *
+ * Along the way it notes which frame bytes are known to be bad, so the decoder
+ * can treat them as erasures:
+ *  - with parmrk set the input is a tty stream with PARMRK on, where a byte
+ *    that arrived with a parity or framing error comes as \377 \0 byte and a
+ *    real \377 as \377 \377. Marked bytes are erased.
+ *  - a frame cut short by a timeout (antenna_deframer_flush()) has its missing
+ *    tail erased.
+ *
+ * A frame that lost bytes runs on into the next one. Frame data may hold any
+ * bytes, a marker included, so that is only looked for once the frame has
+ * failed to decode and the caller hands it back with antenna_deframer_reject().
+ */
+struct antenna_deframer {
+  int tolerance;
+  int simd;
+  size_t start;
+  size_t end;
+  uint8_t buffer[PACKET_BUFFER_LEN];
+
+  // Erasure tracking. Marks are stream offsets, where buffer[0] is at base.
+  int parmrk;
+  int escape;
+  size_t base;
+  int emitted;
+  size_t emitted_start;
+  size_t mark_count;
+  size_t marks[PACKET_MAX_ERASURES];
+  uint16_t frame_erasures[PACKET_MAX_ERASURES];
+  uint8_t frame[PACKET_DATA_LEN];
+
+  // Statistics
+  size_t frames;
+  size_t bytes_skipped;
+  size_t header_errors;
+  size_t bytes_marked;
+  size_t frames_truncated;
+  size_t frames_resynced;
 };
 
 /**
- * @brief Generates a new packet at memory location p. Must be allocated
+ * @brief Computes the CRC-16/CCITT (poly 0x1021, init 0xFFFF) of a buffer.
+ *
+ * @param data Bytes to checksum.
+ * @param len Number of bytes in data.
+ * @return the CRC.
+ */
+uint16_t antenna_packet_crc16(const uint8_t *data, size_t len);
+
+/**
+ * @brief Writes the sync marker and header for a frame of len data bytes.
+ *
+ * @param header Output buffer of PACKET_HEADER_LEN bytes.
+ * @param len Number of data bytes in the frame, at most PACKET_DATA_LEN.
+ * @param flags Flags byte carried in the header.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_packet_header(uint8_t *header, size_t len, uint8_t flags);
+
+/**
+ * @brief Generates a new deframer at memory location d. Must be allocated
  * memory or undefined behavior will occur.
  *
- * @param p Pointer to allocated packet which will be initialized.
+ * @param d Pointer to allocated deframer which will be initialized.
+ * @param tolerance Bit errors accepted in the sync marker, 0 to
+ * PACKET_ASM_TOLERANCE_MAX.
  * @return 0 = OK, -1 = ERR
  */
-int antenna_packet_new(struct antenna_packet *p);
+int antenna_deframer_new(struct antenna_deframer *d, int tolerance);
+
+/**
+ * @brief Selects whether the input is PARMRK escaped (see struct
+ * antenna_deframer). Pair with antenna_set_parmrk_fd() on the tty.
+ *
+ * @param d Deframer to configure.
+ * @param parmrk 1 if the input is PARMRK escaped, 0 if it is raw bytes.
+ */
+void antenna_deframer_set_parmrk(struct antenna_deframer *d, int parmrk);
+
+/**
+ * @brief Copies received bytes into the deframer.
+ *
+ * @param d Deframer to feed.
+ * @param data Received bytes.
+ * @param len Number of bytes in data.
+ * @return number of bytes taken, which may be less than len when the deframer
+ * is full. Call antenna_deframer_next() to make room.
+ */
+size_t antenna_deframer_push(struct antenna_deframer *d, const uint8_t *data,
+                             size_t len);
+
+/**
+ * @brief Makes room and returns the free space at the end of the deframer
+ * buffer, for callers that read() straight into it.
+ *
+ * @param d Deframer to feed.
+ * @param len Set to the number of bytes free.
+ * @return start of the free space.
+ */
+uint8_t *antenna_deframer_space(struct antenna_deframer *d, size_t *len);
+
+/**
+ * @brief Takes len bytes read into the space from antenna_deframer_space().
+ *
+ * @param d Deframer to feed.
+ * @param len Number of bytes read.
+ */
+void antenna_deframer_commit(struct antenna_deframer *d, size_t len);
+
+/**
+ * @brief Pulls the next whole frame out of the deframer. p->data points into
+ * the deframer and stays valid until the next call on it.
+ *
+ * @param d Deframer to use.
+ * @param p Output packet.
+ * @return 1 if a frame was found, 0 if more bytes are needed.
+ */
+int antenna_deframer_next(struct antenna_deframer *d, struct antenna_packet *p);
+
+/**
+ * @brief Tells the deframer that the frame it just handed out failed to
+ * decode. If bytes of that frame were lost, it ran on into the next frame,
+ * whose sync marker and header then sit inside its data. The data is searched
+ * for an exact marker with a valid header, and parsing goes back to the first
+ * one found so the next frame is not lost as well. Must be called before the
+ * deframer is fed again.
+ *
+ * @param d Deframer to use.
+ * @return 1 if a sync point was found inside the frame, 0 if not.
+ */
+int antenna_deframer_reject(struct antenna_deframer *d);
+
+/**
+ * @brief Gives up waiting on the frame in progress, e.g. after a timeout. If
+ * its header has arrived, it is returned with the missing tail zero filled and
+ * erased. Everything else buffered is dropped.
+ *
+ * @param d Deframer to use.
+ * @param p Output packet, as for antenna_deframer_next().
+ * @return 1 if a partial frame was returned, 0 if there was none.
+ */
+int antenna_deframer_flush(struct antenna_deframer *d, struct antenna_packet *p);
+
+/**
+ * @brief Reads from a file descriptor until the deframer produces a frame.
+ *
+ * @param d Deframer to use.
+ * @param fd File descriptor to read from.
+ * @param p Output packet, as for antenna_deframer_next().
+ * @param timeout_ms Longest wait for more bytes, or < 0 to wait forever.
+ * @return 1 if a frame was found, 0 on end of file, timeout or if the fd would
+ * block, -1 on error. On end of file or timeout a partially received frame is
+ * returned as for antenna_deframer_flush().
+ */
+int antenna_deframer_read_fd(struct antenna_deframer *d, int fd,
+                             struct antenna_packet *p, int timeout_ms);
 
-#endif
\ No newline at end of file
+#endif
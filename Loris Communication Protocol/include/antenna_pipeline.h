@@ -0,0 +1,126 @@
+/**
+ * @file antenna_pipeline.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Two stage receive path: one thread drains the fd, another decodes
+ * @version 0.1
+ * @date 2022-04-20
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_PIPELINE_H
+#define LORIS_ANTENNA_PIPELINE_H
+
+// Project headers
+#include "antenna_ring.h"
+#include "antenna_session.h"
+
+// Standard C libraries
+#include <pthread.h>
+
+// Settings
+#define ANTENNA_PIPELINE_RING_LEN (64 * 1024)
+#define ANTENNA_PIPELINE_FRAME_LEN (ANTENNA_MAX_INTERLEAVE * RS_DATA_LEN)
+#define ANTENNA_PIPELINE_QUEUE_LEN 32
+
+/**
+ * @brief Called from the decoder thread with every frame decoded. data is only
+ * valid for the duration of the call.
+ */
+typedef void (*antenna_pipeline_cb)(const char *data, size_t len, void *user);
+
+/**
+ * @brief Receive path split over two threads joined by an SPSC ring.
+ *
+ * The reader thread does nothing but read() the fd straight into the ring, so
+ * the kernel tty buffer is emptied as fast as bytes arrive even while a frame
+ * is being decoded. The decoder thread takes bytes from the ring into the
+ * session deframer and decodes whole frames. If the decoder falls behind far
+ * enough to fill the ring, the reader keeps draining the fd and drops the
+ * bytes, counting them as overruns, and the deframer resyncs at the next sync
+ * marker.
+ *
+ * Decoded frames go to a callback on the decoder thread, or without one into
+ * a queue that antenna_pipeline_recv() reads from, for callers that want a
+ * blocking read like antenna_session_read_rs_fd(). A full queue drops frames,
+ * counting them in frames_dropped.
+ *
+ * Size the ring to hold the bytes that arrive during the longest decode:
+ * baud / 10 bytes per second times the worst case decode time, with margin.
+ * antenna_ring_high_water() on ring shows how much of it has been used so far.
+ */
+struct antenna_pipeline {
+  int fd;
+  struct antenna_session *session;
+  struct antenna_ring ring;
+  antenna_pipeline_cb on_frame;
+  void *user;
+
+  // Thread plumbing
+  pthread_t reader;
+  pthread_t decoder;
+  int datafd;
+  int stopfd;
+  int running;
+  int decoder_waiting;
+
+  // Decoded frames waiting for antenna_pipeline_recv(). A length < 0 marks a
+  // frame that failed to decode.
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  char (*queue)[ANTENNA_PIPELINE_FRAME_LEN];
+  ssize_t queue_len[ANTENNA_PIPELINE_QUEUE_LEN];
+  size_t queue_head;
+  size_t queue_count;
+  size_t queue_offset;
+  int decoder_done;
+
+  // Statistics, updated by the decoder thread with __atomic operations
+  size_t frames;
+  size_t frames_failed;
+  size_t frames_dropped;
+};
+
+/**
+ * @brief Generates a new pipeline at memory location p and starts its
+ * threads. Must be allocated memory or undefined behavior will occur.
+ *
+ * @param p Pointer to allocated pipeline which will be initialized.
+ * @param s Session whose deframer and decoder are used. Framing must be
+ * ANTENNA_FRAMING_ASM, and nothing else may read from the session meanwhile.
+ * @param fd File descriptor to read from.
+ * @param ring_len Ring capacity in bytes, or 0 for ANTENNA_PIPELINE_RING_LEN.
+ * @param on_frame Callback for decoded frames, or NULL to queue them for
+ * antenna_pipeline_recv().
+ * @param user Passed to on_frame.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_pipeline_start(struct antenna_pipeline *p,
+                           struct antenna_session *s, int fd, size_t ring_len,
+                           antenna_pipeline_cb on_frame, void *user);
+
+/**
+ * @brief Takes decoded bytes from the queue of a pipeline started without a
+ * callback. Returns bytes of one frame at most. What does not fit in buffer
+ * is kept for the next call.
+ *
+ * @param p Pipeline to read from.
+ * @param buffer Output buffer for decoded bytes.
+ * @param read_len Size of buffer.
+ * @param timeout_ms Longest wait for a frame, or < 0 to wait forever.
+ * @return number of bytes read, 0 on timeout or once the fd has ended and the
+ * queue is empty, or -1 for a frame that failed to decode.
+ */
+ssize_t antenna_pipeline_recv(struct antenna_pipeline *p, char *buffer,
+                              size_t read_len, int timeout_ms);
+
+/**
+ * @brief Stops both threads, decodes what is left in the ring and releases the
+ * pipeline. Does not close the fd.
+ *
+ * @param p Pipeline to stop.
+ */
+void antenna_pipeline_stop(struct antenna_pipeline *p);
+
+#endif
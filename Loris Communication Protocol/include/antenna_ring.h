@@ -0,0 +1,141 @@
+/**
+ * @file antenna_ring.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Lock-free single producer, single consumer byte ring
+ * @version 0.1
+ * @date 2022-04-20
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_RING_H
+#define LORIS_ANTENNA_RING_H
+
+// Standard C libraries
+#include <stddef.h>
+#include <stdint.h>
+
+// Settings
+#define ANTENNA_CACHELINE 64
+
+/**
+ * @brief Byte ring shared by exactly one producer thread and one consumer
+ * thread, without locks.
+ *
+ * head and tail count bytes ever written and read, and are only stored by the
+ * producer and the consumer respectively. Each side keeps a cached copy of the
+ * other's counter and only reloads it when the cached value says the ring is
+ * full (or empty), so the shared cache lines are touched once per span rather
+ * than once per byte. The producer and consumer fields sit on separate cache
+ * lines so the two threads never false-share.
+ *
+ * Both sides work on contiguous spans of the buffer in place: peek a span,
+ * fill (or parse) it, then commit however much of it was used.
+ */
+struct antenna_ring {
+  // Read-only after antenna_ring_new()
+  uint8_t *buffer;
+  size_t size;
+  size_t mask;
+
+  // Producer side. high_water and overruns are only stored by the producer
+  // and may be read anywhere through antenna_ring_high_water() and
+  // antenna_ring_overruns().
+  _Alignas(ANTENNA_CACHELINE) size_t head;
+  size_t head_cached_tail;
+  size_t high_water;
+  size_t overruns;
+
+  // Consumer side
+  _Alignas(ANTENNA_CACHELINE) size_t tail;
+  size_t tail_cached_head;
+};
+
+/**
+ * @brief Generates a new ring at memory location r. Must be allocated memory or
+ * undefined behavior will occur.
+ *
+ * @param r Pointer to allocated ring which will be initialized.
+ * @param size Capacity in bytes, rounded up to a power of two.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_ring_new(struct antenna_ring *r, size_t size);
+
+/**
+ * @brief Releases the ring buffer.
+ *
+ * @param r Ring to tear down.
+ */
+void antenna_ring_destroy(struct antenna_ring *r);
+
+/**
+ * @brief Producer only. Finds the largest contiguous free span.
+ *
+ * @param r Ring to write to.
+ * @param span Set to the start of the span.
+ * @return number of bytes that may be written at span, 0 if the ring is full.
+ */
+size_t antenna_ring_write_peek(struct antenna_ring *r, uint8_t **span);
+
+/**
+ * @brief Producer only. Publishes len bytes written at the last peeked span.
+ *
+ * @param r Ring to write to.
+ * @param len Number of bytes written, at most the peeked length.
+ */
+void antenna_ring_write_commit(struct antenna_ring *r, size_t len);
+
+/**
+ * @brief Producer only. Records bytes that were dropped because the ring was
+ * full.
+ *
+ * @param r Ring to account on.
+ * @param len Number of bytes dropped.
+ */
+void antenna_ring_overrun(struct antenna_ring *r, size_t len);
+
+/**
+ * @brief Consumer only. Finds the largest contiguous span of unread bytes.
+ *
+ * @param r Ring to read from.
+ * @param span Set to the start of the span.
+ * @return number of bytes readable at span, 0 if the ring is empty.
+ */
+size_t antenna_ring_read_peek(struct antenna_ring *r, const uint8_t **span);
+
+/**
+ * @brief Consumer only. Releases len bytes read from the last peeked span.
+ *
+ * @param r Ring to read from.
+ * @param len Number of bytes consumed, at most the peeked length.
+ */
+void antenna_ring_read_commit(struct antenna_ring *r, size_t len);
+
+/**
+ * @brief Number of unread bytes. Exact only when called from the producer or
+ * the consumer thread with the other side idle.
+ *
+ * @param r Ring to inspect.
+ * @return number of bytes in the ring.
+ */
+size_t antenna_ring_used(struct antenna_ring *r);
+
+/**
+ * @brief Deepest the ring has been, in bytes. Safe from any thread.
+ *
+ * @param r Ring to inspect.
+ * @return high water mark.
+ */
+size_t antenna_ring_high_water(struct antenna_ring *r);
+
+/**
+ * @brief Bytes dropped so far because the ring was full. Safe from any
+ * thread.
+ *
+ * @param r Ring to inspect.
+ * @return number of bytes dropped.
+ */
+size_t antenna_ring_overruns(struct antenna_ring *r);
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * @file antenna_rs_pool.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Reed-solomon encode/decode of large buffers across all cores
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_RS_POOL_H
+#define LORIS_ANTENNA_RS_POOL_H
+
+// Project headers
+#include "antenna.h"
+#include "correct-syndrome.h"
+
+// Standard C libraries
+#include <pthread.h>
+#include <stdint.h>
+
+// Settings
+#define ANTENNA_RS_POOL_MAX_WORKERS 64
+#define ANTENNA_RS_POOL_GRAIN 64
+#define ANTENNA_RS_POOL_MIN_GRAIN 8
+#define ANTENNA_RS_POOL_BLOCK_LEN (RS_DATA_LEN + RS_NUM_ROOTS)
+
+enum { ANTENNA_RS_POOL_ENCODE, ANTENNA_RS_POOL_DECODE };
+
+/*
+ * Encoded buffers are packed blocks: the data is cut into RS_DATA_LEN byte
+ * chunks, and each is followed by its RS_NUM_ROOTS parity bytes, so every
+ * block is ANTENNA_RS_POOL_BLOCK_LEN bytes except a shorter last one. Blocks
+ * are independent, so workers claim a grain of them at a time and write each
+ * one to its own place in the output, which keeps the output in order. A job
+ * is split evenly between the workers, in grains of ANTENNA_RS_POOL_MIN_GRAIN
+ * to ANTENNA_RS_POOL_GRAIN blocks.
+ */
+
+struct antenna_rs_pool;
+
+// One coder pair per worker, so workers share no scratch state
+struct antenna_rs_pool_worker {
+  struct antenna_rs_pool *pool;
+  pthread_t thread;
+  int started;
+  correct_reed_solomon *encoder;
+  correct_reed_solomon_syndrome *decoder;
+};
+
+/**
+ * @brief Fixed set of threads which split Reed-solomon jobs between them. The
+ * thread submitting a job works on it too, as worker 0.
+ */
+struct antenna_rs_pool {
+  size_t worker_count;
+  struct antenna_rs_pool_worker *workers;
+
+  // Job hand-off
+  pthread_mutex_t run_lock;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  uint64_t generation;
+  size_t busy;
+  int shutdown;
+
+  // Current job
+  int mode;
+  const uint8_t *in;
+  size_t in_len;
+  uint8_t *out;
+  size_t blocks;
+  size_t grain;
+  size_t next_block;
+  size_t failed;
+};
+
+/**
+ * @brief Generates a new pool at memory location p and starts its threads.
+ * Must be allocated memory or undefined behavior will occur.
+ *
+ * @param p Pointer to allocated pool which will be initialized.
+ * @param workers Number of workers including the caller, or 0 for one per
+ * online CPU. At most ANTENNA_RS_POOL_MAX_WORKERS.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_rs_pool_new(struct antenna_rs_pool *p, size_t workers);
+
+/**
+ * @brief Stops the threads and releases the pool.
+ *
+ * @param p Pool to tear down.
+ */
+void antenna_rs_pool_destroy(struct antenna_rs_pool *p);
+
+/**
+ * @brief Number of encoded bytes for data_len bytes of data.
+ *
+ * @param data_len Number of data bytes.
+ * @return number of encoded bytes.
+ */
+size_t antenna_rs_pool_encoded_len(size_t data_len);
+
+/**
+ * @brief Number of data bytes in encoded_len bytes of blocks.
+ *
+ * @param encoded_len Number of encoded bytes.
+ * @return number of data bytes or -1 if encoded_len is not a valid length.
+ */
+ssize_t antenna_rs_pool_decoded_len(size_t encoded_len);
+
+/**
+ * @brief Encodes a buffer across the pool.
+ *
+ * @param p Pool to use.
+ * @param data Array of bytes to encode.
+ * @param data_len Number of bytes from data to encode.
+ * @param encoded Output buffer of antenna_rs_pool_encoded_len(data_len) bytes.
+ * @return number of encoded bytes or -1 on error.
+ */
+ssize_t antenna_rs_pool_encode(struct antenna_rs_pool *p, const uint8_t *data,
+                               size_t data_len, uint8_t *encoded);
+
+/**
+ * @brief Decodes a buffer across the pool. Blocks that cannot be corrected
+ * are passed through with their data bytes as received.
+ *
+ * @param p Pool to use.
+ * @param encoded Array of encoded blocks.
+ * @param encoded_len Number of bytes in encoded.
+ * @param data Output buffer of antenna_rs_pool_decoded_len(encoded_len) bytes.
+ * @param failed If not NULL, set to the number of uncorrectable blocks.
+ * @return number of decoded bytes or -1 on error.
+ */
+ssize_t antenna_rs_pool_decode(struct antenna_rs_pool *p,
+                               const uint8_t *encoded, size_t encoded_len,
+                               uint8_t *data, size_t *failed);
+
+/**
+ * @brief Encodes a file into another across the pool. Both are memory mapped,
+ * so the input is never copied whole.
+ *
+ * @param p Pool to use.
+ * @param in_path Path to the file to encode.
+ * @param out_path Path to the encoded file, created or truncated.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_rs_pool_encode_file(struct antenna_rs_pool *p, const char *in_path,
+                                const char *out_path);
+
+/**
+ * @brief Decodes a file of encoded blocks, e.g. a recorded pass, into another
+ * across the pool. Both are memory mapped.
+ *
+ * @param p Pool to use.
+ * @param in_path Path to the encoded file.
+ * @param out_path Path to the decoded file, created or truncated.
+ * @param failed If not NULL, set to the number of uncorrectable blocks.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_rs_pool_decode_file(struct antenna_rs_pool *p, const char *in_path,
+                                const char *out_path, size_t *failed);
+
+#endif
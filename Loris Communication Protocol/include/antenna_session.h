@@ -0,0 +1,437 @@
+/**
+ * @file antenna_session.h
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Persistent Reed-solomon session for the antenna lib for loris
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#ifndef LORIS_ANTENNA_SESSION_H
+#define LORIS_ANTENNA_SESSION_H
+
+// Project headers
+#include "antenna.h"
+#include "antenna_conv.h"
+#include "antenna_lz.h"
+#include "correct-interleave.h"
+#include "correct-syndrome.h"
+
+// Standard C libraries
+#include <pthread.h>
+#include <stdint.h>
+
+// Settings
+#define RS_CHUNK_LEN (RS_DATA_LEN + RS_NUM_ROOTS)
+#define ANTENNA_TX_BATCH_DEFAULT 256
+#define ANTENNA_TX_BATCH_MAX ANTENNA_IOV_MAX
+#define ANTENNA_MAX_INTERLEAVE CORRECT_RS_MAX_INTERLEAVE
+#define ANTENNA_CONV_BLOCK_LEN ((CONV_ENCODED_BITS(RS_BLOCK_LEN) + 7) / 8)
+#define ANTENNA_CONV_RX_LEN (8 * ANTENNA_MAX_INTERLEAVE * ANTENNA_CONV_BLOCK_LEN)
+#define ANTENNA_FRAME_MAX_LEN \
+  (PACKET_HEADER_LEN + ANTENNA_MAX_INTERLEAVE * ANTENNA_CONV_BLOCK_LEN)
+#define ANTENNA_FEC_WINDOW 32
+#define ANTENNA_FEC_ADAPTIVE -1
+
+struct antenna_rs_pool;
+
+enum { ANTENNA_FLUSH_NONE, ANTENNA_FLUSH_DRAIN };
+enum { ANTENNA_CODING_RS, ANTENNA_CODING_RS_CONV };
+enum { ANTENNA_FRAMING_NONE, ANTENNA_FRAMING_ASM };
+enum {
+  ANTENNA_FEC_RS2,
+  ANTENNA_FEC_RS8,
+  ANTENNA_FEC_RS16,
+  ANTENNA_FEC_RS32,
+  ANTENNA_FEC_LEVELS
+};
+
+/*
+ * Frame header flags. The low bits carry the code the frame was sent with, so
+ * the receiver always decodes with the right one. An adaptive sender also
+ * carries the code it would like to receive.
+ *
+ *   | unused (2) | compressed (1) | req. valid (1) | requested (2) | code (2) |
+ *
+ * A compressed frame's data, under the Reed-solomon code, is the original
+ * length (2, big endian) followed by one antenna_lz block.
+ */
+#define ANTENNA_FLAG_FEC_MASK 0x03
+#define ANTENNA_FLAG_REQUEST_SHIFT 2
+#define ANTENNA_FLAG_REQUEST_VALID 0x10
+#define ANTENNA_FLAG_COMPRESSED 0x20
+#define ANTENNA_LZ_PREFIX_LEN 2
+
+/**
+ * @brief Reed-solomon code selection. Every code carries RS_DATA_LEN data
+ * bytes per block and adds 2, 8, 16 or 32 parity bytes, so it corrects 1, 4,
+ * 8 or 16 symbol errors per block.
+ *
+ * When adaptive, the receive half measures every frame: the most symbols
+ * corrected in any one codeword, and whether the frame failed. It asks for
+ * the weakest code with twice the parity that codeword needed. A stronger
+ * code is asked for at once. A weaker one is asked for one step at a time,
+ * and only after ANTENNA_FEC_WINDOW frames that all fit it. A failed frame
+ * asks for one step stronger than the code it came with. The request rides
+ * in the header of every frame sent the other way, and the transmit half at
+ * the other end switches to it.
+ */
+struct antenna_fec {
+  int adaptive;
+  int tx_level;
+  int rx_level;
+  size_t window_frames;
+  size_t window_peak;
+
+  // Statistics
+  size_t frames[ANTENNA_FEC_LEVELS];
+  size_t frames_failed;
+  size_t symbols_corrected;
+};
+
+/**
+ * @brief Controls how encoded blocks are handed to the kernel.
+ *
+ * batch_blocks codewords are encoded back to back into the staging area and
+ * sent with a single writev(). drain selects whether the write returns as soon
+ * as the tty layer has the bytes (ANTENNA_FLUSH_NONE) or waits until the UART
+ * has shifted them out (ANTENNA_FLUSH_DRAIN).
+ */
+struct antenna_flush_policy {
+  size_t batch_blocks;
+  int drain;
+};
+
+/**
+ * @brief Reed-solomon coder state which is built once and reused for every
+ * read and write on a link.
+ *
+ * The TX and RX halves each own their own coder instance, block buffers and
+ * lock so one thread may write while another reads from the same session.
+ */
+struct antenna_session {
+  int fd;
+  int interleave;
+  int coding;
+  int conv_rate;
+  int framing;
+  int rx_timeout;
+
+  // TX half
+  pthread_mutex_t tx_lock;
+  correct_reed_solomon *encoder[ANTENNA_FEC_LEVELS];
+  correct_reed_solomon_interleaved
+      *tx_interleaver[ANTENNA_FEC_LEVELS][ANTENNA_MAX_INTERLEAVE + 1];
+  struct antenna_flush_policy tx_flush;
+  uint8_t *tx_stage;
+  struct iovec *tx_iov;
+  struct antenna_conv tx_conv;
+  uint8_t *tx_coded;
+  uint8_t (*tx_header)[PACKET_HEADER_LEN];
+  int tx_compress;
+  struct antenna_lz tx_lz;
+  uint8_t tx_packed[ANTENNA_MAX_INTERLEAVE * RS_DATA_LEN];
+  struct antenna_rs_pool *tx_pool;
+
+  // RX half
+  pthread_mutex_t rx_lock;
+  correct_reed_solomon_syndrome *decoder[ANTENNA_FEC_LEVELS];
+  correct_reed_solomon_interleaved
+      *rx_interleaver[ANTENNA_FEC_LEVELS][ANTENNA_MAX_INTERLEAVE + 1];
+  uint8_t rx_block[ANTENNA_MAX_INTERLEAVE * RS_BLOCK_LEN];
+  uint8_t rx_decoded[ANTENNA_MAX_INTERLEAVE * RS_BLOCK_LEN];
+  struct antenna_conv rx_conv;
+  uint8_t *rx_coded;
+  struct antenna_deframer *rx_deframer;
+  int rx_parmrk;
+  uint8_t rx_erasures[RS_BLOCK_LEN];
+  size_t rx_erasures_used;
+  uint8_t rx_expanded[ANTENNA_LZ_BLOCK_LEN];
+  size_t rx_pending;
+  size_t rx_pending_len;
+
+  // Code selection, shared by both halves
+  struct antenna_fec fec;
+};
+
+/**
+ * @brief Builds the Reed-solomon encoder/decoder for a new session. Must be
+ * allocated memory or undefined behavior will occur.
+ *
+ * @param s Pointer to allocated session which will be initialized.
+ * @param fd File descriptor the session reads from and writes to.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_new(struct antenna_session *s, int fd);
+
+/**
+ * @brief Releases the coders owned by the session. Does not close the fd.
+ *
+ * @param s Session to tear down.
+ */
+void antenna_session_destroy(struct antenna_session *s);
+
+/**
+ * @brief Changes how the session hands encoded blocks to the kernel.
+ *
+ * @param s Session to configure.
+ * @param policy New flush policy. batch_blocks must be in
+ * [1, ANTENNA_TX_BATCH_MAX].
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_flush(struct antenna_session *s,
+                              const struct antenna_flush_policy *policy);
+
+/**
+ * @brief Sets the interleave depth used by antenna_session_write_rs and
+ * antenna_session_read_rs. Depth 1 sends plain codewords back to back; depth
+ * I sends I codewords interleaved symbol by symbol, so a burst of up to I times
+ * the correctable symbol count is still recovered. Both ends of the link must
+ * use the same depth.
+ *
+ * @param s Session to configure.
+ * @param depth Interleave depth in [1, ANTENNA_MAX_INTERLEAVE].
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_interleave(struct antenna_session *s, int depth);
+
+/**
+ * @brief Selects the channel coding of the session. ANTENNA_CODING_RS sends
+ * Reed-solomon frames as they are. ANTENNA_CODING_RS_CONV adds the CCSDS
+ * rate 1/2, K = 7 convolutional code under Reed-solomon, so each frame goes
+ * out convolutionally coded and is Viterbi decoded before Reed-solomon on the
+ * way in, at the rate set with antenna_session_set_conv_rate. With soft
+ * decisions the receiver reads one soft byte per coded bit (see struct
+ * antenna_conv). Both ends of the link must use the same coding.
+ *
+ * @param s Session to configure.
+ * @param coding ANTENNA_CODING_RS or ANTENNA_CODING_RS_CONV.
+ * @param decision ANTENNA_DECISION_HARD or ANTENNA_DECISION_SOFT. Ignored for
+ * ANTENNA_CODING_RS.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_coding(struct antenna_session *s, int coding,
+                               int decision);
+
+/**
+ * @brief Selects the rate of the convolutional code, which is punctured from
+ * rate 1/2 above that (see antenna_conv.h). Higher rates carry more data per
+ * coded bit and correct fewer errors, so the rate is meant to be picked for
+ * each pass from its expected link margin. The rate is not signalled on the
+ * wire, so both ends of the link must switch together. It is kept across
+ * antenna_session_set_coding calls, and takes effect with
+ * ANTENNA_CODING_RS_CONV.
+ *
+ * @param s Session to configure.
+ * @param rate ANTENNA_CONV_RATE_1_2 (the default), _2_3, _3_4, _5_6 or _7_8.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_conv_rate(struct antenna_session *s, int rate);
+
+/**
+ * @brief Selects how frames are delimited on the wire. With
+ * ANTENNA_FRAMING_ASM (the default) every frame is sent behind a sync marker
+ * and header (see antenna_packet.h), and the receiver finds frames by
+ * searching for the marker, so dropped or garbage bytes only cost the frames
+ * they touch. ANTENNA_FRAMING_NONE sends frames back to back and relies on
+ * every read lining up with a frame. Soft decisions need ANTENNA_FRAMING_NONE.
+ * Both ends of the link must use the same framing.
+ *
+ * @param s Session to configure.
+ * @param framing ANTENNA_FRAMING_NONE or ANTENNA_FRAMING_ASM.
+ * @param tolerance Bit errors accepted in the sync marker, 0 to
+ * PACKET_ASM_TOLERANCE_MAX. Ignored for ANTENNA_FRAMING_NONE.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_framing(struct antenna_session *s, int framing,
+                                int tolerance);
+
+/**
+ * @brief Selects the Reed-solomon code (see struct antenna_fec). A fixed code
+ * is used for everything sent. Framed receivers decode every frame with the
+ * code its header names, whatever their own setting; without framing both
+ * ends must use the same code. ANTENNA_FEC_ADAPTIVE starts from the current
+ * code and follows link quality, and needs ANTENNA_FRAMING_ASM and traffic
+ * both ways.
+ *
+ * @param s Session to configure.
+ * @param level ANTENNA_FEC_RS2, _RS8, _RS16, _RS32 or ANTENNA_FEC_ADAPTIVE.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_fec(struct antenna_session *s, int level);
+
+/**
+ * @brief Turns compression of outgoing data on or off. Each frame then carries
+ * as much data as compresses into it, up to ANTENNA_LZ_BLOCK_LEN bytes, as one
+ * antenna_lz block, and goes out uncompressed when that does not save space.
+ * Frames are compressed on their own, so a lost frame costs no others.
+ * Receivers expand compressed frames whatever their own setting, and bytes of
+ * an expanded frame that do not fit a read are returned by the next one.
+ * Needs ANTENNA_FRAMING_ASM.
+ *
+ * @param s Session to configure.
+ * @param enable 1 to compress, 0 to send data as it is.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_compression(struct antenna_session *s, int enable);
+
+/**
+ * @brief Hands the session a pool to encode large writes across all cores.
+ * Only writes of plain codewords use it: interleave depth 1, the RS2 code, no
+ * inner code and no compression. Anything else is encoded on the calling
+ * thread as before. The pool must outlive the session or be removed first.
+ *
+ * @param s Session to configure.
+ * @param pool Pool to use, or NULL to encode on the calling thread.
+ */
+void antenna_session_set_pool(struct antenna_session *s,
+                              struct antenna_rs_pool *pool);
+
+/**
+ * @brief Sets how long a framed read waits for the next frame before giving
+ * up and returning the bytes decoded so far (0 if none). A frame cut off by
+ * the timeout is still decoded, with its missing tail as erasures.
+ *
+ * @param s Session to configure.
+ * @param timeout_ms Timeout in milliseconds, or < 0 to wait forever (the
+ * default).
+ */
+void antenna_session_set_timeout(struct antenna_session *s, int timeout_ms);
+
+/**
+ * @brief Tells the session whether its input is PARMRK escaped, as set up by
+ * antenna_set_parmrk_fd(). If so, bytes the UART received with parity or
+ * framing errors are passed to the Reed-solomon decoder as erasures, which
+ * repairs twice as many of them as unknown errors. Needs ANTENNA_FRAMING_ASM,
+ * and only takes effect with ANTENNA_CODING_RS.
+ *
+ * @param s Session to configure.
+ * @param parmrk 1 if the input is PARMRK escaped, 0 if it is raw bytes.
+ */
+void antenna_session_set_parmrk(struct antenna_session *s, int parmrk);
+
+/**
+ * @brief Writes bytes to the session fd with Reed-solomon FEC.
+ *
+ * @param s Session to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_session_write_rs(struct antenna_session *s, const char *data,
+                             size_t data_len);
+
+/**
+ * @brief Identical to antenna_session_write_rs, but allows a custom file
+ * descriptor to be specified.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_session_write_rs_fd(struct antenna_session *s, int fd,
+                                const char *data, size_t data_len);
+
+/**
+ * @brief Identical to antenna_session_write_rs_fd, but with an explicit
+ * interleave depth instead of the session default.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @param depth Interleave depth in [1, ANTENNA_MAX_INTERLEAVE].
+ * @return 0 on success, -1 on error
+ */
+int antenna_session_write_rs_interleaved_fd(struct antenna_session *s, int fd,
+                                            const char *data, size_t data_len,
+                                            int depth);
+
+/**
+ * @brief Reads Reed-solomon encoded bytes from the session fd.
+ *
+ * @param s Session to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_session_read_rs(struct antenna_session *s, char *buffer,
+                            size_t read_len, int read_mode);
+
+/**
+ * @brief Identical to antenna_session_read_rs, but allows a custom file
+ * descriptor to be specified.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_session_read_rs_fd(struct antenna_session *s, int fd, char *buffer,
+                               size_t read_len, int read_mode);
+
+/**
+ * @brief Identical to antenna_session_read_rs_fd, but with an explicit
+ * interleave depth instead of the session default. Without framing, the bytes
+ * returned by one read() in READ_MODE_UPTO must form a whole frame.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @param depth Interleave depth in [1, ANTENNA_MAX_INTERLEAVE].
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_session_read_rs_interleaved_fd(struct antenna_session *s, int fd,
+                                           char *buffer, size_t read_len,
+                                           int read_mode, int depth);
+
+/**
+ * @brief Encodes one frame into memory instead of writing it to an fd, for
+ * callers that do their own I/O. Takes at most interleave * RS_DATA_LEN bytes.
+ *
+ * @param s Session to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @param frame Output buffer of at least ANTENNA_FRAME_MAX_LEN bytes. Holds
+ * the header (when framed) and the coded frame.
+ * @return number of bytes written to frame or -1 on error.
+ */
+ssize_t antenna_session_encode_frame(struct antenna_session *s,
+                                     const char *data, size_t data_len,
+                                     uint8_t *frame);
+
+/**
+ * @brief Decodes one frame pulled from the session deframer, for callers that
+ * do their own I/O. A frame that fails to decode is handed back to the
+ * deframer with antenna_deframer_reject(), so call this before feeding it
+ * again.
+ *
+ * @param s Session to use.
+ * @param p Frame from antenna_deframer_next() on s->rx_deframer.
+ * @param buffer Output buffer of at least ANTENNA_LZ_BLOCK_LEN bytes if the
+ * other end compresses, otherwise interleave * RS_DATA_LEN bytes.
+ * @return number of bytes decoded or -1 on error.
+ */
+ssize_t antenna_session_decode_frame(struct antenna_session *s,
+                                     const struct antenna_packet *p,
+                                     char *buffer);
+
+/**
+ * @brief Returns the process-wide session used by the legacy antenna_*_rs
+ * calls. It is built on first use, with a pool that encodes its large writes
+ * across every core.
+ *
+ * @return shared session or NULL on error.
+ */
+struct antenna_session *antenna_session_shared();
+
+#endif
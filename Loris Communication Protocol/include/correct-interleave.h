@@ -0,0 +1,80 @@
+#ifndef CORRECT_INTERLEAVE_H
+#define CORRECT_INTERLEAVE_H
+#include <correct.h>
+
+struct correct_reed_solomon_interleaved;
+typedef struct correct_reed_solomon_interleaved correct_reed_solomon_interleaved;
+
+#define CORRECT_RS_MAX_INTERLEAVE 8
+
+/* Block-interleaved Reed-Solomon, as in the CCSDS TM sync and channel
+ * coding recommendation. depth codewords are interleaved symbol by symbol,
+ * so symbol j of codeword i is sent at position j * depth + i. A burst of
+ * up to depth * num_roots/2 symbols then costs each codeword no more than
+ * num_roots/2 symbols, which is what one codeword can repair on its own.
+ *
+ * The encoder and the syndrome check of the decoder run over all depth
+ * codewords at once using SSSE3/AVX2 byte shuffles where available. Only
+ * codewords with nonzero syndromes go through the full decoder.
+ *
+ * depth must be between 1 and CORRECT_RS_MAX_INTERLEAVE. Remaining
+ * parameters are as for correct_reed_solomon_create.
+ */
+correct_reed_solomon_interleaved *correct_reed_solomon_interleaved_create(
+    uint16_t primitive_polynomial, uint8_t first_consecutive_root,
+    uint8_t generator_root_gap, size_t num_roots, size_t depth);
+
+/* correct_reed_solomon_interleaved_encoded_len returns the number of
+ * bytes correct_reed_solomon_interleaved_encode writes for a message of
+ * msg_length bytes. Messages which are not a multiple of depth are
+ * padded with zeros up to the next multiple, and the padding is sent.
+ */
+size_t correct_reed_solomon_interleaved_encoded_len(correct_reed_solomon_interleaved *rsi,
+                                                    size_t msg_length);
+
+/* correct_reed_solomon_interleaved_encode encodes msg_length bytes,
+ * no more than depth * (255 - num_roots), into one interleaved frame.
+ *
+ * The frame starts with the (padded) message in its original order,
+ * followed by the depth parity blocks interleaved symbol by symbol.
+ * msg and encoded may be the same pointer.
+ *
+ * This function returns the number of bytes written to encoded or -1.
+ */
+ssize_t correct_reed_solomon_interleaved_encode(correct_reed_solomon_interleaved *rsi,
+                                                const uint8_t *msg, size_t msg_length,
+                                                uint8_t *encoded);
+
+/* correct_reed_solomon_interleaved_decode decodes one interleaved frame.
+ * encoded_length must be a multiple of depth.
+ *
+ * This function returns the number of bytes written to msg, including
+ * any padding added by the encoder, or -1 if any of the codewords could
+ * not be recovered.
+ */
+ssize_t correct_reed_solomon_interleaved_decode(correct_reed_solomon_interleaved *rsi,
+                                                const uint8_t *encoded, size_t encoded_length,
+                                                uint8_t *msg);
+
+/* correct_reed_solomon_interleaved_decode_with_erasures decodes one
+ * interleaved frame as correct_reed_solomon_interleaved_decode does, given
+ * the positions in the frame of bytes known to be bad. Each is handed to
+ * the codeword it belongs to as an erasure, which costs one parity symbol
+ * to repair where an unknown error costs two. Codewords are passed no more
+ * than num_roots erasures each; any beyond that are left to be found as
+ * errors.
+ *
+ * This function returns the number of bytes written to msg, including
+ * any padding added by the encoder, or -1 if any of the codewords could
+ * not be recovered.
+ */
+ssize_t correct_reed_solomon_interleaved_decode_with_erasures(
+    correct_reed_solomon_interleaved *rsi, const uint8_t *encoded, size_t encoded_length,
+    const uint16_t *erasure_locations, size_t erasure_length, uint8_t *msg);
+
+/* correct_reed_solomon_interleaved_destroy releases the resources
+ * associated with rsi.
+ */
+void correct_reed_solomon_interleaved_destroy(correct_reed_solomon_interleaved *rsi);
+
+#endif
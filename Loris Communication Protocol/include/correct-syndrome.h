@@ -0,0 +1,67 @@
+#ifndef CORRECT_SYNDROME_H
+#define CORRECT_SYNDROME_H
+#include <correct.h>
+
+struct correct_reed_solomon_syndrome;
+typedef struct correct_reed_solomon_syndrome correct_reed_solomon_syndrome;
+
+/* Reed-Solomon decoder with a vectorized clean-block check in front of
+ * correct_reed_solomon_decode.
+ *
+ * All num_roots syndromes of a block are computed 16 (SSSE3) or 32 (AVX2)
+ * symbols at a time using byte shuffle multiplication, with a scalar
+ * fallback elsewhere. A block whose syndromes are all zero has no errors,
+ * so its message is returned straight away without running
+ * Berlekamp-Massey, the Chien search or Forney. Only blocks with errors
+ * go through the full decoder.
+ *
+ * Parameters are as for correct_reed_solomon_create, and a block decoded
+ * here decodes identically with a plain correct_reed_solomon of the same
+ * parameters.
+ */
+correct_reed_solomon_syndrome *correct_reed_solomon_syndrome_create(
+    uint16_t primitive_polynomial, uint8_t first_consecutive_root,
+    uint8_t generator_root_gap, size_t num_roots);
+
+/* correct_reed_solomon_syndrome_compute evaluates the received block at
+ * every generator root, highest order symbol first. If syndromes is not
+ * NULL, syndrome j (for root alpha^((fcr + j) * gap)) is written to
+ * syndromes[j], which must hold num_roots bytes.
+ *
+ * This function returns 0 if every syndrome is zero, 1 if the block has
+ * errors, or -1 if encoded_length is not a valid block length.
+ */
+int correct_reed_solomon_syndrome_compute(correct_reed_solomon_syndrome *rss,
+                                          const uint8_t *encoded, size_t encoded_length,
+                                          uint8_t *syndromes);
+
+/* correct_reed_solomon_syndrome_decode decodes one block exactly as
+ * correct_reed_solomon_decode does, skipping the error locator search
+ * when the block is clean. encoded and msg may be the same pointer.
+ *
+ * This function returns the number of bytes written to msg or -1.
+ */
+ssize_t correct_reed_solomon_syndrome_decode(correct_reed_solomon_syndrome *rss,
+                                             const uint8_t *encoded, size_t encoded_length,
+                                             uint8_t *msg);
+
+/* correct_reed_solomon_syndrome_decode_with_erasures is
+ * correct_reed_solomon_syndrome_decode for a block with known bad bytes.
+ * erasure_locations holds their indices into encoded. A clean block is
+ * returned as it is; otherwise the first num_roots erasures are passed to
+ * correct_reed_solomon_decode_with_erasures.
+ *
+ * This function returns the number of bytes written to msg or -1.
+ */
+ssize_t correct_reed_solomon_syndrome_decode_with_erasures(correct_reed_solomon_syndrome *rss,
+                                                           const uint8_t *encoded,
+                                                           size_t encoded_length,
+                                                           const uint8_t *erasure_locations,
+                                                           size_t erasure_length, uint8_t *msg);
+
+/* correct_reed_solomon_syndrome_destroy releases the resources associated
+ * with rss.
+ */
+void correct_reed_solomon_syndrome_destroy(correct_reed_solomon_syndrome *rss);
+
+#endif
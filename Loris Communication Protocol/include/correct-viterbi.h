@@ -0,0 +1,96 @@
+#ifndef CORRECT_VITERBI_H
+#define CORRECT_VITERBI_H
+#include <correct.h>
+
+struct correct_viterbi;
+typedef struct correct_viterbi correct_viterbi;
+
+typedef enum {
+    CORRECT_VITERBI_AUTO,
+    CORRECT_VITERBI_PORTABLE,
+    CORRECT_VITERBI_AVX2,
+} correct_viterbi_impl_t;
+
+/* Whole-frame Viterbi decoder for the codes libcorrect's convolutional
+ * encoder produces, for decoding long recorded soft-symbol captures on
+ * the ground. The wire format is the same as correct_convolutional's:
+ * each input bit shifts into the low end of the register, and the
+ * rate output bits of a step are sent for poly[0] first. Frames are
+ * expected to end with the order - 1 zero tail bits the encoder adds.
+ *
+ * The output is the one correct_convolutional_decode_soft gives, bit
+ * for bit: the decoder follows libcorrect's schedule. The first order - 1
+ * steps fill the register from the zero state without decisions. After
+ * that, one decision bit per state is kept for the last 20 * order
+ * steps. Whenever that history fills, the oldest 15 * order bits are
+ * decoded from the best state. The tail steps only keep the states the
+ * zero tail can reach, and the rest of the frame is decoded from the
+ * zero state at the end. Ties go the way libcorrect sends them. Memory
+ * does not grow with the frame. The add-compare-select step runs 16
+ * butterflies at a time with AVX2 where the CPU has it, and one at a
+ * time otherwise, with the same results.
+ *
+ * Path metrics are 16 bits, as in libcorrect, but are renormalized more
+ * often. The two could only differ if libcorrect's metrics wrapped,
+ * which takes a long run of symbols that contradict every path.
+ *
+ * rate must be 2 to 4 and order 3 to 15, and frames must carry at
+ * least order - 1 message bits. The AVX2 path covers orders
+ * 6 and up, including the usual K = 7 and K = 9 codes.
+ */
+correct_viterbi *correct_viterbi_create(size_t rate, size_t order,
+                                        const correct_convolutional_polynomial_t *poly);
+
+/* correct_viterbi_set_impl forces one add-compare-select
+ * implementation, for testing and benchmarks. CORRECT_VITERBI_AUTO
+ * picks the fastest one the CPU supports, which is the default.
+ *
+ * This function returns 0, or -1 if impl cannot run here.
+ */
+int correct_viterbi_set_impl(correct_viterbi *v, correct_viterbi_impl_t impl);
+
+/* correct_viterbi_get_impl returns the implementation in use. */
+correct_viterbi_impl_t correct_viterbi_get_impl(correct_viterbi *v);
+
+/* correct_viterbi_decode_soft decodes num_encoded_bits soft symbols,
+ * one byte each: 0 for a confident 0, 255 for a confident 1 and 128
+ * for no information. num_encoded_bits must be a multiple of rate.
+ *
+ * This function returns the number of bytes written to msg, which is
+ * enough for num_encoded_bits / rate - (order - 1) bits, or -1.
+ */
+ssize_t correct_viterbi_decode_soft(correct_viterbi *v, const correct_convolutional_soft_t *encoded,
+                                    size_t num_encoded_bits, uint8_t *msg);
+
+/* correct_viterbi_decode decodes num_encoded_bits hard bits, packed 8
+ * to a byte with the first bit in the most significant position.
+ *
+ * This function returns the number of bytes written to msg or -1.
+ */
+ssize_t correct_viterbi_decode(correct_viterbi *v, const uint8_t *encoded,
+                               size_t num_encoded_bits, uint8_t *msg);
+
+/* correct_viterbi_decode_soft_parallel decodes like
+ * correct_viterbi_decode_soft, split over up to num_threads threads, for
+ * long recorded captures. The frame is cut into segments on traceback
+ * group boundaries, and each is decoded by its own decoder, starting
+ * overlap steps early with every state equally likely. Once the
+ * survivor paths of the warm-up have merged, a segment's tracebacks
+ * are the ones the sequential decoder makes, so the output is
+ * identical. overlap is rounded up to a whole traceback group of
+ * 15 * order steps, which is already three traceback depths; a few
+ * groups make a difference all but impossible. The calling thread
+ * decodes the first segment. Segments are at least 8 groups long, so
+ * short frames use fewer threads.
+ *
+ * This function returns the number of bytes written to msg or -1.
+ */
+ssize_t correct_viterbi_decode_soft_parallel(correct_viterbi *v,
+                                             const correct_convolutional_soft_t *encoded,
+                                             size_t num_encoded_bits, uint8_t *msg,
+                                             size_t num_threads, size_t overlap);
+
+/* correct_viterbi_destroy releases the resources associated with v. */
+void correct_viterbi_destroy(correct_viterbi *v);
+
+#endif
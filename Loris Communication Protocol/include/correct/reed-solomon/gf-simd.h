@@ -0,0 +1,70 @@
+#ifndef CORRECT_REED_SOLOMON_GF_SIMD
+#define CORRECT_REED_SOLOMON_GF_SIMD
+#include "correct/reed-solomon.h"
+#include "correct/reed-solomon/field.h"
+
+// Multiplication by a constant c in GF(2^8) splits into two 16-entry lookups,
+//   c * x = c * (x & 0x0f) ^ c * (x & 0xf0)
+// which is exactly the shape of a byte shuffle (pshufb). A vector of 16 or 32
+// field elements can then be multiplied by the same constant in a handful of
+// instructions instead of one log/exp lookup per element.
+//
+// Tables for a list of constants are kept as two parallel arrays (all low
+// nibble tables, then all high nibble tables) so that the tables of constants
+// i and i+1 are adjacent and can be loaded as one 256-bit register.
+
+typedef enum {
+    GF_SIMD_SCALAR,
+    GF_SIMD_SSSE3,
+    GF_SIMD_AVX2,
+} gf_simd_level_t;
+
+static inline void gf_nibble_table_fill(field_t field, field_element_t c, uint8_t *lo, uint8_t *hi) {
+    for (unsigned int i = 0; i < 16; i++) {
+        lo[i] = field_mul(field, c, (field_element_t)i);
+        hi[i] = field_mul(field, c, (field_element_t)(i << 4));
+    }
+}
+
+static inline field_element_t gf_nibble_mul(const uint8_t *lo, const uint8_t *hi, field_element_t x) {
+    return lo[x & 0x0f] ^ hi[x >> 4];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CORRECT_GF_SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+__attribute__((target("ssse3")))
+static inline __m128i gf_mul_ssse3(__m128i x, __m128i lo, __m128i hi) {
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i x_lo = _mm_and_si128(x, mask);
+    __m128i x_hi = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+    return _mm_xor_si128(_mm_shuffle_epi8(lo, x_lo), _mm_shuffle_epi8(hi, x_hi));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gf_mul_avx2(__m256i x, __m256i lo, __m256i hi) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    __m256i x_lo = _mm256_and_si256(x, mask);
+    __m256i x_hi = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+    return _mm256_xor_si256(_mm256_shuffle_epi8(lo, x_lo), _mm256_shuffle_epi8(hi, x_hi));
+}
+#endif
+
+static inline gf_simd_level_t gf_simd_detect(void) {
+#if defined(CORRECT_GF_SIMD_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return GF_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return GF_SIMD_SSSE3;
+    }
+#endif
+    return GF_SIMD_SCALAR;
+}
+#endif
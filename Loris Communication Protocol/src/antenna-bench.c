@@ -0,0 +1,392 @@
+/**
+ * @file antenna-bench.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Latency, goodput and CPU cost of the antenna read/write calls over
+ * pty pairs, across payload sizes, read modes and line rates
+ * @version 0.1
+ * @date 2022-04-26
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+// Feature macros
+#define _GNU_SOURCE
+
+// Project headers
+#include "antenna.h"
+
+// Standard C libraries
+#include <getopt.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Settings
+#define BENCH_MAX_LEN (64 * 1024)
+#define BENCH_MAX_CONFIGS 16
+#define BENCH_MESSAGES 200
+#define BENCH_MIN_MESSAGES 2
+#define BENCH_BUDGET_S 2.0
+#define BENCH_BITS_PER_BYTE 10  // 8N1 on the wire
+
+/*
+ * Every message is written by one thread and read by another, one at a time,
+ * so its latency is the time from the start of the write to the last byte
+ * read. With a line rate of 0 the writer and reader share one pty pair and
+ * run as fast as the kernel moves bytes. Otherwise each has its own pair, as
+ * with two UARTs, and a relay thread between the masters holds the bytes to
+ * the line rate, since a pty ignores its baud setting.
+ *
+ * Rows go to the original stdout. Everything else, including the "[!]" lines
+ * the library prints, goes to stderr so the CSV or JSON stays clean.
+ */
+
+enum { API_RAW, API_RS, API_RS_INTERLEAVED };
+
+static const char *api_names[] = {"raw", "rs", "rs-i4"};
+static const char *mode_names[] = {"upto", "until"};
+
+struct bench {
+  // Configuration
+  int api;
+  int mode;
+  long baud;
+  size_t len;
+  size_t messages;
+  const char *msg;
+
+  // Wiring
+  int tx;
+  int rx;
+  int relay_in;
+  int relay_out;
+  sem_t ready;
+  uint64_t start;
+
+  // Results
+  uint64_t *latencies;
+  size_t received;
+  double writer_cpu;
+  double reader_cpu;
+  int failed;
+};
+
+static uint64_t now_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Creates a pty pair the same way master_create() does in the serial chat
+static int pty_create(int *master, int *slave) {
+  if ((*master = getpt()) < 0) {
+    printf("[!] Failed to open master port.\n");
+    return -1;
+  }
+  if (grantpt(*master) < 0 || unlockpt(*master) < 0) {
+    printf("[!] Failed to unlock slave port for master.\n");
+    return -1;
+  }
+  if ((*slave = open(ptsname(*master), O_RDWR | O_NOCTTY)) < 0) {
+    printf("[!] Failed to open slave port.\n");
+    return -1;
+  }
+
+  // Raw mode so the line discipline passes bytes through untouched
+  struct termios tty;
+  tcgetattr(*slave, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(*slave, TCSANOW, &tty);
+  return 0;
+}
+
+static int bench_write(struct bench *b) {
+  switch (b->api) {
+    case API_RAW: return antenna_write_fd(b->tx, b->msg, b->len);
+    case API_RS: return antenna_write_rs_fd(b->tx, b->msg, b->len);
+    default: return antenna_write_rs_interleaved_fd(b->tx, b->msg, b->len, 4);
+  }
+}
+
+static int bench_read(struct bench *b, char *buffer, size_t len) {
+  switch (b->api) {
+    case API_RAW: return antenna_read_fd(b->rx, buffer, len, b->mode);
+    case API_RS: return antenna_read_rs_fd(b->rx, buffer, len, b->mode);
+    default:
+      return antenna_read_rs_interleaved_fd(b->rx, buffer, len, b->mode, 4);
+  }
+}
+
+static void *writer(void *data) {
+  struct bench *b = data;
+  uint64_t cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+  for (size_t x = 0; x < b->messages; x++) {
+    sem_wait(&b->ready);
+    if (b->failed) break;
+    __atomic_store_n(&b->start, now_ns(CLOCK_MONOTONIC), __ATOMIC_RELEASE);
+    if (bench_write(b) < 0) {
+      b->failed = 1;
+      break;
+    }
+  }
+  b->writer_cpu = (now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu) / 1e9;
+  return NULL;
+}
+
+static void *reader(void *data) {
+  struct bench *b = data;
+  char *buffer = malloc(b->len);
+  uint64_t cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+  for (size_t x = 0; x < b->messages && !b->failed; x++) {
+    // In UPTO mode a message may take several reads
+    size_t total = 0;
+    while (total < b->len) {
+      int bytes_read = bench_read(b, &buffer[total], b->len - total);
+      if (bytes_read <= 0) {
+        b->failed = 1;
+        break;
+      }
+      total += bytes_read;
+    }
+    if (b->failed) break;
+    b->latencies[x] =
+        now_ns(CLOCK_MONOTONIC) - __atomic_load_n(&b->start, __ATOMIC_ACQUIRE);
+    if (memcmp(buffer, b->msg, b->len) != 0) {
+      fprintf(stderr, "[!] Message %zu arrived corrupted\n", x);
+      b->failed = 1;
+    }
+    b->received++;
+    sem_post(&b->ready);
+  }
+  b->reader_cpu = (now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu) / 1e9;
+  sem_post(&b->ready);
+  free(buffer);
+  return NULL;
+}
+
+// Moves bytes from one master to the other no faster than the line rate
+static void *relay(void *data) {
+  struct bench *b = data;
+  uint64_t byte_ns = (BENCH_BITS_PER_BYTE * 1000000000ull) / b->baud;
+  uint64_t line_free = 0;
+
+  // Deliver about a millisecond of line time per write
+  ssize_t slice = b->baud / BENCH_BITS_PER_BYTE / 1000;
+  if (slice < 1) slice = 1;
+
+  char chunk[256];
+  for (;;) {
+    ssize_t bytes_read = read(b->relay_in, chunk, sizeof(chunk));
+    if (bytes_read <= 0) break;
+
+    // Bytes are delivered once the line has had time to send them
+    uint64_t now = now_ns(CLOCK_MONOTONIC);
+    if (line_free < now) line_free = now;
+    for (ssize_t x = 0; x < bytes_read; x += slice) {
+      ssize_t len = (bytes_read - x < slice) ? bytes_read - x : slice;
+      line_free += len * byte_ns;
+      int64_t wait = line_free - now_ns(CLOCK_MONOTONIC);
+      if (wait > 0) {
+        struct timespec ts = {wait / 1000000000ll, wait % 1000000000ll};
+        nanosleep(&ts, NULL);
+      }
+      if (write(b->relay_out, &chunk[x], len) != len) return NULL;
+    }
+  }
+  return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Runs one configuration and prints its row to out
+static int run(struct bench *b, FILE *out, int json, int first) {
+  // Wire up the ptys
+  int master_tx, slave_tx, master_rx = -1, slave_rx = -1;
+  if (pty_create(&master_tx, &slave_tx) < 0) return -1;
+  if (b->baud == 0) {
+    b->tx = slave_tx;
+    b->rx = master_tx;
+  } else {
+    if (pty_create(&master_rx, &slave_rx) < 0) return -1;
+    b->tx = slave_tx;
+    b->rx = slave_rx;
+    b->relay_in = master_tx;
+    b->relay_out = master_rx;
+  }
+
+  // Enough messages to fill the time budget, going by the line rate
+  double line_s =
+      b->baud ? (double)b->len * BENCH_BITS_PER_BYTE / b->baud : 0.0;
+  size_t budget =
+      (line_s > 0) ? (size_t)(BENCH_BUDGET_S / line_s) : b->messages;
+  if (budget < b->messages) b->messages = budget;
+  if (b->messages < BENCH_MIN_MESSAGES) b->messages = BENCH_MIN_MESSAGES;
+
+  b->latencies = calloc(b->messages, sizeof(uint64_t));
+  b->received = 0;
+  b->failed = 0;
+  sem_init(&b->ready, 0, 1);
+
+  pthread_t threads[3];
+  uint64_t start = now_ns(CLOCK_MONOTONIC);
+  pthread_create(&threads[0], NULL, reader, b);
+  pthread_create(&threads[1], NULL, writer, b);
+  if (b->baud) pthread_create(&threads[2], NULL, relay, b);
+  pthread_join(threads[1], NULL);
+
+  // The relay stops once the sending slave is closed. After a failed write
+  // the reader may still be blocked in read, so hang up on it: closing the
+  // slave wakes a reader on its master, and closing the receiving master
+  // wakes one on the receiving slave.
+  int relay_running = b->baud != 0;
+  if (b->failed) {
+    close(slave_tx);
+    slave_tx = -1;
+    if (relay_running) {
+      pthread_join(threads[2], NULL);
+      relay_running = 0;
+      close(master_rx);
+      master_rx = -1;
+    }
+  }
+  pthread_join(threads[0], NULL);
+  double seconds = (now_ns(CLOCK_MONOTONIC) - start) / 1e9;
+
+  if (slave_tx >= 0) close(slave_tx);
+  close(master_tx);
+  if (relay_running) pthread_join(threads[2], NULL);
+  if (b->baud) {
+    close(slave_rx);
+    if (master_rx >= 0) close(master_rx);
+  }
+  sem_destroy(&b->ready);
+
+  if (b->failed || b->received == 0) {
+    fprintf(stderr, "[!] %s %s %zu bytes at %ld baud failed\n",
+            api_names[b->api], mode_names[b->mode], b->len, b->baud);
+    free(b->latencies);
+    return -1;
+  }
+
+  qsort(b->latencies, b->received, sizeof(uint64_t), compare_u64);
+  double p50 = b->latencies[b->received / 2] / 1e3;
+  double p99 = b->latencies[(b->received * 99) / 100] / 1e3;
+  double mb = (double)b->received * b->len / 1e6;
+  double goodput = mb * 1e3 / seconds;
+  double cpu_per_mb = (b->writer_cpu + b->reader_cpu) * 1e3 / mb;
+  free(b->latencies);
+
+  if (json)
+    fprintf(out, "%s  {\"api\": \"%s\", \"mode\": \"%s\", \"baud\": %ld, "
+            "\"len\": %zu, \"messages\": %zu, \"p50_us\": %.1f, "
+            "\"p99_us\": %.1f, \"goodput_kBps\": %.2f, "
+            "\"cpu_ms_per_MB\": %.2f}",
+            first ? "" : ",\n", api_names[b->api], mode_names[b->mode],
+            b->baud, b->len, b->received, p50, p99, goodput, cpu_per_mb);
+  else
+    fprintf(out, "%s,%s,%ld,%zu,%zu,%.1f,%.1f,%.2f,%.2f\n",
+            api_names[b->api], mode_names[b->mode], b->baud, b->len,
+            b->received, p50, p99, goodput, cpu_per_mb);
+  fflush(out);
+  return 0;
+}
+
+// Parses a comma separated list of sizes or rates
+static size_t parse_list(const char *arg, long *values) {
+  size_t count = 0;
+  char *end;
+  while (count < BENCH_MAX_CONFIGS) {
+    values[count++] = strtol(arg, &end, 10);
+    if (*end != ',') break;
+    arg = end + 1;
+  }
+  return count;
+}
+
+static void usage(const char *argv0) {
+  printf(
+      "Usage: %s [options]\n"
+      "  -s sizes     payload sizes in bytes (default 16,223,1024,4096)\n"
+      "  -b bauds     line rates, 0 for an unthrottled pty (default "
+      "0,115200,9600)\n"
+      "  -n count     messages per configuration (default %d, fewer when the\n"
+      "               line rate would take more than %.0f s)\n"
+      "  -j           JSON instead of CSV\n",
+      argv0, BENCH_MESSAGES, BENCH_BUDGET_S);
+}
+
+int main(int argc, char *argv[]) {
+  long sizes[BENCH_MAX_CONFIGS] = {16, 223, 1024, 4096};
+  long bauds[BENCH_MAX_CONFIGS] = {0, 115200, 9600};
+  size_t size_count = 4, baud_count = 3, messages = BENCH_MESSAGES;
+  int json = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:b:n:jh")) != -1) {
+    switch (opt) {
+      case 's': size_count = parse_list(optarg, sizes); break;
+      case 'b': baud_count = parse_list(optarg, bauds); break;
+      case 'n': messages = atol(optarg); break;
+      case 'j': json = 1; break;
+      default: usage(argv[0]); return -1;
+    }
+  }
+  for (size_t x = 0; x < size_count; x++) {
+    if (sizes[x] <= 0 || sizes[x] > BENCH_MAX_LEN) {
+      printf("[!] Invalid payload size %ld\n", sizes[x]);
+      return -1;
+    }
+  }
+  for (size_t x = 0; x < baud_count; x++) {
+    if (bauds[x] < 0) {
+      printf("[!] Invalid line rate %ld\n", bauds[x]);
+      return -1;
+    }
+  }
+  if (messages == 0) messages = 1;
+
+  // Keep stdout for the rows and send every printf after this to stderr
+  FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+  if (out == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+    fprintf(stderr, "[!] Failed to split stdout from stderr\n");
+    return -1;
+  }
+
+  char *msg = malloc(BENCH_MAX_LEN);
+  for (int x = 0; x < BENCH_MAX_LEN; x++) msg[x] = rand();
+
+  fprintf(out, json ? "[\n"
+                   : "api,mode,baud,len,messages,p50_us,p99_us,goodput_kBps,"
+                     "cpu_ms_per_MB\n");
+  int status = 0, first = 1;
+  for (size_t r = 0; r < baud_count; r++) {
+    for (int api = API_RAW; api <= API_RS_INTERLEAVED; api++) {
+      for (int mode = READ_MODE_UPTO; mode <= READ_MODE_UNTIL; mode++) {
+        for (size_t l = 0; l < size_count; l++) {
+          struct bench b = {.api = api,
+                            .mode = mode,
+                            .baud = bauds[r],
+                            .len = sizes[l],
+                            .messages = messages,
+                            .msg = msg};
+          if (run(&b, out, json, first) < 0)
+            status = -1;
+          else
+            first = 0;
+        }
+      }
+    }
+  }
+  if (json) fprintf(out, "\n]\n");
+
+  fclose(out);
+  free(msg);
+  return status;
+}
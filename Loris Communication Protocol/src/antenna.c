@@ -1,8 +1,89 @@
 #include "antenna.h"
+#include "antenna_file.h"
+#include "antenna_session.h"
+
+// Linux serial driver interface
+#include <linux/serial.h>
+#include <sys/ioctl.h>
 
 // Glocal variables
 static int uartfd = -1;
 
+// Kernel termios with explicit rates, which glibc does not declare. c_cc is
+// the kernel's 19 entries, not glibc's NCCS.
+struct termios2 {
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+
+// Rates termios can set by name
+static const struct {
+  unsigned int baud;
+  speed_t speed;
+} uart_speeds[] = {
+    {50, B50},         {75, B75},         {110, B110},
+    {134, B134},       {150, B150},       {200, B200},
+    {300, B300},       {600, B600},       {1200, B1200},
+    {1800, B1800},     {2400, B2400},     {4800, B4800},
+    {9600, B9600},     {19200, B19200},   {38400, B38400},
+    {57600, B57600},   {115200, B115200}, {230400, B230400},
+    {460800, B460800}, {500000, B500000}, {576000, B576000},
+    {921600, B921600}, {1000000, B1000000}, {1152000, B1152000},
+    {1500000, B1500000}, {2000000, B2000000}, {2500000, B2500000},
+    {3000000, B3000000}, {3500000, B3500000}, {4000000, B4000000},
+};
+
+// Sets a rate termios has no name for
+static int uart_set_custom_baud(int fd, unsigned int baud) {
+  struct termios2 tty;
+  if (ioctl(fd, TCGETS2, &tty) < 0) {
+    printf("[!] Failed to get termios2: %s\n", strerror(errno));
+    return -1;
+  }
+
+  tty.c_cflag &= ~(CBAUD | CIBAUD);
+  tty.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+  tty.c_ispeed = baud;
+  tty.c_ospeed = baud;
+  if (ioctl(fd, TCSETS2, &tty) < 0) {
+    printf("[!] Failed to set %u baud: %s\n", baud, strerror(errno));
+    return -1;
+  }
+
+  // done
+  return 0;
+}
+
+// Asks the driver to push received bytes to the reader straight away. Not
+// every driver knows the request, so that is only a warning.
+static void uart_set_low_latency(int fd, int enable) {
+  struct serial_struct serial;
+  if (ioctl(fd, TIOCGSERIAL, &serial) < 0) {
+    printf("[!] Low latency mode not supported: %s\n", strerror(errno));
+    return;
+  }
+
+  if (enable)
+    serial.flags |= ASYNC_LOW_LATENCY;
+  else
+    serial.flags &= ~ASYNC_LOW_LATENCY;
+  if (ioctl(fd, TIOCSSERIAL, &serial) < 0)
+    printf("[!] Failed to set low latency mode: %s\n", strerror(errno));
+}
+
 /**
  * @brief Initializes the UART port for the antenna.
  *
@@ -10,27 +91,72 @@ static int uartfd = -1;
  * @return 0 on success, 1 on error.
  */
 int antenna_init(const char *path) {
+  struct antenna_uart_config config = ANTENNA_UART_CONFIG_DEFAULT;
+  return antenna_init_config(path, &config);
+}
+
+/**
+ * @brief Initializes the UART port for the antenna with the given settings
+ * instead of the defaults.
+ *
+ * @param path Sets the device path to configure.
+ * @param config Line settings.
+ * @return 0 on success, -1 on error.
+ */
+int antenna_init_config(const char *path,
+                        const struct antenna_uart_config *config) {
   if ((uartfd = open(path, O_RDWR | O_NOCTTY | O_SYNC)) < 0) {
     printf("[!] Failed to open I/O device at %s\n", path);
     return -1;
   }
 
+  return antenna_configure_fd(uartfd, config);
+}
+
+/**
+ * @brief Returns the file descriptor of the port opened by antenna_init().
+ *
+ * @return antenna file descriptor, or -1 before antenna_init().
+ */
+int antenna_get_fd() { return uartfd; }
+
+/**
+ * @brief Puts a tty in raw 8N1 mode with the given line settings.
+ *
+ * @param fd File descriptor of the tty.
+ * @param config Line settings.
+ * @return 0 on success, -1 on error.
+ */
+int antenna_configure_fd(int fd, const struct antenna_uart_config *config) {
   struct termios tty;
 
-  if (tcgetattr(uartfd, &tty) < 0) {
+  if (tcgetattr(fd, &tty) < 0) {
     printf("Error from tcgetattr: %s\n", strerror(errno));
     return -1;
   }
 
-  cfsetospeed(&tty, (speed_t)UART_SPEED);
-  cfsetispeed(&tty, (speed_t)UART_SPEED);
+  // Standard rates are set here, others once the rest is in place
+  speed_t speed = B38400;
+  int custom = 1;
+  for (size_t x = 0; x < sizeof(uart_speeds) / sizeof(uart_speeds[0]); x++) {
+    if (uart_speeds[x].baud == config->baud) {
+      speed = uart_speeds[x].speed;
+      custom = 0;
+      break;
+    }
+  }
+  cfsetospeed(&tty, speed);
+  cfsetispeed(&tty, speed);
 
   tty.c_cflag |= (CLOCAL | CREAD); /* ignore modem controls */
   tty.c_cflag &= ~CSIZE;
   tty.c_cflag |= CS8;      /* 8-bit characters */
   tty.c_cflag &= ~PARENB;  /* no parity bit */
   tty.c_cflag &= ~CSTOPB;  /* only need 1 stop bit */
-  tty.c_cflag &= ~CRTSCTS; /* no hardware flowcontrol */
+  if (config->flow_control)
+    tty.c_cflag |= CRTSCTS; /* RTS/CTS hardware flowcontrol */
+  else
+    tty.c_cflag &= ~CRTSCTS; /* no hardware flowcontrol */
 
   /* setup for non-canonical mode */
   tty.c_iflag &=
@@ -38,14 +164,50 @@ int antenna_init(const char *path) {
   tty.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
   tty.c_oflag &= ~OPOST;
 
-  /* fetch bytes as they become available */
-  tty.c_cc[VMIN] = 1;
-  tty.c_cc[VTIME] = 1;
+  /* fetch bytes in batches of vmin, or after vtime of silence */
+  tty.c_cc[VMIN] = config->vmin;
+  tty.c_cc[VTIME] = config->vtime;
 
-  if (tcsetattr(uartfd, TCSANOW, &tty) != 0) {
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
     printf("Error from tcsetattr: %s\n", strerror(errno));
     return -1;
   }
+
+  if (custom && uart_set_custom_baud(fd, config->baud) < 0) return -1;
+  if (config->low_latency) uart_set_low_latency(fd, 1);
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Turns PARMRK error marking on or off for a tty. While on, a byte
+ * received with a parity or framing error, or a break, is read as \377 \0 byte
+ * and a real \377 as \377 \377, which antenna_session_set_parmrk() undoes.
+ *
+ * @param fd File descriptor of the tty.
+ * @param enable 1 to mark errors, 0 to pass bytes through as received.
+ * @return 0 on success, -1 on error.
+ */
+int antenna_set_parmrk_fd(int fd, int enable) {
+  struct termios tty;
+  if (tcgetattr(fd, &tty) < 0) {
+    printf("Error from tcgetattr: %s\n", strerror(errno));
+    return -1;
+  }
+
+  // Errors are only reported with INPCK, and IGNPAR or ISTRIP would drop or
+  // mangle the marks
+  tty.c_iflag &= ~(IGNPAR | ISTRIP | PARMRK | INPCK);
+  if (enable) tty.c_iflag |= PARMRK | INPCK;
+
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    printf("Error from tcsetattr: %s\n", strerror(errno));
+    return -1;
+  }
+
+  // done
+  return 0;
 }
 
 /**
@@ -58,13 +220,6 @@ int antenna_init(const char *path) {
  * @return 0 on success, -1 on error
  */
 int antenna_write_fd(int fd, const char *data, size_t data_len) {
-  // Prepare packet
-  struct antenna_packet p;
-  if (antenna_packet_new(&p) < 0) {
-    printf("[!] Failed to create new packet\n");
-    return -1;
-  }
-
   // Write bytes to antenna
   if (write(fd, data, data_len) < data_len) {
     printf("[!] Failed to send data of %d bytes in length.\n", data_len);
@@ -75,6 +230,43 @@ int antenna_write_fd(int fd, const char *data, size_t data_len) {
   return 0;
 }
 
+/**
+ * @brief Writes a list of buffers to a custom file descriptor, handing as many
+ * of them to the kernel per syscall as it will take. Partial writes are
+ * resumed. The iov array is modified.
+ *
+ * @param fd File descriptor to use.
+ * @param iov Array of buffers to send.
+ * @param iovcnt Number of entries in iov.
+ * @return 0 on success, -1 on error
+ */
+int antenna_writev_fd(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    // Write as many buffers as possible
+    ssize_t bytes_written =
+        writev(fd, iov, (iovcnt > ANTENNA_IOV_MAX) ? ANTENNA_IOV_MAX : iovcnt);
+    if (bytes_written < 0) {
+      if (errno == EINTR) continue;
+      printf("[!] Failed to send vectored data: %s\n", strerror(errno));
+      return -1;
+    }
+
+    // Skip the buffers that went out and trim the partially written one
+    while (iovcnt > 0 && (size_t)bytes_written >= iov->iov_len) {
+      bytes_written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + bytes_written;
+      iov->iov_len -= bytes_written;
+    }
+  }
+
+  // done
+  return 0;
+}
+
 /**
  * @brief Writes bytes to the antenna.
  *
@@ -105,49 +297,35 @@ int antenna_write(const char *data, size_t data_len) {
  * @return 0 on success, -1 on error
  */
 int antenna_write_rs_fd(int fd, const char *data, size_t data_len) {
-  // Return status
-  int status = 0;
-
-  // Encode data
-  int bytes_encoded = 0;
-  correct_reed_solomon *encoder = correct_reed_solomon_create(
-      correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, RS_NUM_ROOTS);
-  if (encoder == NULL) {
+  // Reuse the shared coder instead of rebuilding it for every message
+  struct antenna_session *s = antenna_session_shared();
+  if (s == NULL) {
     printf("[!] Failed to create RS encoder\n");
-    status = -1;
-    goto cleanup;
+    return -1;
   }
-  while (bytes_encoded < data_len) {
-    // Encode block of data
-    int bytes_remaining = (data_len - bytes_encoded);
-    int bytes_to_encode =
-        (bytes_remaining > RS_DATA_LEN) ? RS_DATA_LEN : bytes_remaining;
-    char data_encoded[255];
-    int data_encoded_len = correct_reed_solomon_encode(
-        encoder, &data[bytes_encoded], bytes_to_encode, data_encoded);
-    if (data_encoded_len < 0) {
-      printf("[!] Failed to encode data\n");
-      status = -1;
-      goto cleanup;
-    }
 
-    // Send block
-    if (antenna_write_fd(fd, data_encoded, data_encoded_len) < 0) {
-      printf("[!] Failed to send block of encoded data\n");
-      status = -1;
-      goto cleanup;
-    }
+  return antenna_session_write_rs_fd(s, fd, data, data_len);
+}
 
-    // Update counters
-    bytes_encoded += bytes_to_encode;
+/**
+ * @brief Identical to antenna_write_rs_fd, but interleaves depth codewords
+ * symbol by symbol so longer error bursts can be repaired.
+ *
+ * @param fd File descriptor to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @param depth Interleave depth, 1 to 8. Must match the receiver.
+ * @return 0 on success, -1 on error
+ */
+int antenna_write_rs_interleaved_fd(int fd, const char *data, size_t data_len,
+                                    int depth) {
+  struct antenna_session *s = antenna_session_shared();
+  if (s == NULL) {
+    printf("[!] Failed to create RS encoder\n");
+    return -1;
   }
 
-cleanup:
-  // Free encoder
-  correct_reed_solomon_destroy(encoder);
-
-  // done
-  return status;
+  return antenna_session_write_rs_interleaved_fd(s, fd, data, data_len, depth);
 }
 
 /**
@@ -192,10 +370,14 @@ int antenna_read_fd(int fd, char *buffer, size_t read_len, int read_mode) {
       int new_bytes_read = -1;
       if ((new_bytes_read =
                read(fd, &buffer[bytes_read], read_len - bytes_read)) < 0) {
+        if (errno == EINTR) continue;
         printf("[!] Failed to read from fd\n");
         return -1;
       }
 
+      // The other end is gone, so the count will never be met
+      if (new_bytes_read == 0) break;
+
       // Update bytes read so far
       bytes_read += new_bytes_read;
     }
@@ -242,67 +424,37 @@ int antenna_read(char *buffer, size_t read_len, int read_mode) {
  * @return number of bytes read or < 0 for error.
  */
 int antenna_read_rs_fd(int fd, char *buffer, size_t read_len, int read_mode) {
-  // Return status
-  int status = 0;
-
-  // Create encoder
-  correct_reed_solomon *encoder = correct_reed_solomon_create(
-      correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, RS_NUM_ROOTS);
-  if (encoder == NULL) {
-    printf("[!] Failed to create RS encoder\n");
-    status = -1;
-    goto cleanup;
+  // Reuse the shared coder instead of rebuilding it for every message
+  struct antenna_session *s = antenna_session_shared();
+  if (s == NULL) {
+    printf("[!] Failed to create RS decoder\n");
+    return -1;
   }
 
-  // Create placeholders
-  int bytes_decoded = 0;
-  char data_in[RS_BLOCK_LEN];
-
-  // Parse incoming blocks until length satisfied
-  do {
-    // Clear incoming buffer
-    memset(data_in, 0, RS_BLOCK_LEN);
-
-    // Read block
-    int bytes_read = -1;
-    if ((bytes_read = antenna_read_fd(fd, data_in, RS_BLOCK_LEN, read_mode)) <
-        0) {
-      printf("[!] Failed to read encoded block from antenna\n");
-      status = -1;
-      goto cleanup;
-    }
-
-    // Placeholder for decoded bytes
-    char decoded[RS_DATA_LEN];
-
-    // Decode it
-    int new_bytes_decoded = -1;
-    if ((new_bytes_decoded = correct_reed_solomon_decode(
-             encoder, data_in, bytes_read, decoded)) < 0) {
-      printf("[!] Failed to decode incoming block\n");
-      status = -1;
-      goto cleanup;
-    }
-
-    // Copy decoded bytes into buffer
-    int bytes_to_copy = (read_len - bytes_decoded) > new_bytes_decoded
-                            ? new_bytes_decoded
-                            : (read_len - bytes_decoded);
-    memcpy(&buffer[bytes_decoded], decoded, bytes_to_copy);
-
-    // Update counters
-    bytes_decoded += bytes_to_copy;
-  } while (bytes_decoded < read_len && read_mode == READ_MODE_UNTIL);
+  return antenna_session_read_rs_fd(s, fd, buffer, read_len, read_mode);
+}
 
-cleanup:
-  // Free encoder
-  correct_reed_solomon_destroy(encoder);
+/**
+ * @brief Identical to antenna_read_rs_fd, but for data sent with
+ * antenna_write_rs_interleaved_fd.
+ *
+ * @param fd File descriptor to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @param depth Interleave depth, 1 to 8. Must match the sender.
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_read_rs_interleaved_fd(int fd, char *buffer, size_t read_len,
+                                   int read_mode, int depth) {
+  struct antenna_session *s = antenna_session_shared();
+  if (s == NULL) {
+    printf("[!] Failed to create RS decoder\n");
+    return -1;
+  }
 
-  // done
-  if (status)
-    return status;
-  else
-    return bytes_decoded;
+  return antenna_session_read_rs_interleaved_fd(s, fd, buffer, read_len,
+                                                read_mode, depth);
 }
 
 /**
@@ -325,45 +477,13 @@ int antenna_read_rs(char *buffer, size_t read_len, int read_mode) {
  * @return 0 on success, -1 on error
  */
 int antenna_fwrite_fd(int fd, const char *file_path) {
-  // Designate status
-  int status = 0;
-
-  // Get file size
-  struct stat st;
-  stat(file_path, &st);
-  size_t file_size = st.st_size;
-
-  // Open the file
-  FILE *f = fopen(file_path, "r");
-  if (f == NULL) {
-    printf("[!] Failed to open file to send\n");
-    return status;
-  }
-
-  // Send notice of incoming file to destination
-  char file_notice[FILE_NOTICE_LEN];
-  sprintf(file_notice, FILE_NOTICE_FMT, file_size);
-  antenna_write_fd(fd, file_notice, FILE_NOTICE_LEN);
-
-  // Read file into buffer and pass along to antenna
-  char buffer[FILE_BUFFER_SIZE];
-  int bytes_read = 0;
-  size_t total_bytes_read = 0;
-  while ((bytes_read = fread(buffer, sizeof(char), FILE_BUFFER_SIZE, f)) >=
-         FILE_BUFFER_SIZE) {
-    if (antenna_write_fd(fd, buffer, bytes_read) == -1) {
-      printf("[!] Failed to write file data to antenna\n");
-      status = -1;
-      goto cleanup;
-    }
-    total_bytes_read += bytes_read;
+  struct antenna_session *s = antenna_session_shared();
+  if (s == NULL) {
+    printf("[!] Failed to create RS encoder\n");
+    return -1;
   }
 
-cleanup:
-  // Close the file
-  fclose(f);
-
-  return status;
+  return antenna_file_send(s, fd, fd, file_path);
 }
 
 /**
@@ -374,59 +494,11 @@ cleanup:
  * @return 0 on success, -1 on error
  */
 int antenna_fread_fd(int fd, const char *file_path) {
-  int status = 0;
-
-  // Wait for file notice
-  size_t file_size = 0;
-  int ready = 0;
-  while (!ready) {
-    char notice[FILE_NOTICE_LEN];
-    if (antenna_read_fd(fd, notice, FILE_NOTICE_LEN, READ_MODE_UPTO) == -1) {
-      printf("[!] Failed to read from antenna\n");
-      return -1;
-    }
-
-    // Check if file notice received
-    if (notice[0] == 'F') {
-      sscanf(notice, "F%u", &file_size);
-      ready = 1;
-
-      // DEBUG
-      printf("[i] File notice received! Incoming file size is %u bytes\n", file_size);
-
-    } else {
-      continue;
-    }
-  }
-
-  // Create file to store
-  FILE *fp = fopen(file_path, "w");
-  if (fp == NULL) {
-    printf("[!] Failed to open file placeholder for incoming file\n");
+  struct antenna_session *s = antenna_session_shared();
+  if (s == NULL) {
+    printf("[!] Failed to create RS decoder\n");
     return -1;
   }
 
-  // Write incoming data to file
-  char buffer[FILE_BUFFER_SIZE];
-  size_t total_bytes_read = 0;
-  while(total_bytes_read < file_size) {
-    int bytes_read = -1;
-    if((bytes_read = antenna_read_fd(fd, buffer, FILE_BUFFER_SIZE, READ_MODE_UPTO)) == -1) {
-      printf("[!] Failed to read data from the antenna\n");
-      status = -1;
-      goto cleanup;
-    }
-
-    if(fwrite(buffer, sizeof(char), bytes_read, fp) < bytes_read) {
-      printf("[*] Could not write any or full number of bytes to file. SKIPPING.\n");
-      continue;
-    }
-
-    total_bytes_read += bytes_read;
-  }
-
-cleanup:
-  fclose(fp);
-
-  return status;
-}
\ No newline at end of file
+  return antenna_file_receive(s, fd, fd, file_path);
+}
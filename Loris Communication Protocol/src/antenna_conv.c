@@ -0,0 +1,259 @@
+/**
+ * @file antenna_conv.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Convolutional inner code for the concatenated antenna link mode
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_conv.h"
+
+// Pick the SSE build of the libcorrect coder when asked to at compile time
+#ifdef ANTENNA_CONV_SSE
+#define conv_create correct_convolutional_sse_create
+#define conv_destroy correct_convolutional_sse_destroy
+#define conv_encode correct_convolutional_sse_encode
+#define conv_decode correct_convolutional_sse_decode
+#define conv_decode_soft correct_convolutional_sse_decode_soft
+#else
+#define conv_create correct_convolutional_create
+#define conv_destroy correct_convolutional_destroy
+#define conv_encode correct_convolutional_encode
+#define conv_decode correct_convolutional_decode
+#define conv_decode_soft correct_convolutional_decode_soft
+#endif
+
+// Puncturing patterns by rate (see antenna_conv.h). keep[i][j] says whether
+// coded bit j of input bit i of the period is sent.
+static const struct {
+  size_t period;
+  uint8_t keep[CONV_PUNCTURE_PERIOD_MAX][CONV_RATE];
+} conv_puncture[ANTENNA_CONV_RATES] = {
+    [ANTENNA_CONV_RATE_1_2] = {1, {{1, 1}}},
+    [ANTENNA_CONV_RATE_2_3] = {2, {{1, 1}, {0, 1}}},
+    [ANTENNA_CONV_RATE_3_4] = {3, {{1, 1}, {0, 1}, {1, 0}}},
+    [ANTENNA_CONV_RATE_5_6] = {5, {{1, 1}, {0, 1}, {1, 0}, {0, 1}, {1, 0}}},
+    [ANTENNA_CONV_RATE_7_8] =
+        {7, {{1, 1}, {0, 1}, {0, 1}, {0, 1}, {1, 0}, {0, 1}, {1, 0}}},
+};
+
+// Whether rate 1/2 coded bit x of a block is sent at rate
+static int conv_kept(int rate, size_t x) {
+  size_t step = x / CONV_RATE;
+  return conv_puncture[rate].keep[step % conv_puncture[rate].period]
+                              [x % CONV_RATE];
+}
+
+// Number of coded bits sent for steps input bits (tail included) at rate
+static size_t conv_punctured_bits(int rate, size_t steps) {
+  size_t period = conv_puncture[rate].period;
+  size_t bits = 0;
+  for (size_t i = 0; i < period; i++) {
+    size_t count = steps / period + (i < steps % period);
+    for (size_t j = 0; j < CONV_RATE; j++)
+      bits += count * conv_puncture[rate].keep[i][j];
+  }
+  return bits;
+}
+
+/**
+ * @brief Builds the convolutional coder.
+ *
+ * @param c Pointer to allocated coder which will be initialized.
+ * @param decision ANTENNA_DECISION_HARD or ANTENNA_DECISION_SOFT.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_conv_new(struct antenna_conv *c, int decision) {
+  // Check for NULL pointers
+  if (c == NULL) {
+    printf("[!] Cannot initialize null convolutional coder\n");
+    return -1;
+  }
+
+  if (decision != ANTENNA_DECISION_HARD && decision != ANTENNA_DECISION_SOFT) {
+    printf("[!] Invalid decision mode %d\n", decision);
+    return -1;
+  }
+
+  c->decision = decision;
+  c->rate = ANTENNA_CONV_RATE_1_2;
+  c->depunctured = NULL;
+  c->depunctured_len = 0;
+  c->conv = conv_create(CONV_RATE, CONV_ORDER, CONV_POLYNOMIAL);
+  if (c->conv == NULL) {
+    printf("[!] Failed to create convolutional coder\n");
+    return -1;
+  }
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Releases the coder.
+ *
+ * @param c Coder to tear down.
+ */
+void antenna_conv_destroy(struct antenna_conv *c) {
+  if (c == NULL || c->conv == NULL) return;
+  conv_destroy(c->conv);
+  c->conv = NULL;
+  free(c->depunctured);
+  c->depunctured = NULL;
+  c->depunctured_len = 0;
+}
+
+/**
+ * @brief Selects the code rate. Both ends of the link must use the same rate.
+ *
+ * @param c Coder to configure.
+ * @param rate ANTENNA_CONV_RATE_1_2, _2_3, _3_4, _5_6 or _7_8.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_conv_set_rate(struct antenna_conv *c, int rate) {
+  if (rate < ANTENNA_CONV_RATE_1_2 || rate >= ANTENNA_CONV_RATES) {
+    printf("[!] Invalid convolutional code rate %d\n", rate);
+    return -1;
+  }
+  c->rate = rate;
+  return 0;
+}
+
+/**
+ * @brief Number of bytes sent on the wire for data_len bytes of input.
+ *
+ * @param c Coder to use.
+ * @param data_len Number of bytes before the inner code.
+ * @return number of coded bytes.
+ */
+size_t antenna_conv_encoded_len(struct antenna_conv *c, size_t data_len) {
+  return (conv_punctured_bits(c->rate, 8 * data_len + CONV_ORDER - 1) + 7) / 8;
+}
+
+/**
+ * @brief Number of bytes the receiver reads for data_len bytes of input. This
+ * is the encoded length for hard decisions, and one byte per bit of the encoded
+ * bytes (padding included) for soft decisions.
+ *
+ * @param c Coder to use.
+ * @param data_len Number of bytes before the inner code.
+ * @return number of bytes to read.
+ */
+size_t antenna_conv_received_len(struct antenna_conv *c, size_t data_len) {
+  return (c->decision == ANTENNA_DECISION_SOFT)
+             ? 8 * antenna_conv_encoded_len(c, data_len)
+             : antenna_conv_encoded_len(c, data_len);
+}
+
+/**
+ * @brief Encodes bytes with the inner code. The output holds
+ * antenna_conv_encoded_len(c, data_len) bytes, but is punctured in place, so
+ * coded must have room for the CONV_ENCODED_BITS(data_len) bits of rate 1/2.
+ *
+ * @param c Coder to use.
+ * @param data Array of bytes to encode.
+ * @param data_len Number of bytes from data to encode.
+ * @param coded Output buffer for the coded bytes.
+ * @return number of coded bytes or -1 on error.
+ */
+ssize_t antenna_conv_encode(struct antenna_conv *c, const uint8_t *data,
+                            size_t data_len, uint8_t *coded) {
+  size_t bits = conv_encode(c->conv, data, data_len, coded);
+  if (bits != CONV_ENCODED_BITS(data_len)) {
+    printf("[!] Failed to convolutionally encode data\n");
+    return -1;
+  }
+  if (c->rate == ANTENNA_CONV_RATE_1_2)
+    return antenna_conv_encoded_len(c, data_len);
+
+  // Drop the punctured bits. Kept bits only ever move towards the start, past
+  // bits already read.
+  size_t sent = 0;
+  for (size_t x = 0; x < bits; x++) {
+    if (!conv_kept(c->rate, x)) continue;
+    uint8_t bit = (coded[x / 8] >> (7 - x % 8)) & 1;
+    coded[sent / 8] = (coded[sent / 8] & ~(0x80 >> (sent % 8))) |
+                      (bit << (7 - sent % 8));
+    sent++;
+  }
+  if (sent % 8) coded[sent / 8] &= 0xFF << (8 - sent % 8);
+
+  return antenna_conv_encoded_len(c, data_len);
+}
+
+/**
+ * @brief Runs the Viterbi decoder over received bytes, using hard or soft
+ * decisions as the coder was built with.
+ *
+ * @param c Coder to use.
+ * @param received Array of received bytes.
+ * @param received_len Number of bytes in received. Must be a value returned by
+ * antenna_conv_received_len.
+ * @param data Output buffer for the decoded bytes.
+ * @param data_cap Size of data. Blocks that would decode to more are rejected.
+ * @return number of decoded bytes or -1 on error.
+ */
+ssize_t antenna_conv_decode(struct antenna_conv *c, const uint8_t *received,
+                            size_t received_len, uint8_t *data,
+                            size_t data_cap) {
+  // Work back from the received length to the data length. The coded bits
+  // are rounded up to whole bytes on the wire, which the division drops again.
+  size_t received_bits = (c->decision == ANTENNA_DECISION_SOFT)
+                             ? received_len
+                             : received_len * 8;
+  size_t period = conv_puncture[c->rate].period;
+  size_t steps = received_bits * period / conv_punctured_bits(c->rate, period);
+  size_t data_len = (steps - (CONV_ORDER - 1)) / 8;
+  if (steps <= CONV_ORDER - 1 ||
+      antenna_conv_received_len(c, data_len) != received_len) {
+    printf("[!] Invalid convolutional block length %zu\n", received_len);
+    return -1;
+  }
+  if (data_len > data_cap) {
+    printf("[!] Convolutional block of %zu bytes does not fit in %zu\n",
+           data_len, data_cap);
+    return -1;
+  }
+
+  ssize_t decoded_len;
+  size_t bits = CONV_ENCODED_BITS(data_len);
+  if (c->rate == ANTENNA_CONV_RATE_1_2) {
+    decoded_len = (c->decision == ANTENNA_DECISION_SOFT)
+                      ? conv_decode_soft(c->conv, received, bits, data)
+                      : conv_decode(c->conv, received, bits, data);
+  } else {
+    // Rebuild the rate 1/2 block as soft symbols, with nothing known about
+    // the bits that were not sent
+    if (c->depunctured_len < bits) {
+      uint8_t *depunctured = realloc(c->depunctured, bits);
+      if (depunctured == NULL) {
+        printf("[!] Failed to allocate depuncturing buffer\n");
+        return -1;
+      }
+      c->depunctured = depunctured;
+      c->depunctured_len = bits;
+    }
+
+    size_t y = 0;
+    for (size_t x = 0; x < bits; x++) {
+      if (!conv_kept(c->rate, x))
+        c->depunctured[x] = CONV_NEUTRAL_SOFT;
+      else if (c->decision == ANTENNA_DECISION_SOFT)
+        c->depunctured[x] = received[y++];
+      else {
+        c->depunctured[x] = ((received[y / 8] >> (7 - y % 8)) & 1) ? 255 : 0;
+        y++;
+      }
+    }
+    decoded_len = conv_decode_soft(c->conv, c->depunctured, bits, data);
+  }
+  if (decoded_len < 0) {
+    printf("[!] Failed to run Viterbi decoder\n");
+    return -1;
+  }
+
+  return data_len;
+}
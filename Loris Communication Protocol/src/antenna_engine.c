@@ -0,0 +1,572 @@
+/**
+ * @file antenna_engine.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Event driven I/O for several antenna links from one thread
+ * @version 0.1
+ * @date 2022-04-18
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_engine.h"
+
+// Standard C libraries
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+
+static uint64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t deadline(int timeout_ms) {
+  return (timeout_ms < 0) ? 0 : now_ms() + timeout_ms;
+}
+
+// Interrupts epoll_wait() so the engine picks up new state
+static void engine_wake(struct antenna_engine *e) {
+  uint64_t one = 1;
+  if (e != NULL && write(e->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    printf("[!] Failed to wake antenna engine\n");
+}
+
+/**
+ * @brief Generates a new handle at memory location h. Must be allocated
+ * memory or undefined behavior will occur. The handle owns a session which
+ * may be configured with the antenna_session_set_* calls before the handle is
+ * added to an engine. Framing must stay ANTENNA_FRAMING_ASM.
+ *
+ * @param h Pointer to allocated handle which will be initialized.
+ * @param fd File descriptor of the link. Not closed by the handle.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_handle_new(struct antenna_handle *h, int fd) {
+  // Check for NULL pointers
+  if (h == NULL) {
+    printf("[!] Cannot initialize null antenna handle\n");
+    return -1;
+  }
+
+  memset(h, 0, sizeof(struct antenna_handle));
+  h->fd = fd;
+  h->rx_timeout = -1;
+  h->tx_timeout = -1;
+
+  if (antenna_session_new(&h->session, fd) < 0) return -1;
+
+  h->tx_queue = malloc(ANTENNA_HANDLE_TX_QUEUE_LEN);
+  h->rx_queue = malloc(ANTENNA_HANDLE_RX_QUEUE_LEN * ANTENNA_HANDLE_FRAME_LEN);
+  if (h->tx_queue == NULL || h->rx_queue == NULL) {
+    printf("[!] Failed to allocate antenna handle queues\n");
+    goto error;
+  }
+
+  if (pthread_mutex_init(&h->lock, NULL) != 0) {
+    printf("[!] Failed to create antenna handle lock\n");
+    goto error;
+  }
+
+  // done
+  return 0;
+
+error:
+  free(h->tx_queue);
+  free(h->rx_queue);
+  antenna_session_destroy(&h->session);
+  return -1;
+}
+
+/**
+ * @brief Releases the handle. It must have been removed from its engine.
+ *
+ * @param h Handle to tear down.
+ */
+void antenna_handle_destroy(struct antenna_handle *h) {
+  if (h == NULL) return;
+  pthread_mutex_destroy(&h->lock);
+  free(h->tx_queue);
+  free(h->rx_queue);
+  antenna_session_destroy(&h->session);
+  h->tx_queue = NULL;
+  h->rx_queue = NULL;
+}
+
+/**
+ * @brief Sets the callbacks of a handle.
+ *
+ * @param h Handle to configure.
+ * @param on_frame Frame callback, or NULL to queue frames for
+ * antenna_handle_recv().
+ * @param on_timeout Timeout callback, or NULL.
+ * @param user Passed to both callbacks.
+ */
+void antenna_handle_set_callbacks(struct antenna_handle *h,
+                                  antenna_frame_cb on_frame,
+                                  antenna_timeout_cb on_timeout, void *user) {
+  pthread_mutex_lock(&h->lock);
+  h->on_frame = on_frame;
+  h->on_timeout = on_timeout;
+  h->user = user;
+  pthread_mutex_unlock(&h->lock);
+}
+
+/**
+ * @brief Sets the RX and TX timeouts of a handle.
+ *
+ * @param h Handle to configure.
+ * @param rx_timeout_ms Longest gap between frames, or < 0 for none.
+ * @param tx_timeout_ms Longest stall of a non-empty TX queue, or < 0 for none.
+ */
+void antenna_handle_set_timeouts(struct antenna_handle *h, int rx_timeout_ms,
+                                 int tx_timeout_ms) {
+  pthread_mutex_lock(&h->lock);
+  h->rx_timeout = rx_timeout_ms;
+  h->tx_timeout = tx_timeout_ms;
+  h->rx_deadline = deadline(rx_timeout_ms);
+  h->tx_deadline = (h->tx_start < h->tx_end) ? deadline(tx_timeout_ms) : 0;
+  pthread_mutex_unlock(&h->lock);
+
+  engine_wake(h->engine);
+}
+
+// Writes queued bytes until the queue is empty or the fd would block. Callers
+// hold h->lock.
+static int handle_flush(struct antenna_handle *h) {
+  size_t bytes_queued = h->tx_end - h->tx_start;
+  while (h->tx_start < h->tx_end) {
+    ssize_t bytes_written =
+        write(h->fd, &h->tx_queue[h->tx_start], h->tx_end - h->tx_start);
+    if (bytes_written < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      printf("[!] Failed to write to fd %d: %s\n", h->fd, strerror(errno));
+      return -1;
+    }
+    h->tx_start += bytes_written;
+    h->bytes_sent += bytes_written;
+  }
+
+  // Any progress restarts the stall timer
+  if (h->tx_start == h->tx_end) {
+    h->tx_start = h->tx_end = 0;
+    h->tx_deadline = 0;
+  } else if (h->tx_end - h->tx_start < bytes_queued) {
+    h->tx_deadline = deadline(h->tx_timeout);
+  }
+  return 0;
+}
+
+/**
+ * @brief Encodes bytes and queues them for the engine to send. Safe to call
+ * from any thread. Never blocks on the fd.
+ *
+ * @param h Handle to send on.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @return 0 on success, -1 on error or if the TX queue is full.
+ */
+int antenna_handle_send(struct antenna_handle *h, const char *data,
+                        size_t data_len) {
+  // Return status
+  int status = 0;
+  int armed = 0;
+
+  pthread_mutex_lock(&h->lock);
+
+  // Make room at the back of the queue
+  if (h->tx_start > 0) {
+    memmove(h->tx_queue, &h->tx_queue[h->tx_start], h->tx_end - h->tx_start);
+    h->tx_end -= h->tx_start;
+    h->tx_start = 0;
+  }
+
+  // Only queue whole messages
+  size_t frame_data_len = h->session.interleave * RS_DATA_LEN;
+  size_t frames = (data_len + frame_data_len - 1) / frame_data_len;
+  if (frames * ANTENNA_FRAME_MAX_LEN > ANTENNA_HANDLE_TX_QUEUE_LEN - h->tx_end) {
+    printf("[!] TX queue of fd %d is full\n", h->fd);
+    status = -1;
+    goto cleanup;
+  }
+
+  int was_empty = (h->tx_end == 0);
+  for (size_t bytes_encoded = 0; bytes_encoded < data_len;) {
+    size_t bytes_remaining = data_len - bytes_encoded;
+    size_t bytes_to_encode =
+        (bytes_remaining > frame_data_len) ? frame_data_len : bytes_remaining;
+    ssize_t frame_len = antenna_session_encode_frame(
+        &h->session, &data[bytes_encoded], bytes_to_encode,
+        &h->tx_queue[h->tx_end]);
+    if (frame_len < 0) {
+      status = -1;
+      goto cleanup;
+    }
+    h->tx_end += frame_len;
+    bytes_encoded += bytes_to_encode;
+  }
+  if (was_empty) h->tx_deadline = deadline(h->tx_timeout);
+  armed = was_empty && h->tx_deadline != 0;
+
+  // Send what the fd takes now, the engine sends the rest once it is writable
+  status = handle_flush(h);
+
+cleanup:
+  pthread_mutex_unlock(&h->lock);
+
+  // A newly armed TX timeout has to shorten the engine's wait
+  if (armed) engine_wake(h->engine);
+
+  // done
+  return status;
+}
+
+/**
+ * @brief Pops the oldest queued frame of a handle without a frame callback.
+ * Safe to call from any thread. Never blocks.
+ *
+ * @param h Handle to read from.
+ * @param buffer Output buffer array for the frame.
+ * @param read_len Size of buffer. Longer frames are truncated.
+ * @return number of bytes read, 0 if no frame is queued.
+ */
+int antenna_handle_recv(struct antenna_handle *h, char *buffer,
+                        size_t read_len) {
+  int bytes_read = 0;
+
+  pthread_mutex_lock(&h->lock);
+  if (h->rx_count > 0) {
+    size_t len = h->rx_queue_len[h->rx_head];
+    bytes_read = (len > read_len) ? read_len : len;
+    memcpy(buffer, h->rx_queue[h->rx_head], bytes_read);
+    h->rx_head = (h->rx_head + 1) % ANTENNA_HANDLE_RX_QUEUE_LEN;
+    h->rx_count--;
+  }
+  pthread_mutex_unlock(&h->lock);
+
+  return bytes_read;
+}
+
+// Hands a decoded frame to the callback or the RX queue
+static void handle_deliver(struct antenna_handle *h, const char *data,
+                           size_t len) {
+  pthread_mutex_lock(&h->lock);
+  h->frames_received++;
+  h->rx_deadline = deadline(h->rx_timeout);
+  antenna_frame_cb on_frame = h->on_frame;
+  void *user = h->user;
+  if (on_frame == NULL) {
+    if (h->rx_count == ANTENNA_HANDLE_RX_QUEUE_LEN) {
+      h->frames_dropped++;
+    } else {
+      size_t tail = (h->rx_head + h->rx_count) % ANTENNA_HANDLE_RX_QUEUE_LEN;
+      memcpy(h->rx_queue[tail], data, len);
+      h->rx_queue_len[tail] = len;
+      h->rx_count++;
+    }
+  }
+  pthread_mutex_unlock(&h->lock);
+
+  if (on_frame != NULL) on_frame(h, data, len, user);
+}
+
+// Reads everything the fd has and decodes the frames in it. Returns 0, or -1
+// once the link is closed or broken.
+static int handle_read(struct antenna_handle *h) {
+  struct antenna_deframer *d = h->session.rx_deframer;
+  char decoded[ANTENNA_HANDLE_FRAME_LEN];
+  for (;;) {
+    // Make room, then read straight into the deframer
+    size_t space;
+    uint8_t *free_space = antenna_deframer_space(d, &space);
+    ssize_t bytes_read = read(h->fd, free_space, space);
+    if (bytes_read < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      printf("[!] Failed to read from fd %d: %s\n", h->fd, strerror(errno));
+      return -1;
+    }
+    if (bytes_read == 0) return -1;
+    antenna_deframer_commit(d, bytes_read);
+
+    struct antenna_packet p;
+    while (antenna_deframer_next(d, &p)) {
+      ssize_t decoded_len = antenna_session_decode_frame(&h->session, &p, decoded);
+      if (decoded_len < 0) {
+        pthread_mutex_lock(&h->lock);
+        h->frames_failed++;
+        pthread_mutex_unlock(&h->lock);
+        continue;
+      }
+      handle_deliver(h, decoded, decoded_len);
+    }
+  }
+}
+
+// Fires due timeouts and returns the milliseconds until the next one, or -1
+// if none is armed. Callers hold e->lock.
+static int engine_timeouts(struct antenna_engine *e) {
+  uint64_t now = now_ms();
+  uint64_t next = 0;
+  for (size_t x = 0; x < e->handle_count; x++) {
+    struct antenna_handle *h = e->handles[x];
+    int direction = -1;
+
+    pthread_mutex_lock(&h->lock);
+    if (h->tx_deadline != 0 && now >= h->tx_deadline) {
+      // The radio is stuck, drop what it would not take
+      h->tx_start = h->tx_end = 0;
+      h->tx_deadline = 0;
+      direction = ANTENNA_TIMEOUT_TX;
+    } else if (h->rx_deadline != 0 && now >= h->rx_deadline) {
+      h->rx_deadline = deadline(h->rx_timeout);
+      direction = ANTENNA_TIMEOUT_RX;
+    }
+    if (direction >= 0) h->timeouts++;
+    antenna_timeout_cb on_timeout = h->on_timeout;
+    void *user = h->user;
+    if (h->tx_deadline != 0 && (next == 0 || h->tx_deadline < next))
+      next = h->tx_deadline;
+    if (h->rx_deadline != 0 && (next == 0 || h->rx_deadline < next))
+      next = h->rx_deadline;
+    pthread_mutex_unlock(&h->lock);
+
+    if (direction >= 0 && on_timeout != NULL) on_timeout(h, direction, user);
+  }
+
+  if (next == 0) return -1;
+  return (next > now) ? next - now : 0;
+}
+
+/**
+ * @brief Generates a new engine at memory location e. Must be allocated
+ * memory or undefined behavior will occur.
+ *
+ * @param e Pointer to allocated engine which will be initialized.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_new(struct antenna_engine *e) {
+  // Check for NULL pointers
+  if (e == NULL) {
+    printf("[!] Cannot initialize null antenna engine\n");
+    return -1;
+  }
+
+  memset(e, 0, sizeof(struct antenna_engine));
+  e->running = 1;
+  e->epfd = epoll_create1(EPOLL_CLOEXEC);
+  e->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (e->epfd < 0 || e->wakefd < 0) {
+    printf("[!] Failed to create antenna engine: %s\n", strerror(errno));
+    goto error;
+  }
+
+  // The wake fd is the only event without a handle
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+  if (epoll_ctl(e->epfd, EPOLL_CTL_ADD, e->wakefd, &ev) < 0) {
+    printf("[!] Failed to register antenna engine wake fd\n");
+    goto error;
+  }
+
+  if (pthread_mutex_init(&e->lock, NULL) != 0) {
+    printf("[!] Failed to create antenna engine lock\n");
+    goto error;
+  }
+
+  // done
+  return 0;
+
+error:
+  if (e->epfd >= 0) close(e->epfd);
+  if (e->wakefd >= 0) close(e->wakefd);
+  return -1;
+}
+
+/**
+ * @brief Releases the engine. Handles still added are removed, not destroyed.
+ *
+ * @param e Engine to tear down.
+ */
+void antenna_engine_destroy(struct antenna_engine *e) {
+  if (e == NULL) return;
+  while (e->handle_count > 0) antenna_engine_remove(e, e->handles[0]);
+  pthread_mutex_destroy(&e->lock);
+  close(e->epfd);
+  close(e->wakefd);
+}
+
+/**
+ * @brief Starts driving a handle.
+ *
+ * @param e Engine to use.
+ * @param h Handle to add.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_add(struct antenna_engine *e, struct antenna_handle *h) {
+  if (h->session.framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] Antenna engine requires framed sessions\n");
+    return -1;
+  }
+
+  // Return status
+  int status = 0;
+
+  pthread_mutex_lock(&e->lock);
+
+  if (e->handle_count == ANTENNA_ENGINE_MAX_HANDLES || h->engine != NULL) {
+    printf("[!] Cannot add fd %d to antenna engine\n", h->fd);
+    status = -1;
+    goto cleanup;
+  }
+
+  // Nothing may block the loop
+  int flags = fcntl(h->fd, F_GETFL);
+  if (flags < 0 || fcntl(h->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    printf("[!] Failed to make fd %d non-blocking\n", h->fd);
+    status = -1;
+    goto cleanup;
+  }
+
+  // Edge triggered, so the fd is only reported again once it has been drained
+  struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT | EPOLLET,
+                           .data.ptr = h};
+  if (epoll_ctl(e->epfd, EPOLL_CTL_ADD, h->fd, &ev) < 0) {
+    printf("[!] Failed to register fd %d: %s\n", h->fd, strerror(errno));
+    status = -1;
+    goto cleanup;
+  }
+
+  pthread_mutex_lock(&h->lock);
+  h->engine = e;
+  h->rx_deadline = deadline(h->rx_timeout);
+  pthread_mutex_unlock(&h->lock);
+  e->handles[e->handle_count++] = h;
+
+cleanup:
+  pthread_mutex_unlock(&e->lock);
+
+  if (status == 0) engine_wake(e);
+  return status;
+}
+
+/**
+ * @brief Stops driving a handle. Queued TX data stays queued.
+ *
+ * @param e Engine to use.
+ * @param h Handle to remove.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_remove(struct antenna_engine *e, struct antenna_handle *h) {
+  // Return status
+  int status = -1;
+
+  pthread_mutex_lock(&e->lock);
+  for (size_t x = 0; x < e->handle_count; x++) {
+    if (e->handles[x] != h) continue;
+
+    epoll_ctl(e->epfd, EPOLL_CTL_DEL, h->fd, NULL);
+    e->handles[x] = e->handles[--e->handle_count];
+    pthread_mutex_lock(&h->lock);
+    h->engine = NULL;
+    pthread_mutex_unlock(&h->lock);
+    status = 0;
+    break;
+  }
+  pthread_mutex_unlock(&e->lock);
+
+  if (status < 0) printf("[!] fd %d is not in the antenna engine\n", h->fd);
+  return status;
+}
+
+/**
+ * @brief Waits for activity on any handle and services it: reads and decodes
+ * incoming frames, writes queued frames and fires due timeouts.
+ *
+ * @param e Engine to use.
+ * @param timeout_ms Longest wait, or < 0 to wait until something happens.
+ * @return number of events serviced or -1 on error.
+ */
+int antenna_engine_run_once(struct antenna_engine *e, int timeout_ms) {
+  // Never sleep past the next handle timeout
+  pthread_mutex_lock(&e->lock);
+  int next_timeout = engine_timeouts(e);
+  pthread_mutex_unlock(&e->lock);
+  if (next_timeout >= 0 && (timeout_ms < 0 || next_timeout < timeout_ms))
+    timeout_ms = next_timeout;
+
+  struct epoll_event events[ANTENNA_ENGINE_MAX_EVENTS];
+  int event_count =
+      epoll_wait(e->epfd, events, ANTENNA_ENGINE_MAX_EVENTS, timeout_ms);
+  if (event_count < 0) {
+    if (errno == EINTR) return 0;
+    printf("[!] Failed to wait for antenna events: %s\n", strerror(errno));
+    return -1;
+  }
+
+  pthread_mutex_lock(&e->lock);
+  for (int x = 0; x < event_count; x++) {
+    struct antenna_handle *h = events[x].data.ptr;
+    if (h == NULL) {
+      uint64_t count;
+      while (read(e->wakefd, &count, sizeof(count)) > 0) continue;
+      continue;
+    }
+
+    // Skip events for handles removed since epoll_wait() returned
+    size_t y = 0;
+    while (y < e->handle_count && e->handles[y] != h) y++;
+    if (y == e->handle_count) continue;
+
+    if (events[x].events & EPOLLOUT) {
+      pthread_mutex_lock(&h->lock);
+      int flushed = handle_flush(h);
+      pthread_mutex_unlock(&h->lock);
+      if (flushed < 0) goto closed;
+    }
+    if ((events[x].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+        handle_read(h) < 0)
+      goto closed;
+    continue;
+
+  closed:
+    // Stop watching a dead link so it cannot spin the loop
+    printf("[i] Antenna link on fd %d closed\n", h->fd);
+    epoll_ctl(e->epfd, EPOLL_CTL_DEL, h->fd, NULL);
+    e->handles[y] = e->handles[--e->handle_count];
+    pthread_mutex_lock(&h->lock);
+    h->engine = NULL;
+    pthread_mutex_unlock(&h->lock);
+  }
+  engine_timeouts(e);
+  pthread_mutex_unlock(&e->lock);
+
+  // done
+  return event_count;
+}
+
+/**
+ * @brief Runs the engine until antenna_engine_stop() is called. Callbacks run
+ * on this thread and must not add or remove handles.
+ *
+ * @param e Engine to use.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_engine_run(struct antenna_engine *e) {
+  while (__atomic_load_n(&e->running, __ATOMIC_ACQUIRE))
+    if (antenna_engine_run_once(e, -1) < 0) return -1;
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Makes antenna_engine_run() return. Safe to call from any thread.
+ *
+ * @param e Engine to stop.
+ */
+void antenna_engine_stop(struct antenna_engine *e) {
+  __atomic_store_n(&e->running, 0, __ATOMIC_RELEASE);
+  engine_wake(e);
+}
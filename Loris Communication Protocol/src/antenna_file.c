@@ -0,0 +1,681 @@
+/**
+ * @file antenna_file.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Resumable file transfer over an antenna session
+ * @version 0.1
+ * @date 2022-04-14
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_file.h"
+
+// Standard C libraries
+#include <sys/mman.h>
+
+// Receiver state for the file being stored
+struct file_rx {
+  int fd;
+  uint32_t file_id;
+  struct antenna_file_sidecar *part;
+  size_t part_len;
+  uint32_t first_missing;
+};
+
+// Where the receiver's frames come from: the session read path on fd, or a
+// pipeline decoding them on its own threads
+struct file_source {
+  struct antenna_session *s;
+  int fd;
+  struct antenna_pipeline *pipeline;
+};
+
+// CRC-32 of every nibble value, for the table driven loop below
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+    0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+static void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static uint16_t get_u16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+static uint32_t get_u32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief Computes the CRC-32 (poly 0xEDB88320 reflected, init 0xFFFFFFFF) of a
+ * buffer.
+ *
+ * @param data Bytes to checksum.
+ * @param len Number of bytes in data.
+ * @return the CRC.
+ */
+uint32_t antenna_file_crc32(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t x = 0; x < len; x++) {
+    crc ^= data[x];
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+// Clears a slot and writes the message header. Returns the body.
+static uint8_t *file_msg_start(uint8_t *msg, uint8_t type, uint32_t file_id) {
+  memset(msg, 0, FILE_MSG_LEN);
+  msg[0] = type;
+  put_u32(&msg[1], file_id);
+  return &msg[FILE_MSG_HEADER_LEN];
+}
+
+static void file_msg_seal(uint8_t *msg) {
+  put_u32(&msg[FILE_MSG_LEN - FILE_MSG_CRC_LEN],
+          antenna_file_crc32(msg, FILE_MSG_LEN - FILE_MSG_CRC_LEN));
+}
+
+static int file_msg_valid(const uint8_t *msg) {
+  return get_u32(&msg[FILE_MSG_LEN - FILE_MSG_CRC_LEN]) ==
+         antenna_file_crc32(msg, FILE_MSG_LEN - FILE_MSG_CRC_LEN);
+}
+
+// Sends the slots queued in batch as one session write
+static int file_flush(struct antenna_session *s, int fd, uint8_t *batch,
+                      size_t *slots) {
+  if (*slots == 0) return 0;
+  size_t len = *slots * FILE_MSG_LEN;
+  *slots = 0;
+  return antenna_session_write_rs_fd(s, fd, (const char *)batch, len);
+}
+
+// Reads one frame and returns the last NACK or DONE for file_id in it, or
+// NULL if none arrived.
+static const uint8_t *file_reply(struct antenna_session *s, int fd,
+                                 uint8_t *buffer, size_t buffer_len,
+                                 uint32_t file_id) {
+  int bytes_read =
+      antenna_session_read_rs_fd(s, fd, (char *)buffer, buffer_len,
+                                 READ_MODE_UPTO);
+  const uint8_t *reply = NULL;
+  for (int x = 0; x + FILE_MSG_LEN <= bytes_read; x += FILE_MSG_LEN) {
+    const uint8_t *msg = &buffer[x];
+    if (!file_msg_valid(msg) || get_u32(&msg[1]) != file_id) continue;
+    if (msg[0] == FILE_MSG_NACK || msg[0] == FILE_MSG_DONE) reply = msg;
+  }
+  return reply;
+}
+
+// Fills out with the compressed chunk starting at offset, which takes as much
+// of the file as compresses into FILE_ZCHUNK_LEN bytes, or FILE_ZCHUNK_LEN
+// bytes as they are if that is more. Sets *len to the bytes of the file it
+// covers and returns the stored length. The same offset always gives the same
+// chunk, so chunks are split once and compressed again whenever sent.
+static uint16_t file_zchunk(struct antenna_lz *z, const uint8_t *data,
+                            uint32_t file_size, uint32_t offset, uint8_t *out,
+                            uint16_t *len) {
+  size_t remaining = file_size - offset;
+  size_t consumed = 0;
+  size_t stored = antenna_lz_compress(z, &data[offset], remaining, &consumed,
+                                      out, FILE_ZCHUNK_LEN);
+  if (consumed > FILE_ZCHUNK_LEN) {
+    *len = consumed;
+    return stored;
+  }
+
+  *len = (remaining < FILE_ZCHUNK_LEN) ? remaining : FILE_ZCHUNK_LEN;
+  memcpy(out, &data[offset], *len);
+  return *len;
+}
+
+/**
+ * @brief Sends a file over the session. Framing must be enabled. Returns
+ * once the receiver has every chunk, or after FILE_MAX_TIMEOUTS polls in a
+ * row go unanswered. Calling it again later resumes the transfer. If the
+ * session compresses, the file is sent compressed chunk by chunk, and frame
+ * compression is paused for the transfer.
+ *
+ * @param s Session to use.
+ * @param rx_fd File descriptor replies are read from.
+ * @param tx_fd File descriptor chunks are written to.
+ * @param file_path Path to file to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_file_send(struct antenna_session *s, int rx_fd, int tx_fd,
+                      const char *file_path) {
+  if (s->framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] File transfer requires a framed session\n");
+    return -1;
+  }
+
+  // Open the file
+  int fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    printf("[!] Failed to open file to send\n");
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (uint64_t)st.st_size > UINT32_MAX) {
+    printf("[!] Cannot send file %s\n", file_path);
+    close(fd);
+    return -1;
+  }
+  uint32_t file_size = st.st_size;
+
+  // Map it so retransmissions can pick chunks from anywhere
+  const uint8_t *data = NULL;
+  if (file_size > 0 &&
+      (data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+          MAP_FAILED) {
+    printf("[!] Failed to map file to send\n");
+    close(fd);
+    return -1;
+  }
+  uint32_t file_id = antenna_file_crc32(data, file_size);
+  uint32_t chunk_count = (file_size + FILE_CHUNK_LEN - 1) / FILE_CHUNK_LEN;
+
+  // Return status
+  int status = -1;
+
+  int timeout = s->rx_timeout;
+  antenna_session_set_timeout(s, FILE_TIMEOUT_MS);
+
+  // Messages must line up with slots, which compressed frames do not keep
+  int compress = s->tx_compress;
+  antenna_session_set_compression(s, 0);
+
+  // Split a compressed file where each chunk's compression leaves off. Every
+  // chunk covers at least FILE_ZCHUNK_LEN bytes, which bounds the count.
+  struct antenna_lz *lz = NULL;
+  uint32_t *offsets = NULL;
+  int zchunks = compress;
+  if (zchunks) {
+    lz = malloc(sizeof(struct antenna_lz));
+    offsets = malloc(((file_size + FILE_ZCHUNK_LEN - 1) / FILE_ZCHUNK_LEN + 1) *
+                     sizeof(uint32_t));
+    if (lz == NULL || offsets == NULL) {
+      printf("[!] Failed to allocate compression state\n");
+      goto cleanup;
+    }
+
+    uint8_t scratch[FILE_ZCHUNK_LEN];
+    chunk_count = 0;
+    for (uint32_t offset = 0; offset < file_size;) {
+      uint16_t len;
+      file_zchunk(lz, data, file_size, offset, scratch, &len);
+      offsets[chunk_count++] = offset;
+      offset += len;
+    }
+    offsets[chunk_count] = file_size;
+
+    // Send it as it is if that takes no more chunks
+    uint32_t plain_count = (file_size + FILE_CHUNK_LEN - 1) / FILE_CHUNK_LEN;
+    if (chunk_count < plain_count) {
+      printf("[i] Sending %s compressed, %u chunks instead of %u\n", file_path,
+             chunk_count, plain_count);
+    } else {
+      chunk_count = plain_count;
+      zchunks = 0;
+    }
+  }
+
+  uint8_t batch[FILE_TX_BATCH * FILE_MSG_LEN];
+  uint8_t buffer[ANTENNA_MAX_INTERLEAVE * FILE_MSG_LEN];
+  size_t slots = 0;
+  int offer = 1;
+  int timeouts = 0;
+  for (;;) {
+    // (Re)introduce the file when the receiver may not know it yet
+    if (offer) {
+      uint8_t *body = file_msg_start(&batch[slots * FILE_MSG_LEN],
+                                     FILE_MSG_OFFER, file_id);
+      put_u32(&body[0], file_size);
+      put_u32(&body[4], chunk_count);
+      put_u16(&body[8], zchunks ? 0 : FILE_CHUNK_LEN);
+      body[10] = zchunks ? FILE_OFFER_COMPRESSED : 0;
+      file_msg_seal(&batch[slots++ * FILE_MSG_LEN]);
+    }
+
+    // Every burst ends with a poll for the receiver's bitmap
+    file_msg_start(&batch[slots * FILE_MSG_LEN], FILE_MSG_POLL, file_id);
+    file_msg_seal(&batch[slots++ * FILE_MSG_LEN]);
+    if (file_flush(s, tx_fd, batch, &slots) < 0) {
+      printf("[!] Failed to write file data to antenna\n");
+      goto cleanup;
+    }
+
+    const uint8_t *reply =
+        file_reply(s, rx_fd, buffer, sizeof(buffer), file_id);
+    if (reply == NULL) {
+      if (++timeouts >= FILE_MAX_TIMEOUTS) {
+        printf("[!] No reply from receiver, stopping transfer of %s\n",
+               file_path);
+        goto cleanup;
+      }
+      offer = 1;
+      continue;
+    }
+    timeouts = 0;
+    offer = 0;
+
+    if (reply[0] == FILE_MSG_DONE) {
+      status = 0;
+      goto cleanup;
+    }
+
+    // Resend every chunk the NACK lists as missing
+    const uint8_t *nack = &reply[FILE_MSG_HEADER_LEN];
+    uint32_t base = get_u32(&nack[0]);
+    uint32_t bits = get_u16(&nack[4]);
+    if (bits > FILE_NACK_BITS || base > chunk_count ||
+        bits > chunk_count - base) {
+      printf("[!] Ignoring invalid NACK for %s\n", file_path);
+      continue;
+    }
+    for (uint32_t x = 0; x < bits; x++) {
+      if (!(nack[6 + x / 8] & (0x80 >> (x % 8)))) continue;
+
+      uint32_t index = base + x;
+      if (zchunks) {
+        uint16_t len;
+        uint8_t *body = file_msg_start(&batch[slots * FILE_MSG_LEN],
+                                       FILE_MSG_ZCHUNK, file_id);
+        uint16_t stored = file_zchunk(lz, data, file_size, offsets[index],
+                                      &body[12], &len);
+        put_u32(&body[0], index);
+        put_u32(&body[4], offsets[index]);
+        put_u16(&body[8], len);
+        put_u16(&body[10], stored);
+      } else {
+        uint32_t offset = index * FILE_CHUNK_LEN;
+        uint16_t len = (file_size - offset < FILE_CHUNK_LEN)
+                           ? file_size - offset
+                           : FILE_CHUNK_LEN;
+        uint8_t *body = file_msg_start(&batch[slots * FILE_MSG_LEN],
+                                       FILE_MSG_CHUNK, file_id);
+        put_u32(&body[0], index);
+        put_u16(&body[4], len);
+        memcpy(&body[6], &data[offset], len);
+      }
+      file_msg_seal(&batch[slots++ * FILE_MSG_LEN]);
+
+      // Leave room for the offer and poll at the end of the burst
+      if (slots == FILE_TX_BATCH - 2 && file_flush(s, tx_fd, batch, &slots) < 0) {
+        printf("[!] Failed to write file data to antenna\n");
+        goto cleanup;
+      }
+    }
+  }
+
+cleanup:
+  antenna_session_set_timeout(s, timeout);
+  antenna_session_set_compression(s, compress);
+  free(lz);
+  free(offsets);
+  if (data != NULL) munmap((void *)data, file_size);
+  close(fd);
+
+  // done
+  return status;
+}
+
+// Number of data bytes carried by a chunk
+static uint32_t file_rx_chunk_len(struct file_rx *rx, uint32_t index) {
+  uint32_t offset = index * rx->part->chunk_len;
+  return (rx->part->file_size - offset < rx->part->chunk_len)
+             ? rx->part->file_size - offset
+             : rx->part->chunk_len;
+}
+
+static int file_rx_has(struct file_rx *rx, uint32_t index) {
+  return rx->part->bitmap[index / 8] & (0x80 >> (index % 8));
+}
+
+// Flushes the output file, then the bitmap which vouches for it
+static void file_rx_sync(struct file_rx *rx) {
+  fdatasync(rx->fd);
+  msync(rx->part, rx->part_len, MS_SYNC);
+}
+
+static void file_rx_close(struct file_rx *rx, const char *file_path) {
+  if (rx->part == NULL) return;
+
+  file_rx_sync(rx);
+  int complete = rx->part->chunks_received == rx->part->chunk_count;
+  munmap(rx->part, rx->part_len);
+  close(rx->fd);
+  rx->part = NULL;
+  rx->fd = -1;
+
+  // A finished file needs no sidecar
+  if (complete) {
+    char part_path[PATH_MAX];
+    snprintf(part_path, sizeof(part_path), "%s" FILE_SIDECAR_SUFFIX,
+             file_path);
+    unlink(part_path);
+  }
+}
+
+// Opens the output file and its sidecar for an offer, resuming an earlier
+// transfer of the same file if the sidecar matches
+static int file_rx_open(struct file_rx *rx, const char *file_path,
+                        uint32_t file_id, const uint8_t *offer) {
+  uint32_t file_size = get_u32(&offer[0]);
+  uint32_t chunk_count = get_u32(&offer[4]);
+  uint32_t chunk_len = get_u16(&offer[8]);
+  int valid;
+  if (offer[10] & FILE_OFFER_COMPRESSED) {
+    // Chunks vary in length, between FILE_ZCHUNK_LEN and a whole block
+    valid = chunk_len == 0 &&
+            chunk_count <= (file_size + FILE_ZCHUNK_LEN - 1) / FILE_ZCHUNK_LEN &&
+            chunk_count >= (file_size + (uint64_t)ANTENNA_LZ_BLOCK_LEN - 1) /
+                               ANTENNA_LZ_BLOCK_LEN;
+  } else {
+    valid = chunk_len > 0 && chunk_len <= FILE_CHUNK_LEN &&
+            chunk_count == (file_size + (uint64_t)chunk_len - 1) / chunk_len;
+  }
+  if (!valid) {
+    printf("[!] Ignoring invalid file offer\n");
+    return -1;
+  }
+
+  char part_path[PATH_MAX];
+  snprintf(part_path, sizeof(part_path), "%s" FILE_SIDECAR_SUFFIX, file_path);
+  int part_fd = open(part_path, O_RDWR | O_CREAT, 0644);
+  if (part_fd < 0) {
+    printf("[!] Failed to open sidecar %s\n", part_path);
+    return -1;
+  }
+  int fd = open(file_path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    printf("[!] Failed to open file placeholder for incoming file\n");
+    close(part_fd);
+    return -1;
+  }
+
+  size_t part_len = sizeof(struct antenna_file_sidecar) + (chunk_count + 7) / 8;
+  struct stat part_st, st;
+  if (fstat(part_fd, &part_st) < 0 || fstat(fd, &st) < 0) {
+    printf("[!] Failed to stat incoming file\n");
+    goto error;
+  }
+
+  struct antenna_file_sidecar *part = NULL;
+  if ((size_t)part_st.st_size == part_len) {
+    part = mmap(NULL, part_len, PROT_READ | PROT_WRITE, MAP_SHARED, part_fd, 0);
+    if (part == MAP_FAILED) {
+      printf("[!] Failed to map sidecar %s\n", part_path);
+      goto error;
+    }
+    if (part->magic == FILE_SIDECAR_MAGIC && part->file_id == file_id &&
+        part->file_size == file_size && part->chunk_count == chunk_count &&
+        part->chunk_len == chunk_len && st.st_size == file_size) {
+      printf("[i] Resuming %s with %u of %u chunks\n", file_path,
+             part->chunks_received, chunk_count);
+      goto done;
+    }
+    munmap(part, part_len);
+  }
+
+  // Start over. The file is sized first so an interrupted reset leaves an
+  // empty bitmap rather than one describing stale data.
+  if (ftruncate(fd, 0) < 0 || ftruncate(fd, file_size) < 0 ||
+      ftruncate(part_fd, 0) < 0 || ftruncate(part_fd, part_len) < 0) {
+    printf("[!] Failed to size incoming file\n");
+    goto error;
+  }
+  part = mmap(NULL, part_len, PROT_READ | PROT_WRITE, MAP_SHARED, part_fd, 0);
+  if (part == MAP_FAILED) {
+    printf("[!] Failed to map sidecar %s\n", part_path);
+    goto error;
+  }
+  part->file_id = file_id;
+  part->file_size = file_size;
+  part->chunk_count = chunk_count;
+  part->chunk_len = chunk_len;
+  part->chunks_received = 0;
+  part->magic = FILE_SIDECAR_MAGIC;
+  printf("[i] Receiving %s, %u bytes in %u chunks\n", file_path, file_size,
+         chunk_count);
+
+done:
+  close(part_fd);
+  rx->fd = fd;
+  rx->file_id = file_id;
+  rx->part = part;
+  rx->part_len = part_len;
+  rx->first_missing = 0;
+  return 0;
+
+error:
+  close(part_fd);
+  close(fd);
+  return -1;
+}
+
+// Writes a chunk's data to the file and marks it received
+static void file_rx_store(struct file_rx *rx, uint32_t index, off_t offset,
+                          const uint8_t *data, uint32_t len) {
+  if (pwrite(rx->fd, data, len, offset) != len) {
+    printf("[*] Could not write chunk %u to file. SKIPPING.\n", index);
+    return;
+  }
+
+  // Only mark the chunk once its data is in the file
+  rx->part->bitmap[index / 8] |= 0x80 >> (index % 8);
+  rx->part->chunks_received++;
+}
+
+// Stores a chunk unless it is a duplicate or malformed
+static void file_rx_chunk(struct file_rx *rx, const uint8_t *chunk) {
+  uint32_t index = get_u32(&chunk[0]);
+  uint32_t len = get_u16(&chunk[4]);
+  if (rx->part->chunk_len == 0 || index >= rx->part->chunk_count ||
+      len != file_rx_chunk_len(rx, index) || file_rx_has(rx, index))
+    return;
+
+  file_rx_store(rx, index, (off_t)index * rx->part->chunk_len, &chunk[6],
+                len);
+}
+
+// Expands and stores a compressed chunk unless it is a duplicate or malformed
+static void file_rx_zchunk(struct file_rx *rx, const uint8_t *chunk) {
+  uint32_t index = get_u32(&chunk[0]);
+  uint32_t offset = get_u32(&chunk[4]);
+  uint32_t len = get_u16(&chunk[8]);
+  uint32_t stored = get_u16(&chunk[10]);
+  if (rx->part->chunk_len != 0 || index >= rx->part->chunk_count || len == 0 ||
+      len > ANTENNA_LZ_BLOCK_LEN || stored > FILE_ZCHUNK_LEN ||
+      offset > rx->part->file_size || len > rx->part->file_size - offset ||
+      file_rx_has(rx, index))
+    return;
+
+  // Chunks that did not compress are stored as they are
+  uint8_t expanded[ANTENNA_LZ_BLOCK_LEN];
+  const uint8_t *data = &chunk[12];
+  if (stored != len) {
+    if (antenna_lz_decompress(data, stored, expanded, len) < 0) {
+      printf("[*] Could not expand chunk %u. SKIPPING.\n", index);
+      return;
+    }
+    data = expanded;
+  }
+
+  file_rx_store(rx, index, offset, data, len);
+}
+
+// Builds the answer to a poll: DONE, or a NACK for the first missing window
+static void file_rx_reply(struct file_rx *rx, uint8_t *msg) {
+  if (rx->part->chunks_received == rx->part->chunk_count) {
+    file_msg_start(msg, FILE_MSG_DONE, rx->file_id);
+    file_msg_seal(msg);
+    return;
+  }
+
+  while (rx->first_missing < rx->part->chunk_count &&
+         file_rx_has(rx, rx->first_missing))
+    rx->first_missing++;
+
+  uint32_t base = rx->first_missing;
+  uint32_t bits = rx->part->chunk_count - base;
+  if (bits > FILE_NACK_BITS) bits = FILE_NACK_BITS;
+
+  uint8_t *body = file_msg_start(msg, FILE_MSG_NACK, rx->file_id);
+  put_u32(&body[0], base);
+  put_u16(&body[4], bits);
+  for (uint32_t x = 0; x < bits; x++)
+    if (!file_rx_has(rx, base + x)) body[6 + x / 8] |= 0x80 >> (x % 8);
+  file_msg_seal(msg);
+}
+
+// Reads one frame's worth of messages. Returns as
+// antenna_session_read_rs_fd().
+static int file_source_read(struct file_source *src, uint8_t *buffer,
+                            size_t buffer_len, int timeout_ms) {
+  if (src->pipeline != NULL)
+    return antenna_pipeline_recv(src->pipeline, (char *)buffer, buffer_len,
+                                 timeout_ms);
+  antenna_session_set_timeout(src->s, timeout_ms);
+  return antenna_session_read_rs_fd(src->s, src->fd, (char *)buffer,
+                                    buffer_len, READ_MODE_UPTO);
+}
+
+static int file_receive(struct file_source *src, int tx_fd,
+                        const char *file_path) {
+  struct antenna_session *s = src->s;
+  if (s->framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] File transfer requires a framed session\n");
+    return -1;
+  }
+
+  // Wait as long as it takes for the offer
+  int timeout = s->rx_timeout;
+  int rx_timeout = -1;
+
+  // Replies must line up with slots, which compressed frames do not keep
+  int compress = s->tx_compress;
+  antenna_session_set_compression(s, 0);
+
+  struct file_rx rx = {.fd = -1, .part = NULL};
+  uint8_t buffer[ANTENNA_MAX_INTERLEAVE * FILE_MSG_LEN];
+  uint8_t reply[FILE_MSG_LEN];
+  int complete = 0;
+  int timeouts = 0;
+  int errors = 0;
+  for (;;) {
+    int bytes_read = file_source_read(src, buffer, sizeof(buffer), rx_timeout);
+    if (bytes_read < 0) {
+      // Undecodable frames are recovered by retransmission
+      if (++errors >= FILE_MAX_ERRORS) {
+        printf("[!] Too many bad frames, keeping partial %s\n", file_path);
+        break;
+      }
+      continue;
+    }
+    errors = 0;
+
+    if (bytes_read == 0) {
+      if (rx.part == NULL) break;
+
+      // Once the file is complete, silence means the sender saw DONE
+      if (complete && ++timeouts >= FILE_LINGER_TIMEOUTS) break;
+      if (!complete && ++timeouts >= FILE_MAX_TIMEOUTS) {
+        printf("[!] Sender went quiet, keeping partial %s\n", file_path);
+        break;
+      }
+      continue;
+    }
+    timeouts = 0;
+
+    for (int x = 0; x + FILE_MSG_LEN <= bytes_read; x += FILE_MSG_LEN) {
+      const uint8_t *msg = &buffer[x];
+      if (!file_msg_valid(msg)) continue;
+
+      uint32_t file_id = get_u32(&msg[1]);
+      const uint8_t *body = &msg[FILE_MSG_HEADER_LEN];
+      if (msg[0] == FILE_MSG_OFFER) {
+        if (rx.part != NULL && rx.file_id == file_id) continue;
+
+        // A new file ends the current one. A finished one has been
+        // acknowledged, so hand back and let the next call take the offer.
+        if (complete) goto cleanup;
+        file_rx_close(&rx, file_path);
+        if (file_rx_open(&rx, file_path, file_id, body) < 0) continue;
+        complete = rx.part->chunks_received == rx.part->chunk_count;
+        rx_timeout = FILE_TIMEOUT_MS;
+      } else if (rx.part == NULL || rx.file_id != file_id) {
+        continue;
+      } else if (msg[0] == FILE_MSG_CHUNK) {
+        file_rx_chunk(&rx, body);
+        complete = rx.part->chunks_received == rx.part->chunk_count;
+      } else if (msg[0] == FILE_MSG_ZCHUNK) {
+        file_rx_zchunk(&rx, body);
+        complete = rx.part->chunks_received == rx.part->chunk_count;
+      } else if (msg[0] == FILE_MSG_POLL) {
+        // Make what the reply reports durable before sending it
+        file_rx_sync(&rx);
+        file_rx_reply(&rx, reply);
+        if (antenna_session_write_rs_fd(s, tx_fd, (const char *)reply,
+                                        FILE_MSG_LEN) < 0) {
+          printf("[!] Failed to write reply to antenna\n");
+          goto cleanup;
+        }
+      }
+    }
+  }
+
+cleanup:
+  file_rx_close(&rx, file_path);
+  antenna_session_set_timeout(s, timeout);
+  antenna_session_set_compression(s, compress);
+
+  // done
+  return complete ? 0 : -1;
+}
+
+/**
+ * @brief Receives one file over the session. Framing must be enabled. Waits
+ * for an offer, then stores chunks until the file is complete. If the sender
+ * goes quiet for FILE_MAX_TIMEOUTS timeouts the sidecar is kept so the next
+ * call resumes the transfer.
+ *
+ * @param s Session to use.
+ * @param rx_fd File descriptor chunks are read from.
+ * @param tx_fd File descriptor replies are written to.
+ * @param file_path Path to incoming file destination.
+ * @return 0 on success, -1 on error
+ */
+int antenna_file_receive(struct antenna_session *s, int rx_fd, int tx_fd,
+                         const char *file_path) {
+  struct file_source src = {.s = s, .fd = rx_fd, .pipeline = NULL};
+  return file_receive(&src, tx_fd, file_path);
+}
+
+/**
+ * @brief Identical to antenna_file_receive(), but takes the incoming frames
+ * from a pipeline started on the receive fd without a callback, so the fd is
+ * drained while chunks are decoded and stored.
+ *
+ * @param p Pipeline to read from. Its session is used for the replies.
+ * @param tx_fd File descriptor replies are written to.
+ * @param file_path Path to incoming file destination.
+ * @return 0 on success, -1 on error
+ */
+int antenna_file_receive_pipeline(struct antenna_pipeline *p, int tx_fd,
+                                  const char *file_path) {
+  struct file_source src = {.s = p->session, .fd = p->fd, .pipeline = p};
+  return file_receive(&src, tx_fd, file_path);
+}
@@ -0,0 +1,615 @@
+/**
+ * @file antenna_fountain.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Fountain coded file broadcast over an antenna session
+ * @version 0.1
+ * @date 2022-04-29
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_fountain.h"
+
+// Standard C libraries
+#include <math.h>
+#include <sys/mman.h>
+
+// End of an edge list
+#define FOUNTAIN_NONE UINT32_MAX
+
+static void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static uint16_t get_u16(const uint8_t *p) { return (p[0] << 8) | p[1]; }
+
+static uint32_t get_u32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Generator state for a symbol, the same on both ends (splitmix64)
+static uint64_t fountain_seed(uint32_t file_id, uint32_t id) {
+  uint64_t z = (((uint64_t)file_id << 32) | id) + 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  return (z != 0) ? z : 1;
+}
+
+// xorshift64*
+static uint64_t fountain_next(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1Dull;
+}
+
+// Picks the degree distinct source symbols of a symbol into out
+static void fountain_neighbours(uint32_t file_id, uint32_t id, uint32_t degree,
+                                uint32_t k, uint32_t *out) {
+  uint64_t state = fountain_seed(file_id, id);
+  for (uint32_t x = 0; x < degree; x++) {
+    uint32_t n, y;
+    do {
+      n = ((fountain_next(&state) >> 32) * k) >> 32;
+      for (y = 0; y < x && out[y] != n; y++)
+        ;
+    } while (y < x);
+    out[x] = n;
+  }
+}
+
+// Robust soliton distribution for k source symbols, cut off at its spike and
+// renormalized. Fills cdf[1..max] and returns max.
+static uint32_t fountain_cdf(uint32_t k, double *cdf) {
+  double r = FOUNTAIN_SOLITON_C * log(k / FOUNTAIN_SOLITON_DELTA) * sqrt(k);
+  if (r < 1) r = 1;
+  uint32_t spike = k / r;
+  if (spike < 1) spike = 1;
+  if (spike > FOUNTAIN_MAX_DEGREE) spike = FOUNTAIN_MAX_DEGREE;
+  if (spike > k) spike = k;
+
+  double total = 0;
+  cdf[0] = 0;
+  for (uint32_t d = 1; d <= spike; d++) {
+    double rho = (d == 1) ? 1.0 / k : 1.0 / (d * (d - 1.0));
+    double tau = (d < spike) ? r / ((double)d * k)
+                             : r * log(r / FOUNTAIN_SOLITON_DELTA) / k;
+    total += rho + tau;
+    cdf[d] = total;
+  }
+  for (uint32_t d = 1; d <= spike; d++) cdf[d] /= total;
+  return spike;
+}
+
+// Draws the degree of a symbol
+static uint32_t fountain_degree(uint32_t file_id, uint32_t id,
+                                const double *cdf, uint32_t max) {
+  uint64_t state = fountain_seed(~file_id, id);
+  double u = (fountain_next(&state) >> 11) * 0x1.0p-53;
+  uint32_t d = 1;
+  while (d < max && cdf[d] < u) d++;
+  return d;
+}
+
+static void fountain_xor(uint8_t *dst, const uint8_t *src) {
+  for (int x = 0; x < FOUNTAIN_SYMBOL_LEN; x++) dst[x] ^= src[x];
+}
+
+/**
+ * @brief Generates a new fountain decoder at memory location d. Must be
+ * allocated memory or undefined behavior will occur.
+ *
+ * @param d Pointer to allocated decoder which will be initialized.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_fountain_decoder_new(struct antenna_fountain_decoder *d) {
+  // Check for NULL pointers
+  if (d == NULL) {
+    printf("[!] Cannot initialize null fountain decoder\n");
+    return -1;
+  }
+
+  memset(d, 0, sizeof(struct antenna_fountain_decoder));
+  if ((d->neighbours = malloc(FOUNTAIN_MAX_DEGREE * sizeof(uint32_t))) ==
+      NULL) {
+    printf("[!] Failed to allocate fountain decoder\n");
+    return -1;
+  }
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Releases everything held by the decoder.
+ *
+ * @param d Decoder to tear down.
+ */
+void antenna_fountain_decoder_destroy(struct antenna_fountain_decoder *d) {
+  if (d == NULL) return;
+
+  free(d->source);
+  free(d->known);
+  free(d->symbols);
+  free(d->data);
+  free(d->edge_head);
+  free(d->edge_symbol);
+  free(d->edge_next);
+  free(d->stack);
+  free(d->neighbours);
+  memset(d, 0, sizeof(struct antenna_fountain_decoder));
+}
+
+// Sizes the decoder for the file of the first symbol heard
+static int fountain_start(struct antenna_fountain_decoder *d, uint32_t file_id,
+                          uint32_t file_size) {
+  uint32_t k = (file_size + (uint64_t)FOUNTAIN_SYMBOL_LEN - 1) /
+               FOUNTAIN_SYMBOL_LEN;
+  if (k > 0 &&
+      ((d->source = malloc((size_t)k * FOUNTAIN_SYMBOL_LEN)) == NULL ||
+       (d->known = calloc(k, 1)) == NULL ||
+       (d->edge_head = malloc(k * sizeof(uint32_t))) == NULL ||
+       (d->stack = malloc(k * sizeof(uint32_t))) == NULL)) {
+    printf("[!] Failed to allocate fountain decoder for %u bytes\n",
+           file_size);
+    return -1;
+  }
+  for (uint32_t x = 0; x < k; x++) d->edge_head[x] = FOUNTAIN_NONE;
+
+  d->file_id = file_id;
+  d->file_size = file_size;
+  d->k = k;
+  d->started = 1;
+  printf("[i] Receiving fountain coded file, %u bytes in %u symbols\n",
+         file_size, k);
+  return 0;
+}
+
+// Makes room for one more symbol and degree more edges
+static int fountain_reserve(struct antenna_fountain_decoder *d,
+                            uint32_t degree) {
+  if (d->symbol_count == d->symbol_cap) {
+    uint32_t cap = (d->symbol_cap > 0) ? 2 * d->symbol_cap : d->k / 2 + 16;
+    struct fountain_symbol *symbols =
+        realloc(d->symbols, cap * sizeof(struct fountain_symbol));
+    if (symbols == NULL) return -1;
+    d->symbols = symbols;
+    uint8_t *data = realloc(d->data, (size_t)cap * FOUNTAIN_SYMBOL_LEN);
+    if (data == NULL) return -1;
+    d->data = data;
+    d->symbol_cap = cap;
+  }
+
+  if (d->edge_cap - d->edge_count < degree) {
+    uint32_t cap = (d->edge_cap > 0) ? 2 * d->edge_cap : 8 * d->k + 64;
+    if (cap - d->edge_count < degree) cap = d->edge_count + degree;
+    uint32_t *edge_symbol = realloc(d->edge_symbol, cap * sizeof(uint32_t));
+    if (edge_symbol == NULL) return -1;
+    d->edge_symbol = edge_symbol;
+    uint32_t *edge_next = realloc(d->edge_next, cap * sizeof(uint32_t));
+    if (edge_next == NULL) return -1;
+    d->edge_next = edge_next;
+    d->edge_cap = cap;
+  }
+  return 0;
+}
+
+// Stores a recovered source symbol, then peels it off every symbol it is in,
+// recovering whatever that leaves with one unknown, and so on
+static void fountain_recover(struct antenna_fountain_decoder *d, uint32_t n,
+                             const uint8_t *data) {
+  uint32_t top = 0;
+  memcpy(&d->source[(size_t)n * FOUNTAIN_SYMBOL_LEN], data,
+         FOUNTAIN_SYMBOL_LEN);
+  d->known[n] = 1;
+  d->recovered++;
+  d->stack[top++] = n;
+
+  while (top > 0) {
+    n = d->stack[--top];
+    const uint8_t *value = &d->source[(size_t)n * FOUNTAIN_SYMBOL_LEN];
+    for (uint32_t e = d->edge_head[n]; e != FOUNTAIN_NONE; e = d->edge_next[e]) {
+      uint32_t sym = d->edge_symbol[e];
+      struct fountain_symbol *y = &d->symbols[sym];
+      if (y->degree == 0) continue;
+
+      uint8_t *y_data = &d->data[(size_t)sym * FOUNTAIN_SYMBOL_LEN];
+      fountain_xor(y_data, value);
+      y->unknown_xor ^= n;
+      if (--y->degree > 1) continue;
+
+      // Down to one unknown, which it now gives. If that is already known
+      // but not yet peeled, the symbol has nothing more to offer.
+      y->degree = 0;
+      uint32_t last = y->unknown_xor;
+      if (d->known[last]) continue;
+      memcpy(&d->source[(size_t)last * FOUNTAIN_SYMBOL_LEN], y_data,
+             FOUNTAIN_SYMBOL_LEN);
+      d->known[last] = 1;
+      d->recovered++;
+      d->stack[top++] = last;
+    }
+    d->edge_head[n] = FOUNTAIN_NONE;
+  }
+}
+
+// Solves the source symbols peeling left unknown from the symbols still
+// waiting on them. Gives up, leaving the decoder as it was, if they do not
+// pin every unknown down.
+static void fountain_eliminate(struct antenna_fountain_decoder *d) {
+  uint32_t unknowns = d->k - d->recovered;
+  size_t words = (unknowns + 63) / 64;
+
+  uint32_t *columns = malloc(unknowns * sizeof(uint32_t));
+  uint32_t *row_of = malloc((d->symbol_count + 1) * sizeof(uint32_t));
+  uint64_t *bits = NULL;
+  uint8_t *rows = NULL;
+  if (columns == NULL || row_of == NULL) goto cleanup;
+
+  // One row per symbol still waiting
+  uint32_t row_count = 0;
+  for (uint32_t sym = 0; sym < d->symbol_count; sym++)
+    row_of[sym] = (d->symbols[sym].degree > 1) ? row_count++ : FOUNTAIN_NONE;
+  if (row_count < unknowns) goto cleanup;
+
+  if ((bits = calloc((size_t)row_count * words, sizeof(uint64_t))) == NULL ||
+      (rows = malloc((size_t)row_count * FOUNTAIN_SYMBOL_LEN)) == NULL)
+    goto cleanup;
+  for (uint32_t sym = 0; sym < d->symbol_count; sym++)
+    if (row_of[sym] != FOUNTAIN_NONE)
+      memcpy(&rows[(size_t)row_of[sym] * FOUNTAIN_SYMBOL_LEN],
+             &d->data[(size_t)sym * FOUNTAIN_SYMBOL_LEN], FOUNTAIN_SYMBOL_LEN);
+
+  // One column per unknown, set in the rows of the symbols it is in
+  uint32_t column = 0;
+  for (uint32_t n = 0; n < d->k; n++) {
+    if (d->known[n]) continue;
+    for (uint32_t e = d->edge_head[n]; e != FOUNTAIN_NONE; e = d->edge_next[e]) {
+      uint32_t row = row_of[d->edge_symbol[e]];
+      if (row != FOUNTAIN_NONE)
+        bits[row * words + column / 64] |= 1ull << (column % 64);
+    }
+    columns[column++] = n;
+  }
+
+  // Gauss-Jordan, leaving row c with column c alone
+  for (uint32_t c = 0; c < unknowns; c++) {
+    size_t word = c / 64;
+    uint64_t mask = 1ull << (c % 64);
+    uint32_t pivot = c;
+    while (pivot < row_count && !(bits[pivot * words + word] & mask)) pivot++;
+    if (pivot == row_count) goto cleanup;
+
+    if (pivot != c) {
+      uint8_t swap[FOUNTAIN_SYMBOL_LEN];
+      for (size_t w = word; w < words; w++) {
+        uint64_t t = bits[pivot * words + w];
+        bits[pivot * words + w] = bits[c * words + w];
+        bits[c * words + w] = t;
+      }
+      memcpy(swap, &rows[(size_t)pivot * FOUNTAIN_SYMBOL_LEN],
+             FOUNTAIN_SYMBOL_LEN);
+      memcpy(&rows[(size_t)pivot * FOUNTAIN_SYMBOL_LEN],
+             &rows[(size_t)c * FOUNTAIN_SYMBOL_LEN], FOUNTAIN_SYMBOL_LEN);
+      memcpy(&rows[(size_t)c * FOUNTAIN_SYMBOL_LEN], swap,
+             FOUNTAIN_SYMBOL_LEN);
+    }
+
+    for (uint32_t row = 0; row < row_count; row++) {
+      if (row == c || !(bits[row * words + word] & mask)) continue;
+      for (size_t w = word; w < words; w++)
+        bits[row * words + w] ^= bits[c * words + w];
+      fountain_xor(&rows[(size_t)row * FOUNTAIN_SYMBOL_LEN],
+                   &rows[(size_t)c * FOUNTAIN_SYMBOL_LEN]);
+    }
+  }
+
+  for (uint32_t c = 0; c < unknowns; c++) {
+    memcpy(&d->source[(size_t)columns[c] * FOUNTAIN_SYMBOL_LEN],
+           &rows[(size_t)c * FOUNTAIN_SYMBOL_LEN], FOUNTAIN_SYMBOL_LEN);
+    d->known[columns[c]] = 1;
+  }
+  d->recovered = d->k;
+
+cleanup:
+  free(columns);
+  free(row_of);
+  free(bits);
+  free(rows);
+}
+
+/**
+ * @brief Feeds one FILE_MSG_LEN slot into the decoder. Slots that fail their
+ * CRC, are not fountain symbols or belong to another file are ignored.
+ *
+ * @param d Decoder to use.
+ * @param msg Slot of FILE_MSG_LEN bytes.
+ * @return 1 once the file is complete, 0 if more symbols are needed, -1 on
+ * error.
+ */
+int antenna_fountain_decoder_add(struct antenna_fountain_decoder *d,
+                                 const uint8_t *msg) {
+  if (msg[0] != FILE_MSG_FOUNTAIN ||
+      get_u32(&msg[FILE_MSG_LEN - FILE_MSG_CRC_LEN]) !=
+          antenna_file_crc32(msg, FILE_MSG_LEN - FILE_MSG_CRC_LEN))
+    return d->started && d->recovered == d->k;
+
+  uint32_t file_id = get_u32(&msg[1]);
+  const uint8_t *body = &msg[FILE_MSG_HEADER_LEN];
+  uint32_t file_size = get_u32(&body[0]);
+  uint32_t id = get_u32(&body[4]);
+  uint32_t degree = get_u16(&body[8]);
+
+  if (!d->started && fountain_start(d, file_id, file_size) < 0) return -1;
+  if (file_id != d->file_id || file_size != d->file_size) return 0;
+  if (d->recovered == d->k) return 1;
+  if (degree < 1 || degree > d->k || degree > FOUNTAIN_MAX_DEGREE) return 0;
+
+  if (fountain_reserve(d, degree) < 0) {
+    printf("[!] Failed to allocate fountain symbol storage\n");
+    return -1;
+  }
+
+  // Take out the source symbols already known
+  fountain_neighbours(file_id, id, degree, d->k, d->neighbours);
+  uint8_t *data = &d->data[(size_t)d->symbol_count * FOUNTAIN_SYMBOL_LEN];
+  memcpy(data, &body[10], FOUNTAIN_SYMBOL_LEN);
+  struct fountain_symbol y = {0, 0};
+  for (uint32_t x = 0; x < degree; x++) {
+    uint32_t n = d->neighbours[x];
+    if (d->known[n]) {
+      fountain_xor(data, &d->source[(size_t)n * FOUNTAIN_SYMBOL_LEN]);
+    } else {
+      y.degree++;
+      y.unknown_xor ^= n;
+    }
+  }
+  d->received++;
+
+  if (y.degree == 1) {
+    fountain_recover(d, y.unknown_xor, data);
+  } else if (y.degree > 1) {
+    // Keep it until its other unknowns turn up
+    uint32_t sym = d->symbol_count++;
+    d->symbols[sym] = y;
+    for (uint32_t x = 0; x < degree; x++) {
+      uint32_t n = d->neighbours[x];
+      if (d->known[n]) continue;
+      d->edge_symbol[d->edge_count] = sym;
+      d->edge_next[d->edge_count] = d->edge_head[n];
+      d->edge_head[n] = d->edge_count++;
+    }
+  }
+
+  // Peeling stalls now and then near the end, which elimination gets past
+  if (d->recovered < d->k && d->received >= d->k &&
+      d->k - d->recovered <= FOUNTAIN_GE_MAX &&
+      (d->ge_received == 0 || d->received >= d->ge_received + FOUNTAIN_GE_STEP)) {
+    d->ge_received = d->received;
+    fountain_eliminate(d);
+  }
+
+  return d->recovered == d->k;
+}
+
+/**
+ * @brief Writes the rebuilt file.
+ *
+ * @param d Decoder holding a complete file.
+ * @param file_path Path to output file.
+ * @return 0 on success, -1 on error
+ */
+int antenna_fountain_decoder_write(struct antenna_fountain_decoder *d,
+                                   const char *file_path) {
+  if (!d->started || d->recovered != d->k) {
+    printf("[!] Fountain coded file is not complete\n");
+    return -1;
+  }
+
+  int fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("[!] Failed to open file placeholder for incoming file\n");
+    return -1;
+  }
+
+  // Return status
+  int status = 0;
+
+  size_t written = 0;
+  while (written < d->file_size) {
+    ssize_t n = write(fd, &d->source[written], d->file_size - written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      printf("[!] Failed to write %s: %s\n", file_path, strerror(errno));
+      status = -1;
+      break;
+    }
+    written += n;
+  }
+  if (status == 0 && fdatasync(fd) < 0) status = -1;
+  close(fd);
+
+  // done
+  return status;
+}
+
+/**
+ * @brief Sends count encoded symbols of a file over the session, with ids
+ * first_id onwards. Framing must be enabled. Call again with the next ids to
+ * keep the stream going.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor symbols are written to.
+ * @param file_path Path to file to send.
+ * @param first_id Id of the first symbol to send.
+ * @param count Number of symbols to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_fountain_send(struct antenna_session *s, int fd,
+                          const char *file_path, uint32_t first_id,
+                          uint32_t count) {
+  if (s->framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] File transfer requires a framed session\n");
+    return -1;
+  }
+
+  // Open the file
+  int file_fd = open(file_path, O_RDONLY);
+  if (file_fd < 0) {
+    printf("[!] Failed to open file to send\n");
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(file_fd, &st) < 0 || (uint64_t)st.st_size > UINT32_MAX) {
+    printf("[!] Cannot send file %s\n", file_path);
+    close(file_fd);
+    return -1;
+  }
+  uint32_t file_size = st.st_size;
+
+  const uint8_t *data = NULL;
+  if (file_size > 0 &&
+      (data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, file_fd, 0)) ==
+          MAP_FAILED) {
+    printf("[!] Failed to map file to send\n");
+    close(file_fd);
+    return -1;
+  }
+  uint32_t file_id = antenna_file_crc32(data, file_size);
+  uint32_t k = (file_size + (uint64_t)FOUNTAIN_SYMBOL_LEN - 1) /
+               FOUNTAIN_SYMBOL_LEN;
+
+  // Return status
+  int status = 0;
+
+  // Messages must line up with slots, which compressed frames do not keep
+  int compress = s->tx_compress;
+  antenna_session_set_compression(s, 0);
+
+  double cdf[FOUNTAIN_MAX_DEGREE + 1];
+  uint32_t max_degree = (k > 0) ? fountain_cdf(k, cdf) : 0;
+  uint32_t neighbours[FOUNTAIN_MAX_DEGREE];
+
+  uint8_t batch[FILE_TX_BATCH * FILE_MSG_LEN];
+  size_t slots = 0;
+  for (uint32_t x = 0; x < count; x++) {
+    uint32_t id = first_id + x;
+    uint32_t degree = (k > 0) ? fountain_degree(file_id, id, cdf, max_degree)
+                              : 0;
+
+    uint8_t *msg = &batch[slots++ * FILE_MSG_LEN];
+    memset(msg, 0, FILE_MSG_LEN);
+    msg[0] = FILE_MSG_FOUNTAIN;
+    put_u32(&msg[1], file_id);
+    uint8_t *body = &msg[FILE_MSG_HEADER_LEN];
+    put_u32(&body[0], file_size);
+    put_u32(&body[4], id);
+    put_u16(&body[8], degree);
+
+    // XOR of the chosen source symbols, the last one zero padded
+    fountain_neighbours(file_id, id, degree, k, neighbours);
+    for (uint32_t y = 0; y < degree; y++) {
+      size_t offset = (size_t)neighbours[y] * FOUNTAIN_SYMBOL_LEN;
+      size_t len = (file_size - offset < FOUNTAIN_SYMBOL_LEN)
+                       ? file_size - offset
+                       : FOUNTAIN_SYMBOL_LEN;
+      for (size_t z = 0; z < len; z++) body[10 + z] ^= data[offset + z];
+    }
+    put_u32(&msg[FILE_MSG_LEN - FILE_MSG_CRC_LEN],
+            antenna_file_crc32(msg, FILE_MSG_LEN - FILE_MSG_CRC_LEN));
+
+    if (slots == FILE_TX_BATCH || x + 1 == count) {
+      if (antenna_session_write_rs_fd(s, fd, (const char *)batch,
+                                      slots * FILE_MSG_LEN) < 0) {
+        printf("[!] Failed to write file data to antenna\n");
+        status = -1;
+        break;
+      }
+      slots = 0;
+    }
+  }
+
+  antenna_session_set_compression(s, compress);
+  if (data != NULL) munmap((void *)data, file_size);
+  close(file_fd);
+
+  // done
+  return status;
+}
+
+/**
+ * @brief Collects symbols from the session into the decoder until the file is
+ * complete, or the sender goes quiet for FILE_MAX_TIMEOUTS timeouts. Framing
+ * must be enabled. The decoder keeps what it has either way, so symbols from
+ * a later pass or another station can be added to it.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor symbols are read from.
+ * @param d Decoder to collect into.
+ * @return 1 if the file is complete, 0 if the sender went quiet, -1 on error
+ */
+int antenna_fountain_receive(struct antenna_session *s, int fd,
+                             struct antenna_fountain_decoder *d) {
+  if (s->framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] File transfer requires a framed session\n");
+    return -1;
+  }
+  if (d->started && d->recovered == d->k) return 1;
+
+  // Wait as long as it takes for the first symbol
+  int timeout = s->rx_timeout;
+  antenna_session_set_timeout(s, d->started ? FILE_TIMEOUT_MS : -1);
+
+  // Return status
+  int status = 0;
+
+  uint8_t buffer[ANTENNA_MAX_INTERLEAVE * FILE_MSG_LEN];
+  int timeouts = 0;
+  int errors = 0;
+  while (status == 0) {
+    int bytes_read = antenna_session_read_rs_fd(s, fd, (char *)buffer,
+                                                sizeof(buffer), READ_MODE_UPTO);
+    if (bytes_read < 0) {
+      // A lost frame only costs its symbols
+      if (++errors >= FILE_MAX_ERRORS) {
+        printf("[!] Too many bad frames, keeping fountain symbols\n");
+        break;
+      }
+      continue;
+    }
+    errors = 0;
+
+    if (bytes_read == 0) {
+      if (++timeouts >= FILE_MAX_TIMEOUTS) {
+        printf("[!] Sender went quiet with %u of %u symbols recovered\n",
+               d->recovered, d->k);
+        break;
+      }
+      continue;
+    }
+    timeouts = 0;
+
+    int started = d->started;
+    for (int x = 0; x + FILE_MSG_LEN <= bytes_read && status == 0;
+         x += FILE_MSG_LEN)
+      status = antenna_fountain_decoder_add(d, &buffer[x]);
+    if (!started && d->started) antenna_session_set_timeout(s, FILE_TIMEOUT_MS);
+  }
+
+  antenna_session_set_timeout(s, timeout);
+
+  // done
+  return status;
+}
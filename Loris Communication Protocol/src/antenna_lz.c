@@ -0,0 +1,140 @@
+/**
+ * @file antenna_lz.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Small LZSS block compressor for data sent over the antenna
+ * @version 0.1
+ * @date 2022-04-27
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_lz.h"
+
+static uint32_t lz_hash(const uint8_t *p) {
+  uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+  return (v * 2654435761u) >> (32 - ANTENNA_LZ_HASH_BITS);
+}
+
+// Longest earlier match for position x, searching at most ANTENNA_LZ_CHAIN
+// candidates. Returns its length, 0 if under ANTENNA_LZ_MIN_MATCH.
+static size_t lz_match(const struct antenna_lz *z, const uint8_t *in,
+                       size_t in_len, size_t x, size_t *distance) {
+  size_t limit = in_len - x;
+  if (limit > ANTENNA_LZ_MAX_MATCH) limit = ANTENNA_LZ_MAX_MATCH;
+
+  size_t best = 0;
+  uint16_t candidate = z->head[lz_hash(&in[x])];
+  for (int depth = 0; depth < ANTENNA_LZ_CHAIN && candidate != 0; depth++) {
+    size_t y = candidate - 1;
+    if (x - y > ANTENNA_LZ_WINDOW) break;
+
+    size_t len = 0;
+    while (len < limit && in[y + len] == in[x + len]) len++;
+    if (len > best) {
+      best = len;
+      *distance = x - y;
+      if (len == limit) break;
+    }
+    candidate = z->prev[y];
+  }
+  return (best >= ANTENNA_LZ_MIN_MATCH) ? best : 0;
+}
+
+// Adds position x to the match finder
+static void lz_insert(struct antenna_lz *z, const uint8_t *in, size_t in_len,
+                      size_t x) {
+  if (x + ANTENNA_LZ_MIN_MATCH > in_len) return;
+  uint32_t h = lz_hash(&in[x]);
+  z->prev[x] = z->head[h];
+  z->head[h] = x + 1;
+}
+
+/**
+ * @brief Compresses as much of in as fits in out, as one block.
+ *
+ * @param z Compressor state.
+ * @param in Bytes to compress.
+ * @param in_len Number of bytes in in. Only the first ANTENNA_LZ_BLOCK_LEN
+ * are looked at.
+ * @param consumed Set to the number of bytes of in compressed into out.
+ * @param out Output buffer.
+ * @param out_len Capacity of out.
+ * @return number of bytes written to out.
+ */
+size_t antenna_lz_compress(struct antenna_lz *z, const uint8_t *in,
+                           size_t in_len, size_t *consumed, uint8_t *out,
+                           size_t out_len) {
+  if (in_len > ANTENNA_LZ_BLOCK_LEN) in_len = ANTENNA_LZ_BLOCK_LEN;
+  memset(z->head, 0, sizeof(z->head));
+
+  size_t x = 0, used = 0, control = 0;
+  int items = 8;
+  while (x < in_len) {
+    size_t distance = 0;
+    size_t len = (x + ANTENNA_LZ_MIN_MATCH <= in_len)
+                     ? lz_match(z, in, in_len, x, &distance)
+                     : 0;
+
+    // Stop at the first item that does not fit, with its control byte
+    size_t cost = (len ? 2 : 1) + (items == 8);
+    if (used + cost > out_len) break;
+
+    if (items == 8) {
+      control = used++;
+      out[control] = 0;
+      items = 0;
+    }
+    if (len) {
+      out[control] |= 0x80 >> items;
+      out[used++] = (distance - 1) >> 3;
+      out[used++] = ((distance - 1) << 5) | (len - ANTENNA_LZ_MIN_MATCH);
+    } else {
+      len = 1;
+      out[used++] = in[x];
+    }
+    items++;
+
+    for (size_t end = x + len; x < end; x++) lz_insert(z, in, in_len, x);
+  }
+
+  *consumed = x;
+  return used;
+}
+
+/**
+ * @brief Decompresses one block. Decoding stops after out_len bytes, so in
+ * may carry padding after the block.
+ *
+ * @param in Compressed block.
+ * @param in_len Number of bytes in in.
+ * @param out Output buffer.
+ * @param out_len Uncompressed length of the block.
+ * @return out_len or -1 if the block is malformed or does not decompress to
+ * exactly out_len bytes.
+ */
+ssize_t antenna_lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out,
+                              size_t out_len) {
+  size_t x = 0, produced = 0;
+  while (x < in_len && produced < out_len) {
+    uint8_t control = in[x++];
+    for (int item = 0; item < 8 && x < in_len && produced < out_len; item++) {
+      if (control & (0x80 >> item)) {
+        if (x + 2 > in_len) return -1;
+        size_t distance = ((in[x] << 3) | (in[x + 1] >> 5)) + 1;
+        size_t len = (in[x + 1] & 0x1F) + ANTENNA_LZ_MIN_MATCH;
+        x += 2;
+        if (distance > produced || len > out_len - produced) return -1;
+
+        // Byte by byte, since the copy may overlap itself
+        for (size_t y = 0; y < len; y++, produced++)
+          out[produced] = out[produced - distance];
+      } else {
+        if (produced == out_len) return -1;
+        out[produced++] = in[x++];
+      }
+    }
+  }
+
+  return (produced == out_len) ? (ssize_t)produced : -1;
+}
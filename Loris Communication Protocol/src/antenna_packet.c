@@ -11,25 +11,514 @@
 
 #include "antenna_packet.h"
 
+// Standard C libraries
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PACKET_SIMD_X86
+#include <x86intrin.h>
+#endif
+
+enum { PACKET_SIMD_SCALAR, PACKET_SIMD_SSSE3, PACKET_SIMD_AVX2 };
+
+static const uint8_t packet_asm[PACKET_ASM_LEN] = {
+    (PACKET_ASM >> 24) & 0xFF, (PACKET_ASM >> 16) & 0xFF,
+    (PACKET_ASM >> 8) & 0xFF, PACKET_ASM & 0xFF};
+
 /**
- * @brief Generates a new packet at memory location p. Must be allocated
+ * @brief Computes the CRC-16/CCITT (poly 0x1021, init 0xFFFF) of a buffer.
+ *
+ * @param data Bytes to checksum.
+ * @param len Number of bytes in data.
+ * @return the CRC.
+ */
+uint16_t antenna_packet_crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t x = 0; x < len; x++) {
+    crc ^= (uint16_t)data[x] << 8;
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+/**
+ * @brief Writes the sync marker and header for a frame of len data bytes.
+ *
+ * @param header Output buffer of PACKET_HEADER_LEN bytes.
+ * @param len Number of data bytes in the frame, at most PACKET_DATA_LEN.
+ * @param flags Flags byte carried in the header.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_packet_header(uint8_t *header, size_t len, uint8_t flags) {
+  if (len > PACKET_DATA_LEN) {
+    printf("[!] Frame of %zu bytes is too long\n", len);
+    return -1;
+  }
+
+  memcpy(header, packet_asm, PACKET_ASM_LEN);
+  header[PACKET_ASM_LEN] = len >> 8;
+  header[PACKET_ASM_LEN + 1] = len & 0xFF;
+  header[PACKET_ASM_LEN + 2] = flags;
+  uint16_t crc = antenna_packet_crc16(&header[PACKET_ASM_LEN], 3);
+  header[PACKET_ASM_LEN + 3] = crc >> 8;
+  header[PACKET_ASM_LEN + 4] = crc & 0xFF;
+
+  // done
+  return 0;
+}
+
+// Bit errors between the marker and the 4 bytes at p
+static int asm_distance(const uint8_t *p) {
+  uint32_t word = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+                  ((uint32_t)p[2] << 8) | p[3];
+  return __builtin_popcount(word ^ PACKET_ASM);
+}
+
+// The searches below return the first offset in [0, len - PACKET_ASM_LEN]
+// where the marker matches within tolerance, or -1. The vector versions test
+// 16 or 32 offsets at once: each marker byte is compared against a shifted
+// load, the bit differences are counted per byte with a nibble lookup and the
+// four counts are summed.
+static ssize_t asm_search_scalar(const uint8_t *data, size_t len,
+                                 size_t from, int tolerance) {
+  for (size_t x = from; x + PACKET_ASM_LEN <= len; x++)
+    if (asm_distance(&data[x]) <= tolerance) return x;
+  return -1;
+}
+
+#ifdef PACKET_SIMD_X86
+__attribute__((target("ssse3"))) static ssize_t asm_search_ssse3(
+    const uint8_t *data, size_t len, int tolerance) {
+  const __m128i lut =
+      _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i limit = _mm_set1_epi8(tolerance);
+
+  size_t x = 0;
+  for (; x + 16 + PACKET_ASM_LEN - 1 <= len; x += 16) {
+    __m128i distance = _mm_setzero_si128();
+    for (int k = 0; k < PACKET_ASM_LEN; k++) {
+      __m128i diff =
+          _mm_xor_si128(_mm_loadu_si128((const __m128i *)&data[x + k]),
+                        _mm_set1_epi8(packet_asm[k]));
+      __m128i bits = _mm_add_epi8(
+          _mm_shuffle_epi8(lut, _mm_and_si128(diff, nibble)),
+          _mm_shuffle_epi8(lut,
+                           _mm_and_si128(_mm_srli_epi16(diff, 4), nibble)));
+      distance = _mm_add_epi8(distance, bits);
+    }
+    __m128i match = _mm_cmpeq_epi8(_mm_min_epu8(distance, limit), distance);
+    int mask = _mm_movemask_epi8(match);
+    if (mask) return x + __builtin_ctz(mask);
+  }
+  return asm_search_scalar(data, len, x, tolerance);
+}
+
+__attribute__((target("avx2"))) static ssize_t asm_search_avx2(
+    const uint8_t *data, size_t len, int tolerance) {
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2,
+                                       3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2,
+                                       2, 3, 2, 3, 3, 4);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i limit = _mm256_set1_epi8(tolerance);
+
+  size_t x = 0;
+  for (; x + 32 + PACKET_ASM_LEN - 1 <= len; x += 32) {
+    __m256i distance = _mm256_setzero_si256();
+    for (int k = 0; k < PACKET_ASM_LEN; k++) {
+      __m256i diff =
+          _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&data[x + k]),
+                           _mm256_set1_epi8(packet_asm[k]));
+      __m256i bits = _mm256_add_epi8(
+          _mm256_shuffle_epi8(lut, _mm256_and_si256(diff, nibble)),
+          _mm256_shuffle_epi8(
+              lut, _mm256_and_si256(_mm256_srli_epi16(diff, 4), nibble)));
+      distance = _mm256_add_epi8(distance, bits);
+    }
+    __m256i match =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(distance, limit), distance);
+    unsigned int mask = _mm256_movemask_epi8(match);
+    if (mask) return x + __builtin_ctz(mask);
+  }
+  return asm_search_scalar(data, len, x, tolerance);
+}
+#endif
+
+static ssize_t asm_search(struct antenna_deframer *d, const uint8_t *data,
+                          size_t len, int tolerance) {
+  switch (d->simd) {
+#ifdef PACKET_SIMD_X86
+    case PACKET_SIMD_AVX2:
+      return asm_search_avx2(data, len, tolerance);
+    case PACKET_SIMD_SSSE3:
+      return asm_search_ssse3(data, len, tolerance);
+#endif
+    default:
+      return asm_search_scalar(data, len, 0, tolerance);
+  }
+}
+
+// Checks the header after a sync marker and reads the frame length from it
+static int header_valid(const uint8_t *header, uint16_t *len) {
+  *len = (header[PACKET_ASM_LEN] << 8) | header[PACKET_ASM_LEN + 1];
+  uint16_t crc = (header[PACKET_ASM_LEN + 3] << 8) | header[PACKET_ASM_LEN + 4];
+  return crc == antenna_packet_crc16(&header[PACKET_ASM_LEN], 3) &&
+         *len <= PACKET_DATA_LEN;
+}
+
+// Forgets marks on bytes that have been parsed
+static void deframer_prune(struct antenna_deframer *d) {
+  size_t start = d->base + d->start;
+  size_t keep = 0;
+  while (keep < d->mark_count && d->marks[keep] < start) keep++;
+  if (keep == 0) return;
+  memmove(d->marks, &d->marks[keep], (d->mark_count - keep) * sizeof(size_t));
+  d->mark_count -= keep;
+}
+
+// Moves len bytes from src to the end of the buffer, undoing PARMRK escapes
+// if enabled. src may lie in the free part of the buffer, since the output
+// never runs ahead of the input. Returns the number of bytes of src used.
+static size_t deframer_append(struct antenna_deframer *d, const uint8_t *src,
+                              size_t len) {
+  if (!d->parmrk) {
+    size_t space = PACKET_BUFFER_LEN - d->end;
+    size_t bytes_to_copy = (len > space) ? space : len;
+    if (bytes_to_copy > 0) memmove(&d->buffer[d->end], src, bytes_to_copy);
+    d->end += bytes_to_copy;
+    return bytes_to_copy;
+  }
+
+  size_t x = 0;
+  while (x < len && d->end < PACKET_BUFFER_LEN) {
+    uint8_t c = src[x++];
+    if (d->escape == 0 && c == 0xFF) {
+      d->escape = 1;
+      continue;
+    }
+    if (d->escape == 1 && c == 0x00) {
+      d->escape = 2;
+      continue;
+    }
+    if (d->escape == 2) {
+      // c arrived with a parity or framing error
+      if (d->mark_count < PACKET_MAX_ERASURES)
+        d->marks[d->mark_count++] = d->base + d->end;
+      d->bytes_marked++;
+    }
+    d->escape = 0;
+    d->buffer[d->end++] = c;
+  }
+  return x;
+}
+
+// Hands out the frame at d->start, whose header promised len bytes of which
+// received_len arrived. A short frame is copied out, zero filled and has its
+// tail erased. Consumes the header and the bytes received.
+static void deframer_emit(struct antenna_deframer *d, struct antenna_packet *p,
+                          uint16_t len, size_t received_len) {
+  const uint8_t *header = &d->buffer[d->start];
+  const uint8_t *data = &header[PACKET_HEADER_LEN];
+  size_t data_start = d->base + d->start + PACKET_HEADER_LEN;
+
+  // Marked bytes inside the frame
+  size_t count = 0;
+  for (size_t x = 0; x < d->mark_count; x++) {
+    size_t offset = d->marks[x] - data_start;
+    if (d->marks[x] >= data_start && offset < received_len)
+      d->frame_erasures[count++] = offset;
+  }
+
+  p->len = len;
+  p->flags = header[PACKET_ASM_LEN + 2];
+  p->data = data;
+  if (received_len < len) {
+    memcpy(d->frame, data, received_len);
+    memset(&d->frame[received_len], 0, len - received_len);
+    for (size_t x = received_len; x < len && count < PACKET_MAX_ERASURES; x++)
+      d->frame_erasures[count++] = x;
+    p->data = d->frame;
+    d->frames_truncated++;
+  }
+  p->erasures = d->frame_erasures;
+  p->erasure_count = count;
+
+  // Marks are kept until the buffer is compacted, in case the frame is
+  // rejected and parsed again
+  d->emitted = 1;
+  d->emitted_start = d->start;
+  d->start += PACKET_HEADER_LEN + received_len;
+  d->frames++;
+}
+
+/**
+ * @brief Generates a new deframer at memory location d. Must be allocated
  * memory or undefined behavior will occur.
  *
- * @param p Pointer to allocated packet which will be initialized.
+ * @param d Pointer to allocated deframer which will be initialized.
+ * @param tolerance Bit errors accepted in the sync marker, 0 to
+ * PACKET_ASM_TOLERANCE_MAX.
  * @return 0 = OK, -1 = ERR
  */
-int antenna_packet_new(struct antenna_packet *p) {
+int antenna_deframer_new(struct antenna_deframer *d, int tolerance) {
   // Check for NULL pointers
-  if (p == NULL) {
-    printf("[!] Cannot initialize null packet\n");
+  if (d == NULL) {
+    printf("[!] Cannot initialize null deframer\n");
+    return -1;
+  }
+
+  if (tolerance < 0 || tolerance > PACKET_ASM_TOLERANCE_MAX) {
+    printf("[!] Invalid sync marker tolerance %d\n", tolerance);
     return -1;
   }
 
-  // Initialize packet
-  memcpy(p->start_delimiter, PACKET_DELIMITER, PACKET_DELIMITER_LEN);
-  memset(p->data, 0, PACKET_DATA_LEN);
-  memcpy(p->end_delimiter, PACKET_DELIMITER, PACKET_DELIMITER_LEN);
+  // Initialize deframer
+  memset(d, 0, sizeof(struct antenna_deframer));
+  d->tolerance = tolerance;
+  d->simd = PACKET_SIMD_SCALAR;
+#ifdef PACKET_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    d->simd = PACKET_SIMD_AVX2;
+  else if (__builtin_cpu_supports("ssse3"))
+    d->simd = PACKET_SIMD_SSSE3;
+#endif
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Selects whether the input is PARMRK escaped (see struct
+ * antenna_deframer). Pair with antenna_set_parmrk_fd() on the tty.
+ *
+ * @param d Deframer to configure.
+ * @param parmrk 1 if the input is PARMRK escaped, 0 if it is raw bytes.
+ */
+void antenna_deframer_set_parmrk(struct antenna_deframer *d, int parmrk) {
+  d->parmrk = parmrk;
+  d->escape = 0;
+}
+
+/**
+ * @brief Copies received bytes into the deframer.
+ *
+ * @param d Deframer to feed.
+ * @param data Received bytes.
+ * @param len Number of bytes in data.
+ * @return number of bytes taken, which may be less than len when the deframer
+ * is full. Call antenna_deframer_next() to make room.
+ */
+size_t antenna_deframer_push(struct antenna_deframer *d, const uint8_t *data,
+                             size_t len) {
+  size_t space;
+  antenna_deframer_space(d, &space);
+  return (len > 0) ? deframer_append(d, data, len) : 0;
+}
+
+/**
+ * @brief Makes room and returns the free space at the end of the deframer
+ * buffer, for callers that read() straight into it.
+ *
+ * @param d Deframer to feed.
+ * @param len Set to the number of bytes free.
+ * @return start of the free space.
+ */
+uint8_t *antenna_deframer_space(struct antenna_deframer *d, size_t *len) {
+  // Move the unparsed bytes to the front to make room. The last frame handed
+  // out is overwritten, so it can no longer be rejected.
+  d->emitted = 0;
+  deframer_prune(d);
+  if (d->start > 0) {
+    memmove(d->buffer, &d->buffer[d->start], d->end - d->start);
+    d->base += d->start;
+    d->end -= d->start;
+    d->start = 0;
+  }
+
+  *len = PACKET_BUFFER_LEN - d->end;
+  return &d->buffer[d->end];
+}
+
+/**
+ * @brief Takes len bytes read into the space from antenna_deframer_space().
+ *
+ * @param d Deframer to feed.
+ * @param len Number of bytes read.
+ */
+void antenna_deframer_commit(struct antenna_deframer *d, size_t len) {
+  deframer_append(d, &d->buffer[d->end], len);
+}
+
+/**
+ * @brief Pulls the next whole frame out of the deframer. p->data points into
+ * the deframer and stays valid until the next call on it.
+ *
+ * @param d Deframer to use.
+ * @param p Output packet.
+ * @return 1 if a frame was found, 0 if more bytes are needed.
+ */
+int antenna_deframer_next(struct antenna_deframer *d,
+                          struct antenna_packet *p) {
+  d->emitted = 0;
+  while (d->end - d->start >= PACKET_HEADER_LEN) {
+    // Find the sync marker. If there is none, drop everything except the
+    // last few bytes, which may be the start of a marker.
+    uint8_t *unparsed = &d->buffer[d->start];
+    size_t unparsed_len = d->end - d->start;
+    ssize_t offset = asm_search(d, unparsed, unparsed_len, d->tolerance);
+    if (offset < 0) {
+      size_t skip = unparsed_len - (PACKET_ASM_LEN - 1);
+      d->start += skip;
+      d->bytes_skipped += skip;
+      deframer_prune(d);
+      return 0;
+    }
+    if (offset > 0) {
+      d->start += offset;
+      d->bytes_skipped += offset;
+      deframer_prune(d);
+    }
+    if (d->end - d->start < PACKET_HEADER_LEN) return 0;
+
+    // Check the header. A bad CRC or length means this was a false sync, so
+    // search again one byte further on.
+    const uint8_t *header = &d->buffer[d->start];
+    uint16_t len;
+    if (!header_valid(header, &len)) {
+      d->header_errors++;
+      d->start++;
+      d->bytes_skipped++;
+      continue;
+    }
+
+    // Wait for the whole frame
+    if (d->end - d->start - PACKET_HEADER_LEN < len) return 0;
+
+    deframer_emit(d, p, len, len);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Tells the deframer that the frame it just handed out failed to
+ * decode. If bytes of that frame were lost, it ran on into the next frame,
+ * whose sync marker and header then sit inside its data. The data is searched
+ * for an exact marker with a valid header, and parsing goes back to the first
+ * one found so the next frame is not lost as well. Must be called before the
+ * deframer is fed again.
+ *
+ * @param d Deframer to use.
+ * @return 1 if a sync point was found inside the frame, 0 if not.
+ */
+int antenna_deframer_reject(struct antenna_deframer *d) {
+  if (!d->emitted) return 0;
+  d->emitted = 0;
+
+  // A header may run past the end of the frame, so look as far as that when
+  // those bytes are in. One cut short by the end of the buffer is taken on
+  // the marker alone and checked once the rest arrives.
+  const uint8_t *header = &d->buffer[d->emitted_start];
+  const uint8_t *data = &header[PACKET_HEADER_LEN];
+  uint16_t len = (header[PACKET_ASM_LEN] << 8) | header[PACKET_ASM_LEN + 1];
+  size_t available = d->end - d->emitted_start - PACKET_HEADER_LEN;
+  size_t scan_len = len + PACKET_ASM_LEN - 1;
+  if (scan_len > available) scan_len = available;
+  for (size_t from = 0; from + PACKET_ASM_LEN <= scan_len;) {
+    ssize_t found = asm_search(d, &data[from], scan_len - from, 0);
+    if (found < 0) break;
+    size_t cut = from + found;
+    uint16_t next_len;
+    if (cut + PACKET_HEADER_LEN > available ||
+        header_valid(&data[cut], &next_len)) {
+      d->start = d->emitted_start + PACKET_HEADER_LEN + cut;
+      d->frames_resynced++;
+      return 1;
+    }
+    from = cut + 1;
+  }
 
   // done
   return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Gives up waiting on the frame in progress, e.g. after a timeout. If
+ * its header has arrived, it is returned with the missing tail zero filled and
+ * erased. Everything else buffered is dropped.
+ *
+ * @param d Deframer to use.
+ * @param p Output packet, as for antenna_deframer_next().
+ * @return 1 if a partial frame was returned, 0 if there was none.
+ */
+int antenna_deframer_flush(struct antenna_deframer *d,
+                           struct antenna_packet *p) {
+  // antenna_deframer_next() leaves a frame in progress at d->start
+  int found = 0;
+  uint16_t len;
+  if (d->end - d->start >= PACKET_HEADER_LEN &&
+      asm_distance(&d->buffer[d->start]) <= d->tolerance &&
+      header_valid(&d->buffer[d->start], &len)) {
+    size_t received_len = d->end - d->start - PACKET_HEADER_LEN;
+    deframer_emit(d, p, len, (received_len < len) ? received_len : len);
+    found = 1;
+  }
+
+  // Drop the rest
+  d->bytes_skipped += d->end - d->start;
+  d->start = d->end;
+  d->escape = 0;
+  d->emitted = 0;
+  deframer_prune(d);
+
+  // done
+  return found;
+}
+
+/**
+ * @brief Reads from a file descriptor until the deframer produces a frame.
+ *
+ * @param d Deframer to use.
+ * @param fd File descriptor to read from.
+ * @param p Output packet, as for antenna_deframer_next().
+ * @param timeout_ms Longest wait for more bytes, or < 0 to wait forever.
+ * @return 1 if a frame was found, 0 on end of file, timeout or if the fd would
+ * block, -1 on error.
+ */
+int antenna_deframer_read_fd(struct antenna_deframer *d, int fd,
+                             struct antenna_packet *p, int timeout_ms) {
+  while (!antenna_deframer_next(d, p)) {
+    // Wait for more bytes. If none come, salvage the frame in progress.
+    if (timeout_ms >= 0) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      int ready = poll(&pfd, 1, timeout_ms);
+      if (ready < 0) {
+        if (errno == EINTR) continue;
+        printf("[!] Failed to poll fd\n");
+        return -1;
+      }
+      if (ready == 0) return antenna_deframer_flush(d, p);
+    }
+
+    // Make room, then read straight into the deframer
+    size_t space;
+    uint8_t *free_space = antenna_deframer_space(d, &space);
+    ssize_t bytes_read = read(fd, free_space, space);
+    if (bytes_read < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      printf("[!] Failed to read from fd\n");
+      return -1;
+    }
+    if (bytes_read == 0) return antenna_deframer_flush(d, p);
+    antenna_deframer_commit(d, bytes_read);
+  }
+
+  // done
+  return 1;
+}
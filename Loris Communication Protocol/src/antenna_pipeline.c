@@ -0,0 +1,318 @@
+/**
+ * @file antenna_pipeline.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Two stage receive path: one thread drains the fd, another decodes
+ * @version 0.1
+ * @date 2022-04-20
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_pipeline.h"
+
+// Standard C libraries
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+
+// Tells the decoder there are new bytes, but unless forced only if it went to
+// sleep. The fence pairs with the one in pipeline_wait() so one side always
+// sees the other's store.
+static void pipeline_notify(struct antenna_pipeline *p, int force) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (force || __atomic_load_n(&p->decoder_waiting, __ATOMIC_RELAXED)) {
+    uint64_t one = 1;
+    if (write(p->datafd, &one, sizeof(one)) < 0)
+      printf("[!] Failed to wake pipeline decoder\n");
+  }
+}
+
+// Decoder side of pipeline_notify(). Returns once the ring may have bytes.
+static void pipeline_wait(struct antenna_pipeline *p) {
+  const uint8_t *span;
+  __atomic_store_n(&p->decoder_waiting, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (antenna_ring_read_peek(&p->ring, &span) == 0 &&
+      __atomic_load_n(&p->running, __ATOMIC_ACQUIRE)) {
+    uint64_t count;
+    while (read(p->datafd, &count, sizeof(count)) < 0 && errno == EINTR)
+      continue;
+  }
+  __atomic_store_n(&p->decoder_waiting, 0, __ATOMIC_RELAXED);
+}
+
+static void *pipeline_reader(void *data) {
+  struct antenna_pipeline *p = data;
+  uint8_t scratch[4096];
+  struct pollfd fds[2] = {{p->fd, POLLIN, 0}, {p->stopfd, POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      printf("[!] Failed to poll pipeline fd\n");
+      break;
+    }
+    if (fds[1].revents) break;
+    if (!fds[0].revents) continue;
+
+    // Read straight into the ring. With no room left, keep draining the fd
+    // anyway so the kernel buffer never backs up, and count what is lost.
+    uint8_t *span;
+    size_t span_len = antenna_ring_write_peek(&p->ring, &span);
+    ssize_t bytes_read = (span_len > 0)
+                             ? read(p->fd, span, span_len)
+                             : read(p->fd, scratch, sizeof(scratch));
+    if (bytes_read < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) continue;
+      printf("[!] Failed to read from pipeline fd\n");
+      break;
+    }
+    if (bytes_read == 0) break;
+
+    if (span_len > 0) {
+      antenna_ring_write_commit(&p->ring, bytes_read);
+      pipeline_notify(p, 0);
+    } else {
+      antenna_ring_overrun(&p->ring, bytes_read);
+    }
+  }
+
+  // Let the decoder drain the ring and finish
+  __atomic_store_n(&p->running, 0, __ATOMIC_RELEASE);
+  pipeline_notify(p, 1);
+  return NULL;
+}
+
+// Queues a decoded frame, or with len < 0 a failed one, for
+// antenna_pipeline_recv()
+static void pipeline_queue(struct antenna_pipeline *p, const char *data,
+                           ssize_t len) {
+  pthread_mutex_lock(&p->lock);
+  if (p->queue_count == ANTENNA_PIPELINE_QUEUE_LEN) {
+    __atomic_add_fetch(&p->frames_dropped, 1, __ATOMIC_RELAXED);
+  } else {
+    size_t tail = (p->queue_head + p->queue_count) % ANTENNA_PIPELINE_QUEUE_LEN;
+    if (len > 0) memcpy(p->queue[tail], data, len);
+    p->queue_len[tail] = len;
+    p->queue_count++;
+    pthread_cond_signal(&p->ready);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void *pipeline_decoder(void *data) {
+  struct antenna_pipeline *p = data;
+  struct antenna_deframer *d = p->session->rx_deframer;
+  char decoded[ANTENNA_PIPELINE_FRAME_LEN];
+  for (;;) {
+    const uint8_t *span;
+    size_t span_len = antenna_ring_read_peek(&p->ring, &span);
+    if (span_len == 0) {
+      // The reader publishes its last bytes before it clears running
+      if (!__atomic_load_n(&p->running, __ATOMIC_ACQUIRE) &&
+          antenna_ring_read_peek(&p->ring, &span) == 0)
+        break;
+      pipeline_wait(p);
+      continue;
+    }
+
+    // The deframer needs frames contiguous, so this is the one copy
+    antenna_ring_read_commit(&p->ring,
+                             antenna_deframer_push(d, span, span_len));
+
+    struct antenna_packet packet;
+    while (antenna_deframer_next(d, &packet)) {
+      ssize_t decoded_len =
+          antenna_session_decode_frame(p->session, &packet, decoded);
+      if (decoded_len < 0) {
+        __atomic_add_fetch(&p->frames_failed, 1, __ATOMIC_RELAXED);
+        if (p->on_frame == NULL) pipeline_queue(p, NULL, -1);
+        continue;
+      }
+      __atomic_add_fetch(&p->frames, 1, __ATOMIC_RELAXED);
+      if (p->on_frame != NULL)
+        p->on_frame(decoded, decoded_len, p->user);
+      else
+        pipeline_queue(p, decoded, decoded_len);
+    }
+  }
+
+  // Nothing more will be queued
+  pthread_mutex_lock(&p->lock);
+  p->decoder_done = 1;
+  pthread_cond_broadcast(&p->ready);
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+/**
+ * @brief Generates a new pipeline at memory location p and starts its
+ * threads. Must be allocated memory or undefined behavior will occur.
+ *
+ * @param p Pointer to allocated pipeline which will be initialized.
+ * @param s Session whose deframer and decoder are used. Framing must be
+ * ANTENNA_FRAMING_ASM, and nothing else may read from the session meanwhile.
+ * @param fd File descriptor to read from.
+ * @param ring_len Ring capacity in bytes, or 0 for ANTENNA_PIPELINE_RING_LEN.
+ * @param on_frame Callback for decoded frames, or NULL to queue them for
+ * antenna_pipeline_recv().
+ * @param user Passed to on_frame.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_pipeline_start(struct antenna_pipeline *p,
+                           struct antenna_session *s, int fd, size_t ring_len,
+                           antenna_pipeline_cb on_frame, void *user) {
+  // Check for NULL pointers
+  if (p == NULL || s == NULL) {
+    printf("[!] Cannot start pipeline without a session\n");
+    return -1;
+  }
+  if (s->framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] Pipeline requires a framed session\n");
+    return -1;
+  }
+
+  memset(p, 0, sizeof(struct antenna_pipeline));
+  p->fd = fd;
+  p->session = s;
+  p->on_frame = on_frame;
+  p->user = user;
+  p->running = 1;
+  p->datafd = p->stopfd = -1;
+
+  if (antenna_ring_new(&p->ring, ring_len ? ring_len
+                                          : ANTENNA_PIPELINE_RING_LEN) < 0)
+    return -1;
+
+  // Timed waits in antenna_pipeline_recv() must not jump with the wall clock
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->ready, &attr);
+  pthread_condattr_destroy(&attr);
+  if (on_frame == NULL &&
+      (p->queue = malloc(ANTENNA_PIPELINE_QUEUE_LEN *
+                         sizeof(*p->queue))) == NULL) {
+    printf("[!] Failed to allocate pipeline frame queue\n");
+    goto error;
+  }
+
+  p->datafd = eventfd(0, EFD_CLOEXEC);
+  p->stopfd = eventfd(0, EFD_CLOEXEC);
+  if (p->datafd < 0 || p->stopfd < 0) {
+    printf("[!] Failed to create pipeline events: %s\n", strerror(errno));
+    goto error;
+  }
+
+  if (pthread_create(&p->decoder, NULL, pipeline_decoder, p) != 0) {
+    printf("[!] Failed to start pipeline decoder\n");
+    goto error;
+  }
+  if (pthread_create(&p->reader, NULL, pipeline_reader, p) != 0) {
+    printf("[!] Failed to start pipeline reader\n");
+    __atomic_store_n(&p->running, 0, __ATOMIC_RELEASE);
+    pipeline_notify(p, 1);
+    pthread_join(p->decoder, NULL);
+    goto error;
+  }
+
+  // done
+  return 0;
+
+error:
+  if (p->datafd >= 0) close(p->datafd);
+  if (p->stopfd >= 0) close(p->stopfd);
+  free(p->queue);
+  pthread_cond_destroy(&p->ready);
+  pthread_mutex_destroy(&p->lock);
+  antenna_ring_destroy(&p->ring);
+  return -1;
+}
+
+/**
+ * @brief Takes decoded bytes from the queue of a pipeline started without a
+ * callback. Returns bytes of one frame at most. What does not fit in buffer
+ * is kept for the next call.
+ *
+ * @param p Pipeline to read from.
+ * @param buffer Output buffer for decoded bytes.
+ * @param read_len Size of buffer.
+ * @param timeout_ms Longest wait for a frame, or < 0 to wait forever.
+ * @return number of bytes read, 0 on timeout or once the fd has ended and the
+ * queue is empty, or -1 for a frame that failed to decode.
+ */
+ssize_t antenna_pipeline_recv(struct antenna_pipeline *p, char *buffer,
+                              size_t read_len, int timeout_ms) {
+  if (p->queue == NULL) {
+    printf("[!] Pipeline hands its frames to a callback\n");
+    return -1;
+  }
+
+  struct timespec deadline;
+  if (timeout_ms >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  // Return value
+  ssize_t bytes_read = 0;
+
+  pthread_mutex_lock(&p->lock);
+  while (p->queue_count == 0 && !p->decoder_done) {
+    if (timeout_ms < 0)
+      pthread_cond_wait(&p->ready, &p->lock);
+    else if (pthread_cond_timedwait(&p->ready, &p->lock, &deadline) ==
+             ETIMEDOUT)
+      break;
+  }
+  if (p->queue_count == 0) goto cleanup;
+
+  // Copy out what fits of the frame at the head
+  ssize_t len = p->queue_len[p->queue_head];
+  if (len < 0) {
+    bytes_read = -1;
+  } else {
+    bytes_read = len - p->queue_offset;
+    if ((size_t)bytes_read > read_len) bytes_read = read_len;
+    memcpy(buffer, &p->queue[p->queue_head][p->queue_offset], bytes_read);
+    p->queue_offset += bytes_read;
+    if (p->queue_offset < (size_t)len) goto cleanup;
+  }
+  p->queue_head = (p->queue_head + 1) % ANTENNA_PIPELINE_QUEUE_LEN;
+  p->queue_count--;
+  p->queue_offset = 0;
+
+cleanup:
+  pthread_mutex_unlock(&p->lock);
+
+  // done
+  return bytes_read;
+}
+
+/**
+ * @brief Stops both threads, decodes what is left in the ring and releases the
+ * pipeline. Does not close the fd.
+ *
+ * @param p Pipeline to stop.
+ */
+void antenna_pipeline_stop(struct antenna_pipeline *p) {
+  uint64_t one = 1;
+  if (write(p->stopfd, &one, sizeof(one)) < 0)
+    printf("[!] Failed to stop pipeline reader\n");
+  pthread_join(p->reader, NULL);
+  pthread_join(p->decoder, NULL);
+
+  close(p->datafd);
+  close(p->stopfd);
+  free(p->queue);
+  pthread_cond_destroy(&p->ready);
+  pthread_mutex_destroy(&p->lock);
+  antenna_ring_destroy(&p->ring);
+}
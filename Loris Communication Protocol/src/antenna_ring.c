@@ -0,0 +1,175 @@
+/**
+ * @file antenna_ring.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Lock-free single producer, single consumer byte ring
+ * @version 0.1
+ * @date 2022-04-20
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_ring.h"
+
+// Standard C libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Generates a new ring at memory location r. Must be allocated memory or
+ * undefined behavior will occur.
+ *
+ * @param r Pointer to allocated ring which will be initialized.
+ * @param size Capacity in bytes, rounded up to a power of two.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_ring_new(struct antenna_ring *r, size_t size) {
+  // Check for NULL pointers
+  if (r == NULL) {
+    printf("[!] Cannot initialize null ring\n");
+    return -1;
+  }
+
+  // A power of two size lets the counters wrap with a mask
+  size_t capacity = ANTENNA_CACHELINE;
+  while (capacity < size) capacity <<= 1;
+
+  memset(r, 0, sizeof(struct antenna_ring));
+  if (posix_memalign((void **)&r->buffer, ANTENNA_CACHELINE, capacity) != 0) {
+    printf("[!] Failed to allocate ring of %zu bytes\n", capacity);
+    return -1;
+  }
+  r->size = capacity;
+  r->mask = capacity - 1;
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Releases the ring buffer.
+ *
+ * @param r Ring to tear down.
+ */
+void antenna_ring_destroy(struct antenna_ring *r) {
+  if (r == NULL) return;
+  free(r->buffer);
+  r->buffer = NULL;
+}
+
+/**
+ * @brief Producer only. Finds the largest contiguous free span.
+ *
+ * @param r Ring to write to.
+ * @param span Set to the start of the span.
+ * @return number of bytes that may be written at span, 0 if the ring is full.
+ */
+size_t antenna_ring_write_peek(struct antenna_ring *r, uint8_t **span) {
+  size_t head = r->head;
+  size_t free_len = r->size - (head - r->head_cached_tail);
+  if (free_len == 0) {
+    // Only look at the consumer's counter when the cached one says full
+    r->head_cached_tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    free_len = r->size - (head - r->head_cached_tail);
+  }
+
+  // Stop at the end of the buffer
+  size_t offset = head & r->mask;
+  size_t contiguous = r->size - offset;
+  *span = &r->buffer[offset];
+  return (free_len < contiguous) ? free_len : contiguous;
+}
+
+/**
+ * @brief Producer only. Publishes len bytes written at the last peeked span.
+ *
+ * @param r Ring to write to.
+ * @param len Number of bytes written, at most the peeked length.
+ */
+void antenna_ring_write_commit(struct antenna_ring *r, size_t len) {
+  size_t head = r->head + len;
+  __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+
+  // Track the deepest the ring has been, against a fresh tail
+  size_t used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  if (used > r->high_water)
+    __atomic_store_n(&r->high_water, used, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Producer only. Records bytes that were dropped because the ring was
+ * full.
+ *
+ * @param r Ring to account on.
+ * @param len Number of bytes dropped.
+ */
+void antenna_ring_overrun(struct antenna_ring *r, size_t len) {
+  __atomic_store_n(&r->overruns, r->overruns + len, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Consumer only. Finds the largest contiguous span of unread bytes.
+ *
+ * @param r Ring to read from.
+ * @param span Set to the start of the span.
+ * @return number of bytes readable at span, 0 if the ring is empty.
+ */
+size_t antenna_ring_read_peek(struct antenna_ring *r, const uint8_t **span) {
+  size_t tail = r->tail;
+  size_t used = r->tail_cached_head - tail;
+  if (used == 0) {
+    // Only look at the producer's counter when the cached one says empty
+    r->tail_cached_head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    used = r->tail_cached_head - tail;
+  }
+
+  // Stop at the end of the buffer
+  size_t offset = tail & r->mask;
+  size_t contiguous = r->size - offset;
+  *span = &r->buffer[offset];
+  return (used < contiguous) ? used : contiguous;
+}
+
+/**
+ * @brief Consumer only. Releases len bytes read from the last peeked span.
+ *
+ * @param r Ring to read from.
+ * @param len Number of bytes consumed, at most the peeked length.
+ */
+void antenna_ring_read_commit(struct antenna_ring *r, size_t len) {
+  __atomic_store_n(&r->tail, r->tail + len, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Number of unread bytes. Exact only when called from the producer or
+ * the consumer thread with the other side idle.
+ *
+ * @param r Ring to inspect.
+ * @return number of bytes in the ring.
+ */
+size_t antenna_ring_used(struct antenna_ring *r) {
+  return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) -
+         __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Deepest the ring has been, in bytes. Safe from any thread.
+ *
+ * @param r Ring to inspect.
+ * @return high water mark.
+ */
+size_t antenna_ring_high_water(struct antenna_ring *r) {
+  return __atomic_load_n(&r->high_water, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Bytes dropped so far because the ring was full. Safe from any
+ * thread.
+ *
+ * @param r Ring to inspect.
+ * @return number of bytes dropped.
+ */
+size_t antenna_ring_overruns(struct antenna_ring *r) {
+  return __atomic_load_n(&r->overruns, __ATOMIC_RELAXED);
+}
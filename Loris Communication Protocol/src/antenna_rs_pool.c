@@ -0,0 +1,404 @@
+/**
+ * @file antenna_rs_pool.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Reed-solomon encode/decode of large buffers across all cores
+ * @version 0.1
+ * @date 2022-04-22
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_rs_pool.h"
+
+// Standard C libraries
+#include <sys/mman.h>
+
+// Works through blocks of the current job until none are left
+static void pool_work(struct antenna_rs_pool_worker *w) {
+  struct antenna_rs_pool *p = w->pool;
+  size_t failed = 0;
+  for (;;) {
+    size_t first =
+        __atomic_fetch_add(&p->next_block, p->grain, __ATOMIC_RELAXED);
+    if (first >= p->blocks) break;
+    size_t last = first + p->grain;
+    if (last > p->blocks) last = p->blocks;
+
+    for (size_t b = first; b < last; b++) {
+      if (p->mode == ANTENNA_RS_POOL_ENCODE) {
+        size_t offset = b * RS_DATA_LEN;
+        size_t len = p->in_len - offset;
+        if (len > RS_DATA_LEN) len = RS_DATA_LEN;
+        correct_reed_solomon_encode(w->encoder, &p->in[offset], len,
+                                    &p->out[b * ANTENNA_RS_POOL_BLOCK_LEN]);
+      } else {
+        size_t offset = b * ANTENNA_RS_POOL_BLOCK_LEN;
+        size_t len = p->in_len - offset;
+        if (len > ANTENNA_RS_POOL_BLOCK_LEN) len = ANTENNA_RS_POOL_BLOCK_LEN;
+        uint8_t *data = &p->out[b * RS_DATA_LEN];
+        if (correct_reed_solomon_syndrome_decode(w->decoder, &p->in[offset],
+                                                 len, data) < 0) {
+          // Keep the data bytes as they came
+          memcpy(data, &p->in[offset], len - RS_NUM_ROOTS);
+          failed++;
+        }
+      }
+    }
+  }
+
+  if (failed > 0) __atomic_fetch_add(&p->failed, failed, __ATOMIC_RELAXED);
+}
+
+static void *pool_thread(void *data) {
+  struct antenna_rs_pool_worker *w = data;
+  struct antenna_rs_pool *p = w->pool;
+  uint64_t seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&p->lock);
+    while (!p->shutdown && p->generation == seen)
+      pthread_cond_wait(&p->start, &p->lock);
+    if (p->shutdown) {
+      pthread_mutex_unlock(&p->lock);
+      break;
+    }
+    seen = p->generation;
+    pthread_mutex_unlock(&p->lock);
+
+    pool_work(w);
+
+    pthread_mutex_lock(&p->lock);
+    if (--p->busy == 0) pthread_cond_signal(&p->done);
+    pthread_mutex_unlock(&p->lock);
+  }
+
+  return NULL;
+}
+
+// Runs one job on every worker and waits for it to finish. Returns the number
+// of failed blocks.
+static size_t pool_run(struct antenna_rs_pool *p, int mode, const uint8_t *in,
+                       size_t in_len, uint8_t *out, size_t blocks) {
+  pthread_mutex_lock(&p->run_lock);
+
+  p->mode = mode;
+  p->in = in;
+  p->in_len = in_len;
+  p->out = out;
+  p->blocks = blocks;
+  p->next_block = 0;
+  p->failed = 0;
+
+  // Share the blocks out evenly, in grains no smaller than is worth waking
+  // the other threads for
+  size_t grain = (blocks + p->worker_count - 1) / p->worker_count;
+  if (grain > ANTENNA_RS_POOL_GRAIN) grain = ANTENNA_RS_POOL_GRAIN;
+  if (grain < ANTENNA_RS_POOL_MIN_GRAIN) grain = ANTENNA_RS_POOL_MIN_GRAIN;
+  p->grain = grain;
+  int parallel = p->worker_count > 1 && blocks > grain;
+  if (parallel) {
+    pthread_mutex_lock(&p->lock);
+    p->busy = p->worker_count - 1;
+    p->generation++;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+  }
+
+  pool_work(&p->workers[0]);
+
+  if (parallel) {
+    pthread_mutex_lock(&p->lock);
+    while (p->busy > 0) pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+  }
+
+  size_t failed = p->failed;
+  pthread_mutex_unlock(&p->run_lock);
+  return failed;
+}
+
+/**
+ * @brief Generates a new pool at memory location p and starts its threads.
+ * Must be allocated memory or undefined behavior will occur.
+ *
+ * @param p Pointer to allocated pool which will be initialized.
+ * @param workers Number of workers including the caller, or 0 for one per
+ * online CPU. At most ANTENNA_RS_POOL_MAX_WORKERS.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_rs_pool_new(struct antenna_rs_pool *p, size_t workers) {
+  // Check for NULL pointers
+  if (p == NULL) {
+    printf("[!] Cannot initialize null RS pool\n");
+    return -1;
+  }
+
+  if (workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = (cpus > 0) ? cpus : 1;
+    if (workers > ANTENNA_RS_POOL_MAX_WORKERS)
+      workers = ANTENNA_RS_POOL_MAX_WORKERS;
+  }
+  if (workers > ANTENNA_RS_POOL_MAX_WORKERS) {
+    printf("[!] Invalid RS pool size %zu\n", workers);
+    return -1;
+  }
+
+  memset(p, 0, sizeof(struct antenna_rs_pool));
+  p->worker_count = workers;
+  if ((p->workers = calloc(workers, sizeof(struct antenna_rs_pool_worker))) ==
+      NULL) {
+    printf("[!] Failed to allocate RS pool\n");
+    return -1;
+  }
+  pthread_mutex_init(&p->run_lock, NULL);
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->start, NULL);
+  pthread_cond_init(&p->done, NULL);
+
+  for (size_t x = 0; x < workers; x++) {
+    struct antenna_rs_pool_worker *w = &p->workers[x];
+    w->pool = p;
+    w->encoder = correct_reed_solomon_create(
+        correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, RS_NUM_ROOTS);
+    w->decoder = correct_reed_solomon_syndrome_create(
+        correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, RS_NUM_ROOTS);
+    if (w->encoder == NULL || w->decoder == NULL) {
+      printf("[!] Failed to create RS encoder/decoder\n");
+      goto error;
+    }
+  }
+
+  // Worker 0 is whoever submits the job
+  for (size_t x = 1; x < workers; x++) {
+    struct antenna_rs_pool_worker *w = &p->workers[x];
+    if (pthread_create(&w->thread, NULL, pool_thread, w) != 0) {
+      printf("[!] Failed to start RS pool worker\n");
+      goto error;
+    }
+    w->started = 1;
+  }
+
+  // done
+  return 0;
+
+error:
+  antenna_rs_pool_destroy(p);
+  return -1;
+}
+
+/**
+ * @brief Stops the threads and releases the pool.
+ *
+ * @param p Pool to tear down.
+ */
+void antenna_rs_pool_destroy(struct antenna_rs_pool *p) {
+  if (p == NULL || p->workers == NULL) return;
+
+  pthread_mutex_lock(&p->lock);
+  p->shutdown = 1;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  for (size_t x = 0; x < p->worker_count; x++) {
+    struct antenna_rs_pool_worker *w = &p->workers[x];
+    if (w->started) pthread_join(w->thread, NULL);
+    if (w->encoder != NULL) correct_reed_solomon_destroy(w->encoder);
+    if (w->decoder != NULL) correct_reed_solomon_syndrome_destroy(w->decoder);
+  }
+
+  pthread_cond_destroy(&p->start);
+  pthread_cond_destroy(&p->done);
+  pthread_mutex_destroy(&p->lock);
+  pthread_mutex_destroy(&p->run_lock);
+  free(p->workers);
+  p->workers = NULL;
+}
+
+/**
+ * @brief Number of encoded bytes for data_len bytes of data.
+ *
+ * @param data_len Number of data bytes.
+ * @return number of encoded bytes.
+ */
+size_t antenna_rs_pool_encoded_len(size_t data_len) {
+  size_t blocks = (data_len + RS_DATA_LEN - 1) / RS_DATA_LEN;
+  return data_len + blocks * RS_NUM_ROOTS;
+}
+
+/**
+ * @brief Number of data bytes in encoded_len bytes of blocks.
+ *
+ * @param encoded_len Number of encoded bytes.
+ * @return number of data bytes or -1 if encoded_len is not a valid length.
+ */
+ssize_t antenna_rs_pool_decoded_len(size_t encoded_len) {
+  size_t blocks =
+      (encoded_len + ANTENNA_RS_POOL_BLOCK_LEN - 1) / ANTENNA_RS_POOL_BLOCK_LEN;
+  size_t last = encoded_len - (blocks - 1) * ANTENNA_RS_POOL_BLOCK_LEN;
+  if (blocks > 0 && last <= RS_NUM_ROOTS) return -1;
+  return encoded_len - blocks * RS_NUM_ROOTS;
+}
+
+/**
+ * @brief Encodes a buffer across the pool.
+ *
+ * @param p Pool to use.
+ * @param data Array of bytes to encode.
+ * @param data_len Number of bytes from data to encode.
+ * @param encoded Output buffer of antenna_rs_pool_encoded_len(data_len) bytes.
+ * @return number of encoded bytes or -1 on error.
+ */
+ssize_t antenna_rs_pool_encode(struct antenna_rs_pool *p, const uint8_t *data,
+                               size_t data_len, uint8_t *encoded) {
+  size_t blocks = (data_len + RS_DATA_LEN - 1) / RS_DATA_LEN;
+  pool_run(p, ANTENNA_RS_POOL_ENCODE, data, data_len, encoded, blocks);
+  return antenna_rs_pool_encoded_len(data_len);
+}
+
+/**
+ * @brief Decodes a buffer across the pool. Blocks that cannot be corrected
+ * are passed through with their data bytes as received.
+ *
+ * @param p Pool to use.
+ * @param encoded Array of encoded blocks.
+ * @param encoded_len Number of bytes in encoded.
+ * @param data Output buffer of antenna_rs_pool_decoded_len(encoded_len) bytes.
+ * @param failed If not NULL, set to the number of uncorrectable blocks.
+ * @return number of decoded bytes or -1 on error.
+ */
+ssize_t antenna_rs_pool_decode(struct antenna_rs_pool *p,
+                               const uint8_t *encoded, size_t encoded_len,
+                               uint8_t *data, size_t *failed) {
+  ssize_t data_len = antenna_rs_pool_decoded_len(encoded_len);
+  if (data_len < 0) {
+    printf("[!] Invalid encoded length %zu\n", encoded_len);
+    return -1;
+  }
+
+  size_t blocks =
+      (encoded_len + ANTENNA_RS_POOL_BLOCK_LEN - 1) / ANTENNA_RS_POOL_BLOCK_LEN;
+  size_t failed_blocks =
+      pool_run(p, ANTENNA_RS_POOL_DECODE, encoded, encoded_len, data, blocks);
+  if (failed != NULL) *failed = failed_blocks;
+  return data_len;
+}
+
+// Maps in_path for reading and out_path, sized out_len(in size), for writing.
+// Lengths of 0 are left unmapped.
+static int pool_map_files(const char *in_path, const char *out_path,
+                          ssize_t (*out_len)(size_t), const uint8_t **in,
+                          size_t *in_len, uint8_t **out, size_t *out_size) {
+  int in_fd = open(in_path, O_RDONLY);
+  if (in_fd < 0) {
+    printf("[!] Failed to open %s\n", in_path);
+    return -1;
+  }
+  struct stat st;
+  if (fstat(in_fd, &st) < 0) {
+    printf("[!] Failed to stat %s\n", in_path);
+    close(in_fd);
+    return -1;
+  }
+  *in_len = st.st_size;
+  ssize_t len = out_len(*in_len);
+  if (len < 0) {
+    printf("[!] %s is not a whole number of blocks\n", in_path);
+    close(in_fd);
+    return -1;
+  }
+  *out_size = len;
+
+  *in = NULL;
+  if (*in_len > 0) {
+    *in = mmap(NULL, *in_len, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    if (*in == MAP_FAILED) {
+      printf("[!] Failed to map %s\n", in_path);
+      close(in_fd);
+      return -1;
+    }
+    madvise((void *)*in, *in_len, MADV_SEQUENTIAL);
+  }
+  close(in_fd);
+
+  int out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0 || ftruncate(out_fd, *out_size) < 0) {
+    printf("[!] Failed to create %s\n", out_path);
+    goto error;
+  }
+  *out = NULL;
+  if (*out_size > 0 &&
+      (*out = mmap(NULL, *out_size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd,
+                   0)) == MAP_FAILED) {
+    printf("[!] Failed to map %s\n", out_path);
+    goto error;
+  }
+  close(out_fd);
+  return 0;
+
+error:
+  if (out_fd >= 0) close(out_fd);
+  if (*in != NULL) munmap((void *)*in, *in_len);
+  return -1;
+}
+
+static void pool_unmap_files(const uint8_t *in, size_t in_len, uint8_t *out,
+                             size_t out_len) {
+  if (in != NULL) munmap((void *)in, in_len);
+  if (out != NULL) munmap(out, out_len);
+}
+
+static ssize_t pool_encoded_len(size_t data_len) {
+  return antenna_rs_pool_encoded_len(data_len);
+}
+
+/**
+ * @brief Encodes a file into another across the pool. Both are memory mapped,
+ * so the input is never copied whole.
+ *
+ * @param p Pool to use.
+ * @param in_path Path to the file to encode.
+ * @param out_path Path to the encoded file, created or truncated.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_rs_pool_encode_file(struct antenna_rs_pool *p, const char *in_path,
+                                const char *out_path) {
+  const uint8_t *in;
+  uint8_t *out;
+  size_t in_len, out_len;
+  if (pool_map_files(in_path, out_path, pool_encoded_len, &in, &in_len, &out,
+                     &out_len) < 0)
+    return -1;
+
+  antenna_rs_pool_encode(p, in, in_len, out);
+  pool_unmap_files(in, in_len, out, out_len);
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Decodes a file of encoded blocks, e.g. a recorded pass, into another
+ * across the pool. Both are memory mapped.
+ *
+ * @param p Pool to use.
+ * @param in_path Path to the encoded file.
+ * @param out_path Path to the decoded file, created or truncated.
+ * @param failed If not NULL, set to the number of uncorrectable blocks.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_rs_pool_decode_file(struct antenna_rs_pool *p, const char *in_path,
+                                const char *out_path, size_t *failed) {
+  const uint8_t *in;
+  uint8_t *out;
+  size_t in_len, out_len;
+  if (pool_map_files(in_path, out_path, antenna_rs_pool_decoded_len, &in,
+                     &in_len, &out, &out_len) < 0)
+    return -1;
+
+  antenna_rs_pool_decode(p, in, in_len, out, failed);
+  pool_unmap_files(in, in_len, out, out_len);
+
+  // done
+  return 0;
+}
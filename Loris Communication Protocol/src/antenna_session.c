@@ -0,0 +1,1261 @@
+/**
+ * @file antenna_session.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Persistent Reed-solomon session for the antenna lib for loris
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+#include "antenna_session.h"
+
+// Project headers
+#include "antenna_rs_pool.h"
+
+// Shared session used by the legacy antenna_*_rs calls
+static struct antenna_session shared_session;
+static struct antenna_rs_pool shared_pool;
+static pthread_once_t shared_session_once = PTHREAD_ONCE_INIT;
+static int shared_session_status = -1;
+
+static void shared_session_init() {
+  shared_session_status = antenna_session_new(&shared_session, -1);
+
+  // Files and images go out through the shared session, so spread their
+  // encoding over every core. Without the pool it is done on the caller.
+  if (shared_session_status == 0 && antenna_rs_pool_new(&shared_pool, 0) == 0)
+    antenna_session_set_pool(&shared_session, &shared_pool);
+}
+
+// Parity bytes of each code
+static const int fec_roots[ANTENNA_FEC_LEVELS] = {RS_NUM_ROOTS, 8, 16, 32};
+
+// (Re)allocates the TX staging area for the given number of codewords
+static int session_alloc_stage(struct antenna_session *s, size_t blocks) {
+  size_t stage_blocks =
+      (blocks > ANTENNA_MAX_INTERLEAVE) ? blocks : ANTENNA_MAX_INTERLEAVE;
+  uint8_t *stage = realloc(s->tx_stage, stage_blocks * RS_BLOCK_LEN);
+  if (stage == NULL) return -1;
+  s->tx_stage = stage;
+
+  // Each frame may go out behind its own header
+  struct iovec *iov = realloc(s->tx_iov, 2 * blocks * sizeof(struct iovec));
+  if (iov == NULL) return -1;
+  s->tx_iov = iov;
+
+  uint8_t(*header)[PACKET_HEADER_LEN] =
+      realloc(s->tx_header, blocks * PACKET_HEADER_LEN);
+  if (header == NULL) return -1;
+  s->tx_header = header;
+
+  // Convolutionally coded frames need their own, roughly twice as large, area
+  if (s->coding == ANTENNA_CODING_RS_CONV) {
+    uint8_t *coded =
+        realloc(s->tx_coded, stage_blocks * ANTENNA_CONV_BLOCK_LEN);
+    if (coded == NULL) return -1;
+    s->tx_coded = coded;
+  }
+
+  s->tx_flush.batch_blocks = blocks;
+  return 0;
+}
+
+// Returns the interleaver of a code for depth, building it on first use.
+// Callers hold the lock of the direction the cache belongs to.
+static correct_reed_solomon_interleaved *session_interleaver(
+    correct_reed_solomon_interleaved *(*cache)[ANTENNA_MAX_INTERLEAVE + 1],
+    int level, int depth) {
+  if (cache[level][depth] == NULL) {
+    cache[level][depth] = correct_reed_solomon_interleaved_create(
+        correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, fec_roots[level],
+        depth);
+    if (cache[level][depth] == NULL)
+      printf("[!] Failed to create RS(%d) interleaver of depth %d\n",
+             fec_roots[level], depth);
+  }
+  return cache[level][depth];
+}
+
+// Header flags for a frame sent with level, carrying the receive half's
+// request when adaptive
+static uint8_t session_flags(struct antenna_session *s, int level) {
+  uint8_t flags = level;
+  if (s->fec.adaptive)
+    flags |= ANTENNA_FLAG_REQUEST_VALID |
+             (__atomic_load_n(&s->fec.rx_level, __ATOMIC_RELAXED)
+              << ANTENNA_FLAG_REQUEST_SHIFT);
+  return flags;
+}
+
+// Weakest code with twice the parity needed for errors symbol errors
+static int fec_level_for(size_t errors) {
+  for (int level = 0; level < ANTENNA_FEC_LEVELS; level++)
+    if ((size_t)fec_roots[level] >= 4 * errors) return level;
+  return ANTENNA_FEC_LEVELS - 1;
+}
+
+// Feeds one received frame into the code selection. block holds the frame as
+// received and decoded what came out of the decoder, or NULL if it failed.
+// Callers hold rx_lock.
+static void session_fec_measure(struct antenna_session *s, int level,
+                                int depth, uint8_t flags, const uint8_t *block,
+                                const uint8_t *decoded, size_t decoded_len) {
+  struct antenna_fec *fec = &s->fec;
+  fec->frames[level]++;
+
+  // Follow the other end's request
+  if (fec->adaptive && (flags & ANTENNA_FLAG_REQUEST_VALID))
+    __atomic_store_n(&fec->tx_level,
+                     (flags >> ANTENNA_FLAG_REQUEST_SHIFT) &
+                         ANTENNA_FLAG_FEC_MASK,
+                     __ATOMIC_RELAXED);
+
+  // Corrected data symbols of the worst codeword. Parity symbols are not
+  // seen, which the margin in fec_level_for() covers.
+  size_t peak = 0;
+  if (decoded != NULL) {
+    size_t lanes[ANTENNA_MAX_INTERLEAVE] = {0};
+    for (size_t x = 0; x < decoded_len; x++)
+      if (block[x] != decoded[x]) lanes[x % depth]++;
+    for (int lane = 0; lane < depth; lane++) {
+      fec->symbols_corrected += lanes[lane];
+      if (lanes[lane] > peak) peak = lanes[lane];
+    }
+  } else {
+    fec->frames_failed++;
+  }
+  if (!fec->adaptive) return;
+
+  int current = fec->rx_level;
+  int wanted = fec_level_for(peak);
+  if (decoded == NULL) {
+    wanted = ((level > current) ? level : current) + 1;
+    if (wanted >= ANTENNA_FEC_LEVELS) wanted = ANTENNA_FEC_LEVELS - 1;
+  }
+
+  if (decoded == NULL || wanted > current) {
+    // Step up at once
+    __atomic_store_n(&fec->rx_level, wanted, __ATOMIC_RELAXED);
+    fec->window_frames = 0;
+    fec->window_peak = 0;
+  } else {
+    // Step down one code at a time once a whole window fits the weaker one
+    if (peak > fec->window_peak) fec->window_peak = peak;
+    if (++fec->window_frames >= ANTENNA_FEC_WINDOW) {
+      if (current > 0 && fec_level_for(fec->window_peak) < current)
+        __atomic_store_n(&fec->rx_level, current - 1, __ATOMIC_RELAXED);
+      fec->window_frames = 0;
+      fec->window_peak = 0;
+    }
+  }
+}
+
+// Runs one frame through Reed-solomon and, if enabled, the inner code. The
+// Reed-solomon block goes into frame and the inner code into coded. Points
+// *out at the bytes to send and returns their length. Callers hold tx_lock.
+static ssize_t session_encode(struct antenna_session *s,
+                              correct_reed_solomon_interleaved *interleaver,
+                              int level, int depth, const uint8_t *chunk,
+                              size_t len, uint8_t *frame, uint8_t *coded,
+                              uint8_t **out) {
+  ssize_t encoded_len =
+      (depth == 1)
+          ? correct_reed_solomon_encode(s->encoder[level], chunk, len, frame)
+          : correct_reed_solomon_interleaved_encode(interleaver, chunk, len,
+                                                    frame);
+  if (encoded_len < 0) {
+    printf("[!] Failed to encode data\n");
+    return -1;
+  }
+
+  // Wrap the frame in the inner code
+  *out = frame;
+  if (s->coding == ANTENNA_CODING_RS_CONV) {
+    if ((encoded_len =
+             antenna_conv_encode(&s->tx_conv, frame, encoded_len, coded)) < 0)
+      return -1;
+    *out = coded;
+  }
+  return encoded_len;
+}
+
+// Encodes up to max_frames plain codewords of data across the session's pool
+// into the staging area and queues them in tx_iov behind their headers. Only
+// for depth 1, level 0 and no inner code or compression, which is what the
+// pool encodes. Sets *frames and *iovcnt and returns the data bytes taken.
+// Callers hold tx_lock.
+static size_t session_encode_pooled(struct antenna_session *s, int level,
+                                    const uint8_t *data, size_t data_len,
+                                    size_t max_frames, size_t *frames,
+                                    int *iovcnt) {
+  size_t len = max_frames * RS_DATA_LEN;
+  if (len > data_len) len = data_len;
+  size_t encoded_len = antenna_rs_pool_encode(s->tx_pool, data, len,
+                                              s->tx_stage);
+
+  // The pool packs blocks back to back, only the last one short
+  uint8_t flags = session_flags(s, level);
+  for (size_t offset = 0; offset < encoded_len;
+       offset += ANTENNA_RS_POOL_BLOCK_LEN) {
+    size_t frame_len = encoded_len - offset;
+    if (frame_len > ANTENNA_RS_POOL_BLOCK_LEN)
+      frame_len = ANTENNA_RS_POOL_BLOCK_LEN;
+    if (s->framing == ANTENNA_FRAMING_ASM) {
+      antenna_packet_header(s->tx_header[*frames], frame_len, flags);
+      s->tx_iov[*iovcnt].iov_base = s->tx_header[*frames];
+      s->tx_iov[*iovcnt].iov_len = PACKET_HEADER_LEN;
+      (*iovcnt)++;
+    }
+    s->tx_iov[*iovcnt].iov_base = &s->tx_stage[offset];
+    s->tx_iov[*iovcnt].iov_len = frame_len;
+    (*iovcnt)++;
+    (*frames)++;
+  }
+  return len;
+}
+
+// Undoes session_encode on a received frame, leaving the data in
+// s->rx_decoded. erasures are offsets into received of bytes known to be bad.
+// flags are those of the frame header, if any. Returns the number of bytes
+// decoded. Callers hold rx_lock.
+static ssize_t session_decode(struct antenna_session *s,
+                              correct_reed_solomon_interleaved *interleaver,
+                              int level, int depth, uint8_t flags,
+                              const uint8_t *received, size_t received_len,
+                              const uint16_t *erasures, size_t erasure_count) {
+  // Viterbi decode back to the Reed-solomon frame. A bad coded byte does not
+  // map onto one Reed-solomon symbol, so erasures only apply without it.
+  const uint8_t *block = received;
+  ssize_t block_len = received_len;
+  if (s->coding == ANTENNA_CODING_RS_CONV) {
+    // A framed block takes its length from the header, which allows more
+    // than rx_block holds at any rate
+    if (received_len > antenna_conv_received_len(&s->rx_conv,
+                                                 sizeof(s->rx_block))) {
+      printf("[!] Coded frame of %zu bytes is too long\n", received_len);
+      return -1;
+    }
+    if ((block_len = antenna_conv_decode(&s->rx_conv, received, received_len,
+                                         s->rx_block,
+                                         sizeof(s->rx_block))) < 0)
+      return -1;
+    block = s->rx_block;
+    erasure_count = 0;
+  }
+
+  ssize_t decoded_len;
+  if (depth == 1) {
+    // The plain decoder takes byte sized positions
+    size_t count = 0;
+    for (size_t x = 0; x < erasure_count && count < RS_BLOCK_LEN; x++)
+      if (erasures[x] < block_len) s->rx_erasures[count++] = erasures[x];
+    decoded_len = correct_reed_solomon_syndrome_decode_with_erasures(
+        s->decoder[level], block, block_len, s->rx_erasures, count,
+        s->rx_decoded);
+  } else {
+    decoded_len = correct_reed_solomon_interleaved_decode_with_erasures(
+        interleaver, block, block_len, erasures, erasure_count,
+        s->rx_decoded);
+  }
+  s->rx_erasures_used += erasure_count;
+  session_fec_measure(s, level, depth, flags, block,
+                      (decoded_len < 0) ? NULL : s->rx_decoded,
+                      (decoded_len < 0) ? 0 : decoded_len);
+  if (decoded_len < 0) printf("[!] Failed to decode incoming block\n");
+  return decoded_len;
+}
+
+// Compresses the start of data into s->tx_packed as one frame of at most
+// frame_data_len bytes. Returns the frame length and sets *consumed to the
+// bytes of data it carries, or returns 0 if compression is off or would not
+// save space. Callers hold tx_lock.
+static size_t session_compress(struct antenna_session *s, const uint8_t *data,
+                               size_t data_len, size_t frame_data_len,
+                               size_t *consumed) {
+  *consumed = 0;
+  if (!s->tx_compress || frame_data_len <= ANTENNA_LZ_PREFIX_LEN) return 0;
+
+  size_t packed_len =
+      ANTENNA_LZ_PREFIX_LEN +
+      antenna_lz_compress(&s->tx_lz, data, data_len, consumed,
+                          &s->tx_packed[ANTENNA_LZ_PREFIX_LEN],
+                          frame_data_len - ANTENNA_LZ_PREFIX_LEN);
+  if (packed_len >= *consumed) return 0;
+
+  // Original length in front
+  s->tx_packed[0] = *consumed >> 8;
+  s->tx_packed[1] = *consumed & 0xFF;
+  return packed_len;
+}
+
+// Expands a compressed frame decoded into s->rx_decoded into out, which holds
+// at least ANTENNA_LZ_BLOCK_LEN bytes. Returns the expanded length or -1 if the
+// frame is malformed. Callers hold rx_lock.
+static ssize_t session_expand(struct antenna_session *s, size_t decoded_len,
+                              uint8_t *out) {
+  size_t len = 0;
+  if (decoded_len >= ANTENNA_LZ_PREFIX_LEN)
+    len = ((size_t)s->rx_decoded[0] << 8) | s->rx_decoded[1];
+  if (len == 0 || len > ANTENNA_LZ_BLOCK_LEN ||
+      antenna_lz_decompress(&s->rx_decoded[ANTENNA_LZ_PREFIX_LEN],
+                            decoded_len - ANTENNA_LZ_PREFIX_LEN, out,
+                            len) < 0) {
+    printf("[!] Failed to expand compressed frame\n");
+    return -1;
+  }
+  return len;
+}
+
+static void session_free_interleavers(
+    correct_reed_solomon_interleaved *(*cache)[ANTENNA_MAX_INTERLEAVE + 1]) {
+  for (int level = 0; level < ANTENNA_FEC_LEVELS; level++) {
+    for (int depth = 0; depth <= ANTENNA_MAX_INTERLEAVE; depth++) {
+      correct_reed_solomon_interleaved_destroy(cache[level][depth]);
+      cache[level][depth] = NULL;
+    }
+  }
+}
+
+static void session_free_coders(struct antenna_session *s) {
+  for (int level = 0; level < ANTENNA_FEC_LEVELS; level++) {
+    if (s->encoder[level] != NULL) correct_reed_solomon_destroy(s->encoder[level]);
+    if (s->decoder[level] != NULL)
+      correct_reed_solomon_syndrome_destroy(s->decoder[level]);
+    s->encoder[level] = NULL;
+    s->decoder[level] = NULL;
+  }
+}
+
+/**
+ * @brief Builds the Reed-solomon encoder/decoder for a new session. Must be
+ * allocated memory or undefined behavior will occur.
+ *
+ * @param s Pointer to allocated session which will be initialized.
+ * @param fd File descriptor the session reads from and writes to.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_new(struct antenna_session *s, int fd) {
+  // Check for NULL pointers
+  if (s == NULL) {
+    printf("[!] Cannot initialize null session\n");
+    return -1;
+  }
+
+  memset(s, 0, sizeof(struct antenna_session));
+  s->fd = fd;
+  s->interleave = 1;
+  s->coding = ANTENNA_CODING_RS;
+  s->conv_rate = ANTENNA_CONV_RATE_1_2;
+  s->framing = ANTENNA_FRAMING_ASM;
+  s->rx_timeout = -1;
+
+  // Create one coder per direction and code so RX and TX never share scratch
+  // state, and a frame in any code can be decoded as soon as it arrives
+  for (int level = 0; level < ANTENNA_FEC_LEVELS; level++) {
+    s->encoder[level] = correct_reed_solomon_create(
+        correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, fec_roots[level]);
+    // Clean blocks are screened by their syndromes before the full decoder
+    // runs, which also prepares the decode tables up front
+    s->decoder[level] = correct_reed_solomon_syndrome_create(
+        correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, fec_roots[level]);
+    if (s->encoder[level] == NULL || s->decoder[level] == NULL) {
+      printf("[!] Failed to create RS encoder/decoder\n");
+      goto error;
+    }
+  }
+
+  // Preallocate the TX staging area
+  s->tx_flush.drain = ANTENNA_FLUSH_NONE;
+  if (session_alloc_stage(s, ANTENNA_TX_BATCH_DEFAULT) < 0) {
+    printf("[!] Failed to allocate session TX staging area\n");
+    goto error;
+  }
+
+  // Frames are delimited with a sync marker by default
+  if ((s->rx_deframer = malloc(sizeof(struct antenna_deframer))) == NULL ||
+      antenna_deframer_new(s->rx_deframer, PACKET_ASM_TOLERANCE) < 0) {
+    printf("[!] Failed to create session deframer\n");
+    goto error;
+  }
+
+  if (pthread_mutex_init(&s->tx_lock, NULL) != 0) {
+    printf("[!] Failed to create session TX lock\n");
+    goto error;
+  }
+  if (pthread_mutex_init(&s->rx_lock, NULL) != 0) {
+    printf("[!] Failed to create session RX lock\n");
+    pthread_mutex_destroy(&s->tx_lock);
+    goto error;
+  }
+
+  // done
+  return 0;
+
+error:
+  session_free_coders(s);
+  free(s->tx_stage);
+  free(s->tx_iov);
+  free(s->tx_header);
+  free(s->rx_deframer);
+  return -1;
+}
+
+/**
+ * @brief Releases the coders owned by the session. Does not close the fd.
+ *
+ * @param s Session to tear down.
+ */
+void antenna_session_destroy(struct antenna_session *s) {
+  if (s == NULL || s->encoder[0] == NULL) return;
+
+  pthread_mutex_destroy(&s->tx_lock);
+  pthread_mutex_destroy(&s->rx_lock);
+  session_free_coders(s);
+  session_free_interleavers(s->tx_interleaver);
+  session_free_interleavers(s->rx_interleaver);
+  antenna_conv_destroy(&s->tx_conv);
+  antenna_conv_destroy(&s->rx_conv);
+  free(s->tx_stage);
+  free(s->tx_iov);
+  free(s->tx_coded);
+  free(s->rx_coded);
+  free(s->tx_header);
+  free(s->rx_deframer);
+  s->tx_stage = NULL;
+  s->tx_iov = NULL;
+  s->tx_coded = NULL;
+  s->rx_coded = NULL;
+  s->tx_header = NULL;
+  s->rx_deframer = NULL;
+}
+
+/**
+ * @brief Changes how the session hands encoded blocks to the kernel.
+ *
+ * @param s Session to configure.
+ * @param policy New flush policy. batch_blocks must be in
+ * [1, ANTENNA_TX_BATCH_MAX].
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_flush(struct antenna_session *s,
+                              const struct antenna_flush_policy *policy) {
+  if (policy->batch_blocks < 1 || policy->batch_blocks > ANTENNA_TX_BATCH_MAX) {
+    printf("[!] Invalid TX batch size %zu\n", policy->batch_blocks);
+    return -1;
+  }
+
+  int status = 0;
+  pthread_mutex_lock(&s->tx_lock);
+  if (session_alloc_stage(s, policy->batch_blocks) < 0) {
+    printf("[!] Failed to resize session TX staging area\n");
+    status = -1;
+  } else {
+    s->tx_flush = *policy;
+  }
+  pthread_mutex_unlock(&s->tx_lock);
+
+  return status;
+}
+
+/**
+ * @brief Sets the interleave depth used by antenna_session_write_rs and
+ * antenna_session_read_rs. Depth 1 sends plain codewords back to back; depth
+ * I sends I codewords interleaved symbol by symbol, so a burst of up to I times
+ * the correctable symbol count is still recovered. Both ends of the link must
+ * use the same depth.
+ *
+ * @param s Session to configure.
+ * @param depth Interleave depth in [1, ANTENNA_MAX_INTERLEAVE].
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_interleave(struct antenna_session *s, int depth) {
+  if (depth < 1 || depth > ANTENNA_MAX_INTERLEAVE) {
+    printf("[!] Invalid interleave depth %d\n", depth);
+    return -1;
+  }
+
+  // Build both interleavers up front so the first frame does not pay for it
+  int status = 0;
+  pthread_mutex_lock(&s->tx_lock);
+  pthread_mutex_lock(&s->rx_lock);
+  if (depth > 1 &&
+      (session_interleaver(s->tx_interleaver, s->fec.tx_level, depth) == NULL ||
+       session_interleaver(s->rx_interleaver, s->fec.rx_level, depth) ==
+           NULL)) {
+    status = -1;
+  } else {
+    s->interleave = depth;
+  }
+  pthread_mutex_unlock(&s->rx_lock);
+  pthread_mutex_unlock(&s->tx_lock);
+
+  return status;
+}
+
+/**
+ * @brief Selects the channel coding of the session. ANTENNA_CODING_RS sends
+ * Reed-solomon frames as they are. ANTENNA_CODING_RS_CONV adds the CCSDS
+ * rate 1/2, K = 7 convolutional code under Reed-solomon, so each frame goes
+ * out convolutionally coded and is Viterbi decoded before Reed-solomon on the
+ * way in, at the rate set with antenna_session_set_conv_rate. With soft
+ * decisions the receiver reads one soft byte per coded bit (see struct
+ * antenna_conv). Both ends of the link must use the same coding.
+ *
+ * @param s Session to configure.
+ * @param coding ANTENNA_CODING_RS or ANTENNA_CODING_RS_CONV.
+ * @param decision ANTENNA_DECISION_HARD or ANTENNA_DECISION_SOFT. Ignored for
+ * ANTENNA_CODING_RS.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_coding(struct antenna_session *s, int coding,
+                               int decision) {
+  if (coding != ANTENNA_CODING_RS && coding != ANTENNA_CODING_RS_CONV) {
+    printf("[!] Invalid coding %d\n", coding);
+    return -1;
+  }
+
+  int status = 0;
+  pthread_mutex_lock(&s->tx_lock);
+  pthread_mutex_lock(&s->rx_lock);
+
+  // The deframer works on bytes, not soft symbols
+  if (coding == ANTENNA_CODING_RS_CONV && decision == ANTENNA_DECISION_SOFT &&
+      s->framing != ANTENNA_FRAMING_NONE) {
+    printf("[!] Soft decisions need ANTENNA_FRAMING_NONE\n");
+    status = -1;
+    goto cleanup;
+  }
+
+  // Drop the previous inner code, if any
+  antenna_conv_destroy(&s->tx_conv);
+  antenna_conv_destroy(&s->rx_conv);
+  s->coding = coding;
+  if (coding == ANTENNA_CODING_RS) goto cleanup;
+
+  if (antenna_conv_new(&s->tx_conv, ANTENNA_DECISION_HARD) < 0 ||
+      antenna_conv_new(&s->rx_conv, decision) < 0 ||
+      antenna_conv_set_rate(&s->tx_conv, s->conv_rate) < 0 ||
+      antenna_conv_set_rate(&s->rx_conv, s->conv_rate) < 0) {
+    status = -1;
+    goto error;
+  }
+
+  if (session_alloc_stage(s, s->tx_flush.batch_blocks) < 0 ||
+      (s->rx_coded == NULL &&
+       (s->rx_coded = malloc(ANTENNA_CONV_RX_LEN)) == NULL)) {
+    printf("[!] Failed to allocate session convolutional buffers\n");
+    status = -1;
+    goto error;
+  }
+  goto cleanup;
+
+error:
+  antenna_conv_destroy(&s->tx_conv);
+  antenna_conv_destroy(&s->rx_conv);
+  s->coding = ANTENNA_CODING_RS;
+
+cleanup:
+  pthread_mutex_unlock(&s->rx_lock);
+  pthread_mutex_unlock(&s->tx_lock);
+
+  return status;
+}
+
+/**
+ * @brief Selects the rate of the convolutional code, which is punctured from
+ * rate 1/2 above that (see antenna_conv.h). Higher rates carry more data per
+ * coded bit and correct fewer errors, so the rate is meant to be picked for
+ * each pass from its expected link margin. The rate is not signalled on the
+ * wire, so both ends of the link must switch together. It is kept across
+ * antenna_session_set_coding calls, and takes effect with
+ * ANTENNA_CODING_RS_CONV.
+ *
+ * @param s Session to configure.
+ * @param rate ANTENNA_CONV_RATE_1_2 (the default), _2_3, _3_4, _5_6 or _7_8.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_conv_rate(struct antenna_session *s, int rate) {
+  if (rate < ANTENNA_CONV_RATE_1_2 || rate >= ANTENNA_CONV_RATES) {
+    printf("[!] Invalid convolutional code rate %d\n", rate);
+    return -1;
+  }
+
+  pthread_mutex_lock(&s->tx_lock);
+  pthread_mutex_lock(&s->rx_lock);
+  s->conv_rate = rate;
+  if (s->coding == ANTENNA_CODING_RS_CONV) {
+    antenna_conv_set_rate(&s->tx_conv, rate);
+    antenna_conv_set_rate(&s->rx_conv, rate);
+  }
+  pthread_mutex_unlock(&s->rx_lock);
+  pthread_mutex_unlock(&s->tx_lock);
+
+  // done
+  return 0;
+}
+
+/**
+ * @brief Selects how frames are delimited on the wire. With
+ * ANTENNA_FRAMING_ASM (the default) every frame is sent behind a sync marker
+ * and header (see antenna_packet.h), and the receiver finds frames by
+ * searching for the marker, so dropped or garbage bytes only cost the frames
+ * they touch. ANTENNA_FRAMING_NONE sends frames back to back and relies on
+ * every read lining up with a frame. Soft decisions need ANTENNA_FRAMING_NONE.
+ * Both ends of the link must use the same framing.
+ *
+ * @param s Session to configure.
+ * @param framing ANTENNA_FRAMING_NONE or ANTENNA_FRAMING_ASM.
+ * @param tolerance Bit errors accepted in the sync marker, 0 to
+ * PACKET_ASM_TOLERANCE_MAX. Ignored for ANTENNA_FRAMING_NONE.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_framing(struct antenna_session *s, int framing,
+                                int tolerance) {
+  if (framing != ANTENNA_FRAMING_NONE && framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] Invalid framing %d\n", framing);
+    return -1;
+  }
+
+  int status = 0;
+  pthread_mutex_lock(&s->tx_lock);
+  pthread_mutex_lock(&s->rx_lock);
+
+  // Without headers the code in use cannot be signalled
+  if (framing == ANTENNA_FRAMING_NONE && s->fec.adaptive) {
+    printf("[!] Adaptive FEC needs ANTENNA_FRAMING_ASM\n");
+    status = -1;
+    goto cleanup;
+  }
+  if (framing == ANTENNA_FRAMING_NONE && s->tx_compress) {
+    printf("[!] Compression needs ANTENNA_FRAMING_ASM\n");
+    status = -1;
+    goto cleanup;
+  }
+
+  if (framing == ANTENNA_FRAMING_ASM) {
+    if (s->coding == ANTENNA_CODING_RS_CONV &&
+        s->rx_conv.decision == ANTENNA_DECISION_SOFT) {
+      printf("[!] Soft decisions need ANTENNA_FRAMING_NONE\n");
+      status = -1;
+      goto cleanup;
+    }
+
+    // Start searching afresh, dropping anything left from before
+    if ((s->rx_deframer == NULL &&
+         (s->rx_deframer = malloc(sizeof(struct antenna_deframer))) == NULL) ||
+        antenna_deframer_new(s->rx_deframer, tolerance) < 0) {
+      printf("[!] Failed to create session deframer\n");
+      status = -1;
+      goto cleanup;
+    }
+    antenna_deframer_set_parmrk(s->rx_deframer, s->rx_parmrk);
+  }
+  s->framing = framing;
+
+cleanup:
+  pthread_mutex_unlock(&s->rx_lock);
+  pthread_mutex_unlock(&s->tx_lock);
+
+  return status;
+}
+
+/**
+ * @brief Selects the Reed-solomon code (see struct antenna_fec). A fixed code
+ * is used for everything sent. Framed receivers decode every frame with the
+ * code its header names, whatever their own setting; without framing both
+ * ends must use the same code. ANTENNA_FEC_ADAPTIVE starts from the current
+ * code and follows link quality, and needs ANTENNA_FRAMING_ASM and traffic
+ * both ways.
+ *
+ * @param s Session to configure.
+ * @param level ANTENNA_FEC_RS2, _RS8, _RS16, _RS32 or ANTENNA_FEC_ADAPTIVE.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_fec(struct antenna_session *s, int level) {
+  if (level != ANTENNA_FEC_ADAPTIVE &&
+      (level < ANTENNA_FEC_RS2 || level >= ANTENNA_FEC_LEVELS)) {
+    printf("[!] Invalid FEC level %d\n", level);
+    return -1;
+  }
+
+  int status = 0;
+  pthread_mutex_lock(&s->tx_lock);
+  pthread_mutex_lock(&s->rx_lock);
+
+  if (level == ANTENNA_FEC_ADAPTIVE && s->framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] Adaptive FEC needs ANTENNA_FRAMING_ASM\n");
+    status = -1;
+    goto cleanup;
+  }
+
+  int start = (level == ANTENNA_FEC_ADAPTIVE) ? s->fec.tx_level : level;
+  int depth = s->interleave;
+  if (depth > 1 && (session_interleaver(s->tx_interleaver, start, depth) ==
+                        NULL ||
+                    session_interleaver(s->rx_interleaver, start, depth) ==
+                        NULL)) {
+    status = -1;
+    goto cleanup;
+  }
+
+  s->fec.adaptive = (level == ANTENNA_FEC_ADAPTIVE);
+  __atomic_store_n(&s->fec.tx_level, start, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->fec.rx_level, start, __ATOMIC_RELAXED);
+  s->fec.window_frames = 0;
+  s->fec.window_peak = 0;
+
+cleanup:
+  pthread_mutex_unlock(&s->rx_lock);
+  pthread_mutex_unlock(&s->tx_lock);
+
+  return status;
+}
+
+/**
+ * @brief Turns compression of outgoing data on or off. Each frame then carries
+ * as much data as compresses into it, up to ANTENNA_LZ_BLOCK_LEN bytes, as one
+ * antenna_lz block, and goes out uncompressed when that does not save space.
+ * Frames are compressed on their own, so a lost frame costs no others.
+ * Receivers expand compressed frames whatever their own setting, and bytes of
+ * an expanded frame that do not fit a read are returned by the next one.
+ * Needs ANTENNA_FRAMING_ASM.
+ *
+ * @param s Session to configure.
+ * @param enable 1 to compress, 0 to send data as it is.
+ * @return 0 = OK, -1 = ERR
+ */
+int antenna_session_set_compression(struct antenna_session *s, int enable) {
+  int status = 0;
+  pthread_mutex_lock(&s->tx_lock);
+  pthread_mutex_lock(&s->rx_lock);
+
+  // Whether a frame is compressed travels in its header
+  if (enable && s->framing != ANTENNA_FRAMING_ASM) {
+    printf("[!] Compression needs ANTENNA_FRAMING_ASM\n");
+    status = -1;
+  } else {
+    s->tx_compress = (enable != 0);
+  }
+
+  pthread_mutex_unlock(&s->rx_lock);
+  pthread_mutex_unlock(&s->tx_lock);
+
+  return status;
+}
+
+/**
+ * @brief Hands the session a pool to encode large writes across all cores.
+ * Only writes of plain codewords use it: interleave depth 1, the RS2 code, no
+ * inner code and no compression. Anything else is encoded on the calling
+ * thread as before. The pool must outlive the session or be removed first.
+ *
+ * @param s Session to configure.
+ * @param pool Pool to use, or NULL to encode on the calling thread.
+ */
+void antenna_session_set_pool(struct antenna_session *s,
+                              struct antenna_rs_pool *pool) {
+  pthread_mutex_lock(&s->tx_lock);
+  s->tx_pool = pool;
+  pthread_mutex_unlock(&s->tx_lock);
+}
+
+/**
+ * @brief Sets how long a framed read waits for the next frame before giving
+ * up and returning the bytes decoded so far (0 if none). A frame cut off by
+ * the timeout is still decoded, with its missing tail as erasures.
+ *
+ * @param s Session to configure.
+ * @param timeout_ms Timeout in milliseconds, or < 0 to wait forever (the
+ * default).
+ */
+void antenna_session_set_timeout(struct antenna_session *s, int timeout_ms) {
+  pthread_mutex_lock(&s->rx_lock);
+  s->rx_timeout = timeout_ms;
+  pthread_mutex_unlock(&s->rx_lock);
+}
+
+/**
+ * @brief Tells the session whether its input is PARMRK escaped, as set up by
+ * antenna_set_parmrk_fd(). If so, bytes the UART received with parity or
+ * framing errors are passed to the Reed-solomon decoder as erasures, which
+ * repairs twice as many of them as unknown errors. Needs ANTENNA_FRAMING_ASM,
+ * and only takes effect with ANTENNA_CODING_RS.
+ *
+ * @param s Session to configure.
+ * @param parmrk 1 if the input is PARMRK escaped, 0 if it is raw bytes.
+ */
+void antenna_session_set_parmrk(struct antenna_session *s, int parmrk) {
+  pthread_mutex_lock(&s->rx_lock);
+  s->rx_parmrk = parmrk;
+  if (s->rx_deframer != NULL) antenna_deframer_set_parmrk(s->rx_deframer, parmrk);
+  pthread_mutex_unlock(&s->rx_lock);
+}
+
+/**
+ * @brief Identical to antenna_session_write_rs_fd, but with an explicit
+ * interleave depth instead of the session default.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @param depth Interleave depth in [1, ANTENNA_MAX_INTERLEAVE].
+ * @return 0 on success, -1 on error
+ */
+int antenna_session_write_rs_interleaved_fd(struct antenna_session *s, int fd,
+                                            const char *data, size_t data_len,
+                                            int depth) {
+  if (depth < 1 || depth > ANTENNA_MAX_INTERLEAVE) {
+    printf("[!] Invalid interleave depth %d\n", depth);
+    return -1;
+  }
+
+  // Return status
+  int status = 0;
+
+  pthread_mutex_lock(&s->tx_lock);
+
+  // The code is picked once per call, so a request arriving meanwhile applies
+  // from the next one
+  int level = __atomic_load_n(&s->fec.tx_level, __ATOMIC_RELAXED);
+  correct_reed_solomon_interleaved *interleaver = NULL;
+  if (depth > 1 && (interleaver = session_interleaver(s->tx_interleaver, level,
+                                                      depth)) == NULL) {
+    status = -1;
+    goto cleanup;
+  }
+
+  // An interleaved frame counts as depth blocks towards the batch size
+  size_t frame_data_len = depth * RS_DATA_LEN;
+  size_t batch_frames = s->tx_flush.batch_blocks / depth;
+  if (batch_frames == 0) batch_frames = 1;
+
+  // Plain codewords may be encoded across the pool, a batch at a time
+  int pooled = s->tx_pool != NULL && depth == 1 && level == 0 &&
+               s->coding == ANTENNA_CODING_RS && !s->tx_compress;
+
+  size_t bytes_encoded = 0;
+  while (bytes_encoded < data_len) {
+    // Encode a batch of frames back to back into the staging area
+    size_t frames = 0;
+    int iovcnt = 0;
+    if (pooled)
+      bytes_encoded += session_encode_pooled(
+          s, level, (const uint8_t *)&data[bytes_encoded],
+          data_len - bytes_encoded, batch_frames, &frames, &iovcnt);
+    while (bytes_encoded < data_len && frames < batch_frames) {
+      size_t bytes_remaining = (data_len - bytes_encoded);
+      size_t bytes_to_encode =
+          (bytes_remaining > frame_data_len) ? frame_data_len : bytes_remaining;
+      const uint8_t *chunk = (const uint8_t *)&data[bytes_encoded];
+      size_t chunk_len = bytes_to_encode;
+      uint8_t flags = session_flags(s, level);
+
+      // Send the frame compressed if that carries more or is shorter
+      size_t packed_len = session_compress(s, chunk, bytes_remaining,
+                                           frame_data_len, &bytes_to_encode);
+      if (packed_len > 0) {
+        chunk = s->tx_packed;
+        chunk_len = packed_len;
+        flags |= ANTENNA_FLAG_COMPRESSED;
+      } else {
+        bytes_to_encode = chunk_len;
+      }
+
+      uint8_t *frame = NULL;
+      ssize_t data_encoded_len = session_encode(
+          s, interleaver, level, depth, chunk, chunk_len,
+          &s->tx_stage[frames * depth * RS_BLOCK_LEN],
+          (s->coding == ANTENNA_CODING_RS_CONV)
+              ? &s->tx_coded[frames * depth * ANTENNA_CONV_BLOCK_LEN]
+              : NULL,
+          &frame);
+      if (data_encoded_len < 0) {
+        status = -1;
+        goto cleanup;
+      }
+
+      // Put the sync marker and header in front
+      if (s->framing == ANTENNA_FRAMING_ASM) {
+        if (antenna_packet_header(s->tx_header[frames], data_encoded_len,
+                                  flags) < 0) {
+          status = -1;
+          goto cleanup;
+        }
+        s->tx_iov[iovcnt].iov_base = s->tx_header[frames];
+        s->tx_iov[iovcnt].iov_len = PACKET_HEADER_LEN;
+        iovcnt++;
+      }
+
+      s->tx_iov[iovcnt].iov_base = frame;
+      s->tx_iov[iovcnt].iov_len = data_encoded_len;
+      iovcnt++;
+      frames++;
+
+      // Update counters
+      bytes_encoded += bytes_to_encode;
+    }
+
+    // Send the whole batch in one syscall
+    if (antenna_writev_fd(fd, s->tx_iov, iovcnt) < 0) {
+      printf("[!] Failed to send block of encoded data\n");
+      status = -1;
+      goto cleanup;
+    }
+  }
+
+  // Wait for the UART to shift everything out if asked to
+  if (s->tx_flush.drain == ANTENNA_FLUSH_DRAIN && tcdrain(fd) < 0 &&
+      errno != ENOTTY && errno != EINVAL) {
+    printf("[!] Failed to drain encoded data: %s\n", strerror(errno));
+    status = -1;
+  }
+
+cleanup:
+  pthread_mutex_unlock(&s->tx_lock);
+
+  // done
+  return status;
+}
+
+/**
+ * @brief Identical to antenna_session_write_rs, but allows a custom file
+ * descriptor to be specified.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_session_write_rs_fd(struct antenna_session *s, int fd,
+                                const char *data, size_t data_len) {
+  return antenna_session_write_rs_interleaved_fd(s, fd, data, data_len,
+                                                 s->interleave);
+}
+
+/**
+ * @brief Writes bytes to the session fd with Reed-solomon FEC.
+ *
+ * @param s Session to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @return 0 on success, -1 on error
+ */
+int antenna_session_write_rs(struct antenna_session *s, const char *data,
+                             size_t data_len) {
+  return antenna_session_write_rs_fd(s, s->fd, data, data_len);
+}
+
+/**
+ * @brief Identical to antenna_session_read_rs, but allows a custom file
+ * descriptor to be specified.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_session_read_rs_fd(struct antenna_session *s, int fd, char *buffer,
+                               size_t read_len, int read_mode) {
+  return antenna_session_read_rs_interleaved_fd(s, fd, buffer, read_len,
+                                                read_mode, s->interleave);
+}
+
+/**
+ * @brief Identical to antenna_session_read_rs_fd, but with an explicit
+ * interleave depth instead of the session default. In READ_MODE_UPTO the bytes
+ * returned by one read() must form a whole interleaved frame.
+ *
+ * @param s Session to use.
+ * @param fd File descriptor to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @param depth Interleave depth in [1, ANTENNA_MAX_INTERLEAVE].
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_session_read_rs_interleaved_fd(struct antenna_session *s, int fd,
+                                           char *buffer, size_t read_len,
+                                           int read_mode, int depth) {
+  if (depth < 1 || depth > ANTENNA_MAX_INTERLEAVE) {
+    printf("[!] Invalid interleave depth %d\n", depth);
+    return -1;
+  }
+
+  // Return status
+  int status = 0;
+
+  pthread_mutex_lock(&s->rx_lock);
+
+  // Hand out what is left of the last frame first
+  size_t bytes_decoded = 0;
+  if (s->rx_pending < s->rx_pending_len) {
+    bytes_decoded = s->rx_pending_len - s->rx_pending;
+    if (bytes_decoded > read_len) bytes_decoded = read_len;
+    memcpy(buffer, &s->rx_expanded[s->rx_pending], bytes_decoded);
+    s->rx_pending += bytes_decoded;
+    if (bytes_decoded == read_len || read_mode == READ_MODE_UPTO) goto cleanup;
+  }
+
+  // Parse incoming frames until length satisfied
+  size_t frame_data_len = depth * RS_DATA_LEN;
+  do {
+    // Without framing the code cannot change under the reader, so it is the
+    // one configured. With framing each header names its own.
+    int level = s->fec.rx_level;
+    correct_reed_solomon_interleaved *interleaver = NULL;
+    if (depth > 1 && (interleaver = session_interleaver(s->rx_interleaver, level,
+                                                        depth)) == NULL) {
+      status = -1;
+      goto cleanup;
+    }
+
+    // Frames are sent as (payload + parity), with only the last one short. In
+    // UNTIL mode read exactly one frame so the next read stays aligned.
+    size_t frame_len = depth * (RS_DATA_LEN + fec_roots[level]);
+    size_t bytes_remaining = read_len - bytes_decoded;
+    if (read_mode == READ_MODE_UNTIL && bytes_remaining < frame_data_len)
+      frame_len = (depth == 1) ? bytes_remaining + fec_roots[level]
+                               : correct_reed_solomon_interleaved_encoded_len(
+                                     interleaver, bytes_remaining);
+
+    // With the inner code on, the frame arrives convolutionally coded
+    const uint8_t *received = s->rx_block;
+    size_t received_len = frame_len;
+    if (s->coding == ANTENNA_CODING_RS_CONV) {
+      received = s->rx_coded;
+      received_len = antenna_conv_received_len(&s->rx_conv, frame_len);
+    }
+
+    // Read frame. With framing the header gives its length, otherwise it is
+    // assumed to line up with the read.
+    int bytes_read = -1;
+    const uint16_t *erasures = NULL;
+    size_t erasure_count = 0;
+    uint8_t flags = 0;
+    if (s->framing == ANTENNA_FRAMING_ASM) {
+      struct antenna_packet p;
+      if ((bytes_read = antenna_deframer_read_fd(s->rx_deframer, fd, &p,
+                                               s->rx_timeout)) <
+          0) {
+        printf("[!] Failed to read frame from antenna\n");
+        status = -1;
+        goto cleanup;
+      }
+      if (bytes_read > 0) {
+        received = p.data;
+        bytes_read = p.len;
+        erasures = p.erasures;
+        erasure_count = p.erasure_count;
+        flags = p.flags;
+        level = flags & ANTENNA_FLAG_FEC_MASK;
+        if (depth > 1 && (interleaver = session_interleaver(
+                              s->rx_interleaver, level, depth)) == NULL) {
+          status = -1;
+          goto cleanup;
+        }
+      }
+    } else if ((bytes_read = antenna_read_fd(fd, (char *)received,
+                                             received_len, read_mode)) < 0) {
+      printf("[!] Failed to read encoded block from antenna\n");
+      status = -1;
+      goto cleanup;
+    }
+    if (bytes_read == 0) break;
+
+    // Decode it
+    ssize_t new_bytes_decoded =
+        session_decode(s, interleaver, level, depth, flags, received,
+                       bytes_read, erasures, erasure_count);
+    if (new_bytes_decoded < 0) {
+      // The next frame may have begun inside this one
+      if (s->framing == ANTENNA_FRAMING_ASM)
+        antenna_deframer_reject(s->rx_deframer);
+      status = -1;
+      goto cleanup;
+    }
+
+    // Expand compressed frames
+    const uint8_t *decoded = s->rx_decoded;
+    if (flags & ANTENNA_FLAG_COMPRESSED) {
+      if ((new_bytes_decoded =
+               session_expand(s, new_bytes_decoded, s->rx_expanded)) < 0) {
+        status = -1;
+        goto cleanup;
+      }
+      decoded = s->rx_expanded;
+    }
+
+    // Copy decoded bytes into buffer
+    size_t bytes_to_copy = bytes_remaining > (size_t)new_bytes_decoded
+                               ? (size_t)new_bytes_decoded
+                               : bytes_remaining;
+    memcpy(&buffer[bytes_decoded], decoded, bytes_to_copy);
+
+    // Keep what does not fit for the next read. A frame's payload always fits
+    // in rx_expanded.
+    if (bytes_to_copy < (size_t)new_bytes_decoded) {
+      if (decoded != s->rx_expanded)
+        memcpy(&s->rx_expanded[bytes_to_copy], &decoded[bytes_to_copy],
+               new_bytes_decoded - bytes_to_copy);
+      s->rx_pending = bytes_to_copy;
+      s->rx_pending_len = new_bytes_decoded;
+    }
+
+    // Update counters
+    bytes_decoded += bytes_to_copy;
+  } while (bytes_decoded < read_len && read_mode == READ_MODE_UNTIL);
+
+cleanup:
+  pthread_mutex_unlock(&s->rx_lock);
+
+  // done
+  if (status)
+    return status;
+  else
+    return bytes_decoded;
+}
+
+/**
+ * @brief Reads Reed-solomon encoded bytes from the session fd.
+ *
+ * @param s Session to use.
+ * @param buffer Output buffer array for incoming bytes.
+ * @param read_len Read UP TO or block UNTIL this many bytes read.
+ * @param read_mode Set to READ_MODE_UPTO or READ_MODE_UNTIL
+ * @return number of bytes read or < 0 for error.
+ */
+int antenna_session_read_rs(struct antenna_session *s, char *buffer,
+                            size_t read_len, int read_mode) {
+  return antenna_session_read_rs_fd(s, s->fd, buffer, read_len, read_mode);
+}
+
+/**
+ * @brief Encodes one frame into memory instead of writing it to an fd, for
+ * callers that do their own I/O. Takes at most interleave * RS_DATA_LEN bytes.
+ * With compression on, the frame is sent compressed if that makes it shorter.
+ *
+ * @param s Session to use.
+ * @param data Array of bytes to send.
+ * @param data_len Number of bytes from data to send.
+ * @param frame Output buffer of at least ANTENNA_FRAME_MAX_LEN bytes. Holds
+ * the header (when framed) and the coded frame.
+ * @return number of bytes written to frame or -1 on error.
+ */
+ssize_t antenna_session_encode_frame(struct antenna_session *s,
+                                     const char *data, size_t data_len,
+                                     uint8_t *frame) {
+  if (data_len == 0 || data_len > (size_t)s->interleave * RS_DATA_LEN) {
+    printf("[!] Invalid frame length %zu\n", data_len);
+    return -1;
+  }
+
+  // Return value
+  ssize_t frame_len = -1;
+
+  pthread_mutex_lock(&s->tx_lock);
+
+  int depth = s->interleave;
+  int level = __atomic_load_n(&s->fec.tx_level, __ATOMIC_RELAXED);
+  correct_reed_solomon_interleaved *interleaver = NULL;
+  if (depth > 1 && (interleaver = session_interleaver(s->tx_interleaver, level,
+                                                      depth)) == NULL)
+    goto cleanup;
+
+  // Compress only if the whole of data fits
+  const uint8_t *chunk = (const uint8_t *)data;
+  size_t chunk_len = data_len;
+  uint8_t flags = session_flags(s, level);
+  size_t consumed = 0;
+  size_t packed_len =
+      session_compress(s, chunk, data_len, depth * RS_DATA_LEN, &consumed);
+  if (packed_len > 0 && consumed == data_len) {
+    chunk = s->tx_packed;
+    chunk_len = packed_len;
+    flags |= ANTENNA_FLAG_COMPRESSED;
+  }
+
+  // Leave room for the header, which needs the coded length
+  size_t header_len = (s->framing == ANTENNA_FRAMING_ASM) ? PACKET_HEADER_LEN : 0;
+  uint8_t *coded = NULL;
+  ssize_t coded_len =
+      session_encode(s, interleaver, level, depth, chunk, chunk_len,
+                     (s->coding == ANTENNA_CODING_RS_CONV) ? s->tx_stage
+                                                           : &frame[header_len],
+                     &frame[header_len], &coded);
+  if (coded_len < 0) goto cleanup;
+  if (header_len > 0 &&
+      antenna_packet_header(frame, coded_len, flags) < 0)
+    goto cleanup;
+  frame_len = header_len + coded_len;
+
+cleanup:
+  pthread_mutex_unlock(&s->tx_lock);
+
+  // done
+  return frame_len;
+}
+
+/**
+ * @brief Decodes one frame pulled from the session deframer, for callers that
+ * do their own I/O. A frame that fails to decode is handed back to the
+ * deframer with antenna_deframer_reject(), so call this before feeding it
+ * again.
+ *
+ * @param s Session to use.
+ * @param p Frame from antenna_deframer_next() on s->rx_deframer.
+ * @param buffer Output buffer of at least ANTENNA_LZ_BLOCK_LEN bytes if the
+ * other end compresses, otherwise interleave * RS_DATA_LEN bytes.
+ * @return number of bytes decoded or -1 on error.
+ */
+ssize_t antenna_session_decode_frame(struct antenna_session *s,
+                                     const struct antenna_packet *p,
+                                     char *buffer) {
+  // Return value
+  ssize_t decoded_len = -1;
+
+  pthread_mutex_lock(&s->rx_lock);
+
+  int depth = s->interleave;
+  int level = p->flags & ANTENNA_FLAG_FEC_MASK;
+  correct_reed_solomon_interleaved *interleaver = NULL;
+  if (depth > 1 && (interleaver = session_interleaver(s->rx_interleaver, level,
+                                                      depth)) == NULL)
+    goto cleanup;
+
+  if ((decoded_len = session_decode(s, interleaver, level, depth, p->flags,
+                                    p->data, p->len, p->erasures,
+                                    p->erasure_count)) < 0) {
+    // The next frame may have begun inside this one
+    antenna_deframer_reject(s->rx_deframer);
+    goto cleanup;
+  }
+  if (decoded_len == 0) goto cleanup;
+  if (p->flags & ANTENNA_FLAG_COMPRESSED)
+    decoded_len = session_expand(s, decoded_len, (uint8_t *)buffer);
+  else
+    memcpy(buffer, s->rx_decoded, decoded_len);
+
+cleanup:
+  pthread_mutex_unlock(&s->rx_lock);
+
+  // done
+  return decoded_len;
+}
+
+/**
+ * @brief Returns the process-wide session used by the legacy antenna_*_rs
+ * calls. It is built on first use, with a pool that encodes its large writes
+ * across every core.
+ *
+ * @return shared session or NULL on error.
+ */
+struct antenna_session *antenna_session_shared() {
+  pthread_once(&shared_session_once, shared_session_init);
+  return (shared_session_status == 0) ? &shared_session : NULL;
+}
@@ -1,5 +1,6 @@
 // Project headers
 #include "antenna.h"
+#include "antenna_pipeline.h"
 
 // Standard C libraries
 #include <stdio.h>
@@ -33,6 +34,7 @@ int main(int argc, char *argv[]) {
     char txt_file_data[MAX_TXT_FILE_SIZE];
     char *dynamic_file_data = NULL;
     size_t bytes_to_read;
+    struct antenna_pipeline pipeline;
 
     printf(
         "[?] Read or write (r/w) or encoded (R/W) or receive text file (f) or "
@@ -102,11 +104,28 @@ int main(int argc, char *argv[]) {
         //   bytes_to_read = MAX_TXT_FILE_SIZE;
         dynamic_file_data = malloc(bytes_to_read);
         printf("[!] Reading text file...\n");
-        if ((data_len = antenna_read_rs(dynamic_file_data, bytes_to_read,
-                                        READ_MODE_UNTIL)) < 0) {
-          printf("[!] failed to antenna read upto %d bytes\n", choice_len);
+        // Drain the port on its own thread while frames are decoded, so it
+        // does not overflow during a long file
+        if (antenna_pipeline_start(&pipeline, antenna_session_shared(),
+                                   antenna_get_fd(), 0, NULL, NULL) < 0) {
+          printf("[!] failed to start receive pipeline\n");
           return -1;
         }
+        data_len = 0;
+        while (data_len < bytes_to_read) {
+          ssize_t new_bytes_read = antenna_pipeline_recv(
+              &pipeline, &dynamic_file_data[data_len], bytes_to_read - data_len,
+              -1);
+          if (new_bytes_read < 0) {
+            printf("[!] failed to antenna read until %lu bytes\n",
+                   bytes_to_read);
+            antenna_pipeline_stop(&pipeline);
+            return -1;
+          }
+          if (new_bytes_read == 0) break;
+          data_len += new_bytes_read;
+        }
+        antenna_pipeline_stop(&pipeline);
         // fputs(txt_file_data, file_pointer);
         fwrite(dynamic_file_data, sizeof(char), data_len, file_pointer); // NOTE: using fwrite for this to work with bitmaps
         fclose(file_pointer);
@@ -0,0 +1,185 @@
+/**
+ * @file ber-bench.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Bit error rate versus Eb/N0 of the antenna channel codings over a
+ * simulated BPSK/AWGN channel
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+// Project headers
+#include "antenna.h"
+#include "antenna_conv.h"
+#include "correct-syndrome.h"
+
+// libcorrect test bench
+#include "correct/util/error-sim.h"
+
+// Settings
+#define MSG_LEN RS_DATA_LEN
+#define MIN_BITS 2000000
+#define MIN_ERRORS 500
+#define EB_N0_MIN 0.0
+#define EB_N0_MAX 7.0
+#define EB_N0_STEP 1.0
+
+// One channel coding under test
+struct codec {
+  const char *name;
+  int rs;
+  int conv;
+  correct_reed_solomon *encoder;
+  correct_reed_solomon_syndrome *decoder;
+  struct antenna_conv tx;
+  struct antenna_conv rx;
+  uint8_t block[RS_BLOCK_LEN];
+  uint8_t received[8 * ((CONV_ENCODED_BITS(RS_BLOCK_LEN) + 7) / 8)];
+};
+
+// Bytes entering the inner code for msg_len bytes of message
+static size_t codec_block_len(struct codec *c, size_t msg_len) {
+  return c->rs ? msg_len + RS_NUM_ROOTS : msg_len;
+}
+
+static size_t codec_enclen(void *codec, size_t msg_len) {
+  struct codec *c = codec;
+  size_t block_len = codec_block_len(c, msg_len);
+  return c->conv ? CONV_ENCODED_BITS(block_len) : 8 * block_len;
+}
+
+static void codec_encode(void *codec, uint8_t *msg, size_t msg_len,
+                         uint8_t *encoded) {
+  struct codec *c = codec;
+  const uint8_t *block = msg;
+  size_t block_len = codec_block_len(c, msg_len);
+
+  if (c->rs) {
+    correct_reed_solomon_encode(c->encoder, msg, msg_len, c->block);
+    block = c->block;
+  }
+  if (c->conv)
+    antenna_conv_encode(&c->tx, block, block_len, encoded);
+  else
+    memcpy(encoded, block, block_len);
+}
+
+static ssize_t codec_decode(void *codec, uint8_t *soft, size_t soft_len,
+                            uint8_t *msg) {
+  struct codec *c = codec;
+  size_t msg_len = MSG_LEN;
+  size_t block_len = codec_block_len(c, msg_len);
+
+  if (c->conv) {
+    // The receiver sees whole bytes, so mark the padding bits as erased
+    size_t received_len = antenna_conv_received_len(&c->rx, block_len);
+    if (c->rx.decision == ANTENNA_DECISION_SOFT) {
+      memcpy(c->received, soft, soft_len);
+      memset(&c->received[soft_len], 128, received_len - soft_len);
+    } else {
+      memset(c->received, 0, received_len);
+      for (size_t x = 0; x < soft_len; x++)
+        if (soft[x] > 127) c->received[x / 8] |= 0x80 >> (x % 8);
+    }
+    antenna_conv_decode(&c->rx, c->received, received_len, c->block,
+                        sizeof(c->block));
+  } else {
+    memset(c->block, 0, block_len);
+    for (size_t x = 0; x < soft_len; x++)
+      if (soft[x] > 127) c->block[x / 8] |= 0x80 >> (x % 8);
+  }
+
+  // When Reed-solomon gives up the receiver still has the systematic bytes
+  if (!c->rs ||
+      correct_reed_solomon_syndrome_decode(c->decoder, c->block, block_len,
+                                           msg) < 0)
+    memcpy(msg, c->block, msg_len);
+
+  return msg_len;
+}
+
+static int codec_new(struct codec *c, const char *name, int rs, int conv,
+                     int decision) {
+  memset(c, 0, sizeof(struct codec));
+  c->name = name;
+  c->rs = rs;
+  c->conv = conv;
+  c->encoder = correct_reed_solomon_create(
+      correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, RS_NUM_ROOTS);
+  c->decoder = correct_reed_solomon_syndrome_create(
+      correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, RS_NUM_ROOTS);
+  if (c->encoder == NULL || c->decoder == NULL) {
+    printf("[!] Failed to create RS encoder/decoder\n");
+    return -1;
+  }
+  if (antenna_conv_new(&c->tx, ANTENNA_DECISION_HARD) < 0 ||
+      antenna_conv_new(&c->rx, decision) < 0)
+    return -1;
+  return 0;
+}
+
+static void codec_destroy(struct codec *c) {
+  correct_reed_solomon_destroy(c->encoder);
+  correct_reed_solomon_syndrome_destroy(c->decoder);
+  antenna_conv_destroy(&c->tx);
+  antenna_conv_destroy(&c->rx);
+}
+
+// Runs messages through the channel until enough bits or errors are seen
+static double ber(struct codec *c, conv_testbench **scratch, double eb_n0) {
+  const double bpsk_voltage = 1.0 / sqrt(2.0);
+  const double bpsk_sym_energy = pow(bpsk_voltage, 2.0);
+
+  *scratch = resize_conv_testbench(*scratch, codec_enclen, c, MSG_LEN);
+  (*scratch)->encode = codec_encode;
+  (*scratch)->encoder = c;
+  (*scratch)->decode = codec_decode;
+  (*scratch)->decoder = c;
+
+  // Charge every message bit for all the symbols sent for it
+  double bpsk_bit_energy =
+      bpsk_sym_energy * (*scratch)->enclen / (8.0 * MSG_LEN);
+
+  uint8_t msg[MSG_LEN];
+  size_t bits = 0, errors = 0;
+  while (bits < MIN_BITS && errors < MIN_ERRORS) {
+    for (size_t x = 0; x < MSG_LEN; x++) msg[x] = rand();
+    build_white_noise((*scratch)->noise, (*scratch)->enclen, eb_n0,
+                      bpsk_bit_energy);
+    errors += test_conv_noise(*scratch, msg, MSG_LEN, bpsk_voltage);
+    bits += 8 * MSG_LEN;
+  }
+  return (double)errors / bits;
+}
+
+int main() {
+  struct codec codecs[6];
+  if (codec_new(&codecs[0], "uncoded", 0, 0, ANTENNA_DECISION_HARD) < 0 ||
+      codec_new(&codecs[1], "rs", 1, 0, ANTENNA_DECISION_HARD) < 0 ||
+      codec_new(&codecs[2], "conv-hard", 0, 1, ANTENNA_DECISION_HARD) < 0 ||
+      codec_new(&codecs[3], "conv-soft", 0, 1, ANTENNA_DECISION_SOFT) < 0 ||
+      codec_new(&codecs[4], "rs+conv-hard", 1, 1, ANTENNA_DECISION_HARD) < 0 ||
+      codec_new(&codecs[5], "rs+conv-soft", 1, 1, ANTENNA_DECISION_SOFT) < 0)
+    return -1;
+  size_t codec_count = sizeof(codecs) / sizeof(codecs[0]);
+
+  printf("[i] BER of %d byte messages over BPSK/AWGN\n", MSG_LEN);
+  printf("%-8s", "Eb/N0");
+  for (size_t x = 0; x < codec_count; x++) printf(" %13s", codecs[x].name);
+  printf("\n");
+
+  conv_testbench *scratch = NULL;
+  for (double eb_n0 = EB_N0_MIN; eb_n0 <= EB_N0_MAX; eb_n0 += EB_N0_STEP) {
+    printf("%-8.1f", eb_n0);
+    for (size_t x = 0; x < codec_count; x++)
+      printf(" %13.2e", ber(&codecs[x], &scratch, eb_n0));
+    printf("\n");
+    fflush(stdout);
+  }
+
+  free_scratch(scratch);
+  for (size_t x = 0; x < codec_count; x++) codec_destroy(&codecs[x]);
+  return 0;
+}
@@ -0,0 +1,142 @@
+// Project headers
+#include "antenna_conv.h"
+
+// Standard C libraries
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      printf("[!] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      return -1;                                            \
+    }                                                       \
+  } while (0)
+
+// Settings
+#define CONV_TEST_MAX_LEN 2040
+
+static const size_t data_lens[] = {1, 2, 3, 7, 223, 255, CONV_TEST_MAX_LEN};
+
+// The X and Y rows of the puncturing table in antenna_conv.h, written out
+// again so the encoder is checked against the published patterns
+static const char *patterns[ANTENNA_CONV_RATES][CONV_RATE] = {
+    [ANTENNA_CONV_RATE_1_2] = {"1", "1"},
+    [ANTENNA_CONV_RATE_2_3] = {"10", "11"},
+    [ANTENNA_CONV_RATE_3_4] = {"101", "110"},
+    [ANTENNA_CONV_RATE_5_6] = {"10101", "11010"},
+    [ANTENNA_CONV_RATE_7_8] = {"1000101", "1111010"},
+};
+
+static int get_bit(const uint8_t *bytes, size_t x) {
+  return (bytes[x / 8] >> (7 - x % 8)) & 1;
+}
+
+// Punctures a rate 1/2 block by hand, returning the number of bits kept
+static size_t puncture(int rate, const uint8_t *full, size_t bits,
+                       uint8_t *out) {
+  size_t period = strlen(patterns[rate][0]);
+  size_t kept = 0;
+  memset(out, 0, (bits + 7) / 8);
+  for (size_t x = 0; x < bits; x++) {
+    if (patterns[rate][x % CONV_RATE][(x / CONV_RATE) % period] != '1')
+      continue;
+    if (get_bit(full, x)) out[kept / 8] |= 0x80 >> (kept % 8);
+    kept++;
+  }
+  return kept;
+}
+
+static int rate_test(int rate, const uint8_t *data, size_t data_len) {
+  static struct antenna_conv ref, hard, soft;
+  static uint8_t full[CONV_ENCODED_BITS(CONV_TEST_MAX_LEN) / 8 + 1];
+  static uint8_t expected[CONV_ENCODED_BITS(CONV_TEST_MAX_LEN) / 8 + 1];
+  static uint8_t coded[CONV_ENCODED_BITS(CONV_TEST_MAX_LEN) / 8 + 1];
+  static uint8_t symbols[CONV_ENCODED_BITS(CONV_TEST_MAX_LEN) + 8];
+  static uint8_t out[CONV_TEST_MAX_LEN];
+
+  CHECK(antenna_conv_new(&ref, ANTENNA_DECISION_HARD) == 0);
+  CHECK(antenna_conv_new(&hard, ANTENNA_DECISION_HARD) == 0);
+  CHECK(antenna_conv_new(&soft, ANTENNA_DECISION_SOFT) == 0);
+  CHECK(antenna_conv_set_rate(&hard, rate) == 0);
+  CHECK(antenna_conv_set_rate(&soft, rate) == 0);
+
+  // The rate 1/2 block, punctured here, must be what the coder sends
+  size_t bits = CONV_ENCODED_BITS(data_len);
+  CHECK(antenna_conv_encode(&ref, data, data_len, full) ==
+        (ssize_t)((bits + 7) / 8));
+  size_t kept = puncture(rate, full, bits, expected);
+  ssize_t coded_len = antenna_conv_encode(&hard, data, data_len, coded);
+  CHECK(coded_len >= 0);
+  CHECK((size_t)coded_len == (kept + 7) / 8);
+  CHECK((size_t)coded_len == antenna_conv_encoded_len(&hard, data_len));
+  CHECK((size_t)coded_len == antenna_conv_encoded_len(&soft, data_len));
+  CHECK(memcmp(coded, expected, coded_len) == 0);
+
+  // Clean round trip with hard decisions
+  CHECK(antenna_conv_received_len(&hard, data_len) == (size_t)coded_len);
+  memset(out, 0, data_len);
+  CHECK(antenna_conv_decode(&hard, coded, coded_len, out, sizeof(out)) ==
+        (ssize_t)data_len);
+  CHECK(memcmp(out, data, data_len) == 0);
+
+  // Soft decisions get one symbol per bit on the wire, padding included
+  size_t received_len = antenna_conv_received_len(&soft, data_len);
+  CHECK(received_len == 8 * (size_t)coded_len);
+  for (size_t x = 0; x < received_len; x++)
+    symbols[x] = get_bit(coded, x) ? 255 : 0;
+  memset(out, 0, data_len);
+  CHECK(antenna_conv_decode(&soft, symbols, received_len, out, sizeof(out)) ==
+        (ssize_t)data_len);
+  CHECK(memcmp(out, data, data_len) == 0);
+
+  // A single error in the middle of the block is corrected at every rate
+  if (data_len >= 7) {
+    size_t x = kept / 2;
+    coded[x / 8] ^= 0x80 >> (x % 8);
+    memset(out, 0, data_len);
+    CHECK(antenna_conv_decode(&hard, coded, coded_len, out, sizeof(out)) ==
+          (ssize_t)data_len);
+    CHECK(memcmp(out, data, data_len) == 0);
+
+    symbols[x] = 255 - symbols[x];
+    memset(out, 0, data_len);
+    CHECK(antenna_conv_decode(&soft, symbols, received_len, out,
+                              sizeof(out)) == (ssize_t)data_len);
+    CHECK(memcmp(out, data, data_len) == 0);
+  }
+
+  antenna_conv_destroy(&ref);
+  antenna_conv_destroy(&hard);
+  antenna_conv_destroy(&soft);
+
+  // done
+  return 0;
+}
+
+int main() {
+  static uint8_t data[CONV_TEST_MAX_LEN];
+  uint32_t rng = 1;
+  for (size_t x = 0; x < sizeof(data); x++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    data[x] = rng;
+  }
+
+  for (int rate = ANTENNA_CONV_RATE_1_2; rate < ANTENNA_CONV_RATES; rate++) {
+    for (size_t x = 0; x < sizeof(data_lens) / sizeof(data_lens[0]); x++) {
+      if (rate_test(rate, data, data_lens[x]) < 0) {
+        printf("[!] Rate %d round trip of %zu bytes failed\n", rate,
+               data_lens[x]);
+        return -1;
+      }
+    }
+  }
+
+  printf("[i] conv tests passed\n");
+
+  // done
+  return 0;
+}
@@ -0,0 +1,359 @@
+#include "correct-interleave.h"
+#include "correct/reed-solomon.h"
+#include "correct/reed-solomon/field.h"
+#include "correct/reed-solomon/gf-simd.h"
+
+// one row holds the same symbol of every codeword in a frame, one lane each
+#define ROW_LEN 16
+
+struct correct_reed_solomon_interleaved {
+    size_t depth;
+    size_t num_roots;
+    field_t field;
+    gf_simd_level_t simd;
+
+    // per-codeword decoder for the (rare) blocks that have errors
+    correct_reed_solomon *rs;
+
+    // nibble tables for generator coefficients g_1 .. g_num_roots
+    // (g_0 = 1 is implicit). entry 0 and entries past num_roots are zero.
+    uint8_t (*generator_lo)[ROW_LEN];
+    uint8_t (*generator_hi)[ROW_LEN];
+
+    // nibble tables for the generator roots alpha^((fcr + j) * gap),
+    // followed by one zero entry so roots can be taken in pairs
+    uint8_t (*root_lo)[ROW_LEN];
+    uint8_t (*root_hi)[ROW_LEN];
+
+    // scratch, parity registers during encode and syndromes during decode
+    // (do no allocations at steady state)
+    uint8_t (*rows)[ROW_LEN];
+
+    uint8_t codeword[255];
+    uint8_t decoded[255];
+    uint8_t erasures[255];
+};
+
+correct_reed_solomon_interleaved *correct_reed_solomon_interleaved_create(
+    uint16_t primitive_polynomial, uint8_t first_consecutive_root,
+    uint8_t generator_root_gap, size_t num_roots, size_t depth) {
+    if (depth < 1 || depth > CORRECT_RS_MAX_INTERLEAVE || num_roots < 1 || num_roots >= 255) {
+        return NULL;
+    }
+
+    correct_reed_solomon_interleaved *rsi = calloc(1, sizeof(correct_reed_solomon_interleaved));
+    if (rsi == NULL) {
+        return NULL;
+    }
+    rsi->depth = depth;
+    rsi->num_roots = num_roots;
+    rsi->simd = gf_simd_detect();
+
+    rsi->rs = correct_reed_solomon_create(primitive_polynomial, first_consecutive_root,
+                                          generator_root_gap, num_roots);
+    rsi->generator_lo = calloc(num_roots + 2, ROW_LEN);
+    rsi->generator_hi = calloc(num_roots + 2, ROW_LEN);
+    rsi->root_lo = calloc(num_roots + 1, ROW_LEN);
+    rsi->root_hi = calloc(num_roots + 1, ROW_LEN);
+    rsi->rows = calloc(num_roots + 4, ROW_LEN);
+    field_element_t *generator = calloc(num_roots + 1, sizeof(field_element_t));
+    if (rsi->rs == NULL || rsi->generator_lo == NULL || rsi->generator_hi == NULL ||
+        rsi->root_lo == NULL || rsi->root_hi == NULL || rsi->rows == NULL ||
+        generator == NULL) {
+        free(generator);
+        correct_reed_solomon_interleaved_destroy(rsi);
+        return NULL;
+    }
+
+    rsi->field = field_create(primitive_polynomial);
+
+    // build g(x) = prod (x - root_j), highest order coefficient first
+    generator[0] = 1;
+    for (size_t j = 0; j < num_roots; j++) {
+        field_element_t root =
+            rsi->field.exp[((first_consecutive_root + j) * generator_root_gap) % 255];
+        gf_nibble_table_fill(rsi->field, root, rsi->root_lo[j], rsi->root_hi[j]);
+        for (size_t i = j + 1; i > 0; i--) {
+            generator[i] ^= field_mul(rsi->field, generator[i - 1], root);
+        }
+    }
+    for (size_t i = 1; i <= num_roots; i++) {
+        gf_nibble_table_fill(rsi->field, generator[i], rsi->generator_lo[i], rsi->generator_hi[i]);
+    }
+    free(generator);
+
+    // build the decode tables of the fallback decoder now rather than on
+    // the first corrupted block
+    memset(rsi->codeword, 0, sizeof(rsi->codeword));
+    correct_reed_solomon_decode(rsi->rs, rsi->codeword, num_roots + 1, rsi->decoded);
+
+    return rsi;
+}
+
+void correct_reed_solomon_interleaved_destroy(correct_reed_solomon_interleaved *rsi) {
+    if (rsi == NULL) {
+        return;
+    }
+    if (rsi->field.exp != NULL) {
+        field_destroy(rsi->field);
+    }
+    if (rsi->rs != NULL) {
+        correct_reed_solomon_destroy(rsi->rs);
+    }
+    free(rsi->generator_lo);
+    free(rsi->generator_hi);
+    free(rsi->root_lo);
+    free(rsi->root_hi);
+    free(rsi->rows);
+    free(rsi);
+}
+
+size_t correct_reed_solomon_interleaved_encoded_len(correct_reed_solomon_interleaved *rsi,
+                                                    size_t msg_length) {
+    size_t symbols = (msg_length + rsi->depth - 1) / rsi->depth;
+    return rsi->depth * (symbols + rsi->num_roots);
+}
+
+// reads the next symbol of every codeword. avail is how many bytes may be
+// read at p; lanes past depth are don't-care and never leave their lane
+static inline uint64_t load_symbols(const uint8_t *p, size_t depth, size_t avail) {
+    uint64_t symbols = 0;
+    memcpy(&symbols, p, (avail >= sizeof(symbols)) ? sizeof(symbols) : depth);
+    return symbols;
+}
+
+static void encode_scalar(correct_reed_solomon_interleaved *rsi, const uint8_t *data,
+                          size_t symbols) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    for (size_t t = 0; t < symbols; t++) {
+        for (size_t lane = 0; lane < depth; lane++) {
+            field_element_t feedback = data[t * depth + lane] ^ rsi->rows[0][lane];
+            // row num_roots is always zero, so the last register just takes
+            // the product
+            for (size_t i = 0; i < num_roots; i++) {
+                rsi->rows[i][lane] =
+                    rsi->rows[i + 1][lane] ^
+                    gf_nibble_mul(rsi->generator_lo[i + 1], rsi->generator_hi[i + 1], feedback);
+            }
+        }
+    }
+}
+
+#ifdef CORRECT_GF_SIMD_X86
+__attribute__((target("ssse3")))
+static void encode_ssse3(correct_reed_solomon_interleaved *rsi, const uint8_t *data,
+                         size_t symbols, size_t avail) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    for (size_t t = 0; t < symbols; t++) {
+        uint64_t in = load_symbols(data + t * depth, depth, avail - t * depth);
+        __m128i feedback = _mm_xor_si128(_mm_loadl_epi64((const __m128i *)&in),
+                                         _mm_loadu_si128((const __m128i *)rsi->rows[0]));
+        for (size_t i = 0; i < num_roots; i++) {
+            __m128i product = gf_mul_ssse3(feedback,
+                                           _mm_loadu_si128((const __m128i *)rsi->generator_lo[i + 1]),
+                                           _mm_loadu_si128((const __m128i *)rsi->generator_hi[i + 1]));
+            __m128i next = _mm_loadu_si128((const __m128i *)rsi->rows[i + 1]);
+            _mm_storeu_si128((__m128i *)rsi->rows[i], _mm_xor_si128(next, product));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2(correct_reed_solomon_interleaved *rsi, const uint8_t *data,
+                        size_t symbols, size_t avail) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    for (size_t t = 0; t < symbols; t++) {
+        uint64_t in = load_symbols(data + t * depth, depth, avail - t * depth);
+        __m128i feedback = _mm_xor_si128(_mm_loadl_epi64((const __m128i *)&in),
+                                         _mm_loadu_si128((const __m128i *)rsi->rows[0]));
+        __m256i feedback2 = _mm256_broadcastsi128_si256(feedback);
+
+        // registers are shifted down one row per symbol. handle two rows per
+        // step, each 128-bit half using its own generator coefficient
+        for (size_t i = 0; i < num_roots; i += 2) {
+            __m256i current = _mm256_loadu_si256((const __m256i *)rsi->rows[i]);
+            __m256i next = _mm256_loadu_si256((const __m256i *)rsi->rows[i + 2]);
+            __m256i shifted = _mm256_permute2x128_si256(current, next, 0x21);
+            __m256i product = gf_mul_avx2(feedback2,
+                                          _mm256_loadu_si256((const __m256i *)rsi->generator_lo[i + 1]),
+                                          _mm256_loadu_si256((const __m256i *)rsi->generator_hi[i + 1]));
+            _mm256_storeu_si256((__m256i *)rsi->rows[i], _mm256_xor_si256(shifted, product));
+        }
+    }
+}
+#endif
+
+ssize_t correct_reed_solomon_interleaved_encode(correct_reed_solomon_interleaved *rsi,
+                                                const uint8_t *msg, size_t msg_length,
+                                                uint8_t *encoded) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    size_t symbols = (msg_length + depth - 1) / depth;
+    if (symbols == 0 || symbols + num_roots > 255) {
+        return -1;
+    }
+
+    // the frame starts with the message itself, zero padded to a whole
+    // number of symbols per codeword
+    size_t data_length = symbols * depth;
+    size_t encoded_length = data_length + num_roots * depth;
+    memmove(encoded, msg, msg_length);
+    memset(encoded + msg_length, 0, data_length - msg_length);
+
+    memset(rsi->rows, 0, (num_roots + 4) * ROW_LEN);
+    switch (rsi->simd) {
+#ifdef CORRECT_GF_SIMD_X86
+        case GF_SIMD_AVX2:
+            encode_avx2(rsi, encoded, symbols, encoded_length);
+            break;
+        case GF_SIMD_SSSE3:
+            encode_ssse3(rsi, encoded, symbols, encoded_length);
+            break;
+#endif
+        default:
+            encode_scalar(rsi, encoded, symbols);
+            break;
+    }
+
+    for (size_t i = 0; i < num_roots; i++) {
+        memcpy(encoded + data_length + i * depth, rsi->rows[i], depth);
+    }
+
+    return encoded_length;
+}
+
+static void syndromes_scalar(correct_reed_solomon_interleaved *rsi, const uint8_t *encoded,
+                             size_t symbols) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    for (size_t t = 0; t < symbols; t++) {
+        for (size_t lane = 0; lane < depth; lane++) {
+            field_element_t in = encoded[t * depth + lane];
+            for (size_t j = 0; j < num_roots; j++) {
+                rsi->rows[j][lane] =
+                    gf_nibble_mul(rsi->root_lo[j], rsi->root_hi[j], rsi->rows[j][lane]) ^ in;
+            }
+        }
+    }
+}
+
+#ifdef CORRECT_GF_SIMD_X86
+__attribute__((target("ssse3")))
+static void syndromes_ssse3(correct_reed_solomon_interleaved *rsi, const uint8_t *encoded,
+                            size_t symbols, size_t avail) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    for (size_t t = 0; t < symbols; t++) {
+        uint64_t in = load_symbols(encoded + t * depth, depth, avail - t * depth);
+        __m128i x = _mm_loadl_epi64((const __m128i *)&in);
+        for (size_t j = 0; j < num_roots; j++) {
+            __m128i s = gf_mul_ssse3(_mm_loadu_si128((const __m128i *)rsi->rows[j]),
+                                     _mm_loadu_si128((const __m128i *)rsi->root_lo[j]),
+                                     _mm_loadu_si128((const __m128i *)rsi->root_hi[j]));
+            _mm_storeu_si128((__m128i *)rsi->rows[j], _mm_xor_si128(s, x));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void syndromes_avx2(correct_reed_solomon_interleaved *rsi, const uint8_t *encoded,
+                           size_t symbols, size_t avail) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    for (size_t t = 0; t < symbols; t++) {
+        uint64_t in = load_symbols(encoded + t * depth, depth, avail - t * depth);
+        __m256i x = _mm256_broadcastsi128_si256(_mm_loadl_epi64((const __m128i *)&in));
+        // two syndromes per step. with an odd number of roots the last
+        // half runs against a zero table and is ignored
+        for (size_t j = 0; j < num_roots; j += 2) {
+            __m256i s = gf_mul_avx2(_mm256_loadu_si256((const __m256i *)rsi->rows[j]),
+                                    _mm256_loadu_si256((const __m256i *)rsi->root_lo[j]),
+                                    _mm256_loadu_si256((const __m256i *)rsi->root_hi[j]));
+            _mm256_storeu_si256((__m256i *)rsi->rows[j], _mm256_xor_si256(s, x));
+        }
+    }
+}
+#endif
+
+ssize_t correct_reed_solomon_interleaved_decode(correct_reed_solomon_interleaved *rsi,
+                                                const uint8_t *encoded, size_t encoded_length,
+                                                uint8_t *msg) {
+    return correct_reed_solomon_interleaved_decode_with_erasures(rsi, encoded, encoded_length,
+                                                                 NULL, 0, msg);
+}
+
+ssize_t correct_reed_solomon_interleaved_decode_with_erasures(
+    correct_reed_solomon_interleaved *rsi, const uint8_t *encoded, size_t encoded_length,
+    const uint16_t *erasure_locations, size_t erasure_length, uint8_t *msg) {
+    size_t depth = rsi->depth;
+    size_t num_roots = rsi->num_roots;
+    if (encoded_length % depth != 0) {
+        return -1;
+    }
+    size_t symbols = encoded_length / depth;
+    if (symbols <= num_roots || symbols > 255) {
+        return -1;
+    }
+    size_t msg_symbols = symbols - num_roots;
+
+    // syndromes of every codeword at once
+    memset(rsi->rows, 0, (num_roots + 4) * ROW_LEN);
+    switch (rsi->simd) {
+#ifdef CORRECT_GF_SIMD_X86
+        case GF_SIMD_AVX2:
+            syndromes_avx2(rsi, encoded, symbols, encoded_length);
+            break;
+        case GF_SIMD_SSSE3:
+            syndromes_ssse3(rsi, encoded, symbols, encoded_length);
+            break;
+#endif
+        default:
+            syndromes_scalar(rsi, encoded, symbols);
+            break;
+    }
+
+    // the payload is already in message order. clean codewords need no
+    // further work; the others are pulled out, repaired and put back
+    memmove(msg, encoded, msg_symbols * depth);
+    for (size_t lane = 0; lane < depth; lane++) {
+        field_element_t syndromes = 0;
+        for (size_t j = 0; j < num_roots; j++) {
+            syndromes |= rsi->rows[j][lane];
+        }
+        if (!syndromes) {
+            continue;
+        }
+
+        for (size_t t = 0; t < symbols; t++) {
+            rsi->codeword[t] = encoded[t * depth + lane];
+        }
+
+        // erasures in this lane, as symbol indices within the codeword. no
+        // more than num_roots may be passed, further ones count as errors
+        size_t lane_erasures = 0;
+        for (size_t e = 0; e < erasure_length && lane_erasures < num_roots; e++) {
+            size_t location = erasure_locations[e];
+            if (location < encoded_length && location % depth == lane) {
+                rsi->erasures[lane_erasures++] = location / depth;
+            }
+        }
+
+        ssize_t status =
+            lane_erasures
+                ? correct_reed_solomon_decode_with_erasures(rsi->rs, rsi->codeword, symbols,
+                                                            rsi->erasures, lane_erasures,
+                                                            rsi->decoded)
+                : correct_reed_solomon_decode(rsi->rs, rsi->codeword, symbols, rsi->decoded);
+        if (status < 0) {
+            return -1;
+        }
+        for (size_t t = 0; t < msg_symbols; t++) {
+            msg[t * depth + lane] = rsi->decoded[t];
+        }
+    }
+
+    return msg_symbols * depth;
+}
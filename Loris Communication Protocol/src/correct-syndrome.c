@@ -0,0 +1,244 @@
+#include "correct-syndrome.h"
+#include "correct/reed-solomon.h"
+#include "correct/reed-solomon/field.h"
+#include "correct/reed-solomon/gf-simd.h"
+
+// widest vector the kernels use, in symbols
+#define MAX_STRIDE 32
+
+// The block is evaluated with a strided Horner scheme. With a stride of s,
+// lane l accumulates symbols l, l + s, l + 2s, ... by
+//   acc_l = acc_l * root^s + r_(l + ks)
+// so a whole vector of lanes is multiplied by the same constant each step.
+// Once every symbol is in, the lanes are combined as
+//   S = sum_l acc_l * root^(s - 1 - l)
+// The block is zero padded at the front to a multiple of s, which does not
+// change the result since the padding only adds zero high order terms.
+
+struct correct_reed_solomon_syndrome {
+    size_t num_roots;
+    field_t field;
+    gf_simd_level_t simd;
+    size_t stride;
+
+    // full decoder for blocks with errors
+    correct_reed_solomon *rs;
+
+    // nibble tables for root_j^stride
+    uint8_t (*step_lo)[16];
+    uint8_t (*step_hi)[16];
+
+    // root_j^(stride - 1 - l) for each lane l
+    field_element_t (*combine)[MAX_STRIDE];
+
+    // scratch (do no allocations at steady state)
+    uint8_t block[MAX_STRIDE + 255];
+    field_element_t lanes[MAX_STRIDE];
+    field_element_t *syndromes;
+};
+
+correct_reed_solomon_syndrome *correct_reed_solomon_syndrome_create(
+    uint16_t primitive_polynomial, uint8_t first_consecutive_root,
+    uint8_t generator_root_gap, size_t num_roots) {
+    if (num_roots < 1 || num_roots >= 255) {
+        return NULL;
+    }
+
+    correct_reed_solomon_syndrome *rss = calloc(1, sizeof(correct_reed_solomon_syndrome));
+    if (rss == NULL) {
+        return NULL;
+    }
+    rss->num_roots = num_roots;
+    rss->simd = gf_simd_detect();
+    switch (rss->simd) {
+        case GF_SIMD_AVX2:
+            rss->stride = 32;
+            break;
+        case GF_SIMD_SSSE3:
+            rss->stride = 16;
+            break;
+        default:
+            rss->stride = 1;
+            break;
+    }
+
+    rss->rs = correct_reed_solomon_create(primitive_polynomial, first_consecutive_root,
+                                          generator_root_gap, num_roots);
+    rss->step_lo = calloc(num_roots, 16);
+    rss->step_hi = calloc(num_roots, 16);
+    rss->combine = calloc(num_roots, sizeof(*rss->combine));
+    rss->syndromes = calloc(num_roots, sizeof(field_element_t));
+    if (rss->rs == NULL || rss->step_lo == NULL || rss->step_hi == NULL ||
+        rss->combine == NULL || rss->syndromes == NULL) {
+        correct_reed_solomon_syndrome_destroy(rss);
+        return NULL;
+    }
+
+    rss->field = field_create(primitive_polynomial);
+    for (size_t j = 0; j < num_roots; j++) {
+        unsigned int root_log = ((first_consecutive_root + j) * generator_root_gap) % 255;
+        field_element_t step = rss->field.exp[(root_log * rss->stride) % 255];
+        gf_nibble_table_fill(rss->field, step, rss->step_lo[j], rss->step_hi[j]);
+        for (size_t l = 0; l < rss->stride; l++) {
+            rss->combine[j][l] = rss->field.exp[(root_log * (rss->stride - 1 - l)) % 255];
+        }
+    }
+
+    // build the decode tables of the full decoder now rather than on the
+    // first corrupted block
+    memset(rss->block, 0, sizeof(rss->block));
+    correct_reed_solomon_decode(rss->rs, rss->block, num_roots + 1, rss->block + MAX_STRIDE);
+
+    return rss;
+}
+
+void correct_reed_solomon_syndrome_destroy(correct_reed_solomon_syndrome *rss) {
+    if (rss == NULL) {
+        return;
+    }
+    if (rss->field.exp != NULL) {
+        field_destroy(rss->field);
+    }
+    if (rss->rs != NULL) {
+        correct_reed_solomon_destroy(rss->rs);
+    }
+    free(rss->step_lo);
+    free(rss->step_hi);
+    free(rss->combine);
+    free(rss->syndromes);
+    free(rss);
+}
+
+static void syndromes_scalar(correct_reed_solomon_syndrome *rss, const uint8_t *block,
+                             size_t length) {
+    for (size_t j = 0; j < rss->num_roots; j++) {
+        const uint8_t *lo = rss->step_lo[j];
+        const uint8_t *hi = rss->step_hi[j];
+        field_element_t acc = 0;
+        for (size_t i = 0; i < length; i++) {
+            acc = gf_nibble_mul(lo, hi, acc) ^ block[i];
+        }
+        rss->syndromes[j] = acc;
+    }
+}
+
+// folds the lanes of one syndrome into a single field element
+static field_element_t syndrome_combine(correct_reed_solomon_syndrome *rss, size_t j) {
+    field_element_t syndrome = 0;
+    for (size_t l = 0; l < rss->stride; l++) {
+        syndrome ^= field_mul(rss->field, rss->lanes[l], rss->combine[j][l]);
+    }
+    return syndrome;
+}
+
+#ifdef CORRECT_GF_SIMD_X86
+__attribute__((target("ssse3")))
+static void syndromes_ssse3(correct_reed_solomon_syndrome *rss, const uint8_t *block,
+                            size_t length) {
+    for (size_t j = 0; j < rss->num_roots; j++) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)rss->step_lo[j]);
+        __m128i hi = _mm_loadu_si128((const __m128i *)rss->step_hi[j]);
+        __m128i acc = _mm_setzero_si128();
+        for (size_t i = 0; i < length; i += 16) {
+            __m128i in = _mm_loadu_si128((const __m128i *)(block + i));
+            acc = _mm_xor_si128(gf_mul_ssse3(acc, lo, hi), in);
+        }
+        _mm_storeu_si128((__m128i *)rss->lanes, acc);
+        rss->syndromes[j] = syndrome_combine(rss, j);
+    }
+}
+
+__attribute__((target("avx2")))
+static void syndromes_avx2(correct_reed_solomon_syndrome *rss, const uint8_t *block,
+                           size_t length) {
+    for (size_t j = 0; j < rss->num_roots; j++) {
+        __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)rss->step_lo[j]));
+        __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)rss->step_hi[j]));
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t i = 0; i < length; i += 32) {
+            __m256i in = _mm256_loadu_si256((const __m256i *)(block + i));
+            acc = _mm256_xor_si256(gf_mul_avx2(acc, lo, hi), in);
+        }
+        _mm256_storeu_si256((__m256i *)rss->lanes, acc);
+        rss->syndromes[j] = syndrome_combine(rss, j);
+    }
+}
+#endif
+
+int correct_reed_solomon_syndrome_compute(correct_reed_solomon_syndrome *rss,
+                                          const uint8_t *encoded, size_t encoded_length,
+                                          uint8_t *syndromes) {
+    if (encoded_length <= rss->num_roots || encoded_length > 255) {
+        return -1;
+    }
+
+    // front pad to a whole number of vectors
+    size_t pad = (rss->stride - encoded_length % rss->stride) % rss->stride;
+    memset(rss->block, 0, pad);
+    memcpy(rss->block + pad, encoded, encoded_length);
+    size_t length = pad + encoded_length;
+
+    switch (rss->simd) {
+#ifdef CORRECT_GF_SIMD_X86
+        case GF_SIMD_AVX2:
+            syndromes_avx2(rss, rss->block, length);
+            break;
+        case GF_SIMD_SSSE3:
+            syndromes_ssse3(rss, rss->block, length);
+            break;
+#endif
+        default:
+            syndromes_scalar(rss, rss->block, length);
+            break;
+    }
+
+    field_element_t any = 0;
+    for (size_t j = 0; j < rss->num_roots; j++) {
+        any |= rss->syndromes[j];
+    }
+    if (syndromes != NULL) {
+        memcpy(syndromes, rss->syndromes, rss->num_roots);
+    }
+    return any ? 1 : 0;
+}
+
+ssize_t correct_reed_solomon_syndrome_decode(correct_reed_solomon_syndrome *rss,
+                                             const uint8_t *encoded, size_t encoded_length,
+                                             uint8_t *msg) {
+    int status = correct_reed_solomon_syndrome_compute(rss, encoded, encoded_length, NULL);
+    if (status < 0) {
+        return -1;
+    }
+    if (status == 0) {
+        // clean block, the message is the codeword minus its parity
+        size_t msg_length = encoded_length - rss->num_roots;
+        memmove(msg, encoded, msg_length);
+        return msg_length;
+    }
+    return correct_reed_solomon_decode(rss->rs, encoded, encoded_length, msg);
+}
+
+ssize_t correct_reed_solomon_syndrome_decode_with_erasures(correct_reed_solomon_syndrome *rss,
+                                                           const uint8_t *encoded,
+                                                           size_t encoded_length,
+                                                           const uint8_t *erasure_locations,
+                                                           size_t erasure_length, uint8_t *msg) {
+    int status = correct_reed_solomon_syndrome_compute(rss, encoded, encoded_length, NULL);
+    if (status < 0) {
+        return -1;
+    }
+    if (status == 0) {
+        // a marked byte may well have arrived intact
+        size_t msg_length = encoded_length - rss->num_roots;
+        memmove(msg, encoded, msg_length);
+        return msg_length;
+    }
+    if (erasure_length == 0) {
+        return correct_reed_solomon_decode(rss->rs, encoded, encoded_length, msg);
+    }
+    if (erasure_length > rss->num_roots) {
+        erasure_length = rss->num_roots;
+    }
+    return correct_reed_solomon_decode_with_erasures(rss->rs, encoded, encoded_length,
+                                                     erasure_locations, erasure_length, msg);
+}
@@ -0,0 +1,622 @@
+#include "correct-viterbi.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CORRECT_VITERBI_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// same traceback shape as libcorrect's history buffer
+#define TRACEBACK_DEPTH(order) (5 * (order))
+#define TRACEBACK_GROUP(order) (15 * (order))
+
+// metrics are brought back down to a minimum of 0 every RENORMALIZE_INTERVAL
+// steps. a step adds at most 4 * 255, and every state is within order - 1
+// steps of the best one, so they stay under 2^15 and compare as signed.
+// libcorrect renormalizes less often, which only matters if its 16 bit
+// metrics wrap, and no real channel gets near that.
+#define RENORMALIZE_INTERVAL 16
+
+// one AVX2 group is 16 butterflies, 32 states
+#define GROUP_LEN 16
+
+struct correct_viterbi {
+    size_t rate;
+    size_t order;
+    size_t num_states;  // 2**(order - 1)
+    correct_viterbi_impl_t impl;
+    correct_convolutional_polynomial_t poly[4];
+
+    // output bits of each shift register, poly[0] in bit 0
+    unsigned int *table;
+
+    // path metrics for the current and next step
+    uint16_t *metrics;
+    uint16_t *next;
+    size_t steps;
+
+    // AVX2 branch metric masks, 0xff where the register outputs a 1, by
+    // group, then by register (2j, 2j | S, 2j + 1, 2j + 1 | S), then by
+    // output bit
+    uint16_t *masks;
+
+    // one decision bit per state per slice, bit ns % 32 of word ns / 32.
+    // set when the winning predecessor is (ns >> 1) | S / 2. like
+    // libcorrect, slice t is the step that shifts message bit t out of the
+    // register, order - 1 steps after it went in, and the decision is that
+    // bit.
+    uint32_t *decisions;
+    size_t words;
+    size_t depth;
+    size_t group;
+    size_t buffered;
+
+    // traceback and hard decision scratch
+    uint8_t *bits;
+    correct_convolutional_soft_t *soft;
+
+    // output. decisions[0] is for message bit base, and only bits first to
+    // last - 1 are written.
+    uint8_t *msg;
+    size_t base;
+    size_t first;
+    size_t last;
+
+    // position in the frame. step is the next one to decode, and the
+    // last order - 1 of total shift in the zero tail.
+    size_t step;
+    size_t total;
+};
+
+static unsigned int parity(unsigned int x) {
+    x ^= x >> 16;
+    x ^= x >> 8;
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return x & 1;
+}
+
+static int avx2_supported(void) {
+#if defined(CORRECT_VITERBI_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+correct_viterbi *correct_viterbi_create(size_t rate, size_t order,
+                                        const correct_convolutional_polynomial_t *poly) {
+    if (rate < 2 || rate > 4 || order < 3 || order > 15 || poly == NULL) {
+        return NULL;
+    }
+
+    correct_viterbi *v = calloc(1, sizeof(correct_viterbi));
+    if (v == NULL) {
+        return NULL;
+    }
+    v->rate = rate;
+    v->order = order;
+    v->num_states = 1 << (order - 1);
+    v->words = (v->num_states + 31) / 32;
+    v->depth = TRACEBACK_DEPTH(order);
+    v->group = TRACEBACK_GROUP(order);
+    memcpy(v->poly, poly, rate * sizeof(correct_convolutional_polynomial_t));
+
+    size_t cap = v->depth + v->group;
+    v->table = calloc(2 * v->num_states, sizeof(unsigned int));
+    v->metrics = calloc(v->num_states, sizeof(uint16_t));
+    v->next = calloc(v->num_states, sizeof(uint16_t));
+    v->decisions = calloc(cap * v->words, sizeof(uint32_t));
+    v->bits = calloc(cap, 1);
+    v->soft = calloc(v->rate * v->group, sizeof(correct_convolutional_soft_t));
+    if (v->num_states >= 2 * GROUP_LEN) {
+        v->masks = calloc(v->num_states / 2 * 4 * rate, sizeof(uint16_t));
+    }
+    if (v->table == NULL || v->metrics == NULL || v->next == NULL || v->decisions == NULL ||
+        v->bits == NULL || v->soft == NULL ||
+        (v->num_states >= 2 * GROUP_LEN && v->masks == NULL)) {
+        correct_viterbi_destroy(v);
+        return NULL;
+    }
+
+    for (size_t r = 0; r < 2 * v->num_states; r++) {
+        for (size_t k = 0; k < rate; k++) {
+            v->table[r] |= parity(r & poly[k]) << k;
+        }
+    }
+
+    if (v->masks != NULL) {
+        size_t half = v->num_states / 2;
+        for (size_t j = 0; j < half; j++) {
+            size_t registers[4] = {2 * j, 2 * j + v->num_states, 2 * j + 1,
+                                   2 * j + 1 + v->num_states};
+            for (size_t c = 0; c < 4; c++) {
+                for (size_t k = 0; k < rate; k++) {
+                    size_t index = ((j / GROUP_LEN * 4 + c) * rate + k) * GROUP_LEN + j % GROUP_LEN;
+                    v->masks[index] = ((v->table[registers[c]] >> k) & 1) ? 0xff : 0;
+                }
+            }
+        }
+    }
+
+    correct_viterbi_set_impl(v, CORRECT_VITERBI_AUTO);
+    return v;
+}
+
+int correct_viterbi_set_impl(correct_viterbi *v, correct_viterbi_impl_t impl) {
+    switch (impl) {
+        case CORRECT_VITERBI_AUTO:
+            v->impl = (v->masks != NULL && avx2_supported()) ? CORRECT_VITERBI_AVX2
+                                                             : CORRECT_VITERBI_PORTABLE;
+            return 0;
+        case CORRECT_VITERBI_PORTABLE:
+            v->impl = impl;
+            return 0;
+        case CORRECT_VITERBI_AVX2:
+            if (v->masks == NULL || !avx2_supported()) {
+                return -1;
+            }
+            v->impl = impl;
+            return 0;
+    }
+    return -1;
+}
+
+correct_viterbi_impl_t correct_viterbi_get_impl(correct_viterbi *v) {
+    return v->impl;
+}
+
+static void swap_metrics(correct_viterbi *v) {
+    uint16_t *tmp = v->metrics;
+    v->metrics = v->next;
+    v->next = tmp;
+}
+
+static void renormalize(correct_viterbi *v) {
+    uint16_t min = v->metrics[0];
+    for (size_t s = 1; s < v->num_states; s++) {
+        if (v->metrics[s] < min) {
+            min = v->metrics[s];
+        }
+    }
+    for (size_t s = 0; s < v->num_states; s++) {
+        v->metrics[s] -= min;
+    }
+}
+
+// distance from the soft symbols of a step to each of the 2**rate outputs
+static void branch_metrics(correct_viterbi *v, const correct_convolutional_soft_t *soft,
+                           uint16_t *branch) {
+    for (unsigned int out = 0; out < (1u << v->rate); out++) {
+        uint16_t distance = 0;
+        for (size_t k = 0; k < v->rate; k++) {
+            distance += ((out >> k) & 1) ? 255 - soft[k] : soft[k];
+        }
+        branch[out] = distance;
+    }
+}
+
+static void acs_portable(correct_viterbi *v, const correct_convolutional_soft_t *soft,
+                         size_t steps, uint32_t *decisions) {
+    size_t half = v->num_states / 2;
+    uint16_t branch[16];
+
+    for (size_t t = 0; t < steps; t++, soft += v->rate, decisions += v->words) {
+        branch_metrics(v, soft, branch);
+
+        memset(decisions, 0, v->words * sizeof(uint32_t));
+        for (size_t j = 0; j < half; j++) {
+            uint16_t a = v->metrics[j];
+            uint16_t b = v->metrics[j + half];
+            for (size_t ns = 2 * j; ns < 2 * j + 2; ns++) {
+                uint16_t m0 = a + branch[v->table[ns]];
+                uint16_t m1 = b + branch[v->table[ns + v->num_states]];
+                // ties go to the first predecessor
+                if (m1 < m0) {
+                    v->next[ns] = m1;
+                    decisions[ns / 32] |= (uint32_t)1 << (ns % 32);
+                } else {
+                    v->next[ns] = m0;
+                }
+            }
+        }
+
+        swap_metrics(v);
+        if (++v->steps % RENORMALIZE_INTERVAL == 0) {
+            renormalize(v);
+        }
+    }
+}
+
+#ifdef CORRECT_VITERBI_X86
+__attribute__((target("avx2")))
+static void renormalize_avx2(correct_viterbi *v) {
+    __m256i min = _mm256_loadu_si256((const __m256i *)v->metrics);
+    for (size_t s = GROUP_LEN; s < v->num_states; s += GROUP_LEN) {
+        min = _mm256_min_epu16(min, _mm256_loadu_si256((const __m256i *)&v->metrics[s]));
+    }
+    __m128i min128 = _mm_min_epu16(_mm256_castsi256_si128(min), _mm256_extracti128_si256(min, 1));
+    __m256i lowest = _mm256_set1_epi16(_mm_extract_epi16(_mm_minpos_epu16(min128), 0));
+    for (size_t s = 0; s < v->num_states; s += GROUP_LEN) {
+        __m256i m = _mm256_loadu_si256((const __m256i *)&v->metrics[s]);
+        _mm256_storeu_si256((__m256i *)&v->metrics[s], _mm256_sub_epi16(m, lowest));
+    }
+}
+
+__attribute__((target("avx2")))
+static void acs_avx2(correct_viterbi *v, const correct_convolutional_soft_t *soft,
+                     size_t steps, uint32_t *decisions) {
+    size_t half = v->num_states / 2;
+    size_t rate = v->rate;
+
+    for (size_t t = 0; t < steps; t++, soft += rate, decisions += v->words) {
+        __m256i symbol[4];
+        for (size_t k = 0; k < rate; k++) {
+            symbol[k] = _mm256_set1_epi16(soft[k]);
+        }
+
+        const uint16_t *mask = v->masks;
+        for (size_t j = 0; j < half; j += GROUP_LEN) {
+            // 255 - soft where the register outputs a 1, soft where it outputs a 0
+            __m256i branch[4];
+            for (size_t c = 0; c < 4; c++) {
+                branch[c] = _mm256_setzero_si256();
+                for (size_t k = 0; k < rate; k++, mask += GROUP_LEN) {
+                    __m256i m = _mm256_loadu_si256((const __m256i *)mask);
+                    branch[c] = _mm256_add_epi16(branch[c], _mm256_xor_si256(symbol[k], m));
+                }
+            }
+
+            __m256i a = _mm256_loadu_si256((const __m256i *)&v->metrics[j]);
+            __m256i b = _mm256_loadu_si256((const __m256i *)&v->metrics[j + half]);
+            __m256i m0 = _mm256_add_epi16(a, branch[0]);
+            __m256i m1 = _mm256_add_epi16(b, branch[1]);
+            __m256i m2 = _mm256_add_epi16(a, branch[2]);
+            __m256i m3 = _mm256_add_epi16(b, branch[3]);
+
+            // even states 2j, then odd states 2j + 1; ties go to the first
+            // predecessor
+            __m256i even = _mm256_min_epu16(m0, m1);
+            __m256i odd = _mm256_min_epu16(m2, m3);
+            __m256i even_decision = _mm256_cmpgt_epi16(m0, m1);
+            __m256i odd_decision = _mm256_cmpgt_epi16(m2, m3);
+
+            // interleave back into state order. unpack works within each
+            // 128 bit lane, so the lanes are put back in order afterwards
+            __m256i lo = _mm256_unpacklo_epi16(even, odd);
+            __m256i hi = _mm256_unpackhi_epi16(even, odd);
+            _mm256_storeu_si256((__m256i *)&v->next[2 * j], _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)&v->next[2 * j + GROUP_LEN],
+                                _mm256_permute2x128_si256(lo, hi, 0x31));
+
+            lo = _mm256_unpacklo_epi16(even_decision, odd_decision);
+            hi = _mm256_unpackhi_epi16(even_decision, odd_decision);
+            __m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+            __m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(first, second), 0xd8);
+            decisions[j / GROUP_LEN] = (uint32_t)_mm256_movemask_epi8(packed);
+        }
+
+        swap_metrics(v);
+        if (++v->steps % RENORMALIZE_INTERVAL == 0) {
+            renormalize_avx2(v);
+        }
+    }
+}
+#endif
+
+// only every skip-th state is reachable in the tail
+static size_t best_state(correct_viterbi *v, size_t skip) {
+    size_t best = 0;
+    for (size_t s = skip; s < v->num_states; s += skip) {
+        if (v->metrics[s] < v->metrics[best]) {
+            best = s;
+        }
+    }
+    return best;
+}
+
+// walks len buffered slices back from state and writes out the oldest emit
+// decoded bits
+static void traceback(correct_viterbi *v, size_t state, size_t len, size_t emit) {
+    size_t half = v->num_states / 2;
+    for (size_t t = len; t > 0; t--) {
+        const uint32_t *decisions = &v->decisions[(t - 1) * v->words];
+        v->bits[t - 1] = (decisions[state / 32] >> (state % 32)) & 1;
+        state = (state >> 1) | (v->bits[t - 1] ? half : 0);
+    }
+
+    for (size_t t = 0; t < emit; t++) {
+        size_t bit = v->base + t;
+        if (bit >= v->first && bit < v->last) {
+            v->msg[bit / 8] |= v->bits[t] << (7 - bit % 8);
+        }
+    }
+}
+
+// starts decoding a frame of total steps at slice base, writing message bits
+// first to last - 1. the encoder is known to start in the zero state;
+// anywhere else every state starts out equally likely.
+static void viterbi_start(correct_viterbi *v, size_t base, size_t first, size_t last,
+                          size_t total, uint8_t *msg) {
+    v->msg = msg;
+    v->base = base;
+    v->first = first;
+    v->last = last;
+    v->buffered = 0;
+    v->steps = 0;
+    v->step = (base == 0) ? 0 : base + v->order - 1;
+    v->total = total;
+
+    memset(v->metrics, 0, v->num_states * sizeof(uint16_t));
+}
+
+// decodes the oldest group from the best path once the buffer is full, and
+// keeps the rest
+static void viterbi_slices_done(correct_viterbi *v, size_t len, size_t skip) {
+    size_t cap = v->depth + v->group;
+    v->buffered += len;
+    if (v->buffered == cap) {
+        traceback(v, best_state(v, skip), cap, v->group);
+        memmove(v->decisions, &v->decisions[v->group * v->words],
+                v->depth * v->words * sizeof(uint32_t));
+        v->buffered = v->depth;
+        v->base += v->group;
+    }
+}
+
+// the first order - 1 steps fill the register from the zero state. every
+// state reached has one path, so there is nothing to decide yet.
+static void viterbi_warmup(correct_viterbi *v, const correct_convolutional_soft_t *soft) {
+    uint16_t branch[16];
+    branch_metrics(v, soft, branch);
+    for (size_t s = 0; s < ((size_t)2 << v->step); s++) {
+        v->next[s] = v->metrics[s >> 1] + branch[v->table[s]];
+    }
+    swap_metrics(v);
+}
+
+// the last order - 1 steps shift in the zero tail, so only states whose low
+// bits are still zero are reachable. like libcorrect, ties here go to the
+// second predecessor.
+static void viterbi_tail(correct_viterbi *v, const correct_convolutional_soft_t *soft) {
+    size_t half = v->num_states / 2;
+    size_t skip = (size_t)1 << (v->order - (v->total - v->step));
+    uint32_t *decisions = &v->decisions[v->buffered * v->words];
+    uint16_t branch[16];
+    branch_metrics(v, soft, branch);
+
+    memset(decisions, 0, v->words * sizeof(uint32_t));
+    for (size_t ns = 0; ns < v->num_states; ns += skip) {
+        uint16_t m0 = v->metrics[ns >> 1] + branch[v->table[ns]];
+        uint16_t m1 = v->metrics[(ns >> 1) + half] + branch[v->table[ns + v->num_states]];
+        if (m0 < m1) {
+            v->next[ns] = m0;
+        } else {
+            v->next[ns] = m1;
+            decisions[ns / 32] |= (uint32_t)1 << (ns % 32);
+        }
+    }
+
+    swap_metrics(v);
+    if (++v->steps % RENORMALIZE_INTERVAL == 0) {
+        renormalize(v);
+    }
+    viterbi_slices_done(v, 1, skip);
+}
+
+static void viterbi_run(correct_viterbi *v, const correct_convolutional_soft_t *soft,
+                        size_t steps) {
+    size_t cap = v->depth + v->group;
+    while (steps > 0) {
+        size_t len = cap - v->buffered;
+        if (len > steps) {
+            len = steps;
+        }
+
+        uint32_t *decisions = &v->decisions[v->buffered * v->words];
+        switch (v->impl) {
+#ifdef CORRECT_VITERBI_X86
+            case CORRECT_VITERBI_AVX2:
+                acs_avx2(v, soft, len, decisions);
+                break;
+#endif
+            default:
+                acs_portable(v, soft, len, decisions);
+                break;
+        }
+        soft += len * v->rate;
+        steps -= len;
+        viterbi_slices_done(v, len, 1);
+    }
+}
+
+// decodes the next steps of the frame, in the same order as libcorrect:
+// warm-up, then the add-compare-select steps, then the tail
+static void viterbi_feed(correct_viterbi *v, const correct_convolutional_soft_t *soft,
+                         size_t steps) {
+    size_t tail = v->total - (v->order - 1);
+    while (steps > 0) {
+        size_t len = 1;
+        if (v->step < v->order - 1) {
+            viterbi_warmup(v, soft);
+        } else if (v->step >= tail) {
+            viterbi_tail(v, soft);
+        } else {
+            len = (tail - v->step < steps) ? tail - v->step : steps;
+            viterbi_run(v, soft, len);
+        }
+        v->step += len;
+        soft += len * v->rate;
+        steps -= len;
+    }
+}
+
+static void viterbi_finish(correct_viterbi *v) {
+    // the tail brings the encoder back to the zero state
+    traceback(v, 0, v->buffered, v->buffered);
+    v->buffered = 0;
+}
+
+ssize_t correct_viterbi_decode_soft(correct_viterbi *v, const correct_convolutional_soft_t *encoded,
+                                    size_t num_encoded_bits, uint8_t *msg) {
+    if (num_encoded_bits % v->rate || num_encoded_bits / v->rate < 2 * (v->order - 1)) {
+        return -1;
+    }
+
+    size_t steps = num_encoded_bits / v->rate;
+    size_t msg_bits = steps - (v->order - 1);
+    memset(msg, 0, (msg_bits + 7) / 8);
+    viterbi_start(v, 0, 0, msg_bits, steps, msg);
+    viterbi_feed(v, encoded, steps);
+    viterbi_finish(v);
+    return (msg_bits + 7) / 8;
+}
+
+ssize_t correct_viterbi_decode(correct_viterbi *v, const uint8_t *encoded,
+                               size_t num_encoded_bits, uint8_t *msg) {
+    if (num_encoded_bits % v->rate || num_encoded_bits / v->rate < 2 * (v->order - 1)) {
+        return -1;
+    }
+
+    size_t steps = num_encoded_bits / v->rate;
+    size_t msg_bits = steps - (v->order - 1);
+    memset(msg, 0, (msg_bits + 7) / 8);
+    viterbi_start(v, 0, 0, msg_bits, steps, msg);
+    for (size_t t = 0; t < steps; t += v->group) {
+        size_t len = (steps - t < v->group) ? steps - t : v->group;
+        for (size_t i = 0; i < len * v->rate; i++) {
+            size_t bit = t * v->rate + i;
+            v->soft[i] = ((encoded[bit / 8] >> (7 - bit % 8)) & 1) ? 255 : 0;
+        }
+        viterbi_feed(v, v->soft, len);
+    }
+    viterbi_finish(v);
+    return (msg_bits + 7) / 8;
+}
+
+// one segment of a parallel decode
+typedef struct {
+    correct_viterbi *v;
+    const correct_convolutional_soft_t *encoded;
+    uint8_t *msg;
+    size_t start;  // first slice decoded, warm-up included
+    size_t first;  // first message bit written
+    size_t last;   // message bits written end here
+    size_t end;    // steps decoded end here
+    size_t total;  // steps in the frame
+    int finish;    // whether the segment runs to the end of the frame
+} viterbi_segment;
+
+static void *viterbi_segment_run(void *arg) {
+    viterbi_segment *seg = arg;
+    correct_viterbi *v = seg->v;
+
+    // a traceback here happens at the same step, over the same decisions, as
+    // it would in a sequential decode, once the warm-up paths have merged
+    viterbi_start(v, seg->start, seg->first, seg->last, seg->total, seg->msg);
+    viterbi_feed(v, &seg->encoded[v->step * v->rate], seg->end - v->step);
+    if (seg->finish) {
+        viterbi_finish(v);
+    }
+    return NULL;
+}
+
+ssize_t correct_viterbi_decode_soft_parallel(correct_viterbi *v,
+                                             const correct_convolutional_soft_t *encoded,
+                                             size_t num_encoded_bits, uint8_t *msg,
+                                             size_t num_threads, size_t overlap) {
+    if (num_encoded_bits % v->rate || num_encoded_bits / v->rate < 2 * (v->order - 1) ||
+        num_threads < 1) {
+        return -1;
+    }
+
+    // segments start on group boundaries that are also byte boundaries, so
+    // they follow the sequential traceback schedule and never share a byte
+    size_t steps = num_encoded_bits / v->rate;
+    size_t msg_bits = steps - (v->order - 1);
+    size_t unit = 8 * v->group;
+    size_t units = msg_bits / unit;
+    size_t warmup = (overlap + v->group - 1) / v->group * v->group;
+    if (warmup < v->group) {
+        warmup = v->group;
+    }
+    if (num_threads > units) {
+        num_threads = units;
+    }
+    if (num_threads <= 1) {
+        return correct_viterbi_decode_soft(v, encoded, num_encoded_bits, msg);
+    }
+
+    viterbi_segment *segments = calloc(num_threads, sizeof(viterbi_segment));
+    pthread_t *threads = calloc(num_threads, sizeof(pthread_t));
+    if (segments == NULL || threads == NULL) {
+        free(segments);
+        free(threads);
+        return -1;
+    }
+
+    memset(msg, 0, (msg_bits + 7) / 8);
+    ssize_t status = (msg_bits + 7) / 8;
+    size_t started = 0;
+    for (size_t i = 0; i < num_threads; i++) {
+        viterbi_segment *seg = &segments[i];
+        seg->v = (i == 0) ? v : correct_viterbi_create(v->rate, v->order, v->poly);
+        if (seg->v == NULL) {
+            status = -1;
+            break;
+        }
+        seg->v->impl = v->impl;
+        seg->encoded = encoded;
+        seg->msg = msg;
+        seg->first = units * i / num_threads * unit;
+        seg->start = (seg->first > warmup) ? seg->first - warmup : 0;
+        seg->finish = (i == num_threads - 1);
+        seg->last = seg->finish ? msg_bits : units * (i + 1) / num_threads * unit;
+        seg->end = seg->finish ? steps : seg->last + v->depth + v->order - 1;
+        seg->total = steps;
+
+        if (i > 0 && pthread_create(&threads[i], NULL, viterbi_segment_run, seg) != 0) {
+            status = -1;
+            break;
+        }
+        started++;
+    }
+
+    // the caller's thread takes the first segment
+    if (status >= 0) {
+        viterbi_segment_run(&segments[0]);
+    }
+    for (size_t i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (size_t i = 1; i < num_threads; i++) {
+        correct_viterbi_destroy(segments[i].v);
+    }
+    free(segments);
+    free(threads);
+    return status;
+}
+
+void correct_viterbi_destroy(correct_viterbi *v) {
+    if (v == NULL) {
+        return;
+    }
+    free(v->table);
+    free(v->metrics);
+    free(v->next);
+    free(v->masks);
+    free(v->decisions);
+    free(v->bits);
+    free(v->soft);
+    free(v);
+}
@@ -0,0 +1,149 @@
+// Project headers
+#include "antenna_engine.h"
+
+// Standard C libraries
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      printf("[!] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      return -1;                                            \
+    }                                                       \
+  } while (0)
+
+// Settings
+#define ENGINE_TEST_FRAMES 500
+#define ENGINE_TEST_RUNS 10000
+
+struct engine_check {
+  size_t frames;
+  size_t errors;
+  size_t timeouts;
+  uint8_t salt;
+};
+
+// Frames carry their sequence number and a length that varies with it. Each
+// direction uses its own salt so crossed wires show up.
+static size_t frame_fill(char *data, size_t seq, uint8_t salt) {
+  size_t len = 4 + (seq * 37) % (RS_DATA_LEN - 3);
+  memcpy(data, &(uint32_t){seq}, 4);
+  for (size_t x = 4; x < len; x++) data[x] = (char)(seq + x * 7 + salt);
+  return len;
+}
+
+static void on_frame(struct antenna_handle *h, const char *data, size_t len,
+                     void *user) {
+  struct engine_check *c = user;
+  char expected[RS_DATA_LEN];
+  size_t expected_len = frame_fill(expected, c->frames++, c->salt);
+  if (len != expected_len || memcmp(data, expected, len) != 0) c->errors++;
+}
+
+static void on_timeout(struct antenna_handle *h, int direction, void *user) {
+  struct engine_check *c = user;
+  c->timeouts++;
+}
+
+int main() {
+  int sv[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+  static struct antenna_engine e;
+  static struct antenna_handle a, b;
+  CHECK(antenna_engine_new(&e) == 0);
+  CHECK(antenna_handle_new(&a, sv[0]) == 0);
+  CHECK(antenna_handle_new(&b, sv[1]) == 0);
+
+  // Bulk traffic both ways at once, with more queued than the socket holds
+  struct engine_check at_a = {.salt = 0xA0};
+  struct engine_check at_b = {.salt = 0xB0};
+  antenna_handle_set_callbacks(&a, on_frame, on_timeout, &at_a);
+  antenna_handle_set_callbacks(&b, on_frame, on_timeout, &at_b);
+  CHECK(antenna_engine_add(&e, &a) == 0);
+  CHECK(antenna_engine_add(&e, &b) == 0);
+
+  char data[RS_DATA_LEN];
+  for (size_t seq = 0; seq < ENGINE_TEST_FRAMES; seq++) {
+    size_t len = frame_fill(data, seq, at_b.salt);
+    CHECK(antenna_handle_send(&a, data, len) == 0);
+    len = frame_fill(data, seq, at_a.salt);
+    CHECK(antenna_handle_send(&b, data, len) == 0);
+  }
+  for (int run = 0; run < ENGINE_TEST_RUNS; run++) {
+    if (at_a.frames == ENGINE_TEST_FRAMES &&
+        at_b.frames == ENGINE_TEST_FRAMES)
+      break;
+    CHECK(antenna_engine_run_once(&e, 100) >= 0);
+  }
+  CHECK(at_a.frames == ENGINE_TEST_FRAMES);
+  CHECK(at_b.frames == ENGINE_TEST_FRAMES);
+  CHECK(at_a.errors == 0 && at_b.errors == 0);
+  CHECK(a.frames_failed == 0 && b.frames_failed == 0);
+
+  // Without a callback frames wait for antenna_handle_recv(), a queue at a
+  // time
+  antenna_handle_set_callbacks(&a, NULL, on_timeout, &at_a);
+  char out[RS_DATA_LEN];
+  size_t popped = 0;
+  while (popped < ENGINE_TEST_FRAMES) {
+    size_t batch = ENGINE_TEST_FRAMES - popped;
+    if (batch > ANTENNA_HANDLE_RX_QUEUE_LEN)
+      batch = ANTENNA_HANDLE_RX_QUEUE_LEN;
+    for (size_t seq = popped; seq < popped + batch; seq++) {
+      size_t len = frame_fill(data, seq, at_a.salt);
+      CHECK(antenna_handle_send(&b, data, len) == 0);
+    }
+    for (int run = 0; run < ENGINE_TEST_RUNS && a.rx_count < batch; run++)
+      CHECK(antenna_engine_run_once(&e, 100) >= 0);
+
+    int len;
+    while ((len = antenna_handle_recv(&a, out, sizeof(out))) > 0) {
+      size_t expected_len = frame_fill(data, popped++, at_a.salt);
+      CHECK((size_t)len == expected_len && memcmp(out, data, len) == 0);
+    }
+  }
+  CHECK(a.frames_dropped == 0);
+
+  // A full queue drops what does not fit
+  for (size_t seq = 0; seq < ANTENNA_HANDLE_RX_QUEUE_LEN + 4; seq++) {
+    size_t len = frame_fill(data, seq, at_a.salt);
+    CHECK(antenna_handle_send(&b, data, len) == 0);
+  }
+  for (int run = 0; run < ENGINE_TEST_RUNS && a.frames_dropped < 4; run++)
+    CHECK(antenna_engine_run_once(&e, 100) >= 0);
+  CHECK(a.frames_dropped == 4);
+  for (size_t seq = 0; seq < ANTENNA_HANDLE_RX_QUEUE_LEN; seq++) {
+    int len = antenna_handle_recv(&a, out, sizeof(out));
+    size_t expected_len = frame_fill(data, seq, at_a.salt);
+    CHECK((size_t)len == expected_len && memcmp(out, data, len) == 0);
+  }
+  CHECK(antenna_handle_recv(&a, out, sizeof(out)) == 0);
+  CHECK(a.frames_received ==
+        2 * ENGINE_TEST_FRAMES + ANTENNA_HANDLE_RX_QUEUE_LEN + 4);
+  CHECK(b.frames_received == ENGINE_TEST_FRAMES);
+
+  // A silent link times out
+  antenna_handle_set_timeouts(&a, 50, -1);
+  for (int run = 0; run < 10 && at_a.timeouts == 0; run++)
+    CHECK(antenna_engine_run_once(&e, 100) >= 0);
+  CHECK(at_a.timeouts > 0);
+  CHECK(at_b.timeouts == 0);
+
+  CHECK(antenna_engine_remove(&e, &a) == 0);
+  CHECK(antenna_engine_remove(&e, &b) == 0);
+  antenna_handle_destroy(&a);
+  antenna_handle_destroy(&b);
+  antenna_engine_destroy(&e);
+  close(sv[0]);
+  close(sv[1]);
+
+  printf("[i] engine tests passed\n");
+
+  // done
+  return 0;
+}
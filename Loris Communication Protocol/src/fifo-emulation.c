@@ -12,6 +12,7 @@
 // Project headers
 #include "fifo.h"
 #include "antenna.h"
+#include "antenna_file.h"
 
 // Standard C libraries
 #include <stdio.h>
@@ -37,8 +38,16 @@ void * check_rx(void * data) {
 }
 
 void * check_rx_file(void * data) {
+  // Drain the rx fifo on its own thread so it never backs up while chunks
+  // are decoded and stored
+  struct antenna_pipeline pipeline;
+  if(antenna_pipeline_start(&pipeline, antenna_session_shared(), fifo_get_rx(), 0, NULL, NULL) == -1) {
+    printf("[!] Failed to start receive pipeline\n");
+    return NULL;
+  }
+
   start:
-    if(antenna_fread_fd(fifo_get_rx(), "incoming.txt") == -1) {
+    if(antenna_file_receive_pipeline(&pipeline, fifo_get_tx(), "incoming.txt") == -1) {
       printf("[!] Failed to fread file from antenna\n");
       goto start;
     }
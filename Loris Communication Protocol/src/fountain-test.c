@@ -0,0 +1,170 @@
+// Project headers
+#include "antenna_fountain.h"
+
+// Standard C libraries
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      printf("[!] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      return -1;                                            \
+    }                                                       \
+  } while (0)
+
+// Settings
+#define FOUNTAIN_TEST_BATCH 64
+#define FOUNTAIN_TEST_LOSS 4
+
+static const size_t file_lens[] = {0, 1, FOUNTAIN_SYMBOL_LEN,
+                                   FOUNTAIN_SYMBOL_LEN + 1, 50000};
+
+// xorshift, for file contents and which slots are lost
+static uint32_t next_rand(uint32_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 17;
+  *rng ^= *rng << 5;
+  return *rng;
+}
+
+static int write_file(const char *path, const uint8_t *data, size_t len) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK(fd >= 0);
+  CHECK(write(fd, data, len) == (ssize_t)len);
+  close(fd);
+
+  // done
+  return 0;
+}
+
+static int check_file(const char *path, const uint8_t *data, size_t len) {
+  uint8_t *out = malloc(len + 1);
+  CHECK(out != NULL);
+  int fd = open(path, O_RDONLY);
+  CHECK(fd >= 0);
+  ssize_t out_len = read(fd, out, len + 1);
+  close(fd);
+  int same = out_len == (ssize_t)len && memcmp(out, data, len) == 0;
+  free(out);
+  CHECK(same);
+
+  // done
+  return 0;
+}
+
+// Sends the file a batch of symbols at a time and drops about one slot in
+// FOUNTAIN_TEST_LOSS on the way into the decoder, until it is rebuilt
+static int lossy_test(struct antenna_session *tx, struct antenna_session *rx,
+                      int sv[2], const char *in, const char *out,
+                      const uint8_t *data, size_t len, uint32_t *rng) {
+  static struct antenna_fountain_decoder d;
+  CHECK(antenna_fountain_decoder_new(&d) == 0);
+
+  size_t k = (len + FOUNTAIN_SYMBOL_LEN - 1) / FOUNTAIN_SYMBOL_LEN;
+  uint32_t sent = 0;
+  size_t lost = 0;
+  int complete = 0;
+  char slot[ANTENNA_MAX_INTERLEAVE * RS_DATA_LEN];
+  while (!complete) {
+    CHECK(sent < 2 * k + 10 * FOUNTAIN_TEST_BATCH);
+    CHECK(antenna_fountain_send(tx, sv[0], in, sent, FOUNTAIN_TEST_BATCH) ==
+          0);
+    sent += FOUNTAIN_TEST_BATCH;
+
+    // Drain the socket through the deframer, one slot per frame
+    struct antenna_deframer *df = rx->rx_deframer;
+    for (;;) {
+      size_t space;
+      uint8_t *free_space = antenna_deframer_space(df, &space);
+      ssize_t bytes_read = read(sv[1], free_space, space);
+      if (bytes_read <= 0) break;
+      antenna_deframer_commit(df, bytes_read);
+
+      struct antenna_packet p;
+      while (antenna_deframer_next(df, &p)) {
+        ssize_t slot_len = antenna_session_decode_frame(rx, &p, slot);
+        CHECK(slot_len == FILE_MSG_LEN);
+        if (next_rand(rng) % FOUNTAIN_TEST_LOSS == 0) {
+          lost++;
+          continue;
+        }
+        if (!complete) {
+          int status = antenna_fountain_decoder_add(&d, (uint8_t *)slot);
+          CHECK(status >= 0);
+          complete = status;
+        }
+      }
+    }
+  }
+  CHECK(k == 0 || lost > 0);
+  CHECK(d.k == k && d.file_size == len);
+  CHECK(antenna_fountain_decoder_write(&d, out) == 0);
+  CHECK(check_file(out, data, len) == 0);
+  antenna_fountain_decoder_destroy(&d);
+
+  // done
+  return 0;
+}
+
+int main() {
+  char in[] = "/tmp/fountain-test-in-XXXXXX";
+  char out[] = "/tmp/fountain-test-out-XXXXXX";
+  int in_fd = mkstemp(in);
+  int out_fd = mkstemp(out);
+  CHECK(in_fd >= 0 && out_fd >= 0);
+  close(in_fd);
+  close(out_fd);
+
+  int sv[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  CHECK(fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK) == 0);
+
+  static struct antenna_session tx, rx;
+  CHECK(antenna_session_new(&tx, sv[0]) == 0);
+  CHECK(antenna_session_new(&rx, sv[1]) == 0);
+
+  uint32_t rng = 1;
+  size_t max_len = file_lens[sizeof(file_lens) / sizeof(file_lens[0]) - 1];
+  uint8_t *data = malloc(max_len);
+  CHECK(data != NULL);
+  for (size_t x = 0; x < max_len; x++) data[x] = next_rand(&rng);
+
+  for (size_t x = 0; x < sizeof(file_lens) / sizeof(file_lens[0]); x++) {
+    size_t len = file_lens[x];
+    CHECK(write_file(in, data, len) == 0);
+    if (lossy_test(&tx, &rx, sv, in, out, data, len, &rng) < 0) {
+      printf("[!] Fountain round trip of %zu bytes failed\n", len);
+      return -1;
+    }
+  }
+
+  // The empty file also completes through antenna_fountain_receive()
+  static struct antenna_fountain_decoder d;
+  CHECK(write_file(in, data, 0) == 0);
+  CHECK(antenna_fountain_decoder_new(&d) == 0);
+  CHECK(antenna_fountain_send(&tx, sv[0], in, 0, 1) == 0);
+  CHECK(fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) & ~O_NONBLOCK) == 0);
+  CHECK(antenna_fountain_receive(&rx, sv[1], &d) == 1);
+  CHECK(antenna_fountain_decoder_write(&d, out) == 0);
+  CHECK(check_file(out, data, 0) == 0);
+  antenna_fountain_decoder_destroy(&d);
+
+  free(data);
+  antenna_session_destroy(&tx);
+  antenna_session_destroy(&rx);
+  close(sv[0]);
+  close(sv[1]);
+  unlink(in);
+  unlink(out);
+
+  printf("[i] fountain tests passed\n");
+
+  // done
+  return 0;
+}
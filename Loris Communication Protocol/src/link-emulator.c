@@ -0,0 +1,435 @@
+/**
+ * @file link-emulator.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Radio link emulator between two FIFO or pty endpoints, with bit
+ * errors, error bursts, propagation delay and a baud rate limit
+ * @version 0.1
+ * @date 2022-04-25
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+// Feature macros
+#define _GNU_SOURCE
+
+// libcorrect test bench
+#include "correct/util/error-sim.h"
+
+// Standard C libraries
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Settings
+#define LINK_QUEUE_LEN 4096
+#define LINK_CHUNK_LEN 512
+#define LINK_BITS_PER_BYTE 10  // 8N1 on the wire
+#define LINK_REPORT_S 10
+
+/*
+ * Each direction is a queue of bytes stamped with the time they leave the far
+ * end. A byte takes LINK_BITS_PER_BYTE / baud seconds on the line after the
+ * one before it, then the propagation delay. The queue is as deep as a UART
+ * transmit buffer, and once it is full the emulator stops reading the sender,
+ * which then blocks in write() as it would on a real port.
+ *
+ * Errors are drawn from a generator per direction seeded from the command
+ * line, so the same bytes sent with the same seed always get the same errors,
+ * whatever the timing of the reads.
+ */
+
+// Gilbert-Elliott burst model. Every bit the channel moves from the good to
+// the bad state with probability enter and back with probability leave, and
+// flips with probability ber_bad while bad.
+struct link_bursts {
+  double enter;
+  double leave;
+  double ber_bad;
+};
+
+struct link_config {
+  long baud;
+  double delay_ms;
+  double ber;
+  double eb_n0;
+  int awgn;
+  struct link_bursts bursts;
+  uint64_t seed;
+  size_t queue_len;
+};
+
+struct link_dir {
+  const char *name;
+  int in;
+  int out;
+
+  // Queued bytes and the time each one is due out, in ns
+  uint8_t *data;
+  uint64_t *due;
+  size_t head;
+  size_t tail;
+  size_t mask;
+  uint64_t line_free;
+
+  // Channel state
+  uint64_t rng;
+  int bad;
+  double voltages[8 * LINK_CHUNK_LEN];
+  double noise[8 * LINK_CHUNK_LEN];
+  uint8_t soft[8 * LINK_CHUNK_LEN];
+
+  // Statistics
+  size_t bytes;
+  size_t bits_flipped;
+  size_t bursts;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int sig) {
+  (void)sig;
+  running = 0;
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// xorshift64*, one stream per direction
+static uint64_t link_rand(struct link_dir *d) {
+  d->rng ^= d->rng >> 12;
+  d->rng ^= d->rng << 25;
+  d->rng ^= d->rng >> 27;
+  return d->rng * 0x2545f4914f6cdd1dull;
+}
+
+// Uniform in [0, 1)
+static double link_uniform(struct link_dir *d) {
+  return (link_rand(d) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// BPSK over AWGN with the libcorrect test bench helpers. The noise comes from
+// the direction's own generator rather than gaussian(), which uses rand().
+static void link_awgn(struct link_dir *d, const struct link_config *c,
+                      uint8_t *bytes, size_t len) {
+  size_t n_syms = 8 * len;
+  double sigma = sigma_for_eb_n0(c->eb_n0, 1.0);
+  for (size_t x = 0; x < n_syms; x += 2) {
+    // Box-Muller, two samples at a time
+    double u = link_uniform(d), v = link_uniform(d);
+    double r = sqrt(-2.0 * log(1.0 - u)) * sigma;
+    d->noise[x] = r * cos(2 * M_PI * v);
+    if (x + 1 < n_syms) d->noise[x + 1] = r * sin(2 * M_PI * v);
+  }
+
+  encode_bpsk(bytes, d->voltages, n_syms, 1.0);
+  add_white_noise(d->voltages, d->noise, n_syms);
+  decode_bpsk_soft(d->voltages, d->soft, n_syms, 1.0);
+
+  uint8_t clean[LINK_CHUNK_LEN];
+  memcpy(clean, bytes, len);
+  memset(bytes, 0, len);
+  decode_bpsk(d->soft, bytes, n_syms);
+  for (size_t x = 0; x < len; x++)
+    d->bits_flipped += __builtin_popcount(clean[x] ^ bytes[x]);
+}
+
+// Random and burst bit errors
+static void link_flip(struct link_dir *d, const struct link_config *c,
+                      uint8_t *bytes, size_t len) {
+  const struct link_bursts *b = &c->bursts;
+  for (size_t x = 0; x < len; x++) {
+    for (int bit = 0; bit < 8; bit++) {
+      if (b->enter > 0) {
+        if (!d->bad && link_uniform(d) < b->enter) {
+          d->bad = 1;
+          d->bursts++;
+        } else if (d->bad && link_uniform(d) < b->leave) {
+          d->bad = 0;
+        }
+      }
+      double ber = d->bad ? b->ber_bad : c->ber;
+      if (ber > 0 && link_uniform(d) < ber) {
+        bytes[x] ^= 0x80 >> bit;
+        d->bits_flipped++;
+      }
+    }
+  }
+}
+
+// Takes what the sender has written, up to the room left in the queue
+static int link_receive(struct link_dir *d, const struct link_config *c) {
+  size_t room = c->queue_len - (d->tail - d->head);
+  uint8_t chunk[LINK_CHUNK_LEN];
+  ssize_t bytes_read =
+      read(d->in, chunk, (room < LINK_CHUNK_LEN) ? room : LINK_CHUNK_LEN);
+  if (bytes_read < 0) {
+    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+    printf("[!] Failed to read from %s sender: %s\n", d->name, strerror(errno));
+    return -1;
+  }
+  if (bytes_read == 0) return 0;
+
+  if (c->awgn) link_awgn(d, c, chunk, bytes_read);
+  if (c->ber > 0 || c->bursts.enter > 0) link_flip(d, c, chunk, bytes_read);
+
+  // Put the bytes on the line one after the other
+  uint64_t now = now_ns();
+  uint64_t byte_ns =
+      c->baud ? (LINK_BITS_PER_BYTE * 1000000000ull) / c->baud : 0;
+  uint64_t delay_ns = c->delay_ms * 1e6;
+  if (d->line_free < now) d->line_free = now;
+  for (ssize_t x = 0; x < bytes_read; x++) {
+    d->line_free += byte_ns;
+    d->data[d->tail & d->mask] = chunk[x];
+    d->due[d->tail & d->mask] = d->line_free + delay_ns;
+    d->tail++;
+  }
+
+  // done
+  return 0;
+}
+
+// Hands the receiver every byte that is due
+static int link_deliver(struct link_dir *d) {
+  uint64_t now = now_ns();
+  while (d->head != d->tail && d->due[d->head & d->mask] <= now) {
+    // Find the due run up to the end of the buffer
+    size_t offset = d->head & d->mask;
+    size_t len = 0;
+    while (d->head + len != d->tail && offset + len <= d->mask &&
+           d->due[offset + len] <= now)
+      len++;
+
+    ssize_t bytes_written = write(d->out, &d->data[offset], len);
+    if (bytes_written < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      printf("[!] Failed to write to %s receiver: %s\n", d->name,
+             strerror(errno));
+      return -1;
+    }
+    d->head += bytes_written;
+    d->bytes += bytes_written;
+  }
+
+  // done
+  return 0;
+}
+
+// Opens one endpoint. "pty" creates a pseudo-terminal and prints the path the
+// endpoint should open. "rx_path,tx_path" uses the endpoint's pair of FIFOs,
+// named as it sees them, creating them if needed.
+static int link_open(const char *spec, const char *name, int *in, int *out) {
+  if (strcmp(spec, "pty") == 0) {
+    int master;
+    if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) < 0 ||
+        unlockpt(master) < 0) {
+      printf("[!] Failed to create pty for %s\n", name);
+      return -1;
+    }
+
+    // Pass bytes through untouched
+    struct termios tty;
+    if (tcgetattr(master, &tty) == 0) {
+      cfmakeraw(&tty);
+      tcsetattr(master, TCSANOW, &tty);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    // Hold the slave open too, or the master hangs up whenever the endpoint
+    // has it closed
+    if (open(ptsname(master), O_RDWR | O_NOCTTY) < 0) {
+      printf("[!] Failed to open pty slave for %s\n", name);
+      return -1;
+    }
+    printf("[i] %s: %s\n", name, ptsname(master));
+    *in = *out = master;
+    return 0;
+  }
+
+  const char *comma = strchr(spec, ',');
+  if (comma == NULL) {
+    printf("[!] Invalid endpoint %s, expected pty or rx_path,tx_path\n", spec);
+    return -1;
+  }
+  char rx_path[256];
+  snprintf(rx_path, sizeof(rx_path), "%.*s", (int)(comma - spec), spec);
+  const char *tx_path = comma + 1;
+
+  // Opening both ends read/write never blocks on the other side, and keeps
+  // the FIFOs open while an endpoint restarts
+  if ((mkfifo(rx_path, 0666) < 0 && errno != EEXIST) ||
+      (mkfifo(tx_path, 0666) < 0 && errno != EEXIST) ||
+      (*in = open(tx_path, O_RDWR | O_NONBLOCK)) < 0 ||
+      (*out = open(rx_path, O_RDWR | O_NONBLOCK)) < 0) {
+    printf("[!] Failed to open FIFOs for %s: %s\n", name, strerror(errno));
+    return -1;
+  }
+  printf("[i] %s: reads %s, writes %s\n", name, rx_path, tx_path);
+
+  // done
+  return 0;
+}
+
+static int link_dir_new(struct link_dir *d, const char *name, int in, int out,
+                        const struct link_config *c, uint64_t stream) {
+  memset(d, 0, sizeof(struct link_dir));
+  d->name = name;
+  d->in = in;
+  d->out = out;
+
+  size_t capacity = 1;
+  while (capacity < c->queue_len) capacity <<= 1;
+  d->mask = capacity - 1;
+  if ((d->data = malloc(capacity)) == NULL ||
+      (d->due = malloc(capacity * sizeof(uint64_t))) == NULL) {
+    printf("[!] Failed to allocate %s queue\n", name);
+    return -1;
+  }
+
+  // splitmix64 of the seed, so nearby seeds give unrelated streams
+  uint64_t z = c->seed + stream * 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  d->rng = (z ^ (z >> 31)) | 1;
+  return 0;
+}
+
+static void link_report(struct link_dir *dirs) {
+  for (int x = 0; x < 2; x++)
+    printf("[i] %s: %zu bytes, %zu bits flipped (%.2e), %zu bursts, %zu "
+           "queued\n",
+           dirs[x].name, dirs[x].bytes, dirs[x].bits_flipped,
+           dirs[x].bytes ? (double)dirs[x].bits_flipped / (8.0 * dirs[x].bytes)
+                         : 0.0,
+           dirs[x].bursts, dirs[x].tail - dirs[x].head);
+  fflush(stdout);
+}
+
+static void usage(const char *argv0) {
+  printf(
+      "Usage: %s [options] A B\n"
+      "  A, B         endpoint: pty, or rx_path,tx_path of its FIFOs\n"
+      "  -b baud      line rate, 0 for unlimited (default 9600)\n"
+      "  -d ms        one way propagation delay (default 0)\n"
+      "  -e ber       random bit error rate (default 0)\n"
+      "  -n eb_n0     BPSK over AWGN at this Eb/N0 in dB\n"
+      "  -g p,r,ber   Gilbert-Elliott bursts: enter and leave probability per\n"
+      "               bit, and bit error rate while in a burst\n"
+      "  -q bytes     transmit queue depth (default %d)\n"
+      "  -s seed      error generator seed (default 1)\n",
+      argv0, LINK_QUEUE_LEN);
+}
+
+int main(int argc, char *argv[]) {
+  struct link_config c = {
+      .baud = 9600, .seed = 1, .queue_len = LINK_QUEUE_LEN};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:d:e:n:g:q:s:h")) != -1) {
+    switch (opt) {
+      case 'b': c.baud = atol(optarg); break;
+      case 'd': c.delay_ms = atof(optarg); break;
+      case 'e': c.ber = atof(optarg); break;
+      case 'n':
+        c.awgn = 1;
+        c.eb_n0 = atof(optarg);
+        break;
+      case 'g':
+        if (sscanf(optarg, "%lf,%lf,%lf", &c.bursts.enter, &c.bursts.leave,
+                   &c.bursts.ber_bad) != 3) {
+          printf("[!] Invalid burst model %s\n", optarg);
+          return -1;
+        }
+        break;
+      case 'q': c.queue_len = atol(optarg); break;
+      case 's': c.seed = strtoull(optarg, NULL, 0); break;
+      default: usage(argv[0]); return -1;
+    }
+  }
+  if (argc - optind != 2 || c.baud < 0 || c.queue_len == 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // A to B goes one way, B to A the other
+  int a_in, a_out, b_in, b_out;
+  struct link_dir dirs[2];
+  if (link_open(argv[optind], "A", &a_in, &a_out) < 0 ||
+      link_open(argv[optind + 1], "B", &b_in, &b_out) < 0 ||
+      link_dir_new(&dirs[0], "A->B", a_in, b_out, &c, 0) < 0 ||
+      link_dir_new(&dirs[1], "B->A", b_in, a_out, &c, 1) < 0)
+    return -1;
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+  printf("[i] %ld baud, %.1f ms, BER %.2e, seed %llu\n", c.baud, c.delay_ms,
+         c.ber, (unsigned long long)c.seed);
+  fflush(stdout);
+
+  uint64_t next_report = now_ns() + LINK_REPORT_S * 1000000000ull;
+  while (running) {
+    // Read senders with room queued for them, wait on receivers that are
+    // full, and otherwise sleep until the next byte is due
+    struct pollfd fds[4];
+    int timeout = LINK_REPORT_S * 1000;
+    uint64_t now = now_ns();
+    for (int x = 0; x < 2; x++) {
+      struct link_dir *d = &dirs[x];
+      fds[2 * x] = (struct pollfd){d->in, 0, 0};
+      fds[2 * x + 1] = (struct pollfd){d->out, 0, 0};
+      if (d->tail - d->head < c.queue_len) fds[2 * x].events = POLLIN;
+      if (d->head != d->tail) {
+        uint64_t due = d->due[d->head & d->mask];
+        if (due <= now) {
+          fds[2 * x + 1].events = POLLOUT;
+        } else {
+          int wait_ms = (due - now + 999999) / 1000000;
+          if (wait_ms < timeout) timeout = wait_ms;
+        }
+      }
+    }
+
+    if (poll(fds, 4, timeout) < 0) {
+      if (errno == EINTR) continue;
+      printf("[!] Failed to poll endpoints\n");
+      break;
+    }
+
+    for (int x = 0; x < 2; x++) {
+      if ((fds[2 * x].revents & (POLLIN | POLLHUP)) &&
+          link_receive(&dirs[x], &c) < 0)
+        running = 0;
+      if (link_deliver(&dirs[x]) < 0) running = 0;
+    }
+
+    if (now_ns() >= next_report) {
+      link_report(dirs);
+      next_report += LINK_REPORT_S * 1000000000ull;
+    }
+  }
+
+  link_report(dirs);
+  for (int x = 0; x < 2; x++) {
+    free(dirs[x].data);
+    free(dirs[x].due);
+  }
+
+  // done
+  return 0;
+}
@@ -0,0 +1,178 @@
+// Project headers
+#include "antenna_lz.h"
+
+// Standard C libraries
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      printf("[!] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      return -1;                                            \
+    }                                                       \
+  } while (0)
+
+// Worst case is a control byte for every 8 literals
+#define LZ_TEST_OUT_LEN (ANTENNA_LZ_BLOCK_LEN + ANTENNA_LZ_BLOCK_LEN / 8 + 1)
+
+struct lz_stats {
+  size_t matches;
+  size_t max_len;
+  size_t max_distance;
+};
+
+static uint32_t next_rand(uint32_t *rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 17;
+  *rng ^= *rng << 5;
+  return *rng;
+}
+
+// Walks a compressed block the way antenna_lz_decompress() reads it
+static void lz_stats(const uint8_t *in, size_t in_len, size_t out_len,
+                     struct lz_stats *s) {
+  memset(s, 0, sizeof(*s));
+  size_t x = 0, produced = 0;
+  while (x < in_len && produced < out_len) {
+    uint8_t control = in[x++];
+    for (int item = 0; item < 8 && x < in_len && produced < out_len; item++) {
+      if (!(control & (0x80 >> item))) {
+        x++;
+        produced++;
+        continue;
+      }
+      size_t distance = ((in[x] << 3) | (in[x + 1] >> 5)) + 1;
+      size_t len = (in[x + 1] & 0x1F) + ANTENNA_LZ_MIN_MATCH;
+      x += 2;
+      produced += len;
+      s->matches++;
+      if (len > s->max_len) s->max_len = len;
+      if (distance > s->max_distance) s->max_distance = distance;
+    }
+  }
+}
+
+// Compresses in whole into a roomy buffer and checks it comes back
+static int round_trip(struct antenna_lz *z, const uint8_t *in, size_t in_len,
+                      struct lz_stats *s) {
+  static uint8_t compressed[LZ_TEST_OUT_LEN];
+  static uint8_t out[ANTENNA_LZ_BLOCK_LEN];
+  size_t consumed;
+  size_t used = antenna_lz_compress(z, in, in_len, &consumed, compressed,
+                                    sizeof(compressed));
+  CHECK(consumed == in_len);
+  CHECK(used <= in_len + (in_len + 7) / 8);
+  CHECK(antenna_lz_decompress(compressed, used, out, in_len) ==
+        (ssize_t)in_len);
+  CHECK(memcmp(out, in, in_len) == 0);
+  lz_stats(compressed, used, in_len, s);
+
+  // done
+  return 0;
+}
+
+int main() {
+  static struct antenna_lz z;
+  static uint8_t in[ANTENNA_LZ_BLOCK_LEN];
+  static uint8_t compressed[LZ_TEST_OUT_LEN];
+  static uint8_t out[ANTENNA_LZ_BLOCK_LEN];
+  struct lz_stats s;
+  uint32_t rng = 1;
+
+  // Incompressible input grows by its control bytes only
+  for (size_t x = 0; x < sizeof(in); x++) in[x] = next_rand(&rng);
+  CHECK(round_trip(&z, in, sizeof(in), &s) == 0);
+  CHECK(s.matches < 4);
+  CHECK(round_trip(&z, in, 0, &s) == 0);
+  CHECK(round_trip(&z, in, 1, &s) == 0);
+  CHECK(round_trip(&z, in, ANTENNA_LZ_MIN_MATCH, &s) == 0);
+
+  // Runs longer than a match are split into maximal matches, which overlap
+  // what they copy
+  memset(in, 'A', 1000);
+  for (size_t x = 1000; x < sizeof(in); x++) in[x] = "LORIS"[x % 5];
+  CHECK(round_trip(&z, in, sizeof(in), &s) == 0);
+  CHECK(s.max_len == ANTENNA_LZ_MAX_MATCH);
+  CHECK(s.max_distance <= 5);
+
+  // A block is shorter than the window, so the compressor reaches back at
+  // most to the start of the block
+  for (size_t x = 0; x < sizeof(in); x++) in[x] = next_rand(&rng);
+  size_t farthest = sizeof(in) - ANTENNA_LZ_MAX_MATCH;
+  memcpy(&in[farthest], in, ANTENNA_LZ_MAX_MATCH);
+  CHECK(round_trip(&z, in, sizeof(in), &s) == 0);
+  CHECK(s.max_distance == farthest);
+  CHECK(s.max_len == ANTENNA_LZ_MAX_MATCH);
+
+  // The decoder takes a match exactly ANTENNA_LZ_WINDOW back, the largest the
+  // distance field holds
+  static uint8_t window[ANTENNA_LZ_WINDOW + ANTENNA_LZ_WINDOW / 8 + 3];
+  static uint8_t window_out[ANTENNA_LZ_WINDOW + ANTENNA_LZ_MAX_MATCH];
+  size_t window_len = 0;
+  for (size_t x = 0; x < ANTENNA_LZ_WINDOW; x++) {
+    if (x % 8 == 0) window[window_len++] = 0;
+    window[window_len++] = next_rand(&rng);
+  }
+  window[window_len++] = 0x80;
+  window[window_len++] = (ANTENNA_LZ_WINDOW - 1) >> 3;
+  window[window_len++] =
+      (uint8_t)((ANTENNA_LZ_WINDOW - 1) << 5) |
+      (ANTENNA_LZ_MAX_MATCH - ANTENNA_LZ_MIN_MATCH);
+  CHECK(antenna_lz_decompress(window, window_len, window_out,
+                              sizeof(window_out)) ==
+        (ssize_t)sizeof(window_out));
+  CHECK(memcmp(&window_out[ANTENNA_LZ_WINDOW], window_out,
+               ANTENNA_LZ_MAX_MATCH) == 0);
+  CHECK(window_out[0] == window[1]);
+
+  // Every output size short of the whole block stops at an item boundary and
+  // still decodes to the prefix it consumed
+  for (size_t x = 0; x < sizeof(in); x++)
+    in[x] = (x % 300 < 150) ? "LORIS"[x % 5] : (uint8_t)next_rand(&rng);
+  size_t full_len;
+  size_t full = antenna_lz_compress(&z, in, sizeof(in), &full_len, compressed,
+                                    sizeof(compressed));
+  CHECK(full_len == sizeof(in));
+  for (size_t out_len = 0; out_len < full; out_len++) {
+    size_t consumed;
+    size_t used = antenna_lz_compress(&z, in, sizeof(in), &consumed,
+                                      compressed, out_len);
+    CHECK(used <= out_len && used + 3 > out_len);
+    CHECK(consumed < sizeof(in));
+    CHECK(antenna_lz_decompress(compressed, used, out, consumed) ==
+          (ssize_t)consumed);
+    CHECK(memcmp(out, in, consumed) == 0);
+  }
+
+  // Padding after the block is ignored, a block too short for out_len is not
+  size_t consumed;
+  size_t used = antenna_lz_compress(&z, in, 500, &consumed, compressed,
+                                    sizeof(compressed));
+  CHECK(consumed == 500);
+  memset(&compressed[used], 0, 16);
+  CHECK(antenna_lz_decompress(compressed, used + 16, out, 500) == 500);
+  CHECK(memcmp(out, in, 500) == 0);
+  CHECK(antenna_lz_decompress(compressed, used, out, 501) == -1);
+  CHECK(antenna_lz_decompress(compressed, used - 1, out, 500) == -1);
+
+  // Malformed blocks: a match reaching before the start, a match cut short,
+  // a match past out_len and literals that run out before it
+  const uint8_t before_start[] = {0x40, 'a', 0x00, 0x20};
+  const uint8_t cut_short[] = {0x40, 'a', 0x00};
+  const uint8_t too_long[] = {0x40, 'a', 0x00, 0x1F};
+  const uint8_t literals[] = {0x00, 'a', 'b'};
+  CHECK(antenna_lz_decompress(before_start, sizeof(before_start), out, 4) ==
+        -1);
+  CHECK(antenna_lz_decompress(cut_short, sizeof(cut_short), out, 4) == -1);
+  CHECK(antenna_lz_decompress(too_long, sizeof(too_long), out, 5) == -1);
+  CHECK(antenna_lz_decompress(too_long, sizeof(too_long), out, 35) == 35);
+  CHECK(antenna_lz_decompress(literals, sizeof(literals), out, 2) == 2);
+  CHECK(antenna_lz_decompress(literals, sizeof(literals), out, 3) == -1);
+
+  printf("[i] lz tests passed\n");
+
+  // done
+  return 0;
+}
@@ -0,0 +1,218 @@
+// Project headers
+#include "antenna_file.h"
+#include "antenna_pipeline.h"
+
+// Standard C libraries
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      printf("[!] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      return -1;                                            \
+    }                                                       \
+  } while (0)
+
+// Settings
+#define NACK_TEST_FILE_LEN (100 * 1024)
+#define NACK_TEST_BURSTS "1e-5,0.01,0.5"
+#define NACK_TEST_SEED "7"
+#define NACK_TEST_TIMEOUT_S 600
+
+/*
+ * Sends a file from endpoint A to endpoint B of the link emulator, once
+ * received with antenna_file_receive() and once through a pipeline. Error
+ * bursts long enough to defeat Reed-solomon cost whole frames, so the
+ * transfer only completes if the NACKs bring back every lost chunk.
+ */
+
+struct nack_sender {
+  struct antenna_session session;
+  int rx_fd;
+  int tx_fd;
+  const char *path;
+  int status;
+};
+
+static void *nack_send(void *arg) {
+  struct nack_sender *a = arg;
+  a->status = antenna_file_send(&a->session, a->rx_fd, a->tx_fd, a->path);
+  return NULL;
+}
+
+static int check_file(const char *path, const uint8_t *data, size_t len) {
+  uint8_t *out = malloc(len + 1);
+  CHECK(out != NULL);
+  int fd = open(path, O_RDONLY);
+  CHECK(fd >= 0);
+  size_t out_len = 0;
+  ssize_t n;
+  while ((n = read(fd, &out[out_len], len + 1 - out_len)) > 0) out_len += n;
+  close(fd);
+  int same = out_len == len && memcmp(out, data, len) == 0;
+  free(out);
+  CHECK(same);
+
+  // done
+  return 0;
+}
+
+// Starts the emulator between the FIFO endpoints, logging to log_path
+static pid_t start_link(const char *linkemu, const char *a, const char *b,
+                        const char *log_path) {
+  pid_t pid = fork();
+  if (pid != 0) return pid;
+
+  // Never outlive the test
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  int log_fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (log_fd >= 0) dup2(log_fd, STDOUT_FILENO);
+  execl(linkemu, linkemu, "-b", "0", "-g", NACK_TEST_BURSTS, "-s",
+        NACK_TEST_SEED, a, b, (char *)NULL);
+  printf("[!] Failed to run %s\n", linkemu);
+  _exit(127);
+}
+
+// Bits the emulator flipped from A to B, from its last report
+static size_t link_bits_flipped(const char *log_path) {
+  FILE *log = fopen(log_path, "r");
+  if (log == NULL) return 0;
+  char line[256];
+  size_t bytes, flipped = 0;
+  while (fgets(line, sizeof(line), log) != NULL)
+    sscanf(line, "[i] A->B: %zu bytes, %zu bits flipped", &bytes, &flipped);
+  fclose(log);
+  return flipped;
+}
+
+static int transfer(struct nack_sender *a, struct antenna_session *b,
+                    int b_rx, int b_tx, const char *out, int pipelined) {
+  pthread_t sender;
+  CHECK(pthread_create(&sender, NULL, nack_send, a) == 0);
+
+  int status;
+  if (pipelined) {
+    struct antenna_pipeline p;
+    CHECK(antenna_pipeline_start(&p, b, b_rx, 0, NULL, NULL) == 0);
+    status = antenna_file_receive_pipeline(&p, b_tx, out);
+    antenna_pipeline_stop(&p);
+  } else {
+    status = antenna_file_receive(b, b_rx, b_tx, out);
+  }
+  pthread_join(sender, NULL);
+  CHECK(status == 0);
+  CHECK(a->status == 0);
+
+  // done
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *linkemu = (argc > 1) ? argv[1] : "./linkemu.bin";
+
+  char dir[] = "/tmp/nack-test-XXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  char a_rx[64], a_tx[64], b_rx[64], b_tx[64], in[64], out[64], part[80],
+      log_path[64], a_spec[140], b_spec[140];
+  snprintf(a_rx, sizeof(a_rx), "%s/a.rx", dir);
+  snprintf(a_tx, sizeof(a_tx), "%s/a.tx", dir);
+  snprintf(b_rx, sizeof(b_rx), "%s/b.rx", dir);
+  snprintf(b_tx, sizeof(b_tx), "%s/b.tx", dir);
+  snprintf(in, sizeof(in), "%s/in", dir);
+  snprintf(out, sizeof(out), "%s/out", dir);
+  snprintf(part, sizeof(part), "%s" FILE_SIDECAR_SUFFIX, out);
+  snprintf(log_path, sizeof(log_path), "%s/linkemu.log", dir);
+  snprintf(a_spec, sizeof(a_spec), "%s,%s", a_rx, a_tx);
+  snprintf(b_spec, sizeof(b_spec), "%s,%s", b_rx, b_tx);
+
+  // Random, so it neither compresses nor hides errors
+  uint8_t *data = malloc(NACK_TEST_FILE_LEN);
+  CHECK(data != NULL);
+  uint32_t rng = 1;
+  for (size_t x = 0; x < NACK_TEST_FILE_LEN; x++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    data[x] = rng;
+  }
+  int fd = open(in, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK(fd >= 0);
+  CHECK(write(fd, data, NACK_TEST_FILE_LEN) == NACK_TEST_FILE_LEN);
+  close(fd);
+
+  // Both ends hold their FIFOs read/write, so no open waits for the other
+  CHECK(mkfifo(a_rx, 0666) == 0 && mkfifo(a_tx, 0666) == 0);
+  CHECK(mkfifo(b_rx, 0666) == 0 && mkfifo(b_tx, 0666) == 0);
+  pid_t link = start_link(linkemu, a_spec, b_spec, log_path);
+  CHECK(link > 0);
+  usleep(100000);
+  CHECK(waitpid(link, NULL, WNOHANG) == 0);
+
+  // A transfer that never finishes fails the test instead of hanging it
+  alarm(NACK_TEST_TIMEOUT_S);
+
+  static struct nack_sender a;
+  static struct antenna_session b;
+  a.path = in;
+  CHECK((a.rx_fd = open(a_rx, O_RDWR)) >= 0);
+  CHECK((a.tx_fd = open(a_tx, O_RDWR)) >= 0);
+  int b_rx_fd = open(b_rx, O_RDWR);
+  int b_tx_fd = open(b_tx, O_RDWR);
+  CHECK(b_rx_fd >= 0 && b_tx_fd >= 0);
+  CHECK(antenna_session_new(&a.session, a.tx_fd) == 0);
+  CHECK(antenna_session_new(&b, b_tx_fd) == 0);
+
+  int status = 0;
+  for (int pipelined = 0; pipelined < 2 && status == 0; pipelined++) {
+    unlink(out);
+    status = transfer(&a, &b, b_rx_fd, b_tx_fd, out, pipelined);
+    if (status == 0) status = check_file(out, data, NACK_TEST_FILE_LEN);
+    if (status == 0 && access(part, F_OK) == 0) {
+      printf("[!] Sidecar %s left behind\n", part);
+      status = -1;
+    }
+  }
+
+  kill(link, SIGTERM);
+  waitpid(link, NULL, 0);
+  size_t flipped = link_bits_flipped(log_path);
+
+  antenna_session_destroy(&a.session);
+  antenna_session_destroy(&b);
+  close(a.rx_fd);
+  close(a.tx_fd);
+  close(b_rx_fd);
+  close(b_tx_fd);
+  if (status < 0) {
+    printf("[!] Transfer failed, files kept in %s\n", dir);
+    return -1;
+  }
+
+  // Errors must really have been injected
+  CHECK(flipped > 0);
+
+  unlink(a_rx);
+  unlink(a_tx);
+  unlink(b_rx);
+  unlink(b_tx);
+  unlink(in);
+  unlink(out);
+  unlink(log_path);
+  rmdir(dir);
+  free(data);
+
+  printf("[i] NACK tests passed, %zu bits flipped\n", flipped);
+
+  // done
+  return 0;
+}
@@ -0,0 +1,160 @@
+// Project headers
+#include "antenna_packet.h"
+#include "antenna_session.h"
+
+// Standard C libraries
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      printf("[!] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      return -1;                                            \
+    }                                                       \
+  } while (0)
+
+static size_t put_frame(uint8_t *out, const uint8_t *data, size_t len,
+                        size_t sent_len, uint8_t flags) {
+  antenna_packet_header(out, len, flags);
+  memcpy(&out[PACKET_HEADER_LEN], data, sent_len);
+  return PACKET_HEADER_LEN + sent_len;
+}
+
+// A framed, convolutionally coded frame that is valid but decodes to more
+// than the session's block buffer must be rejected without touching the
+// fields behind it. A normal frame must still decode.
+static int oversized_test(int rate) {
+  static struct antenna_session tx, rx;
+  static uint8_t stream[PACKET_HEADER_LEN + CONV_ENCODED_BITS(PACKET_DATA_LEN)];
+  static uint8_t data[PACKET_DATA_LEN];
+  static char out[ANTENNA_MAX_INTERLEAVE * RS_BLOCK_LEN];
+  struct antenna_packet p;
+
+  CHECK(antenna_session_new(&tx, -1) == 0);
+  CHECK(antenna_session_new(&rx, -1) == 0);
+  CHECK(antenna_session_set_conv_rate(&tx, rate) == 0);
+  CHECK(antenna_session_set_conv_rate(&rx, rate) == 0);
+  CHECK(antenna_session_set_coding(&tx, ANTENNA_CODING_RS_CONV,
+                                   ANTENNA_DECISION_HARD) == 0);
+  CHECK(antenna_session_set_coding(&rx, ANTENNA_CODING_RS_CONV,
+                                   ANTENNA_DECISION_HARD) == 0);
+  for (size_t x = 0; x < sizeof(data); x++) data[x] = x * 7;
+
+  // The smallest block that does not fit, and the longest one whose coded
+  // form still fits in a frame
+  size_t max_len = 0;
+  while (antenna_conv_encoded_len(&tx.tx_conv, max_len + 1) <= PACKET_DATA_LEN)
+    max_len++;
+  size_t block_lens[] = {sizeof(rx.rx_block) + 1, max_len};
+  CHECK(max_len >= block_lens[0]);
+
+  for (size_t y = 0; y < 2; y++) {
+    ssize_t coded_len =
+        antenna_conv_encode(&tx.tx_conv, data, block_lens[y],
+                            &stream[PACKET_HEADER_LEN]);
+    CHECK(coded_len > 0 && coded_len <= PACKET_DATA_LEN);
+    CHECK(antenna_packet_header(stream, coded_len, 0) == 0);
+
+    memset(rx.rx_decoded, 0x5A, sizeof(rx.rx_decoded));
+    CHECK(antenna_deframer_push(rx.rx_deframer, stream,
+                                PACKET_HEADER_LEN + coded_len) ==
+          (size_t)(PACKET_HEADER_LEN + coded_len));
+    CHECK(antenna_deframer_next(rx.rx_deframer, &p) == 1);
+    CHECK(p.len == (size_t)coded_len);
+    CHECK(antenna_session_decode_frame(&rx, &p, out) == -1);
+    for (size_t x = 0; x < sizeof(rx.rx_decoded); x++)
+      CHECK(rx.rx_decoded[x] == 0x5A);
+    while (antenna_deframer_next(rx.rx_deframer, &p))
+      antenna_deframer_reject(rx.rx_deframer);
+  }
+
+  // A frame that fits still decodes
+  ssize_t frame_len =
+      antenna_session_encode_frame(&tx, (const char *)data, RS_DATA_LEN,
+                                   stream);
+  CHECK(frame_len > 0);
+  CHECK(antenna_deframer_push(rx.rx_deframer, stream, frame_len) ==
+        (size_t)frame_len);
+  CHECK(antenna_deframer_next(rx.rx_deframer, &p) == 1);
+  CHECK(antenna_session_decode_frame(&rx, &p, out) == RS_DATA_LEN);
+  CHECK(memcmp(out, data, RS_DATA_LEN) == 0);
+
+  antenna_session_destroy(&tx);
+  antenna_session_destroy(&rx);
+  return 0;
+}
+
+int main() {
+  static struct antenna_deframer d;
+  static uint8_t stream[4 * PACKET_HEADER_LEN + 512];
+  struct antenna_packet p;
+  size_t stream_len = 0;
+
+  // A frame that lost 20 of its 50 bytes and so runs into the next one
+  uint8_t short_data[50];
+  memset(short_data, 0x11, sizeof(short_data));
+  uint8_t next_data[40];
+  memset(next_data, 0x22, sizeof(next_data));
+
+  // A frame whose data holds a whole valid frame, e.g. a recorded link stream
+  uint8_t nested[200];
+  memset(nested, 0x55, sizeof(nested));
+  put_frame(&nested[20], short_data, 30, 30, 7);
+
+  stream_len += put_frame(&stream[stream_len], nested, sizeof(nested),
+                          sizeof(nested), 1);
+  stream_len += put_frame(&stream[stream_len], short_data, sizeof(short_data),
+                          30, 2);
+  stream_len += put_frame(&stream[stream_len], next_data, sizeof(next_data),
+                          sizeof(next_data), 3);
+
+  // Feed it in awkward chunks
+  CHECK(antenna_deframer_new(&d, PACKET_ASM_TOLERANCE) == 0);
+  size_t fed = 0;
+  int frame = 0;
+  while (fed < stream_len) {
+    size_t chunk = (stream_len - fed < 7) ? stream_len - fed : 7;
+    fed += antenna_deframer_push(&d, &stream[fed], chunk);
+    while (antenna_deframer_next(&d, &p)) {
+      switch (frame++) {
+        case 0:
+          // The nested frame must not cut the outer one
+          CHECK(p.flags == 1 && p.len == sizeof(nested));
+          CHECK(memcmp(p.data, nested, sizeof(nested)) == 0);
+          CHECK(p.erasure_count == 0);
+          break;
+        case 1:
+          // Full length, so it takes the next header with it. Once it fails
+          // to decode the next frame is found inside it.
+          CHECK(p.flags == 2 && p.len == sizeof(short_data));
+          CHECK(antenna_deframer_reject(&d) == 1);
+          break;
+        case 2:
+          CHECK(p.flags == 3 && p.len == sizeof(next_data));
+          CHECK(memcmp(p.data, next_data, sizeof(next_data)) == 0);
+          CHECK(antenna_deframer_reject(&d) == 0);
+          break;
+      }
+    }
+  }
+  CHECK(frame == 3);
+  CHECK(d.frames_resynced == 1);
+
+  // A frame cut short by a timeout comes back with its tail erased
+  stream_len = put_frame(stream, next_data, sizeof(next_data), 25, 4);
+  CHECK(antenna_deframer_push(&d, stream, stream_len) == stream_len);
+  CHECK(antenna_deframer_next(&d, &p) == 0);
+  CHECK(antenna_deframer_flush(&d, &p) == 1);
+  CHECK(p.len == sizeof(next_data) && p.erasure_count == 15);
+  CHECK(p.erasures[0] == 25 && p.data[39] == 0);
+
+  printf("[i] Deframer tests passed\n");
+
+  // Punctured rates pack more data into the same frame
+  for (int rate = ANTENNA_CONV_RATE_1_2; rate < ANTENNA_CONV_RATES; rate++)
+    if (oversized_test(rate) < 0) return -1;
+
+  printf("[i] Frame length tests passed\n");
+  return 0;
+}
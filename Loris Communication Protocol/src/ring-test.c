@@ -0,0 +1,206 @@
+// Project headers
+#include "antenna_pipeline.h"
+#include "antenna_ring.h"
+#include "antenna_session.h"
+
+// Standard C libraries
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) {                                          \
+      printf("[!] %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      return -1;                                            \
+    }                                                       \
+  } while (0)
+
+// Settings
+#define RING_TEST_LEN 4096
+#define RING_TEST_BYTES (16 * 1024 * 1024)
+#define PIPELINE_TEST_FRAMES 2000
+#define PIPELINE_TEST_RING_LEN (1024 * 1024)
+
+// Both threads derive the same byte stream, so the consumer can check every
+// byte without the producer sharing anything but the ring
+static uint8_t stream_byte(size_t at) {
+  uint32_t x = (uint32_t)at * 2654435761u;
+  return (uint8_t)(x >> 24);
+}
+
+// xorshift, one generator per thread for span sizes
+static size_t next_len(uint32_t *rng, size_t max) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 17;
+  *rng ^= *rng << 5;
+  return 1 + *rng % max;
+}
+
+static void *ring_producer(void *arg) {
+  struct antenna_ring *r = arg;
+  uint32_t rng = 1;
+  size_t sent = 0;
+  while (sent < RING_TEST_BYTES) {
+    uint8_t *span;
+    size_t len = antenna_ring_write_peek(r, &span);
+    if (len == 0) {
+      sched_yield();
+      continue;
+    }
+
+    // Commit less than was peeked most of the time
+    size_t n = next_len(&rng, len);
+    if (n > RING_TEST_BYTES - sent) n = RING_TEST_BYTES - sent;
+    for (size_t x = 0; x < n; x++) span[x] = stream_byte(sent + x);
+    antenna_ring_write_commit(r, n);
+    sent += n;
+  }
+  return NULL;
+}
+
+static int ring_test() {
+  struct antenna_ring r;
+  CHECK(antenna_ring_new(&r, RING_TEST_LEN - 1) == 0);
+  CHECK(r.size == RING_TEST_LEN);
+
+  pthread_t producer;
+  CHECK(pthread_create(&producer, NULL, ring_producer, &r) == 0);
+
+  uint32_t rng = 2;
+  size_t received = 0;
+  size_t mismatches = 0;
+  while (received < RING_TEST_BYTES) {
+    const uint8_t *span;
+    size_t len = antenna_ring_read_peek(&r, &span);
+    if (len == 0) {
+      sched_yield();
+      continue;
+    }
+    CHECK(len <= RING_TEST_LEN);
+
+    size_t n = next_len(&rng, len);
+    for (size_t x = 0; x < n; x++)
+      if (span[x] != stream_byte(received + x)) mismatches++;
+    antenna_ring_read_commit(&r, n);
+    received += n;
+  }
+  pthread_join(producer, NULL);
+
+  CHECK(mismatches == 0);
+  CHECK(received == RING_TEST_BYTES);
+  CHECK(antenna_ring_used(&r) == 0);
+  CHECK(antenna_ring_high_water(&r) <= RING_TEST_LEN);
+  CHECK(antenna_ring_overruns(&r) == 0);
+
+  // Overruns are only counted, never written
+  antenna_ring_overrun(&r, 10);
+  CHECK(antenna_ring_overruns(&r) == 10);
+  CHECK(antenna_ring_used(&r) == 0);
+
+  antenna_ring_destroy(&r);
+
+  // done
+  return 0;
+}
+
+struct pipeline_check {
+  size_t frames;
+  size_t errors;
+};
+
+// Frames carry their sequence number and a length that varies with it
+static size_t frame_fill(char *data, size_t seq) {
+  size_t len = 4 + seq % (RS_DATA_LEN - 3);
+  memcpy(data, &(uint32_t){seq}, 4);
+  for (size_t x = 4; x < len; x++) data[x] = stream_byte(seq * RS_DATA_LEN + x);
+  return len;
+}
+
+static void on_frame(const char *data, size_t len, void *user) {
+  struct pipeline_check *c = user;
+  char expected[RS_DATA_LEN];
+  size_t expected_len = frame_fill(expected, c->frames);
+  if (len != expected_len || memcmp(data, expected, len) != 0) c->errors++;
+  __atomic_add_fetch(&c->frames, 1, __ATOMIC_RELEASE);
+}
+
+static int pipeline_test() {
+  int sv[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+  static struct antenna_session tx, rx;
+  CHECK(antenna_session_new(&tx, sv[0]) == 0);
+  CHECK(antenna_session_new(&rx, sv[1]) == 0);
+
+  // Every frame must come out of the callback in order
+  struct pipeline_check c = {0};
+  struct antenna_pipeline p;
+  CHECK(antenna_pipeline_start(&p, &rx, sv[1], PIPELINE_TEST_RING_LEN,
+                               on_frame, &c) == 0);
+  char data[RS_DATA_LEN];
+  for (size_t seq = 0; seq < PIPELINE_TEST_FRAMES; seq++) {
+    size_t len = frame_fill(data, seq);
+    CHECK(antenna_session_write_rs(&tx, data, len) == 0);
+  }
+
+  // Stopping drops what the reader has not taken yet, so wait for the last
+  // frame first
+  for (int x = 0; x < 1000; x++) {
+    if (__atomic_load_n(&c.frames, __ATOMIC_ACQUIRE) == PIPELINE_TEST_FRAMES)
+      break;
+    usleep(10000);
+  }
+  antenna_pipeline_stop(&p);
+  CHECK(c.errors == 0);
+  CHECK(c.frames == PIPELINE_TEST_FRAMES);
+  CHECK(__atomic_load_n(&p.frames, __ATOMIC_RELAXED) == PIPELINE_TEST_FRAMES);
+  CHECK(__atomic_load_n(&p.frames_failed, __ATOMIC_RELAXED) == 0);
+  CHECK(antenna_ring_overruns(&p.ring) == 0);
+  antenna_session_destroy(&rx);
+  close(sv[1]);
+
+  // The same again through the queue, read in pieces smaller than a frame
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+  CHECK(antenna_session_new(&rx, sv[1]) == 0);
+  tx.fd = sv[0];
+  CHECK(antenna_pipeline_start(&p, &rx, sv[1], 0, NULL, NULL) == 0);
+  char out[RS_DATA_LEN];
+  for (size_t seq = 0; seq < 100; seq++) {
+    size_t len = frame_fill(data, seq);
+    CHECK(antenna_session_write_rs(&tx, data, len) == 0);
+
+    size_t got = 0;
+    while (got < len) {
+      size_t want = len - got < 50 ? len - got : 50;
+      ssize_t n = antenna_pipeline_recv(&p, &out[got], want, 5000);
+      CHECK(n > 0);
+      got += n;
+    }
+    CHECK(memcmp(out, data, len) == 0);
+  }
+
+  // Nothing else is queued
+  CHECK(antenna_pipeline_recv(&p, out, sizeof(out), 10) == 0);
+  antenna_pipeline_stop(&p);
+  antenna_session_destroy(&rx);
+  antenna_session_destroy(&tx);
+  close(sv[0]);
+  close(sv[1]);
+
+  // done
+  return 0;
+}
+
+int main() {
+  if (ring_test() < 0 || pipeline_test() < 0) return -1;
+
+  printf("[i] ring tests passed\n");
+
+  // done
+  return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file rs-bench.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Compares plain and syndrome-screened Reed-solomon decoding speed at
+ * several symbol error densities, and how the block pool scales with workers
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+// Project headers
+#include "antenna.h"
+#include "antenna_rs_pool.h"
+#include "correct-syndrome.h"
+
+// Standard C libraries
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Settings
+#define BLOCK_COUNT 20000
+#define REPEAT 5
+
+static double elapsed(struct timespec *start, struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Encodes BLOCK_COUNT random messages and flips symbols with probability
+// density
+static uint8_t *make_blocks(correct_reed_solomon *rs, size_t num_roots,
+                            double density) {
+  size_t data_len = RS_BLOCK_LEN - num_roots;
+  uint8_t *blocks = malloc((size_t)BLOCK_COUNT * RS_BLOCK_LEN);
+  uint8_t msg[RS_BLOCK_LEN];
+  for (size_t b = 0; b < BLOCK_COUNT; b++) {
+    uint8_t *block = &blocks[b * RS_BLOCK_LEN];
+    for (size_t x = 0; x < data_len; x++) msg[x] = rand();
+    correct_reed_solomon_encode(rs, msg, data_len, block);
+    for (size_t x = 0; x < RS_BLOCK_LEN; x++)
+      if (rand() < density * RAND_MAX) block[x] ^= 1 + rand() % 255;
+  }
+  return blocks;
+}
+
+// Decodes every block REPEAT times and prints decoded MB/s
+static double run(void *coder, int screened, const uint8_t *blocks,
+                  size_t num_roots, size_t *failed) {
+  uint8_t decoded[RS_BLOCK_LEN];
+  size_t data_len = RS_BLOCK_LEN - num_roots;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  *failed = 0;
+  for (int r = 0; r < REPEAT; r++) {
+    for (size_t b = 0; b < BLOCK_COUNT; b++) {
+      const uint8_t *block = &blocks[b * RS_BLOCK_LEN];
+      ssize_t len = screened ? correct_reed_solomon_syndrome_decode(
+                                   coder, block, RS_BLOCK_LEN, decoded)
+                             : correct_reed_solomon_decode(
+                                   coder, block, RS_BLOCK_LEN, decoded);
+      if (len < 0 && r == 0) (*failed)++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  return (double)REPEAT * BLOCK_COUNT * data_len / elapsed(&start, &end) / 1e6;
+}
+
+static int bench(size_t num_roots) {
+  correct_reed_solomon *rs = correct_reed_solomon_create(
+      correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, num_roots);
+  correct_reed_solomon_syndrome *rss = correct_reed_solomon_syndrome_create(
+      correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, num_roots);
+  if (rs == NULL || rss == NULL) {
+    printf("[!] Failed to create encoder/decoder\n");
+    return -1;
+  }
+
+  printf("\n[i] RS(%d,%zu), %d blocks x %d\n", RS_BLOCK_LEN,
+         RS_BLOCK_LEN - num_roots, BLOCK_COUNT, REPEAT);
+  printf("%-10s %10s %12s %14s\n", "sym errors", "failed", "plain MB/s",
+         "screened MB/s");
+
+  const double densities[] = {0, 1e-4, 1e-3, 1e-2, 5e-2};
+  for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+    uint8_t *blocks = make_blocks(rs, num_roots, densities[d]);
+    size_t failed_plain, failed_screened;
+    double plain = run(rs, 0, blocks, num_roots, &failed_plain);
+    double screened = run(rss, 1, blocks, num_roots, &failed_screened);
+    if (failed_plain != failed_screened)
+      printf("[!] Decoders disagree on %zu vs %zu failed blocks\n",
+             failed_plain, failed_screened);
+    printf("%-10g %10zu %12.2f %14.2f\n", densities[d], failed_plain, plain,
+           screened);
+    free(blocks);
+  }
+
+  correct_reed_solomon_destroy(rs);
+  correct_reed_solomon_syndrome_destroy(rss);
+  return 0;
+}
+
+// Encodes and decodes one large buffer on pools of 1, 2, 4... workers up to one
+// per CPU and prints data MB/s
+static int bench_pool(double density) {
+  size_t data_len = (size_t)BLOCK_COUNT * RS_DATA_LEN;
+  size_t encoded_len = antenna_rs_pool_encoded_len(data_len);
+  uint8_t *data = malloc(data_len);
+  uint8_t *encoded = malloc(encoded_len);
+  uint8_t *decoded = malloc(data_len);
+  if (data == NULL || encoded == NULL || decoded == NULL) {
+    printf("[!] Failed to allocate pool buffers\n");
+    return -1;
+  }
+  for (size_t x = 0; x < data_len; x++) data[x] = rand();
+
+  printf("\n[i] RS pool, %zu byte buffer x %d, %g symbol errors\n", data_len,
+         REPEAT, density);
+  printf("%-8s %10s %12s %12s\n", "workers", "failed", "encode MB/s",
+         "decode MB/s");
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (long workers = 1;; workers *= 2) {
+    if (workers > cpus) workers = cpus;
+    struct antenna_rs_pool pool;
+    if (antenna_rs_pool_new(&pool, workers) < 0) return -1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < REPEAT; r++)
+      antenna_rs_pool_encode(&pool, data, data_len, encoded);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double encode = REPEAT * data_len / elapsed(&start, &end) / 1e6;
+
+    // Same errors for every pool size
+    srand(1);
+    for (size_t x = 0; x < encoded_len; x++)
+      if (rand() < density * RAND_MAX) encoded[x] ^= 1 + rand() % 255;
+
+    size_t failed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < REPEAT; r++)
+      antenna_rs_pool_decode(&pool, encoded, encoded_len, decoded, &failed);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double decode = REPEAT * data_len / elapsed(&start, &end) / 1e6;
+
+    printf("%-8ld %10zu %12.2f %12.2f\n", workers, failed, encode, decode);
+    antenna_rs_pool_destroy(&pool);
+    if (workers >= cpus) break;
+  }
+
+  free(data);
+  free(encoded);
+  free(decoded);
+  return 0;
+}
+
+int main() {
+  // The link setting, then the CCSDS code for comparison
+  if (bench(RS_NUM_ROOTS) < 0) return -1;
+  if (bench(32) < 0) return -1;
+  if (bench_pool(1e-3) < 0) return -1;
+  return 0;
+}
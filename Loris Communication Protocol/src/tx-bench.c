@@ -0,0 +1,128 @@
+/**
+ * @file tx-bench.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Compares per-block and batched Reed-solomon transmission over a pty
+ * @version 0.1
+ * @date 2022-04-08
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+// Feature macros
+#define _GNU_SOURCE
+
+// Project headers
+#include "antenna.h"
+#include "antenna_session.h"
+
+// Standard C libraries
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Settings
+#define MSG_LEN (100 * 1024)
+#define MSG_COUNT 20
+
+struct drain_args {
+  int fd;
+  size_t expected;
+};
+
+// Reads everything the writer sends so the pty never fills up
+static void *drain(void *data) {
+  struct drain_args *args = data;
+  char buffer[4096];
+  size_t total = 0;
+  while (total < args->expected) {
+    ssize_t bytes_read = read(args->fd, buffer, sizeof(buffer));
+    if (bytes_read <= 0) break;
+    total += bytes_read;
+  }
+  return NULL;
+}
+
+// Creates a pty pair the same way master_create() does in the serial chat
+static int pty_create(int *master, int *slave) {
+  if ((*master = getpt()) < 0) {
+    printf("[!] Failed to open master port.\n");
+    return -1;
+  }
+  if (grantpt(*master) < 0 || unlockpt(*master) < 0) {
+    printf("[!] Failed to unlock slave port for master.\n");
+    return -1;
+  }
+  if ((*slave = open(ptsname(*master), O_RDWR | O_NOCTTY | O_SYNC)) < 0) {
+    printf("[!] Failed to open slave port.\n");
+    return -1;
+  }
+
+  // Raw mode so the line discipline passes bytes through untouched
+  struct termios tty;
+  tcgetattr(*slave, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(*slave, TCSANOW, &tty);
+  return 0;
+}
+
+static double elapsed(struct timespec *start, struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int run(const char *name, size_t batch_blocks, const char *msg) {
+  int master, slave;
+  if (pty_create(&master, &slave) < 0) return -1;
+
+  struct antenna_session s;
+  if (antenna_session_new(&s, slave) < 0) return -1;
+  struct antenna_flush_policy policy = {batch_blocks, ANTENNA_FLUSH_NONE};
+  if (antenna_session_set_flush(&s, &policy) < 0) return -1;
+
+  // Work out how many bytes the reader has to wait for
+  size_t blocks = (MSG_LEN + RS_DATA_LEN - 1) / RS_DATA_LEN;
+  struct drain_args args = {
+      master, (size_t)MSG_COUNT *
+                  (MSG_LEN + blocks * (RS_NUM_ROOTS + PACKET_HEADER_LEN))};
+  pthread_t reader;
+  pthread_create(&reader, NULL, drain, &args);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int x = 0; x < MSG_COUNT; x++) {
+    if (antenna_session_write_rs(&s, msg, MSG_LEN) < 0) {
+      printf("[!] Failed to write message\n");
+      return -1;
+    }
+  }
+  pthread_join(reader, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds = elapsed(&start, &end);
+  size_t syscalls = (blocks + batch_blocks - 1) / batch_blocks;
+  printf("%-10s %6zu %10zu %12.2f\n", name, batch_blocks, syscalls,
+         (double)MSG_COUNT * MSG_LEN / seconds / 1e6);
+
+  antenna_session_destroy(&s);
+  close(slave);
+  close(master);
+  return 0;
+}
+
+int main() {
+  char *msg = malloc(MSG_LEN);
+  for (int x = 0; x < MSG_LEN; x++) msg[x] = rand();
+
+  printf("[i] %d messages of %d bytes through RS(%d,%d) over a pty pair\n",
+         MSG_COUNT, MSG_LEN, RS_CHUNK_LEN, RS_DATA_LEN);
+  printf("%-10s %6s %10s %12s\n", "path", "batch", "writes/msg", "MB/s");
+  if (run("per-block", 1, msg) < 0) return -1;
+  if (run("batched", 16, msg) < 0) return -1;
+  if (run("batched", 64, msg) < 0) return -1;
+  if (run("batched", ANTENNA_TX_BATCH_DEFAULT, msg) < 0) return -1;
+  if (run("batched", ANTENNA_TX_BATCH_MAX, msg) < 0) return -1;
+
+  free(msg);
+  return 0;
+}
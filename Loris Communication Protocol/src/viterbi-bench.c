@@ -0,0 +1,257 @@
+/**
+ * @file viterbi-bench.c
+ * @author Alex Amellal (loris@alexamellal.com)
+ * @brief Soft decision Viterbi decoding speed of libcorrect and of each
+ * correct-viterbi implementation, and how the segmented decoder scales with
+ * threads, for reprocessing recorded passes. Exits non-zero if any of them
+ * decodes differently from libcorrect.
+ * @version 0.1
+ * @date 2022-05-02
+ *
+ * @copyright Dalhousie Space Systems Lab (c) 2022
+ *
+ */
+
+// Project headers
+#include "correct-viterbi.h"
+#include "correct.h"
+
+// Standard C libraries
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Settings
+#define MSG_LEN (256 * 1024)
+#define REPEAT 3
+#define EB_N0 3.0
+#define OVERLAP 512
+
+// Frame lengths in bytes checked against libcorrect before timing
+static const size_t check_lens[] = {1, 2, 3, 31, 223, 1000, 4096, 20000};
+
+static double elapsed(struct timespec *start, struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double gaussian(void) {
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// Sends the encoded bits as BPSK over AWGN at EB_N0 dB and quantizes to soft
+// symbols, 128 + 64 per unit of amplitude
+static void make_soft(const uint8_t *encoded, size_t num_bits, size_t rate,
+                      uint8_t *soft) {
+  double sigma = sqrt(rate / (2 * pow(10, EB_N0 / 10)));
+  for (size_t x = 0; x < num_bits; x++) {
+    double level = ((encoded[x / 8] >> (7 - x % 8)) & 1) ? 1 : -1;
+    double sample = 128 + 64 * (level + sigma * gaussian());
+    soft[x] = (sample < 0) ? 0 : (sample > 255) ? 255 : (uint8_t)sample;
+  }
+}
+
+// Soft symbols with no relation to any codeword, to exercise ties and the
+// tail on paths a clean channel never takes
+static void make_random(size_t num_bits, uint8_t *soft) {
+  for (size_t x = 0; x < num_bits; x++) soft[x] = rand();
+}
+
+static size_t bit_errors(const uint8_t *a, const uint8_t *b, size_t len) {
+  size_t errors = 0;
+  for (size_t x = 0; x < len; x++) errors += __builtin_popcount(a[x] ^ b[x]);
+  return errors;
+}
+
+// Decodes the soft symbols REPEAT times and returns decoded Mbit/s. Uses
+// libcorrect without v, and the segmented decoder with threads > 0.
+static double run(correct_convolutional *conv, correct_viterbi *v,
+                  size_t threads, const uint8_t *soft, size_t num_bits,
+                  uint8_t *msg) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int r = 0; r < REPEAT; r++) {
+    if (v == NULL)
+      correct_convolutional_decode_soft(conv, soft, num_bits, msg);
+    else if (threads > 0)
+      correct_viterbi_decode_soft_parallel(v, soft, num_bits, msg, threads,
+                                           OVERLAP);
+    else
+      correct_viterbi_decode_soft(v, soft, num_bits, msg);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (double)REPEAT * 8 * MSG_LEN / elapsed(&start, &end) / 1e6;
+}
+
+// Decodes soft with every implementation and thread count and compares each
+// with libcorrect. Returns the number of mismatches.
+static int compare(correct_convolutional *conv, correct_viterbi *v,
+                   const uint8_t *soft, size_t num_bits, size_t len,
+                   const char *input) {
+  const correct_viterbi_impl_t impls[] = {CORRECT_VITERBI_PORTABLE,
+                                          CORRECT_VITERBI_AVX2};
+  const char *names[] = {"portable", "avx2"};
+  uint8_t *reference = malloc(len);
+  uint8_t *msg = malloc(len);
+  int mismatches = 0;
+
+  if (correct_convolutional_decode_soft(conv, soft, num_bits, reference) !=
+      (ssize_t)len) {
+    printf("[!] libcorrect failed to decode %zu bytes of %s input\n", len,
+           input);
+    mismatches++;
+    goto cleanup;
+  }
+  for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+    if (correct_viterbi_set_impl(v, impls[i]) < 0) continue;
+    memset(msg, 0xa5, len);
+    if (correct_viterbi_decode_soft(v, soft, num_bits, msg) != (ssize_t)len ||
+        memcmp(reference, msg, len) != 0) {
+      printf("[!] %s differs from libcorrect on %zu bytes of %s input\n",
+             names[i], len, input);
+      mismatches++;
+    }
+  }
+  correct_viterbi_set_impl(v, CORRECT_VITERBI_AUTO);
+  for (size_t threads = 2; threads <= 4; threads++) {
+    memset(msg, 0xa5, len);
+    if (correct_viterbi_decode_soft_parallel(v, soft, num_bits, msg, threads,
+                                             OVERLAP) != (ssize_t)len ||
+        memcmp(reference, msg, len) != 0) {
+      printf("[!] %zu threads differ from libcorrect on %zu bytes of %s "
+             "input\n",
+             threads, len, input);
+      mismatches++;
+    }
+  }
+
+cleanup:
+  free(reference);
+  free(msg);
+  return mismatches;
+}
+
+// Checks noisy codewords and pure noise of several lengths against libcorrect
+static int check(correct_convolutional *conv, correct_viterbi *v,
+                 size_t rate) {
+  int mismatches = 0;
+  for (size_t l = 0; l < sizeof(check_lens) / sizeof(check_lens[0]); l++) {
+    size_t len = check_lens[l];
+    size_t num_bits = correct_convolutional_encode_len(conv, len);
+    uint8_t *data = malloc(len);
+    uint8_t *encoded = malloc((num_bits + 7) / 8);
+    uint8_t *soft = malloc(num_bits);
+
+    for (size_t x = 0; x < len; x++) data[x] = rand();
+    correct_convolutional_encode(conv, data, len, encoded);
+    make_soft(encoded, num_bits, rate, soft);
+    mismatches += compare(conv, v, soft, num_bits, len, "noisy");
+    make_random(num_bits, soft);
+    mismatches += compare(conv, v, soft, num_bits, len, "random");
+
+    free(data);
+    free(encoded);
+    free(soft);
+  }
+  return mismatches;
+}
+
+static int bench(const char *name, size_t rate, size_t order,
+                 const correct_convolutional_polynomial_t *poly) {
+  correct_convolutional *conv = correct_convolutional_create(rate, order, poly);
+  correct_viterbi *v = correct_viterbi_create(rate, order, poly);
+  if (conv == NULL || v == NULL) {
+    printf("[!] Failed to create %s decoders\n", name);
+    return -1;
+  }
+
+  int mismatches = check(conv, v, rate);
+  printf("\n[i] %s, %s libcorrect on %zu frame lengths\n", name,
+         mismatches ? "does not match" : "matches",
+         sizeof(check_lens) / sizeof(check_lens[0]));
+
+  size_t num_bits = correct_convolutional_encode_len(conv, MSG_LEN);
+  uint8_t *data = malloc(MSG_LEN);
+  uint8_t *encoded = malloc((num_bits + 7) / 8);
+  uint8_t *soft = malloc(num_bits);
+  uint8_t *reference = malloc(MSG_LEN + 1);
+  uint8_t *msg = malloc(MSG_LEN + 1);
+  if (data == NULL || encoded == NULL || soft == NULL || reference == NULL ||
+      msg == NULL) {
+    printf("[!] Failed to allocate buffers\n");
+    return -1;
+  }
+  for (size_t x = 0; x < MSG_LEN; x++) data[x] = rand();
+  correct_convolutional_encode(conv, data, MSG_LEN, encoded);
+  make_soft(encoded, num_bits, rate, soft);
+
+  printf("\n[i] %s, %d kB x %d, Eb/N0 %.1f dB\n", name, MSG_LEN / 1024, REPEAT,
+         EB_N0);
+  printf("%-12s %12s %12s\n", "decoder", "bit errors", "Mbit/s");
+
+  double speed = run(conv, NULL, 0, soft, num_bits, msg);
+  printf("%-12s %12zu %12.2f\n", "libcorrect", bit_errors(data, msg, MSG_LEN),
+         speed);
+  memcpy(reference, msg, MSG_LEN);
+
+  // Every implementation must give libcorrect's output
+  int status = mismatches ? -1 : 0;
+  const correct_viterbi_impl_t impls[] = {CORRECT_VITERBI_PORTABLE,
+                                          CORRECT_VITERBI_AVX2};
+  const char *names[] = {"portable", "avx2"};
+  for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+    if (correct_viterbi_set_impl(v, impls[i]) < 0) {
+      printf("%-12s %12s %12s\n", names[i], "-", "unsupported");
+      continue;
+    }
+    memset(msg, 0, MSG_LEN + 1);
+    speed = run(NULL, v, 0, soft, num_bits, msg);
+    printf("%-12s %12zu %12.2f\n", names[i], bit_errors(data, msg, MSG_LEN),
+           speed);
+
+    if (memcmp(reference, msg, MSG_LEN) != 0) {
+      printf("[!] %s output differs from libcorrect\n", names[i]);
+      status = -1;
+    }
+  }
+
+  // Segments on threads of their own must too
+  correct_viterbi_set_impl(v, CORRECT_VITERBI_AUTO);
+  printf("%-12s %12s %12s\n", "threads", "bit errors", "Mbit/s");
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (long threads = 1;; threads *= 2) {
+    if (threads > cpus) threads = cpus;
+    memset(msg, 0, MSG_LEN + 1);
+    speed = run(NULL, v, threads, soft, num_bits, msg);
+    printf("%-12ld %12zu %12.2f\n", threads, bit_errors(data, msg, MSG_LEN),
+           speed);
+    if (memcmp(reference, msg, MSG_LEN) != 0) {
+      printf("[!] %ld thread output differs from libcorrect\n", threads);
+      status = -1;
+    }
+    if (threads == cpus) break;
+  }
+
+  free(data);
+  free(encoded);
+  free(soft);
+  free(reference);
+  free(msg);
+  correct_convolutional_destroy(conv);
+  correct_viterbi_destroy(v);
+  return status;
+}
+
+int main() {
+  srand(1);
+  int status = 0;
+  status |= bench("rate 1/2, K = 7", 2, 7, correct_conv_r12_7_polynomial);
+  status |= bench("rate 1/2, K = 9", 2, 9, correct_conv_r12_9_polynomial);
+  status |= bench("rate 1/3, K = 7", 3, 7, correct_conv_r13_7_polynomial);
+  status |= bench("rate 1/3, K = 9", 3, 9, correct_conv_r13_9_polynomial);
+  return status ? 1 : 0;
+}